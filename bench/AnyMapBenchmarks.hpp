@@ -0,0 +1,100 @@
+#ifndef __ANY_MAP_BENCHMARKS_HPP__
+#define __ANY_MAP_BENCHMARKS_HPP__
+
+/*
+ * The cost of the type erasure: the same operations on a map and on an
+ * AnyMap wrapping a map of that type.
+ */
+
+#include "AnyMap/AnyMap.hpp"
+#include "BenchmarkData.hpp"
+
+#include <boost/unordered_map.hpp>
+#include <map>
+
+namespace AnyMapBenchmarks
+{
+  typedef std::map<int, double> StlMap;
+  typedef boost::unordered_map<int, double> BoostMap;
+
+  // The map itself.
+  template <typename Map>
+  struct Raw
+  {
+    typedef Map Map_t;
+    static Map_t make() { return Map_t(); }
+  };
+
+  // An AnyMap of the map.
+  template <typename Map>
+  struct Erased
+  {
+    typedef MapTypeErasure::AnyMap<int, double> Map_t;
+    static Map_t make() { return Map_t( Map() ); }
+  };
+
+  template <typename Maker>
+  typename Maker::Map_t filled( std::vector<int> const& keys )
+  {
+    typename Maker::Map_t map( Maker::make() );
+    for( std::size_t i = 0; i < keys.size(); ++i )
+      map[keys[i]] = keys[i];
+    return map;
+  }
+
+  template <typename Maker>
+  void Find( benchmark::State& state )
+  {
+    const std::vector<int> keys( BenchmarkData::shuffledKeys( state.range(0) ) );
+    typename Maker::Map_t const map( filled<Maker>( keys ) );
+    for( auto _ : state )
+      for( std::size_t i = 0; i < keys.size(); ++i )
+	{
+	  bool found( map.find( keys[i] ) != map.end() );
+	  benchmark::DoNotOptimize( found );
+	}
+    state.SetItemsProcessed( state.iterations() * keys.size() );
+  }
+
+  template <typename Maker>
+  void Insert( benchmark::State& state )
+  {
+    const std::vector<int> keys( BenchmarkData::shuffledKeys( state.range(0) ) );
+    for( auto _ : state )
+      {
+	typename Maker::Map_t map( Maker::make() );
+	for( std::size_t i = 0; i < keys.size(); ++i )
+	  map.insert( std::make_pair( keys[i], 1.0 ) );
+	benchmark::DoNotOptimize( map );
+      }
+    state.SetItemsProcessed( state.iterations() * keys.size() );
+  }
+
+  template <typename Maker>
+  void Iterate( benchmark::State& state )
+  {
+    typename Maker::Map_t const map( filled<Maker>( BenchmarkData::shuffledKeys( state.range(0) ) ) );
+    for( auto _ : state )
+      {
+	double sum(0);
+	for( typename Maker::Map_t::const_iterator i(map.begin()); i != map.end(); ++i )
+	  sum += i->second;
+	benchmark::DoNotOptimize( sum );
+      }
+    state.SetItemsProcessed( state.iterations() * map.size() );
+  }
+
+#define ANY_MAP_BENCHMARK(OP)						\
+  BENCHMARK_TEMPLATE(OP, Raw<StlMap>)->RangeMultiplier(10)->Range(1000, 1000000); \
+  BENCHMARK_TEMPLATE(OP, Erased<StlMap>)->RangeMultiplier(10)->Range(1000, 1000000); \
+  BENCHMARK_TEMPLATE(OP, Raw<BoostMap>)->RangeMultiplier(10)->Range(1000, 1000000); \
+  BENCHMARK_TEMPLATE(OP, Erased<BoostMap>)->RangeMultiplier(10)->Range(1000, 1000000)
+
+  ANY_MAP_BENCHMARK(Find);
+  ANY_MAP_BENCHMARK(Insert);
+  ANY_MAP_BENCHMARK(Iterate);
+
+#undef ANY_MAP_BENCHMARK
+};
+
+#endif // __ANY_MAP_BENCHMARKS_HPP__
@@ -0,0 +1,65 @@
+#ifndef __BENCHMARK_DATA_HPP__
+#define __BENCHMARK_DATA_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace BenchmarkData
+{
+  // The keys 0 to n - 1 in a fixed random order.
+  inline std::vector<int> shuffledKeys( std::size_t n )
+  {
+    std::vector<int> keys( n );
+    for( std::size_t i = 0; i < n; ++i )
+      keys[i] = static_cast<int>(i);
+    std::mt19937 rng( 42 );
+    std::shuffle( keys.begin(), keys.end(), rng );
+    return keys;
+  }
+
+  /*
+   * A text of the given number of words, generated by a random walk over the
+   * word bigrams of the test text, so that it has the vocabulary and the
+   * transition structure of a natural text at any size. Empty if the test
+   * text cannot be read. The texts are generated once.
+   */
+  inline std::string const& corpus( std::size_t words )
+  {
+    static std::map<std::size_t, std::string> corpora;
+    std::map<std::size_t, std::string>::iterator found( corpora.find( words ) );
+    if( found != corpora.end() )
+      return found->second;
+
+    std::string& text( corpora[words] );
+    std::ifstream infile( "bench/data/rock-n-roll-nerd" );
+    std::vector<std::string> source( (std::istream_iterator<std::string>( infile )),
+				     std::istream_iterator<std::string>() );
+    if( source.size() < 2 )
+      return text;
+
+    // the successors of each distinct word, by position in source
+    std::map<std::string, std::vector<std::size_t> > successors;
+    for( std::size_t i = 0; i + 1 < source.size(); ++i )
+      successors[source[i]].push_back( i + 1 );
+
+    std::mt19937 rng( 7 );
+    std::size_t at( 0 );
+    for( std::size_t w = 0; w < words; ++w )
+      {
+	text += source[at];
+	text += ' ';
+	std::vector<std::size_t> const& next( successors[source[at]] );
+	at = next.empty() ? rng() % source.size() : next[rng() % next.size()];
+      }
+    return text;
+  }
+};
+
+#endif // __BENCHMARK_DATA_HPP__
@@ -0,0 +1,7 @@
+#include <benchmark/benchmark.h>
+
+#include "AnyMapBenchmarks.hpp"
+#include "CounterBenchmarks.hpp"
+#include "CounterMapBenchmarks.hpp"
+
+BENCHMARK_MAIN();
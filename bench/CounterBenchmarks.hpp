@@ -0,0 +1,124 @@
+#ifndef __COUNTER_BENCHMARKS_HPP__
+#define __COUNTER_BENCHMARKS_HPP__
+
+/*
+ * The Counter operations at 10^3 to 10^7 values, over the default AnyMap and
+ * over a statically-typed FlatHashMap.
+ */
+
+#include "Counters/Counter.hpp"
+#include "AnyMap/FlatHashMap.hpp"
+#include "AnyMap/StaticMap.hpp"
+#include "BenchmarkData.hpp"
+
+namespace CounterBenchmarks
+{
+  typedef Counters::Counter<int> AnyCounter;
+  typedef Counters::Counter<int, MapTypeErasure::StaticMap< MapTypeErasure::FlatHashMap<int, double> > > FlatCounter;
+
+  template <typename C>
+  C filled( std::vector<int> const& keys )
+  {
+    C counter;
+    for( std::size_t i = 0; i < keys.size(); ++i )
+      counter.incrementCount( keys[i], 1 + keys[i] % 7 );
+    return counter;
+  }
+
+  // Increments of values which are already counted.
+  template <typename C>
+  void Increment( benchmark::State& state )
+  {
+    const std::vector<int> keys( BenchmarkData::shuffledKeys( state.range(0) ) );
+    C counter( filled<C>( keys ) );
+    for( auto _ : state )
+      for( std::size_t i = 0; i < keys.size(); ++i )
+	counter.incrementCount( keys[i], 1 );
+    state.SetItemsProcessed( state.iterations() * keys.size() );
+  }
+
+  template <typename C>
+  void GetCount( benchmark::State& state )
+  {
+    const std::vector<int> keys( BenchmarkData::shuffledKeys( state.range(0) ) );
+    C const counter( filled<C>( keys ) );
+    for( auto _ : state )
+      for( std::size_t i = 0; i < keys.size(); ++i )
+	benchmark::DoNotOptimize( counter.getCount( keys[i] ) );
+    state.SetItemsProcessed( state.iterations() * keys.size() );
+  }
+
+  // The total of an unsynchronized cache, i.e. a full scan.
+  template <typename C>
+  void TotalCount( benchmark::State& state )
+  {
+    C const counter( filled<C>( BenchmarkData::shuffledKeys( state.range(0) ) ) );
+    for( auto _ : state )
+      {
+	counter.resetCache();
+	benchmark::DoNotOptimize( counter.totalCount() );
+      }
+    state.SetItemsProcessed( state.iterations() * counter.size() );
+  }
+
+  template <typename C>
+  void Normalize( benchmark::State& state )
+  {
+    C counter( filled<C>( BenchmarkData::shuffledKeys( state.range(0) ) ) );
+    for( auto _ : state )
+      {
+	counter.resetCache();
+	counter.normalize();
+      }
+    state.SetItemsProcessed( state.iterations() * counter.size() );
+  }
+
+  template <typename C>
+  void Copy( benchmark::State& state )
+  {
+    C const counter( filled<C>( BenchmarkData::shuffledKeys( state.range(0) ) ) );
+    for( auto _ : state )
+      {
+	C copy( counter );
+	benchmark::DoNotOptimize( copy );
+      }
+    state.SetItemsProcessed( state.iterations() * counter.size() );
+  }
+
+  template <typename C>
+  void PlusEquals( benchmark::State& state )
+  {
+    const std::vector<int> keys( BenchmarkData::shuffledKeys( state.range(0) ) );
+    C counter( filled<C>( keys ) );
+    C const other( filled<C>( keys ) );
+    for( auto _ : state )
+      counter += other;
+    state.SetItemsProcessed( state.iterations() * counter.size() );
+  }
+
+  template <typename C>
+  void Equals( benchmark::State& state )
+  {
+    const std::vector<int> keys( BenchmarkData::shuffledKeys( state.range(0) ) );
+    C const counter( filled<C>( keys ) ), other( counter );
+    for( auto _ : state )
+      benchmark::DoNotOptimize( counter.equals( other ) );
+    state.SetItemsProcessed( state.iterations() * counter.size() );
+  }
+
+#define COUNTER_BENCHMARK(OP)						\
+  BENCHMARK_TEMPLATE(OP, AnyCounter)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond); \
+  BENCHMARK_TEMPLATE(OP, FlatCounter)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond)
+
+  COUNTER_BENCHMARK(Increment);
+  COUNTER_BENCHMARK(GetCount);
+  COUNTER_BENCHMARK(TotalCount);
+  COUNTER_BENCHMARK(Normalize);
+  COUNTER_BENCHMARK(Copy);
+  COUNTER_BENCHMARK(PlusEquals);
+  COUNTER_BENCHMARK(Equals);
+
+#undef COUNTER_BENCHMARK
+};
+
+#endif // __COUNTER_BENCHMARKS_HPP__
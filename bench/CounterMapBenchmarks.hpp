@@ -0,0 +1,119 @@
+#ifndef __COUNTER_MAP_BENCHMARKS_HPP__
+#define __COUNTER_MAP_BENCHMARKS_HPP__
+
+/*
+ * Bigram models of synthetic texts of 10^4 to 10^6 words (see
+ * BenchmarkData::corpus()): their ingestion, and the copies, sums and
+ * comparisons of the resulting models.
+ */
+
+#include "Counters/CounterMap.hpp"
+#include "Counters/TextIngestion.hpp"
+#include "BenchmarkData.hpp"
+
+#include <string>
+
+namespace CounterMapBenchmarks
+{
+  typedef Counters::CounterMap<std::string, std::string> Model;
+
+  // The corpus of state.range(0) words, or NULL (and the benchmark skipped)
+  // if the test text is missing.
+  inline std::string const* corpusOrSkip( benchmark::State& state )
+  {
+    std::string const& text( BenchmarkData::corpus( state.range(0) ) );
+    if( text.empty() )
+      {
+	state.SkipWithError( "bench/data/rock-n-roll-nerd cannot be read" );
+	return NULL;
+      }
+    return &text;
+  }
+
+  inline Model model( std::string const& text )
+  {
+    Model m;
+    Counters::ingestText( text.data(), text.data() + text.size(), m );
+    return m;
+  }
+
+  // The bigrams counted word by word with operator>> and incrementCount().
+  void IncrementCount( benchmark::State& state )
+  {
+    std::string const* text( corpusOrSkip( state ) );
+    if( text == NULL )
+      return;
+    for( auto _ : state )
+      {
+	Model m;
+	std::istringstream is( *text );
+	std::string previous, word;
+	is >> previous;
+	while( is >> word )
+	  {
+	    m.incrementCount( previous, word, 1 );
+	    previous.swap( word );
+	  }
+	benchmark::DoNotOptimize( m );
+      }
+    state.SetBytesProcessed( state.iterations() * text->size() );
+  }
+
+  // The bigrams counted by ingestText() with state.range(1) threads.
+  void IngestText( benchmark::State& state )
+  {
+    std::string const* text( corpusOrSkip( state ) );
+    if( text == NULL )
+      return;
+    const Counters::IngestionOptions options( 2, false, state.range(1), 1 << 16 );
+    for( auto _ : state )
+      {
+	Model m;
+	Counters::ingestText( text->data(), text->data() + text->size(), m, options );
+	benchmark::DoNotOptimize( m );
+      }
+    state.SetBytesProcessed( state.iterations() * text->size() );
+  }
+
+  void Copy( benchmark::State& state )
+  {
+    std::string const* text( corpusOrSkip( state ) );
+    if( text == NULL )
+      return;
+    Model const m( model( *text ) );
+    for( auto _ : state )
+      {
+	Model copy( m );
+	benchmark::DoNotOptimize( copy );
+      }
+  }
+
+  void PlusEquals( benchmark::State& state )
+  {
+    std::string const* text( corpusOrSkip( state ) );
+    if( text == NULL )
+      return;
+    Model m( model( *text ) );
+    Model const other( m );
+    for( auto _ : state )
+      m += other;
+  }
+
+  void Equals( benchmark::State& state )
+  {
+    std::string const* text( corpusOrSkip( state ) );
+    if( text == NULL )
+      return;
+    Model const m( model( *text ) ), other( m );
+    for( auto _ : state )
+      benchmark::DoNotOptimize( m.equals( other ) );
+  }
+
+  BENCHMARK(IncrementCount)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+  BENCHMARK(IngestText)->ArgsProduct( { { 10000, 100000, 1000000 }, { 1, 4 } } )->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(Copy)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+  BENCHMARK(PlusEquals)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+  BENCHMARK(Equals)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+};
+
+#endif // __COUNTER_MAP_BENCHMARKS_HPP__
@@ -13,11 +13,18 @@
  */
 
 #include "IteratorTypeErasure/any_iterator/any_iterator.hpp"
+#include "AnyMap/details/_MapTraits.hpp"
+#include "AnyMap/details/_KeyView.hpp"
+#include "AnyMap/details/_MapOps.hpp"
+#include "AnyMap/FlatHashMap.hpp"
+#include "AnyMap/MapStats.hpp"
 
 #include <boost/unordered_map.hpp>
 
 #include <ostream>
 
+#include <new>
+#include <type_traits>
 #include <utility>
 
 
@@ -38,7 +45,8 @@ namespace MapTypeErasure
    * parametrized with the types of the keys (K) and of the mapped objects (V).
    * The rest is taken care of by the map object passed to AnyMap during 
    * construction. If none is passed, AnyMap with a default map type (currently,
-   * boost::unordered_map with default type arguments) is created.
+   * boost::unordered_map with default type arguments, or FlatHashMap if
+   * ANY_MAP_FLAT_DEFAULT_MAP is defined) is created.
    *
    * Map Interface Requirements
    * The following methods are required from the underlying map of some type
@@ -63,10 +71,55 @@ namespace MapTypeErasure
    * - const_itr begin() const
    * - itr end()
    * - const_itr end() const
+   * - MapType::const_iterator (used for internal iteration, see for_each())
    * - std::pair<iteraotr, bool> insert(value_type const &)
+   * - std::pair<iteraotr, bool> insert(value_type &&)
    * - void insert(const_iterator, const_iterator)
+   * - std::pair<iteraotr, bool> emplace(K &&, V &&)
+   * - std::pair<iteraotr, bool> try_emplace(K &&, Args...) (+)
+   *   Without it, ordered maps (those with lower_bound(), key_comp() and
+   *   emplace_hint()) emplace at the lower bound of the key, other maps use
+   *   find() followed by emplace().
    * - size_type erase(K const&)
+   * - iterator erase(const_iterator) (+)
+   * - size_type erase_if(Predicate) (+)
+   *   Used by erase_if(). Without a native erase_if(), the maps with an
+   *   iterator erase are erased from during a single traversal, the other
+   *   maps by key after the traversal.
    * - void clear()
+   * - void reserve(size_type) (+)
+   * - void rehash(size_type) (+)
+   * - void shrink_to_fit() (+)
+   *   Without it, maps with rehash() are shrunk with rehash(0).
+   * - float max_load_factor() const (+)
+   * - void max_load_factor(float) (+)
+   * - size_type bucket_count() const (+)
+   *   Capacity management calls are no-ops for maps which lack them.
+   * - size_type memory_usage() const (+)
+   *   The bytes allocated by the map (see memory_usage()); estimated for maps
+   *   which lack it.
+   * - itr find(key_view_type const &) (+)
+   * - const_itr find(key_view_type const &) const (+)
+   *   Used by heterogeneous lookups (see find(KeyLike const&)). Without it,
+   *   maps with a CompatibleKeyLookup use find(key_view_type, hash, eq);
+   *   other maps construct a key from the view and then call find().
+   * - V sum_mapped() const (+)
+   * - void scale_mapped(V const &) (+)
+   * - bool add_mapped(MapType const &, V const &) (+)
+   * - bool equal_mapped(MapType const &, V const &) const (+)
+   *   Native bulk arithmetic on the mapped values, for maps which do not
+   *   store one mapped value per key (e.g. Counters::CountMinSketch), or
+   *   which can scan their values faster than the element-wise iteration
+   *   (e.g. FlatHashMap). See sum_mapped(V&) const and the related AnyMap
+   *   methods.
+   *
+   * Storage
+   * The wrapper of the underlying map is stored within the AnyMap itself if it
+   * fits into INLINE_MODEL_SIZE bytes (as the default_map_type, std::map,
+   * FlatHashMap and SortedVectorMap do, also with a one-pointer allocator such
+   * as ArenaAllocator), and allocated on the heap otherwise.
+   * Moving and swapping AnyMaps with inline maps therefore moves the maps
+   * themselves, rather than pointers to them.
    *
    * @param K Key type
    * @param V Mapped value type
@@ -84,6 +137,9 @@ namespace MapTypeErasure
     typedef std::pair<K const, V> value_type;
     /*! @brief Unsigned integer type that can represent any non-negative value.*/
     typedef size_t size_type;
+    /*! @brief Non-owning type used by heterogeneous lookups (e.g.
+     *  boost::string_view for std::string keys). See KeyView. */
+    typedef typename KeyView<K>::type key_view_type;
   
     /*! @brief A forward iterator to value_type. */
     typedef any_iterator<value_type, boost::forward_traversal_tag> iterator;
@@ -91,11 +147,42 @@ namespace MapTypeErasure
     typedef any_iterator<value_type const, boost::forward_traversal_tag> const_iterator;
     
     /*! @brief The map used in AnyMap's construction when no other is specified.
+     *  Define ANY_MAP_FLAT_DEFAULT_MAP to use FlatHashMap (note that its inserts
+     *  invalidate references to the elements).
      */
+#ifdef ANY_MAP_FLAT_DEFAULT_MAP
+    typedef FlatHashMap<K, V> default_map_type;
+#else
     typedef boost::unordered_map<K, V> default_map_type;
+#endif
+
+    /*! @brief Size of the storage for the underlying map within the AnyMap
+     *  (see the class description). */
+    static const size_type INLINE_MODEL_SIZE = 9 * sizeof(void*);
 
   private:
 
+    typedef typename std::aligned_storage<INLINE_MODEL_SIZE, alignof(void*)>::type InlineStorage_t;
+
+    // Callbacks used by internal iteration (see for_each()). The context
+    // argument is the address of the caller's function object.
+    typedef void (*ConstVisitor)(void* context, value_type const& val);
+    typedef void (*Visitor)(void* context, value_type& val);
+    typedef bool (*Predicate)(void* context, value_type const& val);
+
+    template<typename F, typename Value>
+    static void invokeVisitor(void* f, Value& val) { (*static_cast<F*>(f))(val); }
+
+    template<typename F>
+    static bool invokePredicate(void* f, value_type const& val) { return (*static_cast<F*>(f))(val); }
+
+    // Callback used by try_emplace() to construct the mapped value only once
+    // the key is known to be missing.
+    typedef V (*MappedFactory)(void* context);
+
+    template<typename F>
+    static V invokeFactory(void* f) { return (*static_cast<F*>(f))(); }
+
     // struct: MapConcept
     //
     // This class is the parent of specificly map-type templated classes.
@@ -107,7 +194,8 @@ namespace MapTypeErasure
     //   Checking equality is done by iterating through all elements contained
     //   in this map and looking them up in the other map. If all elements
     //   are matched and the numbers of stored elements are equal in both
-    //   maps, the MapConcepts are declared to be equal.
+    //   maps, the MapConcepts are declared to be equal. Maps of the same
+    //   type are compared natively (see MapModel::equals()).
     //   Inequality is implemented as !this->operator==(other).
     //
     // NOTE:
@@ -123,13 +211,25 @@ namespace MapTypeErasure
     
       virtual ~MapConcept() {}
 
-      // clone
-      virtual MapConcept* clone() const = 0;
+      // clone: copies or moves this map into the storage if it fits, or to
+      // the heap otherwise
+      virtual MapConcept* clone_into(InlineStorage_t* storage) const = 0;
+      virtual MapConcept* move_into(InlineStorage_t* storage) = 0;
 
       // size and capasity
       virtual bool empty() const = 0;
       virtual size_type size() const = 0;
       virtual size_type max_size() const = 0;
+      virtual void reserve(size_type n) = 0;
+      virtual void rehash(size_type n) = 0;
+      virtual void shrink_to_fit() = 0;
+      virtual float max_load_factor() const = 0;
+      virtual void max_load_factor(float z) = 0;
+      virtual size_type bucket_count() const = 0;
+      virtual bool is_sorted() const = 0;
+      // the bytes of this MapConcept, unless it is stored inline, and of the
+      // memory owned by the map
+      virtual size_type memory_usage(bool inlined) const = 0;
 
       // lookup
       virtual V& operator[](const K& k) = 0;
@@ -139,6 +239,8 @@ namespace MapTypeErasure
       virtual typename AnyMap::iterator       find(K const& k)       = 0;
       virtual typename AnyMap::const_iterator find(K const& k) const = 0;
       virtual size_type count(K const& k) const = 0;
+      virtual typename AnyMap::iterator       find_view(key_view_type const& k)       = 0;
+      virtual typename AnyMap::const_iterator find_view(key_view_type const& k) const = 0;
 
       // traversal iterators
       virtual typename AnyMap::iterator       begin()       = 0;
@@ -146,31 +248,60 @@ namespace MapTypeErasure
       virtual typename AnyMap::iterator         end()       = 0;
       virtual typename AnyMap::const_iterator   end() const = 0;
 
+      // internal iteration
+      virtual void for_each(ConstVisitor visit, void* context) const = 0;
+      virtual void for_each_mut(Visitor visit, void* context)        = 0;
+      virtual bool all_of(Predicate pred, void* context) const       = 0;
+
+      // native bulk arithmetic
+      virtual bool sum_mapped(V& sum) const = 0;
+      virtual bool scale_mapped(V const& n) = 0;
+      virtual bool add_mapped(MapConcept const& other, V const& factor) = 0;
+      virtual bool equal_mapped(MapConcept const& other, V const& precision, bool& equal) const = 0;
+      virtual bool add_many(K const* const* keys, V const* deltas, size_type n, V const& factor, V* results) = 0;
+      virtual void get_many(K const* const* keys, size_type n, V* out, V const& missing) const = 0;
+
       // inserts
       virtual std::pair<iterator, bool> insert(value_type const& val)    = 0;
+      virtual std::pair<iterator, bool> insert(value_type&& val)         = 0;
       virtual void insert(const_iterator i1, const_iterator i2) = 0;
+      virtual void insert_all(MapConcept const& other) = 0;
+      virtual std::pair<iterator, bool> emplace(K&& k, V&& v)            = 0;
+      virtual std::pair<iterator, bool> try_emplace(K const& k, MappedFactory make, void* context) = 0;
+      virtual std::pair<iterator, bool> try_emplace(K     && k, MappedFactory make, void* context) = 0;
+      virtual std::pair<iterator, bool> try_emplace_view(key_view_type const& k, MappedFactory make, void* context) = 0;
 
       // erases
       virtual size_type erase(K const& k) = 0;
+      virtual size_type erase_if(Predicate pred, void* context) = 0;
 
       // clear
       virtual void clear() = 0;
 
-      // comparison
+      // comparison of maps of the same size
+      virtual bool equals(MapConcept const& other) const = 0;
+
+      // The MapConcept which holds the map: itself, unless it decorates
+      // another one (see InstrumentedModel). The native paths between maps
+      // of the same type look through the decorators.
+      virtual MapConcept const& unwrapped() const { return *this; }
+
       bool operator==(const MapConcept& other) const {
 	if( this == &other ) return true;
 	if( size() != other.size() ) { return false; }
-	for( AnyMap::const_iterator i(begin()); i != end(); ++i ) {
-	  AnyMap::const_iterator const& oi( other.find( i->first ) );
-	  if( oi == other.end() || oi->second != i->second )
-	    {
-	      return false;
-	    }
-	}
-	return true;
+	return equals( other );
       }
 
       bool operator!=(const MapConcept& other) const { return !operator==(other); }
+
+    protected:
+      // Predicate for all_of(): true if the MapConcept pointed to by context
+      // maps val.first to val.second.
+      static bool isMatchedIn(void* context, value_type const& val) {
+	MapConcept const& other( *static_cast<MapConcept const*>(context) );
+	AnyMap::const_iterator const& oi( other.find( val.first ) );
+	return oi != other.end() && oi->second == val.second;
+      }
     };
 
     // struct: MapModel
@@ -200,12 +331,32 @@ namespace MapTypeErasure
       virtual ~MapModel() {}
 
       // clone 
-      MapModel* clone() const { return new MapModel<MapType>( map_ ); }
+      MapConcept* clone_into(InlineStorage_t* storage) const { return create( storage, map_ ); }
+      MapConcept* move_into(InlineStorage_t* storage)        { return create( storage, std::move(*this) ); }
+
+      // Constructs a MapModel from args in the storage if it fits, or on the
+      // heap otherwise.
+      template<typename... Args>
+      static MapConcept* create(InlineStorage_t* storage, Args&&... args)
+      {
+	if( sizeof(MapModel) <= sizeof(InlineStorage_t) && alignof(MapModel) <= alignof(InlineStorage_t) )
+	  return new (storage) MapModel( std::forward<Args>(args)... );
+	return new MapModel( std::forward<Args>(args)... );
+      }
 
       // size and capasity
       bool empty() const                              { return map_.empty();    }
       typename MapConcept::size_type size() const     { return map_.size();     }
       typename MapConcept::size_type max_size() const { return map_.max_size(); }
+      void reserve(size_type n)       { Ops::reserve( map_, n ); }
+      void rehash(size_type n)        { Ops::rehash( map_, n ); }
+      void shrink_to_fit()            { Ops::shrinkToFit( map_ ); }
+      float max_load_factor() const   { return Ops::maxLoadFactor( map_ ); }
+      void max_load_factor(float z)   { Ops::maxLoadFactor( map_, z ); }
+      size_type bucket_count() const  { return Ops::bucketCount( map_ ); }
+      bool is_sorted() const          { return Ops::isSorted(); }
+      size_type memory_usage(bool inlined) const
+      { return (inlined ? 0 : sizeof(MapModel)) + Ops::memoryUsage( map_ ); }
 
       // lookup
       V& operator[] (const K  & k)          { return map_[k];    }
@@ -215,6 +366,10 @@ namespace MapTypeErasure
       size_type count(K const& k) const                      { return map_.count(k); }
       typename AnyMap::iterator       find(K const& k)       { return AnyMap::iterator(map_.find(k)); }
       typename AnyMap::const_iterator find(K const& k) const { return AnyMap::const_iterator(map_.find(k)); }
+      typename AnyMap::iterator       find_view(key_view_type const& k)
+      { return AnyMap::iterator(Ops::findView(map_, k)); }
+      typename AnyMap::const_iterator find_view(key_view_type const& k) const
+      { return AnyMap::const_iterator(Ops::findView(map_, k)); }
 
       // traversal iterators
       typename AnyMap::iterator       begin()       { return AnyMap::iterator(map_.begin()); }
@@ -222,39 +377,144 @@ namespace MapTypeErasure
       typename AnyMap::iterator         end()       { return AnyMap::iterator(map_.end()); }
       typename AnyMap::const_iterator   end() const { return AnyMap::const_iterator(map_.end()); }
 
+      // internal iteration
+      void for_each(ConstVisitor visit, void* context) const
+      {
+	for( typename MapType::const_iterator i(map_.begin()), e(map_.end()); i != e; ++i )
+	  visit(context, *i);
+      }
+
+      void for_each_mut(Visitor visit, void* context)
+      {
+	for( typename MapType::iterator i(map_.begin()), e(map_.end()); i != e; ++i )
+	  visit(context, *i);
+      }
+
+      bool all_of(Predicate pred, void* context) const
+      {
+	for( typename MapType::const_iterator i(map_.begin()), e(map_.end()); i != e; ++i )
+	  if( !pred(context, *i) )
+	    return false;
+	return true;
+      }
+
+      // native bulk arithmetic
+      bool sum_mapped(V& sum) const  { return Ops::sumMapped( map_, sum ); }
+      bool scale_mapped(V const& n)  { return Ops::scaleMapped( map_, n ); }
+      bool add_mapped(MapConcept const& other, V const& factor)
+      {
+	MapModel const* o( dynamic_cast<MapModel const*>(&other.unwrapped()) );
+	return o != NULL && Ops::addMapped( map_, o->map_, factor );
+      }
+      bool equal_mapped(MapConcept const& other, V const& precision, bool& equal) const
+      {
+	MapModel const* o( dynamic_cast<MapModel const*>(&other.unwrapped()) );
+	return Ops::equalMapped( map_, o == NULL ? NULL : &o->map_, precision, equal );
+      }
+      bool add_many(K const* const* keys, V const* deltas, size_type n, V const& factor, V* results)
+      { return Ops::addMany( map_, keys, deltas, n, factor, results ); }
+      void get_many(K const* const* keys, size_type n, V* out, V const& missing) const
+      { Ops::getMany( map_, keys, n, out, missing ); }
+
       // inserts
-      std::pair<iterator, bool> insert(value_type const& val)                { return map_.insert(val);    }
+      std::pair<iterator, bool> insert(value_type const& val)
+      { return wrap( map_.insert(val) ); }
+      std::pair<iterator, bool> insert(value_type&& val)
+      { return wrap( map_.insert(std::move(val)) ); }
       void                      insert(const_iterator i1, const_iterator i2) { return map_.insert(i1, i2); }
+      void insert_all(MapConcept const& other)
+      {
+	MapModel const* o( dynamic_cast<MapModel const*>(&other.unwrapped()) );
+	if( o == this ) return;
+	if( o != NULL ) map_.insert( o->map_.begin(), o->map_.end() );
+	else            map_.insert( other.begin(), other.end() );
+      }
+      std::pair<iterator, bool> emplace(K&& k, V&& v)
+      { return wrap( map_.emplace(std::move(k), std::move(v)) ); }
+      std::pair<iterator, bool> try_emplace(K const& k, MappedFactory make, void* context)
+      { BoundFactory f( make, context );  return wrap( Ops::tryEmplace( map_, k, f ) ); }
+      std::pair<iterator, bool> try_emplace(K     && k, MappedFactory make, void* context)
+      { BoundFactory f( make, context );  return wrap( Ops::tryEmplace( map_, std::move(k), f ) ); }
+      std::pair<iterator, bool> try_emplace_view(key_view_type const& k, MappedFactory make, void* context)
+      { BoundFactory f( make, context );  return wrap( Ops::tryEmplaceView( map_, k, f ) ); }
 
       // erases
       size_type erase(K const& k) { return map_.erase(k); }
+      size_type erase_if(Predicate pred, void* context)
+      { BoundPredicate p( pred, context );  return Ops::eraseIf( map_, p ); }
 
       // clear
       void clear() { map_.clear(); }
 
+      // comparison: maps of the same type are compared without type erasure
+      // (see details::MapOps::equals())
+      bool equals(MapConcept const& other) const
+      {
+	MapModel const* o( dynamic_cast<MapModel const*>(&other.unwrapped()) );
+	if( o != NULL )
+	  return Ops::equals( map_, o->map_ );
+	// a map compared natively (e.g. a sketch, which visits no elements)
+	// differs from the maps of other types
+	bool equal(false);
+	if( this->equal_mapped( other, V(), equal ) || other.equal_mapped( *this, V(), equal ) )
+	  return equal;
+	return this->all_of( &MapConcept::isMatchedIn, const_cast<MapConcept*>(&other) );
+      }
+
     private:
+      typedef details::MapOps<MapType, K, V> Ops;
+
+      // A MappedFactory and its context as the function object expected by
+      // the MapOps.
+      struct BoundFactory
+      {
+	BoundFactory( MappedFactory make, void* context ) : make_(make), context_(context) {}
+	V operator()() const { return make_(context_); }
+      private:
+	MappedFactory make_;
+	void* context_;
+      };
+
+      // A Predicate and its context as the function object expected by the
+      // MapOps.
+      struct BoundPredicate
+      {
+	BoundPredicate( Predicate pred, void* context ) : pred_(pred), context_(context) {}
+	bool operator()(value_type const& val) const { return pred_(context_, val); }
+      private:
+	Predicate pred_;
+	void* context_;
+      };
+
+      static std::pair<iterator, bool> wrap( std::pair<typename MapType::iterator, bool> const& r )
+      { return std::pair<iterator, bool>( iterator(r.first), r.second ); }
+
       MapType map_;
     };
 
+    // Decorates the MapConcept of another AnyMap, recording MapStats (see
+    // details/_InstrumentedModel.hpp).
+    struct InstrumentedModel;
+
   public:
 
     /*! @brief Constructs an AnyMap with a default_map_type. */
-    AnyMap() : mapConcept_( new MapModel<default_map_type>() ) {}
+    AnyMap() : mapConcept_( MapModel<default_map_type>::create(&storage_) ) {}
 
     /*! @brief Constructs an AnyMap with a copy of the specified map. Uses move
     *   semantics. */
     template<typename MapType>
     explicit AnyMap( MapType m )
-      : mapConcept_( new MapModel<MapType>( std::move(m) ) ) {
+      : mapConcept_( MapModel<MapType>::create( &storage_, std::move(m) ) ) {
     }
 
     /*! @brief Copies the other AnyMap's underlying container. */
-    AnyMap( AnyMap const & o ) : mapConcept_( o.mapConcept_->clone() ) {}
+    AnyMap( AnyMap const & o ) : mapConcept_( o.mapConcept_->clone_into(&storage_) ) {}
 
     /*! @brief Steals the temporary AnyMap's underlying container. */
-    AnyMap( AnyMap && o ) : mapConcept_( o.mapConcept_ ) { o.mapConcept_ = 0; }
+    AnyMap( AnyMap && o ) : mapConcept_( NULL ) { steal(o); }
     
-    ~AnyMap() { delete mapConcept_; }
+    ~AnyMap() { destroy(); }
 
     /*! @brief Copies the contents of the other map.
      *  @return This AnyMap. */
@@ -273,7 +533,19 @@ namespace MapTypeErasure
     
     /*! @brief Swaps contents with the other AnyMap. */
     void swap(AnyMap& other) 
-    { using std::swap;  swap( mapConcept_, other.mapConcept_ ); }
+    {
+      if( isInline() || other.isInline() ) {
+	AnyMap tmp( std::move(other) );
+	other.destroy();
+	other.steal( *this );
+	destroy();
+	steal( tmp );
+      }
+      else {
+	using std::swap;
+	swap( mapConcept_, other.mapConcept_ );
+      }
+    }
   
     /*!
      * @name Size and Capacity
@@ -285,6 +557,37 @@ namespace MapTypeErasure
     size_type size() const  { return mapConcept_->size(); }
     /*! @brief Returns the maximum number of elements the map can store. */
     size_type max_size() const  { return mapConcept_->max_size(); }
+    /*! @brief Prepares the map to hold n elements without rehashing. No-op if
+     *  the underlying map has no reserve(). */
+    void reserve(size_type n) { mapConcept_->reserve(n); }
+    /*! @brief Sets the number of buckets to at least n (and enough for the
+     *  current size). No-op if the underlying map has no rehash(). */
+    void rehash(size_type n)  { mapConcept_->rehash(n); }
+    /*! @brief Releases the capacity which is not needed for the current
+     *  elements. Uses the underlying map's shrink_to_fit() if it has one,
+     *  rehash(0) if it has that, and does nothing otherwise. */
+    void shrink_to_fit()      { mapConcept_->shrink_to_fit(); }
+    /*! @brief Returns the maximum load factor, or 0 if the underlying map has
+     *  none. */
+    float max_load_factor() const  { return mapConcept_->max_load_factor(); }
+    /*! @brief Sets the maximum load factor. No-op if the underlying map has
+     *  none. */
+    void max_load_factor(float z)  { mapConcept_->max_load_factor(z); }
+    /*! @brief Returns the number of buckets, or 0 if the underlying map has
+     *  none. */
+    size_type bucket_count() const { return mapConcept_->bucket_count(); }
+    /*! @brief Checks whether the traversal visits the keys in increasing
+     *  std::less<K> order, i.e. whether the underlying map is ordered (has
+     *  lower_bound(), key_comp() and emplace_hint()) by std::less<K>. */
+    bool is_sorted() const         { return mapConcept_->is_sorted(); }
+    /*! @brief Returns the bytes used by the map: the AnyMap itself, the
+     *  underlying map if it is not stored inline, and the memory the
+     *  underlying map has allocated. The last part is exact for maps with a
+     *  memory_usage() of their own (e.g. FlatHashMap, SortedVectorMap) and
+     *  estimated for the others, as one node (the element and two pointers,
+     *  four for ordered maps) per element and a pointer per bucket. Memory
+     *  drawn from an Arena is counted as if it were allocated per element. */
+    size_type memory_usage() const { return sizeof(AnyMap) + mapConcept_->memory_usage( isInline() ); }
     /*! @} */
     
     /*!
@@ -305,6 +608,28 @@ namespace MapTypeErasure
     const_iterator find(K const& k) const { return mapConcept_->find(k); }
     /*! @brief Counts the number elements with the given key stored in the map.*/
     size_type count(K const& k) const { return mapConcept_->count(k); }
+
+    /*! @brief Gets an iterator pointing to the value_type with a key equal to
+     *  k without constructing a key_type (heterogeneous lookup). Enabled for
+     *  arguments other than K which convert to key_view_type, e.g. const char*
+     *  or boost::string_view for std::string keys. */
+    template<typename KeyLike>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, iterator>::type
+    find(KeyLike const& k)       { return mapConcept_->find_view(key_view_type(k)); }
+    /*! @overload find(KeyLike const& k) */
+    template<typename KeyLike>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, const_iterator>::type
+    find(KeyLike const& k) const { return mapConcept_->find_view(key_view_type(k)); }
+    /*! @brief Counts the elements with a key equal to k without constructing a
+     *  key_type. See find(KeyLike const& k). */
+    template<typename KeyLike>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, size_type>::type
+    count(KeyLike const& k) const { return find(k) == end() ? 0 : 1; }
+    /*! @brief Sets out[i] to the mapped value of *keys[i], or to missing if
+     *  the key is not in the map, for each i in [0, n), with a single virtual
+     *  call (see add_many()). */
+    void get_many(K const* const* keys, size_type n, V* out, V const& missing) const
+    { mapConcept_->get_many(keys, n, out, missing); }
     /*! @} */
 
     /*!
@@ -325,6 +650,81 @@ namespace MapTypeErasure
     const_iterator   end() const  { return mapConcept_->end();   }
     /*! @} */
 
+    /*!
+     * @name Internal Iteration
+     * Each of these methods walks the whole map with the underlying map's own
+     * iterators, paying a single virtual call for the traversal instead of the
+     * several virtual calls per element that an iterator-based loop costs.
+     * The elements must not be inserted or erased from within the function
+     * objects.
+     * @{
+     */
+    /*! @brief Calls f(value_type const&) on every element of the map.
+     *  @return The function object after it has visited all elements. */
+    template<typename F>
+    F for_each(F f) const
+    { mapConcept_->for_each( &AnyMap::invokeVisitor<F, value_type const>, &f );  return f; }
+
+    /*! @brief Calls f(value_type&) on every element of the map. f may modify
+     *  the mapped values.
+     *  @return The function object after it has visited all elements. */
+    template<typename F>
+    F for_each_mut(F f)
+    { mapConcept_->for_each_mut( &AnyMap::invokeVisitor<F, value_type>, &f );  return f; }
+
+    /*! @brief Calls pred(value_type const&) on the elements of the map until it
+     *  first returns false.
+     *  @return TRUE if pred returned true for every element, FALSE otherwise. */
+    template<typename Pred>
+    bool all_of(Pred pred) const
+    { return mapConcept_->all_of( &AnyMap::invokePredicate<Pred>, &pred ); }
+    /*! @} */
+
+    /*!
+     * @name Native Bulk Arithmetic
+     * Arithmetic on all the mapped values done by the underlying map itself.
+     * Only maps which do not keep a mapped value per key (such as sketches)
+     * need to provide it; for the others, these methods do nothing and return
+     * FALSE, and the caller falls back to internal iteration.
+     * @{
+     */
+    /*! @brief Sets sum to the sum of the mapped values.
+     *  @return FALSE, leaving sum unchanged, if the underlying map has no
+     *  sum_mapped(). */
+    bool sum_mapped(V& sum) const { return mapConcept_->sum_mapped(sum); }
+    /*! @brief Multiplies all the mapped values by n.
+     *  @return FALSE, changing nothing, if the underlying map has no
+     *  scale_mapped(). */
+    bool scale_mapped(V const& n) { return mapConcept_->scale_mapped(n); }
+    /*! @brief Adds the mapped values of other, multiplied by factor, to the
+     *  mapped values of this map (inserting the missing keys), with a loop
+     *  over the underlying maps.
+     *  @return FALSE, changing nothing, unless both maps have the same
+     *  underlying type, which either has an add_mapped() accepting the other
+     *  map or has arithmetic mapped values. In the latter case ordered maps
+     *  are merged in a single linear pass, with hinted inserts. */
+    bool add_mapped(AnyMap const& other, V const& factor)
+    { return mapConcept_->add_mapped(*other.mapConcept_, factor); }
+    /*! @brief Sets equal to whether other has the same underlying type and
+     *  the same mapped values, within precision (see the equal_mapped() of
+     *  the underlying map). Compares maps which do not visit their mapped
+     *  values, such as sketches; operator==() uses it for them.
+     *  @return FALSE, leaving equal unchanged, if the underlying map has no
+     *  equal_mapped(). */
+    bool equal_mapped(AnyMap const& other, V const& precision, bool& equal) const
+    { return mapConcept_->equal_mapped(*other.mapConcept_, precision, equal); }
+    /*! @brief Adds deltas[i] times factor to the mapped value of *keys[i]
+     *  (inserting a value initialized one if the key is missing) for each i
+     *  in [0, n), in order, and stores the resulting mapped values in
+     *  results, unless it is NULL. The batch costs a single virtual call;
+     *  maps with an add_many() of their own (e.g. FlatHashMap) can prefetch
+     *  the elements of the keys ahead of the probes.
+     *  @return FALSE, changing nothing, if the mapped values are not
+     *  arithmetic and the underlying map has no add_many(). */
+    bool add_many(K const* const* keys, V const* deltas, size_type n, V const& factor, V* results = NULL)
+    { return mapConcept_->add_many(keys, deltas, n, factor, results); }
+    /*! @} */
+
     /*!
      * @name Modifiers
      * @{
@@ -332,14 +732,74 @@ namespace MapTypeErasure
     /*! @brief Inserts the value provided. */
     std::pair<iterator, bool> insert(value_type const& val) { return mapConcept_->insert(val); }
 
+    /*! @brief Inserts the value provided, moving it into the map. */
+    std::pair<iterator, bool> insert(value_type&& val) { return mapConcept_->insert(std::move(val)); }
+
+    /*! @brief Inserts an element constructed from the key and the mapped value
+     *  arguments if the key is not in the map yet.
+     *  @return Iterator to the element with the key and TRUE if the element was
+     *  inserted. */
+    template<typename KeyArg, typename MappedArg>
+    std::pair<iterator, bool> emplace(KeyArg&& k, MappedArg&& v)
+    { return mapConcept_->emplace( K(std::forward<KeyArg>(k)), V(std::forward<MappedArg>(v)) ); }
+
+    /*! @brief If the key is not in the map, inserts it with the mapped value
+     *  constructed from args. Otherwise does nothing; in particular, the mapped
+     *  value is not constructed and args are not moved from.
+     *
+     *  Costs a single lookup unless the underlying map has neither
+     *  try_emplace() nor ordered lookup (see the interface requirements).
+     *  @return Iterator to the element with the key and TRUE if the element was
+     *  inserted. */
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(K const& k, Args&&... args)
+    {
+      auto make = [&]() { return V(std::forward<Args>(args)...); };
+      return mapConcept_->try_emplace( k, &AnyMap::invokeFactory<decltype(make)>, &make );
+    }
+
+    /*! @overload try_emplace(K const& k, Args&&... args) */
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& k, Args&&... args)
+    {
+      auto make = [&]() { return V(std::forward<Args>(args)...); };
+      return mapConcept_->try_emplace( std::move(k), &AnyMap::invokeFactory<decltype(make)>, &make );
+    }
+
+    /*! @brief Heterogeneous try_emplace(): the key_type is only constructed
+     *  from k if the element is inserted. See find(KeyLike const& k). */
+    template<typename KeyLike, typename... Args>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, std::pair<iterator, bool> >::type
+    try_emplace(KeyLike const& k, Args&&... args)
+    {
+      auto make = [&]() { return V(std::forward<Args>(args)...); };
+      return mapConcept_->try_emplace_view( key_view_type(k), &AnyMap::invokeFactory<decltype(make)>, &make );
+    }
+
     /*! @brief Inserts all values starting at the value pointed to by i1 and
     *   ending at but not including the value pointed to by i2. */
     template<typename InputIterator>
     void insert(InputIterator i1, InputIterator i2) { return mapConcept_->insert(i1, i2); }
 
+    /*! @brief Inserts all the values of the other map whose keys are not in
+     *  this map. Iterates over the other map natively if the underlying maps
+     *  have the same type. */
+    void insert(AnyMap const& other) { mapConcept_->insert_all(*other.mapConcept_); }
+
     /*! @brief Removes the key and it's associated element from the container. */
     size_type erase(K const& k) { return mapConcept_->erase(k); }
 
+    /*! @brief Removes the elements for which pred(value_type const&) is
+     *  true, with a single virtual call. Uses the underlying map's
+     *  erase_if() if it has one (e.g. FlatHashMap, SortedVectorMap, which
+     *  compact their arrays in a single pass), erases with the iterators of
+     *  a single traversal if it has erase(const_iterator), and erases the
+     *  collected keys otherwise. pred must not modify the map.
+     *  @return The number of elements removed. */
+    template<typename Pred>
+    size_type erase_if(Pred pred)
+    { return mapConcept_->erase_if( &AnyMap::invokePredicate<Pred>, &pred ); }
+
     /*! @brief Removes all keys and associted elements from the container. */
     void clear() { mapConcept_->clear(); }
     /*! @} */
@@ -349,7 +809,9 @@ namespace MapTypeErasure
      *  Checking equality is done by iterating through all elements contained
      *  in this map and looking them up in the other map. If all elements
      *  are matched and the numbers of stored elements are equal in both
-     *  maps, the MapConcepts are declared to be equal.
+     *  maps, the MapConcepts are declared to be equal. If the underlying
+     *  maps have the same type, the iteration and the lookups are native,
+     *  and ordered maps are compared in a single linear pass.
      *
      *  NOTE:
      *  *  Because of the implementation of equality it may be more efficient
@@ -363,11 +825,89 @@ namespace MapTypeErasure
      *  negation of the equality operator. */
     bool operator!=(const AnyMap& other) const  { return mapConcept_->operator!=(*other.mapConcept_); }
 
+    /*!
+     * @name Instrumentation
+     * An instrumented AnyMap counts and times its operations (see MapStats)
+     * before forwarding them to the underlying map, at the cost of an extra
+     * virtual call and two clock readings per operation. The native paths
+     * between maps of the same underlying type (add_mapped(), ==, ...) are
+     * kept. Copies of an instrumented AnyMap are instrumented and start with
+     * the statistics of the original.
+     * @{
+     */
+    /*! @brief Turns the instrumentation on (with fresh statistics) or off.
+     *  No-op if it already is in that state. */
+    void set_instrumented(bool on)
+    {
+      if( on == is_instrumented() ) return;
+      if( on ) {
+	InstrumentedModel* model( new InstrumentedModel( std::move(*this) ) );
+	destroy();
+	mapConcept_ = model;
+      }
+      else {
+	AnyMap inner( std::move( static_cast<InstrumentedModel*>(mapConcept_)->map_ ) );
+	destroy();
+	steal( inner );
+      }
+    }
+    /*! @brief Checks whether the map is instrumented. */
+    bool is_instrumented() const { return dynamic_cast<InstrumentedModel const*>(mapConcept_) != NULL; }
+    /*! @brief Sets result to the statistics recorded since the
+     *  instrumentation was turned on (or since reset_stats()).
+     *  @return FALSE, leaving result unchanged, if the map is not
+     *  instrumented. */
+    bool stats(MapStats& result) const
+    {
+      InstrumentedModel const* model( dynamic_cast<InstrumentedModel const*>(mapConcept_) );
+      if( model == NULL ) return false;
+      result = model->stats();
+      return true;
+    }
+    /*! @brief Clears the statistics of an instrumented map. */
+    void reset_stats()
+    {
+      InstrumentedModel* model( dynamic_cast<InstrumentedModel*>(mapConcept_) );
+      if( model != NULL ) model->reset_stats();
+    }
+    /*! @} */
+
   private:
+    bool isInline() const
+    {
+      char const* p( reinterpret_cast<char const*>(mapConcept_) );
+      char const* b( reinterpret_cast<char const*>(&storage_) );
+      return p >= b && p < b + sizeof(storage_);
+    }
+
+    // Destroys the underlying map, leaving the AnyMap without one.
+    void destroy()
+    {
+      if( isInline() ) mapConcept_->~MapConcept();
+      else             delete mapConcept_;
+      mapConcept_ = NULL;
+    }
+
+    // Takes the underlying map of o, which must not be this AnyMap, into an
+    // AnyMap without one. A heap map is taken over, leaving o without a map; an
+    // inline map is moved, leaving o with an empty one.
+    void steal(AnyMap& o)
+    {
+      if( o.isInline() ) mapConcept_ = o.mapConcept_->move_into(&storage_);
+      else {
+	mapConcept_ = o.mapConcept_;
+	o.mapConcept_ = NULL;
+      }
+    }
+
+    // Points either into storage_ or to the heap (see isInline()).
     MapConcept* mapConcept_;
+    InlineStorage_t storage_;
 
   }; // class AnyMap
 
 }; // namespace MapTypeErasure
 
+#include "AnyMap/details/_InstrumentedModel.hpp"
+
 #endif // __ANY_MAP_HPP__
@@ -0,0 +1,157 @@
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+/*!
+ * @file Arena.hpp
+ * @brief A memory arena and an allocator drawing from it, for maps (e.g.
+ * boost::unordered_map) whose many small nodes should be packed together and
+ * released at once.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace MapTypeErasure
+{
+  /*!
+   * @brief A monotonic arena with size-class free lists.
+   *
+   * Memory is carved out of chunks of chunkSize() bytes (larger requests get
+   * a chunk of their own). Blocks of up to MAX_POOLED_SIZE bytes which are
+   * deallocated are kept on a free list of their size class (multiples of
+   * ALIGNMENT) and reused by later allocations of that class; larger blocks
+   * are only reclaimed with the arena. The chunks are released together when
+   * the arena is destroyed, so objects allocated from it must be destroyed
+   * first (see ArenaAllocator).
+   *
+   * All blocks are aligned to ALIGNMENT. An Arena is not thread safe and
+   * cannot be copied.
+   */
+  class Arena
+  {
+  public:
+    /*! @brief Alignment of (and granularity of the sizes of) all blocks. */
+    static const std::size_t ALIGNMENT = 16;
+    /*! @brief Largest block size which is reused after deallocation. */
+    static const std::size_t MAX_POOLED_SIZE = 256;
+
+    /*! @brief Constructs an empty arena which allocates chunks of chunkSize
+     *  bytes. */
+    explicit Arena( std::size_t chunkSize = 64 * 1024 );
+    /*! @brief Releases all the chunks. */
+    ~Arena();
+
+    /*! @brief Allocates a block of at least bytes bytes.
+     *  @throw std::bad_alloc if a new chunk cannot be allocated. */
+    void* allocate( std::size_t bytes );
+    /*! @brief Returns a block of bytes bytes, allocated from this arena, for
+     *  reuse. */
+    void deallocate( void* p, std::size_t bytes );
+
+    /*! @brief Size of the chunks allocated for small blocks. */
+    std::size_t chunkSize() const { return chunkSize_; }
+    /*! @brief Number of bytes in the blocks currently allocated. */
+    std::size_t bytesUsed() const { return bytesUsed_; }
+    /*! @brief Number of bytes obtained from the heap. */
+    std::size_t bytesReserved() const { return bytesReserved_; }
+    /*! @brief Number of chunks obtained from the heap. */
+    std::size_t chunkCount() const { return chunks_.size(); }
+
+  private:
+    Arena( Arena const& );
+    Arena& operator=( Arena const& );
+
+    static std::size_t roundUp( std::size_t bytes )
+    { return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+    // A block on a free list.
+    struct FreeBlock { FreeBlock* next; };
+
+    char* newChunk( std::size_t bytes );
+
+    std::size_t chunkSize_;
+    std::vector<char*> chunks_;
+    // the unused part of the current chunk
+    char* next_;
+    char* end_;
+    FreeBlock* freeLists_[MAX_POOLED_SIZE / ALIGNMENT];
+    std::size_t bytesUsed_;
+    std::size_t bytesReserved_;
+  };
+
+  /*!
+   * @brief A standard allocator which draws from an Arena, or from the heap
+   * if it has none (e.g. when default constructed).
+   *
+   * The allocator does not own the arena. To keep the copies of a container
+   * from depending on the arena's lifetime, copy construction of a container
+   * gives the copy a heap allocator (see
+   * select_on_container_copy_construction()); moves and swaps take the
+   * allocator along with the elements.
+   *
+   * @param T Allocated type; its alignment must not exceed Arena::ALIGNMENT.
+   */
+  template <typename T>
+  class ArenaAllocator
+  {
+    template <typename U> friend class ArenaAllocator;
+
+  public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef T const* const_pointer;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type  propagate_on_container_move_assignment;
+    typedef std::true_type  propagate_on_container_swap;
+
+    template <typename U>
+    struct rebind { typedef ArenaAllocator<U> other; };
+
+    /*! @brief An allocator which uses the heap. */
+    ArenaAllocator() : arena_(NULL) {}
+    /*! @brief An allocator which uses the arena (or the heap if NULL). */
+    explicit ArenaAllocator( Arena* arena ) : arena_(arena) {}
+    template <typename U>
+    ArenaAllocator( ArenaAllocator<U> const& other ) : arena_(other.arena_) {}
+
+    T* allocate( size_type n )
+    {
+      static_assert( alignof(T) <= Arena::ALIGNMENT, "ArenaAllocator: over-aligned type" );
+      return static_cast<T*>( arena_ == NULL ? ::operator new( n * sizeof(T) )
+			                     : arena_->allocate( n * sizeof(T) ) );
+    }
+
+    void deallocate( T* p, size_type n )
+    {
+      if( arena_ == NULL ) ::operator delete( p );
+      else                 arena_->deallocate( p, n * sizeof(T) );
+    }
+
+    /*! @brief A heap allocator, for the copies of containers. */
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    /*! @brief The arena used, or NULL for the heap. */
+    Arena* arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==( ArenaAllocator<U> const& other ) const { return arena_ == other.arena_; }
+    template <typename U>
+    bool operator!=( ArenaAllocator<U> const& other ) const { return arena_ != other.arena_; }
+
+  private:
+    Arena* arena_;
+  };
+
+}; // namespace MapTypeErasure
+
+#include "AnyMap/details/_Arena.IMPL.hpp"
+
+#endif // __ARENA_HPP__
@@ -0,0 +1,314 @@
+#ifndef __FLAT_HASH_MAP_HPP__
+#define __FLAT_HASH_MAP_HPP__
+
+/*!
+ * @file FlatHashMap.hpp
+ * @brief An open-addressing hash map which stores its elements in a single
+ * contiguous array. Satisfies the map interface requirements of AnyMap and
+ * can be used wherever boost::unordered_map is (e.g. as the CoreMap of a
+ * MapTypeCounterFactory).
+ *
+ * @author Yuriy Skobov
+ */
+
+#include "AnyMap/details/_KeyView.hpp"
+
+#include <boost/functional/hash.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+
+namespace MapTypeErasure
+{
+  /*!
+   * @brief A hash map with open addressing and linear probing.
+   *
+   * The elements live in one contiguous array of slots (no per-element
+   * allocation). Next to it, the map keeps one control byte per slot which
+   * records whether the slot is empty, erased or full, and for full slots 7
+   * bits of the element's hash. Lookups scan the control bytes and only
+   * compare the keys whose hash bits match; traversal is a linear scan over
+   * both arrays.
+   *
+   * The interface follows boost::unordered_map with the following
+   * differences:
+   * - Any insert may move the elements to a new array, invalidating all
+   *   iterators, pointers and references to them (not only iterators).
+   *   Calling reserve() first prevents this for the reserved number of
+   *   elements.
+   * - max_load_factor() is capped at 0.9375 so that a lookup always reaches
+   *   an empty slot.
+   * - The elements are stored as value_type, i.e. std::pair<K const, V>. Keys
+   *   and values are therefore interleaved; the mapped values can still be
+   *   reached by a linear scan since the slots are contiguous.
+   *
+   * @param K Key type
+   * @param V Mapped value type
+   * @param Hash Hash function object type.
+   * @param Pred Key equality function object type.
+   */
+  template <typename K, typename V,
+	    typename Hash = boost::hash<K>, typename Pred = std::equal_to<K> >
+  class FlatHashMap
+  {
+    template <typename Value>
+    class Iterator;
+
+  public:
+    /*! @brief Type of the keys in the map. */
+    typedef K key_type;
+    /*! @brief Type of the mapped types stored in the map. */
+    typedef V mapped_type;
+    /*! @brief The Key-Value pair type stored in the container. */
+    typedef std::pair<K const, V> value_type;
+    /*! @brief Hash function object type. */
+    typedef Hash hasher;
+    /*! @brief Key equality function object type. */
+    typedef Pred key_equal;
+    /*! @brief Unsigned integer type that can represent any non-negative value.*/
+    typedef std::size_t size_type;
+    /*! @brief A forward iterator to value_type. */
+    typedef Iterator<value_type> iterator;
+    /*! @brief A forward iterator to const value_type. */
+    typedef Iterator<value_type const> const_iterator;
+
+    /*! @name Constructors, Destructor, Assignment, and Swap
+     *  @{ */
+    /*! @brief Constructs an empty map. Allocates nothing. */
+    FlatHashMap();
+    /*! @brief Constructs an empty map with room for n elements. */
+    explicit FlatHashMap( size_type n, hasher const& hash = hasher(),
+			  key_equal const& eq = key_equal() );
+    /*! @brief Constructs the map with the elements in the range [first, last). */
+    template <typename InputIterator>
+    FlatHashMap( InputIterator first, InputIterator last );
+    /*! @brief Standard copy constructor. */
+    FlatHashMap( FlatHashMap const& other );
+    /*! @brief Steals the storage of the temporary map. */
+    FlatHashMap( FlatHashMap && other );
+    ~FlatHashMap();
+
+    /*! @brief Copies the contents of the other map. */
+    FlatHashMap& operator=( FlatHashMap const& other );
+    /*! @brief Swaps contents with the temporary other map. */
+    FlatHashMap& operator=( FlatHashMap && other );
+    /*! @brief Swaps contents with the other map in constant time. */
+    void swap( FlatHashMap& other );
+    /*! @} */
+
+    /*! @name Size and Capacity
+     *  @{ */
+    /*! @brief Returns true if the map stores no elements. */
+    bool empty() const { return size_ == 0; }
+    /*! @brief Returns the number of elements stored in the map. */
+    size_type size() const { return size_; }
+    /*! @brief Returns the maximum number of elements the map can store. */
+    size_type max_size() const;
+    /*! @brief Returns the number of slots. */
+    size_type bucket_count() const { return capacity_; }
+    /*! @brief Returns size() / bucket_count(), or 0 if there are no slots. */
+    float load_factor() const;
+    /*! @brief Returns the maximum ratio of used (full or erased) slots. */
+    float max_load_factor() const { return maxLoadFactor_; }
+    /*! @brief Sets the maximum load factor, capped at 0.9375. Rehashes if the
+     *  map is over the new limit. */
+    void max_load_factor( float z );
+    /*! @brief Sets the number of slots to at least n and enough for size()
+     *  elements. rehash(0) shrinks the map to fit its elements. */
+    void rehash( size_type n );
+    /*! @brief Makes room for n elements so that inserting them does not
+     *  rehash. Never shrinks the map. */
+    void reserve( size_type n );
+    /*! @brief Returns the bytes allocated by the map: the slots and the
+     *  control bytes. */
+    size_type memory_usage() const
+    { return capacity_ == 0 ? 0 : capacity_ * sizeof(value_type) + capacity_ + 1; }
+    /*! @} */
+
+    /*! @name Lookup
+     *  @{ */
+    /*! @brief Gets the value associated with the key, inserting a value
+     *  initialized one if the key is not in the map. */
+    V& operator[]( K const& k ) { return try_emplace(k).first->second; }
+    /*! @overload operator[](K const& k) */
+    V& operator[]( K && k ) { return try_emplace(std::move(k)).first->second; }
+    /*! @brief Gets the value associated with the key. Throws std::out_of_range
+     *  if there is no such key. */
+    V& at( K const& k );
+    /*! @overload at(K const& k) */
+    V const& at( K const& k ) const;
+    /*! @brief Gets an iterator to the element with the key, or end(). */
+    iterator find( K const& k );
+    /*! @overload find(K const& k) */
+    const_iterator find( K const& k ) const;
+    /*! @brief Looks up a key compatible with K, e.g. a string view for string
+     *  keys. hash(k) must equal hash_function()(key) and eq(k, key) must
+     *  equal key_eq()(K(k), key) for any key in the map. */
+    template <typename CompatibleKey, typename CompatibleHash, typename CompatiblePred>
+    iterator find( CompatibleKey const& k, CompatibleHash const& hash, CompatiblePred const& eq );
+    /*! @overload find(CompatibleKey const& k, CompatibleHash const& hash, CompatiblePred const& eq) */
+    template <typename CompatibleKey, typename CompatibleHash, typename CompatiblePred>
+    const_iterator find( CompatibleKey const& k, CompatibleHash const& hash, CompatiblePred const& eq ) const;
+    /*! @brief Returns 1 if the key is in the map, 0 otherwise. */
+    size_type count( K const& k ) const;
+    /*! @} */
+
+    /*! @name Traversal Iterators
+     *  @{ */
+    iterator       begin();
+    const_iterator begin() const;
+    iterator         end() { return iterator( ctrl_ + capacity_, slots_ + capacity_ ); }
+    const_iterator   end() const { return const_iterator( ctrl_ + capacity_, slots_ + capacity_ ); }
+    /*! @} */
+
+    /*! @name Modifiers
+     *  @{ */
+    /*! @brief Inserts a copy of the value if its key is not in the map. */
+    std::pair<iterator, bool> insert( value_type const& val )
+    { return try_emplace( val.first, val.second ); }
+    /*! @brief Inserts the value if its key is not in the map. The mapped value
+     *  is moved; the key is copied (it is const in value_type). */
+    std::pair<iterator, bool> insert( value_type && val )
+    { return try_emplace( val.first, std::move(val.second) ); }
+    /*! @brief Inserts all values in the range [first, last). */
+    template <typename InputIterator>
+    void insert( InputIterator first, InputIterator last );
+    /*! @brief Inserts an element constructed from the key and mapped value
+     *  arguments if the key is not in the map. */
+    template <typename KeyArg, typename MappedArg>
+    std::pair<iterator, bool> emplace( KeyArg && k, MappedArg && v );
+    /*! @brief If the key is not in the map, inserts it with a mapped value
+     *  constructed from args. Otherwise, args are left untouched. */
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace( K const& k, Args&&... args );
+    /*! @overload try_emplace(K const& k, Args&&... args) */
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace( K && k, Args&&... args );
+
+    /*! @brief Removes the element with the key. Returns the number of elements
+     *  removed. */
+    size_type erase( K const& k );
+    /*! @brief Removes the element pointed to by the iterator. Returns the
+     *  iterator following it. */
+    iterator erase( const_iterator i );
+    /*! @brief Removes the elements for which pred(value_type const&) is
+     *  true, in a single scan of the slots. Keeps the slots. Returns the
+     *  number of elements removed. */
+    template <typename Predicate>
+    size_type erase_if( Predicate pred );
+    /*! @brief Removes all elements. Keeps the slots. */
+    void clear();
+    /*! @} */
+
+    /*! @name Bulk Arithmetic
+     *  Scans of the slots for arithmetic mapped types, which AnyMap uses
+     *  instead of its element-wise iteration (see AnyMap::sum_mapped()). The
+     *  elements are visited in the order of the iterators.
+     *  @{ */
+    /*! @brief Returns the sum of the mapped values. */
+    template <typename T = V>
+    typename std::enable_if<std::is_arithmetic<T>::value, T>::type sum_mapped() const;
+    /*! @brief Multiplies the mapped values by n. */
+    template <typename T = V>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type scale_mapped( V const& n );
+    /*! @brief Adds deltas[i] * factor to the mapped value of *keys[i]
+     *  (inserted if missing) for each i in [0, n), storing the results in
+     *  results unless it is NULL. The keys are hashed a group at a time and
+     *  the probe starts of the group are prefetched before they are probed. */
+    template <typename T = V>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type
+    add_many( K const* const* keys, V const* deltas, size_type n, V const& factor, V* results );
+    /*! @} */
+
+    /*! @brief Sets out[i] to the mapped value of *keys[i], or to missing, for
+     *  each i in [0, n), prefetching as add_many() does. */
+    void get_many( K const* const* keys, size_type n, V* out, V const& missing ) const;
+
+    /*! @brief Returns the hash function object. */
+    hasher hash_function() const { return hash_; }
+    /*! @brief Returns the key equality function object. */
+    key_equal key_eq() const { return eq_; }
+
+  private:
+    typedef unsigned char ctrl_t;
+
+    // Control byte values. Full slots store 7 bits of the hash (0x00-0x7F).
+    static const ctrl_t CTRL_EMPTY    = 0x80;
+    static const ctrl_t CTRL_DELETED  = 0xFE;
+    static const ctrl_t CTRL_SENTINEL = 0xFF;  // one past the last slot
+
+    static bool isFull( ctrl_t c )           { return c < 0x80; }
+    static bool isEmptyOrDeleted( ctrl_t c ) { return c == CTRL_EMPTY || c == CTRL_DELETED; }
+
+    static std::size_t mix( std::size_t h );
+    static ctrl_t h2( std::size_t h ) { return static_cast<ctrl_t>( h & 0x7F ); }
+    size_type probeStart( std::size_t h ) const { return (h >> 7) & (capacity_ - 1); }
+
+    size_type growthLimit( size_type capacity ) const;
+    size_type capacityFor( size_type n ) const;
+
+    // Index of the slot holding an element equal to k, or capacity_.
+    template <typename KeyArg, typename Eq>
+    size_type findIndex( KeyArg const& k, std::size_t h, Eq const& eq ) const;
+    // Index of a free slot for an element with the hash h; grows the map if
+    // needed. The caller constructs the element, then calls commitInsert().
+    size_type prepareInsert( std::size_t h );
+    void commitInsert( size_type i, std::size_t h );
+
+    template <typename KeyArg, typename... Args>
+    std::pair<iterator, bool> tryEmplaceImpl( KeyArg && k, Args&&... args );
+    template <typename KeyArg, typename... Args>
+    std::pair<iterator, bool> tryEmplaceHashed( KeyArg && k, std::size_t h, Args&&... args );
+
+    // The number of keys hashed and prefetched ahead of their probes by the
+    // batches (see add_many()).
+    enum { PREFETCH_GROUP = 16 };
+    void prefetch( std::size_t h ) const;
+
+    void eraseAt( size_type i );
+    void rehashTo( size_type capacity );
+    void allocate( size_type capacity );
+    void destroyAndDeallocate();
+
+    iterator       iteratorAt( size_type i )       { return iterator( ctrl_ + i, slots_ + i ); }
+    const_iterator iteratorAt( size_type i ) const { return const_iterator( ctrl_ + i, slots_ + i ); }
+
+    ctrl_t* ctrl_;         // capacity_ + 1 control bytes, or NULL
+    value_type* slots_;    // capacity_ slots, or NULL
+    size_type capacity_;   // 0 or a power of 2
+    size_type size_;
+    size_type deleted_;
+    float maxLoadFactor_;
+    hasher hash_;
+    key_equal eq_;
+    std::allocator<value_type> alloc_;
+  };
+
+  /*! @brief Swaps the contents of the maps. */
+  template <typename K, typename V, typename Hash, typename Pred>
+  void swap( FlatHashMap<K, V, Hash, Pred>& a, FlatHashMap<K, V, Hash, Pred>& b ) { a.swap(b); }
+
+  namespace details
+  {
+    /*! @brief FlatHashMaps with string keys and default hash and equality
+     *  support lookups by string view (see CompatibleKeyLookup). */
+    template <typename C, typename T, typename A, typename M>
+    struct CompatibleKeyLookup< FlatHashMap< std::basic_string<C, T, A>, M,
+					     boost::hash< std::basic_string<C, T, A> >,
+					     std::equal_to< std::basic_string<C, T, A> > >,
+				boost::basic_string_view<C, T> >
+      : StringViewKeyLookup<C, T, A> {};
+
+  }; // namespace details
+
+}; // namespace MapTypeErasure
+
+#include "AnyMap/details/_FlatHashMap.IMPL.hpp"
+
+#endif // __FLAT_HASH_MAP_HPP__
@@ -0,0 +1,122 @@
+#ifndef __MAP_STATS_HPP__
+#define __MAP_STATS_HPP__
+
+/*!
+ * @file MapStats.hpp
+ * @brief The statistics recorded by instrumented AnyMaps (see
+ * AnyMap::set_instrumented()).
+ *
+ * @author Yuriy Skobov
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace MapTypeErasure
+{
+  /*!
+   * @brief The number of calls of a kind of operation and a histogram of
+   * their latencies.
+   *
+   * Bucket 0 of the histogram counts the calls which took less than 2
+   * nanoseconds, bucket i > 0 the calls which took [2^i, 2^(i+1))
+   * nanoseconds, and the last bucket all the longer calls.
+   */
+  struct OperationStats
+  {
+    /*! @brief Number of buckets of the latency histogram. */
+    static const std::size_t LATENCY_BUCKETS = 32;
+
+    OperationStats() : count(0), totalNanoseconds(0)
+    {
+      for( std::size_t i = 0; i < LATENCY_BUCKETS; ++i )
+	histogram[i] = 0;
+    }
+
+    /*! @brief Counts a call which took the nanoseconds. */
+    void record( std::uint64_t nanoseconds )
+    {
+      ++count;
+      totalNanoseconds += nanoseconds;
+      ++histogram[ bucketOf(nanoseconds) ];
+    }
+
+    /*! @brief Returns the mean latency, or 0 if there were no calls. */
+    double meanNanoseconds() const
+    { return count == 0 ? 0 : double(totalNanoseconds) / count; }
+
+    /*! @brief Returns the histogram bucket of the latency. */
+    static std::size_t bucketOf( std::uint64_t nanoseconds )
+    {
+      std::size_t bucket(0);
+      while( nanoseconds > 1 && bucket + 1 < LATENCY_BUCKETS )
+	{
+	  nanoseconds >>= 1;
+	  ++bucket;
+	}
+      return bucket;
+    }
+
+    std::uint64_t count;
+    std::uint64_t totalNanoseconds;
+    std::uint64_t histogram[LATENCY_BUCKETS];
+  };
+
+  /*!
+   * @brief The operations of an instrumented AnyMap, their latencies, and
+   * the size of the map.
+   *
+   * The operations are grouped as follows:
+   * - find: at(), find(), count() and get_many() (one call per batch);
+   * - insert: operator[](), insert(), emplace(), try_emplace(), add_many()
+   *   and add_mapped();
+   * - erase: erase(), erase_if() and clear();
+   * - iteration: the internal iterations (for_each(), for_each_mut(),
+   *   all_of()) and the native bulk arithmetic (sum_mapped(),
+   *   scale_mapped()), timed over the whole traversal;
+   * - rehash: rehash(), reserve() and shrink_to_fit().
+   * The traversals with iterators happen outside the map, so only their
+   * begin() calls are counted, untimed, in iteratorTraversals.
+   */
+  struct MapStats
+  {
+    MapStats() : iteratorTraversals(0), size(0), peakSize(0), estimatedBytes(0) {}
+
+    OperationStats find, insert, erase, iteration, rehash;
+    std::uint64_t iteratorTraversals;
+    /*! @brief The number of elements when the statistics were taken. */
+    std::size_t size;
+    /*! @brief The largest number of elements after an insert. */
+    std::size_t peakSize;
+    /*! @brief The memory used by the decorated map, as returned by its
+     *  AnyMap::memory_usage() (exact for maps with a memory_usage() of their
+     *  own, estimated for the others). */
+    std::size_t estimatedBytes;
+  };
+
+  namespace details
+  {
+    // Records the time from its construction to its destruction in the stats.
+    class OperationTimer
+    {
+    public:
+      explicit OperationTimer( OperationStats& stats )
+	: stats_(stats), start_( std::chrono::steady_clock::now() ) {}
+      ~OperationTimer()
+      {
+	stats_.record( std::chrono::duration_cast<std::chrono::nanoseconds>(
+			 std::chrono::steady_clock::now() - start_ ).count() );
+      }
+
+    private:
+      OperationTimer( OperationTimer const& );
+      OperationTimer& operator=( OperationTimer const& );
+
+      OperationStats& stats_;
+      std::chrono::steady_clock::time_point start_;
+    };
+  };
+};
+
+#endif // __MAP_STATS_HPP__
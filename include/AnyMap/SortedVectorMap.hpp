@@ -0,0 +1,201 @@
+#ifndef __SORTED_VECTOR_MAP_HPP__
+#define __SORTED_VECTOR_MAP_HPP__
+
+/*!
+ * @file SortedVectorMap.hpp
+ * @brief An ordered map stored as a sorted array. Satisfies the map interface
+ * requirements of AnyMap and is meant for small maps with cheap keys, such as
+ * the rows of an InternedCounterMap.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+
+namespace MapTypeErasure
+{
+  /*!
+   * @brief An ordered map which keeps its elements sorted by key in a single
+   * contiguous array.
+   *
+   * Lookups are binary searches; traversal is a scan over the array. Inserts
+   * and erases shift the elements behind the affected position, i.e. they cost
+   * O(size()), and they invalidate all iterators, pointers and references.
+   * Since value_type has a const key, shifting an element copies its key (the
+   * mapped value is moved), so keys should be cheap to copy (e.g. integer
+   * ids).
+   *
+   * The interface follows std::map; the iterators are pointers into the
+   * array.
+   *
+   * @param K Key type
+   * @param V Mapped value type
+   * @param Compare Key ordering function object type.
+   */
+  template <typename K, typename V, typename Compare = std::less<K> >
+  class SortedVectorMap
+  {
+  public:
+    /*! @brief Type of the keys in the map. */
+    typedef K key_type;
+    /*! @brief Type of the mapped types stored in the map. */
+    typedef V mapped_type;
+    /*! @brief The Key-Value pair type stored in the container. */
+    typedef std::pair<K const, V> value_type;
+    /*! @brief Key ordering function object type. */
+    typedef Compare key_compare;
+    /*! @brief Unsigned integer type that can represent any non-negative value.*/
+    typedef std::size_t size_type;
+    /*! @brief A random access iterator to value_type. */
+    typedef value_type* iterator;
+    /*! @brief A random access iterator to const value_type. */
+    typedef value_type const* const_iterator;
+
+    /*! @name Constructors, Destructor, Assignment, and Swap
+     *  @{ */
+    /*! @brief Constructs an empty map. Allocates nothing. */
+    explicit SortedVectorMap( key_compare const& comp = key_compare() );
+    /*! @brief Constructs the map with the elements in the range [first, last). */
+    template <typename InputIterator>
+    SortedVectorMap( InputIterator first, InputIterator last );
+    /*! @brief Standard copy constructor. */
+    SortedVectorMap( SortedVectorMap const& other );
+    /*! @brief Steals the storage of the temporary map. */
+    SortedVectorMap( SortedVectorMap && other );
+    ~SortedVectorMap();
+
+    /*! @brief Copies the contents of the other map. */
+    SortedVectorMap& operator=( SortedVectorMap const& other );
+    /*! @brief Swaps contents with the temporary other map. */
+    SortedVectorMap& operator=( SortedVectorMap && other );
+    /*! @brief Swaps contents with the other map in constant time. */
+    void swap( SortedVectorMap& other );
+    /*! @} */
+
+    /*! @name Size and Capacity
+     *  @{ */
+    /*! @brief Returns true if the map stores no elements. */
+    bool empty() const { return size_ == 0; }
+    /*! @brief Returns the number of elements stored in the map. */
+    size_type size() const { return size_; }
+    /*! @brief Returns the maximum number of elements the map can store. */
+    size_type max_size() const { return alloc_.max_size(); }
+    /*! @brief Returns the number of elements the map can hold without
+     *  reallocating. */
+    size_type capacity() const { return capacity_; }
+    /*! @brief Makes room for n elements. Never shrinks the map. */
+    void reserve( size_type n );
+    /*! @brief Releases the capacity not needed by the elements. */
+    void shrink_to_fit();
+    /*! @brief Returns the bytes allocated by the map. */
+    size_type memory_usage() const { return capacity_ * sizeof(value_type); }
+    /*! @} */
+
+    /*! @name Lookup
+     *  @{ */
+    /*! @brief Gets the value associated with the key, inserting a value
+     *  initialized one if the key is not in the map. */
+    V& operator[]( K const& k ) { return try_emplace(k).first->second; }
+    /*! @overload operator[](K const& k) */
+    V& operator[]( K && k ) { return try_emplace(std::move(k)).first->second; }
+    /*! @brief Gets the value associated with the key. Throws std::out_of_range
+     *  if there is no such key. */
+    V& at( K const& k );
+    /*! @overload at(K const& k) */
+    V const& at( K const& k ) const;
+    /*! @brief Gets an iterator to the element with the key, or end(). */
+    iterator find( K const& k );
+    /*! @overload find(K const& k) */
+    const_iterator find( K const& k ) const;
+    /*! @brief Returns 1 if the key is in the map, 0 otherwise. */
+    size_type count( K const& k ) const { return find(k) == end() ? 0 : 1; }
+    /*! @brief Gets an iterator to the first element whose key is not less
+     *  than k. */
+    iterator lower_bound( K const& k );
+    /*! @overload lower_bound(K const& k) */
+    const_iterator lower_bound( K const& k ) const;
+    /*! @brief Returns the key ordering function object. */
+    key_compare key_comp() const { return comp_; }
+    /*! @} */
+
+    /*! @name Traversal Iterators
+     *  @{ */
+    iterator       begin()       { return data_; }
+    const_iterator begin() const { return data_; }
+    iterator         end()       { return data_ + size_; }
+    const_iterator   end() const { return data_ + size_; }
+    /*! @} */
+
+    /*! @name Modifiers
+     *  @{ */
+    /*! @brief Inserts a copy of the value if its key is not in the map. */
+    std::pair<iterator, bool> insert( value_type const& val )
+    { return try_emplace( val.first, val.second ); }
+    /*! @brief Inserts the value if its key is not in the map. */
+    std::pair<iterator, bool> insert( value_type && val )
+    { return try_emplace( val.first, std::move(val.second) ); }
+    /*! @brief Inserts all values in the range [first, last). */
+    template <typename InputIterator>
+    void insert( InputIterator first, InputIterator last );
+    /*! @brief Inserts an element constructed from the key and mapped value
+     *  arguments if the key is not in the map. */
+    template <typename KeyArg, typename MappedArg>
+    std::pair<iterator, bool> emplace( KeyArg && k, MappedArg && v )
+    { return try_emplace( K(std::forward<KeyArg>(k)), std::forward<MappedArg>(v) ); }
+    /*! @brief Inserts a value_type constructed from args if its key is not in
+     *  the map. The hint is only used if the element belongs right before it.
+     *  @return Iterator to the element with the key. */
+    template <typename... Args>
+    iterator emplace_hint( const_iterator hint, Args&&... args );
+    /*! @brief If the key is not in the map, inserts it with a mapped value
+     *  constructed from args. Otherwise, args are left untouched. */
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace( K const& k, Args&&... args );
+    /*! @overload try_emplace(K const& k, Args&&... args) */
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace( K && k, Args&&... args );
+
+    /*! @brief Removes the element with the key. Returns the number of elements
+     *  removed. */
+    size_type erase( K const& k );
+    /*! @brief Removes the element pointed to by the iterator. Returns the
+     *  iterator following it. */
+    iterator erase( const_iterator i );
+    /*! @brief Removes the elements for which pred(value_type const&) is
+     *  true, moving each of the others at most once. Keeps the capacity.
+     *  Returns the number of elements removed. */
+    template <typename Predicate>
+    size_type erase_if( Predicate pred );
+    /*! @brief Removes all elements. Keeps the capacity. */
+    void clear();
+    /*! @} */
+
+  private:
+    template <typename KeyArg, typename... Args>
+    std::pair<iterator, bool> tryEmplaceImpl( KeyArg && k, Args&&... args );
+    template <typename KeyArg, typename... Args>
+    iterator insertAt( size_type i, KeyArg && k, Args&&... args );
+    void reallocate( size_type capacity );
+    static void relocate( value_type* from, value_type* to );
+
+    value_type* data_;
+    size_type size_;
+    size_type capacity_;
+    key_compare comp_;
+    std::allocator<value_type> alloc_;
+  };
+
+  /*! @brief Swaps the contents of the maps. */
+  template <typename K, typename V, typename Compare>
+  void swap( SortedVectorMap<K, V, Compare>& a, SortedVectorMap<K, V, Compare>& b ) { a.swap(b); }
+
+}; // namespace MapTypeErasure
+
+#include "AnyMap/details/_SortedVectorMap.IMPL.hpp"
+
+#endif // __SORTED_VECTOR_MAP_HPP__
@@ -0,0 +1,245 @@
+#ifndef __ANY_MAP_STATIC_MAP_HPP__
+#define __ANY_MAP_STATIC_MAP_HPP__
+
+/*!
+ * @file StaticMap.hpp
+ * @brief The MapTypeErasure::StaticMap template class: AnyMap's interface
+ * over a map type known at compile time.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include "AnyMap/AnyMap.hpp"
+#include "AnyMap/details/_KeyView.hpp"
+#include "AnyMap/details/_MapOps.hpp"
+
+#include <type_traits>
+#include <utility>
+
+namespace MapTypeErasure
+{
+  /*!
+   * @brief A map with the interface of AnyMap which holds a MapType directly,
+   * without type erasure.
+   *
+   * Every call is a direct (and usually inlined) call of the underlying map,
+   * and the iterators are those of MapType, so nothing is virtual and nothing
+   * is allocated by the lookups and the iteration. The optional parts of the
+   * interface fall back exactly as they do in AnyMap (see the map interface
+   * requirements of AnyMap), so a StaticMap can stand in for an AnyMap
+   * wherever the map type is fixed at compile time, e.g. as the backend of a
+   * Counters::Counter.
+   *
+   * any_map() converts to an AnyMap holding a copy of the underlying map.
+   *
+   * @param MapType The underlying map (see AnyMap's interface requirements).
+   */
+  template<typename MapType>
+  class StaticMap
+  {
+  public:
+    /*! @brief The underlying map type. */
+    typedef MapType map_type;
+    /*! @brief Type of the keys in the map. */
+    typedef typename MapType::key_type key_type;
+    /*! @brief Type of the mapped types stored in the map. */
+    typedef typename MapType::mapped_type mapped_type;
+    /*! @brief The Key-Value pair type stored in the container. */
+    typedef std::pair<key_type const, mapped_type> value_type;
+    /*! @brief Unsigned integer type that can represent any non-negative value.*/
+    typedef size_t size_type;
+    /*! @brief Non-owning type used by heterogeneous lookups. See KeyView. */
+    typedef typename KeyView<key_type>::type key_view_type;
+    /*! @brief The iterator of the underlying map. */
+    typedef typename MapType::iterator iterator;
+    /*! @brief The const_iterator of the underlying map. */
+    typedef typename MapType::const_iterator const_iterator;
+    /*! @brief The AnyMap with the same keys and mapped values. */
+    typedef AnyMap<key_type, mapped_type> any_map_type;
+
+  private:
+    typedef key_type K;
+    typedef mapped_type V;
+    typedef details::MapOps<MapType, K, V> Ops;
+
+  public:
+    /*! @brief Constructs an empty MapType. */
+    StaticMap() : map_() {}
+    /*! @brief Constructs the StaticMap with the specified map, moving it. */
+    explicit StaticMap( MapType m ) : map_( std::move(m) ) {}
+
+    /*! @brief Swaps contents with the other StaticMap. */
+    void swap(StaticMap& other) { using std::swap;  swap( map_, other.map_ ); }
+
+    /*! @brief The underlying map. */
+    MapType const& map() const { return map_; }
+    /*! @brief The underlying map. */
+    MapType&       map()       { return map_; }
+    /*! @brief An AnyMap holding a copy of the underlying map. */
+    any_map_type any_map() const { return any_map_type( map_ ); }
+
+    /*!
+     * @name Size and Capacity
+     * See the corresponding methods of AnyMap.
+     * @{
+     */
+    bool empty() const          { return map_.empty(); }
+    size_type size() const      { return map_.size(); }
+    size_type max_size() const  { return map_.max_size(); }
+    void reserve(size_type n)   { Ops::reserve( map_, n ); }
+    void rehash(size_type n)    { Ops::rehash( map_, n ); }
+    void shrink_to_fit()        { Ops::shrinkToFit( map_ ); }
+    float max_load_factor() const  { return Ops::maxLoadFactor( map_ ); }
+    void max_load_factor(float z)  { Ops::maxLoadFactor( map_, z ); }
+    size_type bucket_count() const { return Ops::bucketCount( map_ ); }
+    bool is_sorted() const         { return Ops::isSorted(); }
+    size_type memory_usage() const { return sizeof(StaticMap) + Ops::memoryUsage( map_ ); }
+    /*! @} */
+
+    /*!
+     * @name Lookup
+     * See the corresponding methods of AnyMap.
+     * @{
+     */
+    V& operator[] (const K  & k)  { return map_[k]; }
+    V& operator[] (      K && k)  { return map_[std::move(k)]; }
+    V&       at(K const& k)       { return map_.at(k); }
+    V const& at(K const& k) const { return map_.at(k); }
+    iterator       find(K const& k)       { return map_.find(k); }
+    const_iterator find(K const& k) const { return map_.find(k); }
+    size_type count(K const& k) const { return map_.count(k); }
+
+    template<typename KeyLike>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, iterator>::type
+    find(KeyLike const& k)       { return Ops::findView( map_, key_view_type(k) ); }
+    template<typename KeyLike>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, const_iterator>::type
+    find(KeyLike const& k) const { return Ops::findView( map_, key_view_type(k) ); }
+    template<typename KeyLike>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, size_type>::type
+    count(KeyLike const& k) const { return find(k) == end() ? 0 : 1; }
+    /*! @} */
+
+    /*!
+     * @name Traversal Iterators
+     * @{
+     */
+    iterator       begin()        { return map_.begin(); }
+    const_iterator begin() const  { return map_.begin(); }
+    iterator         end()        { return map_.end(); }
+    const_iterator   end() const  { return map_.end(); }
+    /*! @} */
+
+    /*!
+     * @name Internal Iteration
+     * See the corresponding methods of AnyMap.
+     * @{
+     */
+    template<typename F>
+    F for_each(F f) const
+    {
+      for( const_iterator i(map_.begin()), e(map_.end()); i != e; ++i )
+	f(*i);
+      return f;
+    }
+
+    template<typename F>
+    F for_each_mut(F f)
+    {
+      for( iterator i(map_.begin()), e(map_.end()); i != e; ++i )
+	f(*i);
+      return f;
+    }
+
+    template<typename Pred>
+    bool all_of(Pred pred) const
+    {
+      for( const_iterator i(map_.begin()), e(map_.end()); i != e; ++i )
+	if( !pred(*i) )
+	  return false;
+      return true;
+    }
+    /*! @} */
+
+    /*!
+     * @name Native Bulk Arithmetic
+     * See the corresponding methods of AnyMap.
+     * @{
+     */
+    bool sum_mapped(V& sum) const { return Ops::sumMapped( map_, sum ); }
+    bool scale_mapped(V const& n) { return Ops::scaleMapped( map_, n ); }
+    bool add_mapped(StaticMap const& other, V const& factor)
+    { return Ops::addMapped( map_, other.map_, factor ); }
+    bool equal_mapped(StaticMap const& other, V const& precision, bool& equal) const
+    { return Ops::equalMapped( map_, &other.map_, precision, equal ); }
+    bool add_many(K const* const* keys, V const* deltas, size_type n, V const& factor, V* results = NULL)
+    { return Ops::addMany( map_, keys, deltas, n, factor, results ); }
+    void get_many(K const* const* keys, size_type n, V* out, V const& missing) const
+    { Ops::getMany( map_, keys, n, out, missing ); }
+    /*! @} */
+
+    /*!
+     * @name Modifiers
+     * See the corresponding methods of AnyMap.
+     * @{
+     */
+    std::pair<iterator, bool> insert(value_type const& val) { return map_.insert(val); }
+    std::pair<iterator, bool> insert(value_type&& val)      { return map_.insert(std::move(val)); }
+    template<typename InputIterator>
+    void insert(InputIterator i1, InputIterator i2) { map_.insert(i1, i2); }
+    void insert(StaticMap const& other) { if( this != &other ) map_.insert( other.map_.begin(), other.map_.end() ); }
+
+    template<typename KeyArg, typename MappedArg>
+    std::pair<iterator, bool> emplace(KeyArg&& k, MappedArg&& v)
+    { return map_.emplace( K(std::forward<KeyArg>(k)), V(std::forward<MappedArg>(v)) ); }
+
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(K const& k, Args&&... args)
+    {
+      auto make = [&]() { return V(std::forward<Args>(args)...); };
+      return Ops::tryEmplace( map_, k, make );
+    }
+
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& k, Args&&... args)
+    {
+      auto make = [&]() { return V(std::forward<Args>(args)...); };
+      return Ops::tryEmplace( map_, std::move(k), make );
+    }
+
+    template<typename KeyLike, typename... Args>
+    typename std::enable_if<IsKeyLike<K, KeyLike>::value, std::pair<iterator, bool> >::type
+    try_emplace(KeyLike const& k, Args&&... args)
+    {
+      auto make = [&]() { return V(std::forward<Args>(args)...); };
+      return Ops::tryEmplaceView( map_, key_view_type(k), make );
+    }
+
+    size_type erase(K const& k) { return map_.erase(k); }
+    template<typename Pred>
+    size_type erase_if(Pred pred) { return Ops::eraseIf( map_, pred ); }
+    void clear() { map_.clear(); }
+    /*! @} */
+
+    /*! @brief Compares the maps based on their contents (see
+     *  AnyMap::operator==()). */
+    bool operator==(StaticMap const& other) const
+    { return this == &other || (size() == other.size() && Ops::equals( map_, other.map_ )); }
+    bool operator!=(StaticMap const& other) const { return !operator==(other); }
+
+  private:
+    MapType map_;
+  };
+
+  /*! @brief True if From is a StaticMap whose any_map_type is To, i.e. if
+   *  To can hold a copy of the underlying map of a From. */
+  template<typename From, typename To>
+  struct IsWrappedBy : std::false_type {};
+
+  template<typename MapType, typename K, typename V>
+  struct IsWrappedBy< StaticMap<MapType>, AnyMap<K, V> >
+    : std::is_same< typename StaticMap<MapType>::any_map_type, AnyMap<K, V> > {};
+
+}; // namespace MapTypeErasure
+
+#endif // __ANY_MAP_STATIC_MAP_HPP__
@@ -0,0 +1,77 @@
+#ifndef __ARENA_IMPL_HPP__
+#define __ARENA_IMPL_HPP__
+
+// Included from Arena.hpp; the include below is for form and for the
+// editors' autocompletion (see _Counter.IMPL.hpp).
+#include "AnyMap/Arena.hpp"
+
+#include <algorithm>
+
+namespace MapTypeErasure
+{
+  inline Arena::Arena( std::size_t chunkSize )
+    : chunkSize_( roundUp( chunkSize > MAX_POOLED_SIZE ? chunkSize : std::size_t(MAX_POOLED_SIZE) ) ),
+      chunks_(), next_(NULL), end_(NULL),
+      bytesUsed_(0), bytesReserved_(0)
+  {
+    std::fill( freeLists_, freeLists_ + MAX_POOLED_SIZE / ALIGNMENT, static_cast<FreeBlock*>(NULL) );
+  }
+
+  inline Arena::~Arena()
+  {
+    for( std::vector<char*>::const_iterator i(chunks_.begin()); i != chunks_.end(); ++i )
+      ::operator delete( *i );
+  }
+
+  inline void* Arena::allocate( std::size_t bytes )
+  {
+    bytes = roundUp( std::max<std::size_t>(bytes, 1) );
+    bytesUsed_ += bytes;
+    if( bytes <= MAX_POOLED_SIZE )
+      {
+	FreeBlock*& list( freeLists_[bytes / ALIGNMENT - 1] );
+	if( list != NULL )
+	  {
+	    FreeBlock* block( list );
+	    list = block->next;
+	    return block;
+	  }
+      }
+    if( bytes > std::size_t(end_ - next_) )
+      {
+	// Large blocks get a chunk of their own, keeping the current one.
+	if( bytes > chunkSize_ / 4 )
+	  return newChunk( bytes );
+	next_ = newChunk( chunkSize_ );
+	end_ = next_ + chunkSize_;
+      }
+    void* block( next_ );
+    next_ += bytes;
+    return block;
+  }
+
+  inline void Arena::deallocate( void* p, std::size_t bytes )
+  {
+    bytes = roundUp( std::max<std::size_t>(bytes, 1) );
+    bytesUsed_ -= bytes;
+    if( bytes <= MAX_POOLED_SIZE )
+      {
+	FreeBlock*& list( freeLists_[bytes / ALIGNMENT - 1] );
+	FreeBlock* block( static_cast<FreeBlock*>(p) );
+	block->next = list;
+	list = block;
+      }
+  }
+
+  inline char* Arena::newChunk( std::size_t bytes )
+  {
+    chunks_.reserve( chunks_.size() + 1 );
+    char* chunk( static_cast<char*>( ::operator new(bytes) ) );
+    chunks_.push_back( chunk );
+    bytesReserved_ += bytes;
+    return chunk;
+  }
+
+}; // namespace MapTypeErasure
+
+#endif // __ARENA_IMPL_HPP__
@@ -0,0 +1,604 @@
+#ifndef __FLAT_HASH_MAP_IMPL_HPP__
+#define __FLAT_HASH_MAP_IMPL_HPP__
+
+// Included from FlatHashMap.hpp; the include below is for form and for the
+// editors' autocompletion (see _Counter.IMPL.hpp).
+#include "AnyMap/FlatHashMap.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <tuple>
+
+namespace MapTypeErasure
+{
+  //------------------------------ Iterator ------------------------------------
+
+  // Points to a slot and its control byte. Incrementing skips the empty and
+  // erased slots; the sentinel control byte after the last slot stops it.
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename Value>
+  class FlatHashMap<K, V, Hash, Pred>::Iterator
+    : public boost::iterator_facade< Iterator<Value>, Value, boost::forward_traversal_tag >
+  {
+  public:
+    Iterator() : ctrl_(NULL), slot_(NULL) {}
+
+    // iterator converts to const_iterator
+    template <typename OtherValue>
+    Iterator( Iterator<OtherValue> const& other,
+	      typename std::enable_if< std::is_convertible<OtherValue*, Value*>::value >::type* = 0 )
+      : ctrl_(other.ctrl_), slot_(other.slot_) {}
+
+  private:
+    friend class FlatHashMap;
+    friend class boost::iterator_core_access;
+    template <typename> friend class Iterator;
+
+    Iterator( ctrl_t const* ctrl, Value* slot ) : ctrl_(ctrl), slot_(slot) {}
+
+    void skipFree() { while( isEmptyOrDeleted(*ctrl_) ) { ++ctrl_; ++slot_; } }
+    void increment() { ++ctrl_; ++slot_; skipFree(); }
+    template <typename OtherValue>
+    bool equal( Iterator<OtherValue> const& other ) const { return slot_ == other.slot_; }
+    Value& dereference() const { return *slot_; }
+
+    ctrl_t const* ctrl_;
+    Value* slot_;
+  };
+
+  //------------- Constructors, Destructor, Assignment -------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  FlatHashMap<K, V, Hash, Pred>::FlatHashMap()
+    : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), deleted_(0),
+      maxLoadFactor_(0.875f), hash_(), eq_()
+  {}
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  FlatHashMap<K, V, Hash, Pred>::FlatHashMap( size_type n, hasher const& hash, key_equal const& eq )
+    : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), deleted_(0),
+      maxLoadFactor_(0.875f), hash_(hash), eq_(eq)
+  {
+    reserve(n);
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename InputIterator>
+  FlatHashMap<K, V, Hash, Pred>::FlatHashMap( InputIterator first, InputIterator last )
+    : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), deleted_(0),
+      maxLoadFactor_(0.875f), hash_(), eq_()
+  {
+    insert( first, last );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  FlatHashMap<K, V, Hash, Pred>::FlatHashMap( FlatHashMap const& other )
+    : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), deleted_(0),
+      maxLoadFactor_(other.maxLoadFactor_), hash_(other.hash_), eq_(other.eq_)
+  {
+    if( other.capacity_ == 0 )
+      return;
+    // Same capacity, so every element goes to the same slot as in other.
+    allocate( other.capacity_ );
+    for( size_type i = 0; i < capacity_; ++i )
+      if( isFull(other.ctrl_[i]) )
+	{
+	  new (slots_ + i) value_type( other.slots_[i] );
+	  ctrl_[i] = other.ctrl_[i];
+	  ++size_;
+	}
+      else if( other.ctrl_[i] == CTRL_DELETED )
+	{
+	  ctrl_[i] = CTRL_DELETED;
+	  ++deleted_;
+	}
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  FlatHashMap<K, V, Hash, Pred>::FlatHashMap( FlatHashMap && other )
+    : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), deleted_(0),
+      maxLoadFactor_(other.maxLoadFactor_), hash_(other.hash_), eq_(other.eq_)
+  {
+    swap( other );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  FlatHashMap<K, V, Hash, Pred>::~FlatHashMap()
+  {
+    destroyAndDeallocate();
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  FlatHashMap<K, V, Hash, Pred>& FlatHashMap<K, V, Hash, Pred>::operator=( FlatHashMap const& other )
+  {
+    if( this != &other ) {
+      FlatHashMap tmp( other );
+      swap( tmp );
+    }
+    return *this;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  FlatHashMap<K, V, Hash, Pred>& FlatHashMap<K, V, Hash, Pred>::operator=( FlatHashMap && other )
+  {
+    swap( other );
+    return *this;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::swap( FlatHashMap& other )
+  {
+    using std::swap;
+    swap( ctrl_, other.ctrl_ );
+    swap( slots_, other.slots_ );
+    swap( capacity_, other.capacity_ );
+    swap( size_, other.size_ );
+    swap( deleted_, other.deleted_ );
+    swap( maxLoadFactor_, other.maxLoadFactor_ );
+    swap( hash_, other.hash_ );
+    swap( eq_, other.eq_ );
+  }
+
+  //-------------------------- Size and Capacity -------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type FlatHashMap<K, V, Hash, Pred>::max_size() const
+  {
+    return std::numeric_limits<size_type>::max() / (sizeof(value_type) + 1);
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  float FlatHashMap<K, V, Hash, Pred>::load_factor() const
+  {
+    return capacity_ == 0 ? 0 : static_cast<float>(size_) / capacity_;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::max_load_factor( float z )
+  {
+    maxLoadFactor_ = std::max( 0.125f, std::min( z, 0.9375f ) );
+    if( size_ + deleted_ > growthLimit(capacity_) )
+      rehashTo( capacityFor(size_) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::rehash( size_type n )
+  {
+    size_type capacity( capacityFor(size_) );
+    if( n > capacity )
+      for( capacity = std::max<size_type>( capacity, 8 ); capacity < n; capacity *= 2 ) ;
+    if( capacity != capacity_ || deleted_ > 0 )
+      rehashTo( capacity );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::reserve( size_type n )
+  {
+    const size_type capacity( capacityFor(n) );
+    if( capacity > capacity_ )
+      rehashTo( capacity );
+  }
+
+  //------------------------------- Lookup -------------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  V& FlatHashMap<K, V, Hash, Pred>::at( K const& k )
+  {
+    const size_type i( findIndex( k, mix(hash_(k)), eq_ ) );
+    if( i == capacity_ )
+      throw std::out_of_range( "FlatHashMap::at: key not found" );
+    return slots_[i].second;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  V const& FlatHashMap<K, V, Hash, Pred>::at( K const& k ) const
+  {
+    const size_type i( findIndex( k, mix(hash_(k)), eq_ ) );
+    if( i == capacity_ )
+      throw std::out_of_range( "FlatHashMap::at: key not found" );
+    return slots_[i].second;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::iterator FlatHashMap<K, V, Hash, Pred>::find( K const& k )
+  {
+    return iteratorAt( findIndex( k, mix(hash_(k)), eq_ ) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::const_iterator FlatHashMap<K, V, Hash, Pred>::find( K const& k ) const
+  {
+    return iteratorAt( findIndex( k, mix(hash_(k)), eq_ ) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename CompatibleKey, typename CompatibleHash, typename CompatiblePred>
+  typename FlatHashMap<K, V, Hash, Pred>::iterator
+  FlatHashMap<K, V, Hash, Pred>::find( CompatibleKey const& k, CompatibleHash const& hash,
+				       CompatiblePred const& eq )
+  {
+    return iteratorAt( findIndex( k, mix(hash(k)), eq ) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename CompatibleKey, typename CompatibleHash, typename CompatiblePred>
+  typename FlatHashMap<K, V, Hash, Pred>::const_iterator
+  FlatHashMap<K, V, Hash, Pred>::find( CompatibleKey const& k, CompatibleHash const& hash,
+				       CompatiblePred const& eq ) const
+  {
+    return iteratorAt( findIndex( k, mix(hash(k)), eq ) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type FlatHashMap<K, V, Hash, Pred>::count( K const& k ) const
+  {
+    return findIndex( k, mix(hash_(k)), eq_ ) == capacity_ ? 0 : 1;
+  }
+
+  //------------------------------ Traversal -----------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::iterator FlatHashMap<K, V, Hash, Pred>::begin()
+  {
+    if( size_ == 0 ) return end();
+    iterator i( iteratorAt(0) );
+    i.skipFree();
+    return i;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::const_iterator FlatHashMap<K, V, Hash, Pred>::begin() const
+  {
+    if( size_ == 0 ) return end();
+    const_iterator i( iteratorAt(0) );
+    i.skipFree();
+    return i;
+  }
+
+  //------------------------------ Modifiers -----------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename InputIterator>
+  void FlatHashMap<K, V, Hash, Pred>::insert( InputIterator first, InputIterator last )
+  {
+    for( ; first != last; ++first )
+      insert( *first );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename KeyArg, typename MappedArg>
+  std::pair<typename FlatHashMap<K, V, Hash, Pred>::iterator, bool>
+  FlatHashMap<K, V, Hash, Pred>::emplace( KeyArg && k, MappedArg && v )
+  {
+    return tryEmplaceImpl( K(std::forward<KeyArg>(k)), std::forward<MappedArg>(v) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename... Args>
+  std::pair<typename FlatHashMap<K, V, Hash, Pred>::iterator, bool>
+  FlatHashMap<K, V, Hash, Pred>::try_emplace( K const& k, Args&&... args )
+  {
+    return tryEmplaceImpl( k, std::forward<Args>(args)... );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename... Args>
+  std::pair<typename FlatHashMap<K, V, Hash, Pred>::iterator, bool>
+  FlatHashMap<K, V, Hash, Pred>::try_emplace( K && k, Args&&... args )
+  {
+    return tryEmplaceImpl( std::move(k), std::forward<Args>(args)... );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename KeyArg, typename... Args>
+  std::pair<typename FlatHashMap<K, V, Hash, Pred>::iterator, bool>
+  FlatHashMap<K, V, Hash, Pred>::tryEmplaceImpl( KeyArg && k, Args&&... args )
+  {
+    const std::size_t h( mix(hash_(k)) );
+    return tryEmplaceHashed( std::forward<KeyArg>(k), h, std::forward<Args>(args)... );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename KeyArg, typename... Args>
+  std::pair<typename FlatHashMap<K, V, Hash, Pred>::iterator, bool>
+  FlatHashMap<K, V, Hash, Pred>::tryEmplaceHashed( KeyArg && k, std::size_t h, Args&&... args )
+  {
+    size_type i( findIndex( k, h, eq_ ) );
+    if( i != capacity_ )
+      return std::make_pair( iteratorAt(i), false );
+    i = prepareInsert( h );
+    new (slots_ + i) value_type( std::piecewise_construct,
+				 std::forward_as_tuple( std::forward<KeyArg>(k) ),
+				 std::forward_as_tuple( std::forward<Args>(args)... ) );
+    commitInsert( i, h );
+    return std::make_pair( iteratorAt(i), true );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type FlatHashMap<K, V, Hash, Pred>::erase( K const& k )
+  {
+    const size_type i( findIndex( k, mix(hash_(k)), eq_ ) );
+    if( i == capacity_ )
+      return 0;
+    eraseAt( i );
+    return 1;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::iterator FlatHashMap<K, V, Hash, Pred>::erase( const_iterator i )
+  {
+    const size_type index( i.slot_ - slots_ );
+    eraseAt( index );
+    iterator next( iteratorAt(index) );
+    next.skipFree();
+    return next;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename Predicate>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type FlatHashMap<K, V, Hash, Pred>::erase_if( Predicate pred )
+  {
+    const size_type before( size_ );
+    // Backwards, so that a run of erased slots ending at an empty one
+    // becomes empty rather than deleted (see eraseAt()).
+    for( size_type i = capacity_; i > 0; --i )
+      if( isFull(ctrl_[i - 1]) && pred( static_cast<value_type const&>(slots_[i - 1]) ) )
+	eraseAt( i - 1 );
+    return before - size_;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::clear()
+  {
+    for( size_type i = 0; i < capacity_; ++i )
+      if( isFull(ctrl_[i]) )
+	slots_[i].~value_type();
+    if( capacity_ > 0 )
+      std::memset( ctrl_, CTRL_EMPTY, capacity_ );
+    size_ = 0;
+    deleted_ = 0;
+  }
+
+  //--------------------------- Bulk Arithmetic --------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value, T>::type
+  FlatHashMap<K, V, Hash, Pred>::sum_mapped() const
+  {
+    T sum(0);
+    for( size_type i = 0; i < capacity_; ++i )
+      if( isFull(ctrl_[i]) )
+	sum += slots_[i].second;
+    return sum;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type
+  FlatHashMap<K, V, Hash, Pred>::scale_mapped( V const& n )
+  {
+    for( size_type i = 0; i < capacity_; ++i )
+      if( isFull(ctrl_[i]) )
+	slots_[i].second *= n;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type
+  FlatHashMap<K, V, Hash, Pred>::add_many( K const* const* keys, V const* deltas, size_type n,
+					   V const& factor, V* results )
+  {
+    std::size_t hashes[PREFETCH_GROUP];
+    for( size_type first = 0; first < n; first += PREFETCH_GROUP )
+      {
+	const size_type m( std::min<size_type>( PREFETCH_GROUP, n - first ) );
+	for( size_type j = 0; j < m; ++j )
+	  {
+	    hashes[j] = mix( hash_(*keys[first + j]) );
+	    prefetch( hashes[j] );
+	  }
+	for( size_type j = 0; j < m; ++j )
+	  {
+	    const size_type i( first + j );
+	    V& v( tryEmplaceHashed( *keys[i], hashes[j] ).first->second );
+	    v += deltas[i] * factor;
+	    if( results != NULL )
+	      results[i] = v;
+	  }
+      }
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::get_many( K const* const* keys, size_type n, V* out,
+						V const& missing ) const
+  {
+    std::size_t hashes[PREFETCH_GROUP];
+    for( size_type first = 0; first < n; first += PREFETCH_GROUP )
+      {
+	const size_type m( std::min<size_type>( PREFETCH_GROUP, n - first ) );
+	for( size_type j = 0; j < m; ++j )
+	  {
+	    hashes[j] = mix( hash_(*keys[first + j]) );
+	    prefetch( hashes[j] );
+	  }
+	for( size_type j = 0; j < m; ++j )
+	  {
+	    const size_type i( findIndex( *keys[first + j], hashes[j], eq_ ) );
+	    out[first + j] = i == capacity_ ? missing : slots_[i].second;
+	  }
+      }
+  }
+
+  //------------------------------- Private ------------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::prefetch( std::size_t h ) const
+  {
+#if defined(__GNUC__)
+    if( capacity_ == 0 ) return;
+    const size_type i( probeStart(h) );
+    __builtin_prefetch( ctrl_ + i );
+    __builtin_prefetch( slots_ + i );
+#else
+    (void)h;
+#endif
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  std::size_t FlatHashMap<K, V, Hash, Pred>::mix( std::size_t h )
+  {
+    // Spreads the bits of weak hashes (e.g. boost::hash of integers is the
+    // identity) over the whole word; both the probe start and the control
+    // byte's hash bits depend on all bits of h.
+    const int half( sizeof(std::size_t) * 4 );
+    h ^= h >> half;
+    h *= static_cast<std::size_t>( 0xff51afd7ed558ccdULL );
+    h ^= h >> half;
+    return h;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type
+  FlatHashMap<K, V, Hash, Pred>::growthLimit( size_type capacity ) const
+  {
+    // At least one slot always stays empty so that probing terminates.
+    if( capacity == 0 ) return 0;
+    return std::min( capacity - 1,
+		     static_cast<size_type>( static_cast<double>(capacity) * maxLoadFactor_ ) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type
+  FlatHashMap<K, V, Hash, Pred>::capacityFor( size_type n ) const
+  {
+    if( n == 0 ) return 0;
+    size_type capacity( 8 );
+    while( growthLimit(capacity) < n )
+      capacity *= 2;
+    return capacity;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename KeyArg, typename Eq>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type
+  FlatHashMap<K, V, Hash, Pred>::findIndex( KeyArg const& k, std::size_t h, Eq const& eq ) const
+  {
+    if( size_ == 0 ) return capacity_;
+    const ctrl_t tag( h2(h) );
+    const size_type mask( capacity_ - 1 );
+    for( size_type i( probeStart(h) ); ; i = (i + 1) & mask )
+      {
+	const ctrl_t c( ctrl_[i] );
+	if( c == tag && eq( k, slots_[i].first ) )
+	  return i;
+	if( c == CTRL_EMPTY )
+	  return capacity_;
+      }
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename FlatHashMap<K, V, Hash, Pred>::size_type
+  FlatHashMap<K, V, Hash, Pred>::prepareInsert( std::size_t h )
+  {
+    if( size_ + deleted_ + 1 > growthLimit(capacity_) )
+      {
+	// Mostly erased slots: clean up in place, otherwise grow.
+	if( capacity_ > 0 && size_ + 1 <= growthLimit(capacity_) / 2 )
+	  rehashTo( capacity_ );
+	else
+	  rehashTo( capacity_ == 0 ? capacityFor(1) : capacity_ * 2 );
+      }
+    const size_type mask( capacity_ - 1 );
+    size_type i( probeStart(h) );
+    while( !isEmptyOrDeleted(ctrl_[i]) )
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::commitInsert( size_type i, std::size_t h )
+  {
+    if( ctrl_[i] == CTRL_DELETED )
+      --deleted_;
+    ctrl_[i] = h2(h);
+    ++size_;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::eraseAt( size_type i )
+  {
+    slots_[i].~value_type();
+    --size_;
+    // With linear probing, a slot followed by an empty one ends every probe
+    // sequence which reaches it, so it can become empty itself.
+    if( ctrl_[(i + 1) & (capacity_ - 1)] == CTRL_EMPTY )
+      ctrl_[i] = CTRL_EMPTY;
+    else
+      {
+	ctrl_[i] = CTRL_DELETED;
+	++deleted_;
+      }
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::rehashTo( size_type capacity )
+  {
+    ctrl_t* oldCtrl( ctrl_ );
+    value_type* oldSlots( slots_ );
+    const size_type oldCapacity( capacity_ );
+
+    ctrl_ = NULL;
+    slots_ = NULL;
+    capacity_ = 0;
+    size_ = 0;
+    deleted_ = 0;
+    if( capacity > 0 )
+      allocate( capacity );
+
+    for( size_type i = 0; i < oldCapacity; ++i )
+      if( isFull(oldCtrl[i]) )
+	{
+	  value_type& old( oldSlots[i] );
+	  const std::size_t h( mix(hash_(old.first)) );
+	  const size_type j( prepareInsert(h) );
+	  // The key is const in value_type and has to be copied; the mapped
+	  // value is moved.
+	  new (slots_ + j) value_type( old.first, std::move(old.second) );
+	  commitInsert( j, h );
+	  old.~value_type();
+	}
+
+    if( oldCapacity > 0 )
+      {
+	alloc_.deallocate( oldSlots, oldCapacity );
+	delete[] oldCtrl;
+      }
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::allocate( size_type capacity )
+  {
+    ctrl_ = new ctrl_t[capacity + 1];
+    std::memset( ctrl_, CTRL_EMPTY, capacity );
+    ctrl_[capacity] = CTRL_SENTINEL;
+    slots_ = alloc_.allocate( capacity );
+    capacity_ = capacity;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void FlatHashMap<K, V, Hash, Pred>::destroyAndDeallocate()
+  {
+    if( capacity_ == 0 ) return;
+    clear();
+    alloc_.deallocate( slots_, capacity_ );
+    delete[] ctrl_;
+    ctrl_ = NULL;
+    slots_ = NULL;
+    capacity_ = 0;
+  }
+
+}; // namespace MapTypeErasure
+
+#endif // __FLAT_HASH_MAP_IMPL_HPP__
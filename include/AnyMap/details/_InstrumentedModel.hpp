@@ -0,0 +1,156 @@
+#ifndef __ANY_MAP_INSTRUMENTED_MODEL_HPP__
+#define __ANY_MAP_INSTRUMENTED_MODEL_HPP__
+
+// Included at the end of AnyMap.hpp: InstrumentedModel is a nested class of
+// AnyMap, defined once AnyMap is complete because it holds one.
+#include "AnyMap/AnyMap.hpp"
+#include "AnyMap/MapStats.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace MapTypeErasure
+{
+  // struct: InstrumentedModel
+  //
+  // A MapConcept decorating the MapConcept of another AnyMap: every call is
+  // forwarded to the decorated map, and the calls listed in MapStats are
+  // counted and timed. The decorated AnyMap keeps its own storage, so the
+  // InstrumentedModel is always allocated on the heap.
+  //
+  template<typename K, typename V>
+  struct AnyMap<K, V>::InstrumentedModel : AnyMap<K, V>::MapConcept
+  {
+    typedef typename AnyMap::size_type size_type;
+    typedef typename AnyMap::iterator iterator;
+    typedef typename AnyMap::const_iterator const_iterator;
+    typedef details::OperationTimer Timer;
+
+    explicit InstrumentedModel( AnyMap&& map ) : map_( std::move(map) ), stats_()
+    { stats_.peakSize = map_.size(); }
+
+    InstrumentedModel( InstrumentedModel const& o ) : map_( o.map_ ), stats_( o.stats_ ) {}
+
+    InstrumentedModel( InstrumentedModel&& o ) : map_( std::move(o.map_) ), stats_( o.stats_ ) {}
+
+    // clone
+    MapConcept* clone_into(InlineStorage_t*) const { return new InstrumentedModel( *this ); }
+    MapConcept* move_into(InlineStorage_t*)        { return new InstrumentedModel( std::move(*this) ); }
+
+    MapConcept const& unwrapped() const { return inner(); }
+
+    // size and capasity
+    bool empty() const                    { return inner().empty(); }
+    size_type size() const                { return inner().size(); }
+    size_type max_size() const            { return inner().max_size(); }
+    void reserve(size_type n)             { Timer t( stats_.rehash );  inner().reserve(n); }
+    void rehash(size_type n)              { Timer t( stats_.rehash );  inner().rehash(n); }
+    void shrink_to_fit()                  { Timer t( stats_.rehash );  inner().shrink_to_fit(); }
+    float max_load_factor() const         { return inner().max_load_factor(); }
+    void max_load_factor(float z)         { inner().max_load_factor(z); }
+    size_type bucket_count() const        { return inner().bucket_count(); }
+    bool is_sorted() const                { return inner().is_sorted(); }
+    // always on the heap; map_ is counted by its own memory_usage()
+    size_type memory_usage(bool) const
+    { return sizeof(InstrumentedModel) - sizeof(AnyMap) + map_.memory_usage(); }
+
+    // lookup
+    V& operator[](const K& k)             { Inserting t( *this );  return inner()[k]; }
+    V& operator[](K&& k)                  { Inserting t( *this );  return inner()[std::move(k)]; }
+    V      & at(K const& k)               { Timer t( stats_.find );  return inner().at(k); }
+    V const& at(K const& k) const         { Timer t( stats_.find );  return inner().at(k); }
+    iterator       find(K const& k)       { Timer t( stats_.find );  return inner().find(k); }
+    const_iterator find(K const& k) const { Timer t( stats_.find );  return inner().find(k); }
+    size_type count(K const& k) const     { Timer t( stats_.find );  return inner().count(k); }
+    iterator       find_view(key_view_type const& k)
+    { Timer t( stats_.find );  return inner().find_view(k); }
+    const_iterator find_view(key_view_type const& k) const
+    { Timer t( stats_.find );  return inner().find_view(k); }
+
+    // traversal iterators
+    iterator       begin()       { ++stats_.iteratorTraversals;  return inner().begin(); }
+    const_iterator begin() const { ++stats_.iteratorTraversals;  return inner().begin(); }
+    iterator         end()       { return inner().end(); }
+    const_iterator   end() const { return inner().end(); }
+
+    // internal iteration
+    void for_each(ConstVisitor visit, void* context) const
+    { Timer t( stats_.iteration );  inner().for_each(visit, context); }
+    void for_each_mut(Visitor visit, void* context)
+    { Timer t( stats_.iteration );  inner().for_each_mut(visit, context); }
+    bool all_of(Predicate pred, void* context) const
+    { Timer t( stats_.iteration );  return inner().all_of(pred, context); }
+
+    // native bulk arithmetic
+    bool sum_mapped(V& sum) const { Timer t( stats_.iteration );  return inner().sum_mapped(sum); }
+    bool scale_mapped(V const& n) { Timer t( stats_.iteration );  return inner().scale_mapped(n); }
+    bool add_mapped(MapConcept const& other, V const& factor)
+    { Inserting t( *this );  return inner().add_mapped(other, factor); }
+    bool equal_mapped(MapConcept const& other, V const& precision, bool& equal) const
+    { Timer t( stats_.iteration );  return inner().equal_mapped(other, precision, equal); }
+    bool add_many(K const* const* keys, V const* deltas, size_type n, V const& factor, V* results)
+    { Inserting t( *this );  return inner().add_many(keys, deltas, n, factor, results); }
+    void get_many(K const* const* keys, size_type n, V* out, V const& missing) const
+    { Timer t( stats_.find );  inner().get_many(keys, n, out, missing); }
+
+    // inserts
+    std::pair<iterator, bool> insert(value_type const& val)
+    { Inserting t( *this );  return inner().insert(val); }
+    std::pair<iterator, bool> insert(value_type&& val)
+    { Inserting t( *this );  return inner().insert(std::move(val)); }
+    void insert(const_iterator i1, const_iterator i2)
+    { Inserting t( *this );  inner().insert(i1, i2); }
+    void insert_all(MapConcept const& other)
+    { Inserting t( *this );  inner().insert_all(other); }
+    std::pair<iterator, bool> emplace(K&& k, V&& v)
+    { Inserting t( *this );  return inner().emplace(std::move(k), std::move(v)); }
+    std::pair<iterator, bool> try_emplace(K const& k, MappedFactory make, void* context)
+    { Inserting t( *this );  return inner().try_emplace(k, make, context); }
+    std::pair<iterator, bool> try_emplace(K     && k, MappedFactory make, void* context)
+    { Inserting t( *this );  return inner().try_emplace(std::move(k), make, context); }
+    std::pair<iterator, bool> try_emplace_view(key_view_type const& k, MappedFactory make, void* context)
+    { Inserting t( *this );  return inner().try_emplace_view(k, make, context); }
+
+    // erases
+    size_type erase(K const& k) { Timer t( stats_.erase );  return inner().erase(k); }
+    size_type erase_if(Predicate pred, void* context)
+    { Timer t( stats_.erase );  return inner().erase_if(pred, context); }
+
+    // clear
+    void clear() { Timer t( stats_.erase );  inner().clear(); }
+
+    // comparison: the decorated map unwraps other (see MapModel::equals())
+    bool equals(MapConcept const& other) const { return inner().equals(other); }
+
+    // The statistics, with the size fields taken now.
+    MapStats stats() const
+    {
+      MapStats s( stats_ );
+      s.size = map_.size();
+      s.estimatedBytes = map_.memory_usage();
+      return s;
+    }
+
+    void reset_stats() { stats_ = MapStats();  stats_.peakSize = map_.size(); }
+
+    AnyMap map_;
+
+  private:
+    MapConcept      & inner()       { return *map_.mapConcept_; }
+    MapConcept const& inner() const { return *map_.mapConcept_; }
+
+    // Times an insert and updates the peak size after it.
+    struct Inserting
+    {
+      explicit Inserting( InstrumentedModel& m ) : model_(m), timer_( m.stats_.insert ) {}
+      ~Inserting() { model_.stats_.peakSize = std::max( model_.stats_.peakSize, model_.map_.size() ); }
+      InstrumentedModel& model_;
+      Timer timer_;
+    };
+
+    mutable MapStats stats_;
+  };
+
+}; // namespace MapTypeErasure
+
+#endif // __ANY_MAP_INSTRUMENTED_MODEL_HPP__
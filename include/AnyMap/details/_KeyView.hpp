@@ -0,0 +1,130 @@
+#ifndef __ANY_MAP_KEY_VIEW_HPP__
+#define __ANY_MAP_KEY_VIEW_HPP__
+
+/*!
+ * @file _KeyView.hpp
+ * @brief Key views used by the heterogeneous lookups of AnyMap.
+ *
+ * A key view is a cheap, non-owning stand-in for a key (e.g. a string_view
+ * for a std::string key). AnyMap's lookups accept anything convertible to the
+ * key view type of its key, and only build a real key when a new element is
+ * inserted.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include "AnyMap/details/_MapTraits.hpp"
+
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <string>
+#include <type_traits>
+
+namespace MapTypeErasure
+{
+  /*!
+   * @brief Describes the type used by AnyMap to look up keys of type K without
+   * constructing a K.
+   *
+   * The default is K itself, which disables heterogeneous lookups. Specialize
+   * this template to enable them for other key types. A specialization must
+   * provide the view type and a static materialize() which builds a K from it.
+   */
+  template <typename K>
+  struct KeyView
+  {
+    typedef K type;
+    static K const& materialize( type const& k ) { return k; }
+  };
+
+  /*! @brief std::basic_string keys are looked up by boost::basic_string_view. */
+  template <typename C, typename T, typename A>
+  struct KeyView< std::basic_string<C, T, A> >
+  {
+    typedef boost::basic_string_view<C, T> type;
+    static std::basic_string<C, T, A> materialize( type const& k )
+    { return std::basic_string<C, T, A>( k.data(), k.size() ); }
+  };
+
+  /*!
+   * @brief True if an Arg can be used for a heterogeneous lookup of a K, i.e.
+   * Arg is not K itself, K has a key view distinct from K and Arg converts to
+   * it.
+   */
+  template <typename K, typename Arg>
+  struct IsKeyLike : std::integral_constant<bool,
+    !std::is_same<typename KeyView<K>::type, K>::value &&
+    !std::is_same<typename std::decay<Arg>::type, K>::value &&
+    std::is_convertible<Arg const&, typename KeyView<K>::type>::value> {};
+
+  namespace details
+  {
+    // How MapModel looks up a key view.
+    struct NativeViewLookup {};        // map's find() accepts the view
+    struct CompatibleViewLookup {};    // find(view, hash, eq) with CompatibleKeyLookup
+    struct MaterializedViewLookup {};  // construct the key, then find()
+
+    /*! @brief Provides a hasher and an equality predicate for looking up keys
+     *  of MapType by View via find(View, hasher, key_equal). Specialized for
+     *  the maps which support that overload and hash the view identically to
+     *  the key. */
+    template <typename MapType, typename View>
+    struct CompatibleKeyLookup : std::false_type {};
+
+    /*! @brief Hasher and equality predicate for looking up std::basic_string
+     *  keys hashed by boost::hash by boost::basic_string_view. */
+    template <typename C, typename T, typename A>
+    struct StringViewKeyLookup : std::true_type
+    {
+      typedef boost::basic_string_view<C, T> View;
+
+      // Same as boost::hash<std::basic_string>, which hashes the character range.
+      struct hasher
+      {
+	std::size_t operator()( View const& v ) const { return boost::hash_range( v.begin(), v.end() ); }
+      };
+
+      struct key_equal
+      {
+	bool operator()( View const& v, std::basic_string<C, T, A> const& k ) const
+	{ return v == View( k.data(), k.size() ); }
+	bool operator()( std::basic_string<C, T, A> const& k, View const& v ) const
+	{ return v == View( k.data(), k.size() ); }
+      };
+    };
+
+    template <typename C, typename T, typename A, typename M, typename Alloc>
+    struct CompatibleKeyLookup< boost::unordered_map< std::basic_string<C, T, A>, M,
+						      boost::hash< std::basic_string<C, T, A> >,
+						      std::equal_to< std::basic_string<C, T, A> >,
+						      Alloc >,
+				boost::basic_string_view<C, T> >
+      : StringViewKeyLookup<C, T, A> {};
+
+    /*! @brief True if MapType has find(View const&). */
+    template <typename MapType, typename View, typename = void>
+    struct HasViewFind : std::false_type {};
+
+    template <typename MapType, typename View>
+    struct HasViewFind<MapType, View, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().find( std::declval<View const&>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief Selects the way MapModel looks up a View in a MapType. */
+    template <typename MapType, typename View>
+    struct ViewLookup
+    {
+      typedef typename std::conditional< HasViewFind<MapType, View>::value,
+	NativeViewLookup,
+	typename std::conditional< CompatibleKeyLookup<MapType, View>::value,
+				   CompatibleViewLookup,
+				   MaterializedViewLookup >::type >::type type;
+    };
+
+  }; // namespace details
+
+}; // namespace MapTypeErasure
+
+#endif // __ANY_MAP_KEY_VIEW_HPP__
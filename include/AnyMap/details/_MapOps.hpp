@@ -0,0 +1,347 @@
+#ifndef __ANY_MAP_MAP_OPS_HPP__
+#define __ANY_MAP_MAP_OPS_HPP__
+
+/*!
+ * @file _MapOps.hpp
+ * @brief The map operations which AnyMap and StaticMap provide on top of the
+ * interface of the underlying map.
+ *
+ * Each operation is forwarded natively when the underlying map supports it
+ * (see _MapTraits.hpp) and falls back to an equivalent sequence of required
+ * calls otherwise. AnyMap::MapModel calls them behind its virtual interface,
+ * StaticMap calls them directly.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include "AnyMap/details/_MapTraits.hpp"
+#include "AnyMap/details/_KeyView.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace MapTypeErasure
+{
+  namespace details
+  {
+    /*!
+     * @brief Operations on a MapType with keys K and mapped values V.
+     *
+     * The functions which construct mapped values take a function object
+     * make, called without arguments, which is only called once the key is
+     * known to be missing.
+     */
+    template <typename MapType, typename K, typename V>
+    struct MapOps
+    {
+      typedef typename KeyView<K>::type key_view_type;
+      typedef typename MapType::iterator iterator;
+      typedef std::pair<iterator, bool> InsertResult_t;
+
+      // capacity management: forwarded if supported, no-ops otherwise
+      static void reserve(MapType& m, std::size_t n)  { reserve( m, n, HasReserve<MapType>() ); }
+      static void rehash(MapType& m, std::size_t n)   { rehash( m, n, HasRehash<MapType>() ); }
+      static void shrinkToFit(MapType& m)             { shrinkToFit( m, HasShrinkToFit<MapType>(), HasRehash<MapType>() ); }
+      static float maxLoadFactor(MapType const& m)    { return maxLoadFactor( m, HasMaxLoadFactor<MapType>() ); }
+      static void maxLoadFactor(MapType& m, float z)  { maxLoadFactor( m, z, HasMaxLoadFactor<MapType>() ); }
+      static std::size_t bucketCount(MapType const& m) { return bucketCount( m, HasBucketCount<MapType>() ); }
+
+      // native bulk arithmetic: forwarded if supported, reported as missing
+      // otherwise
+      static bool sumMapped(MapType const& m, V& sum) { return sumMapped( m, sum, HasSumMapped<MapType>() ); }
+      static bool scaleMapped(MapType& m, V const& n) { return scaleMapped( m, n, HasScaleMapped<MapType>() ); }
+      static bool addMapped(MapType& m, MapType const& o, V const& factor)
+      { return addMapped( m, o, factor, AddMapped_t() ); }
+      // the comparison of a map with o, which is NULL if it has another type
+      static bool equalMapped(MapType const& m, MapType const* o, V const& precision, bool& equal)
+      { return equalMapped( m, o, precision, equal, HasEqualMapped<MapType>() ); }
+
+      // batches: forwarded if supported (e.g. FlatHashMap, which prefetches
+      // the slots of the keys), loops of single calls otherwise; add_many()
+      // is reported as missing for non-arithmetic mapped values
+      static bool addMany(MapType& m, K const* const* keys, V const* deltas, std::size_t n,
+			  V const& factor, V* results)
+      { return addMany( m, keys, deltas, n, factor, results, AddMany_t() ); }
+      static void getMany(MapType const& m, K const* const* keys, std::size_t n, V* out, V const& missing)
+      { getMany( m, keys, n, out, missing, HasGetMany<MapType>() ); }
+
+      // removal of the elements matching pred, called with a value_type
+      // const&: native if supported; otherwise a single traversal erasing
+      // with the iterators, or, for maps without erase(const_iterator), a
+      // traversal collecting the keys followed by their erases
+      template<typename Pred>
+      static std::size_t eraseIf( MapType& m, Pred& pred ) { return eraseIf( m, pred, EraseIf_t() ); }
+
+      // the bytes allocated by the map: native if supported; otherwise an
+      // estimate for a node-based map, with a node (the element and two
+      // pointers, or four for ordered maps) per element and a pointer per
+      // bucket
+      static std::size_t memoryUsage(MapType const& m) { return memoryUsage( m, HasMemoryUsage<MapType>() ); }
+
+      // whether the traversal visits the keys in increasing std::less<K>
+      // order (ordered maps with the default comparison)
+      static bool isSorted() { return IsSorted_t::value; }
+
+      // comparison of maps of the same size: native for maps with
+      // equal_mapped() (which may not visit their elements, e.g. sketches),
+      // ordered ones in a single linear pass (assuming that their comparison
+      // objects order the keys alike)
+      struct NativeEquals {};
+      typedef typename std::conditional< HasEqualMapped<MapType>::value, NativeEquals,
+	      std::integral_constant<bool, IsOrderedMap<MapType>::value> >::type Equals_t;
+      static bool equals(MapType const& m, MapType const& o) { return equals( m, o, Equals_t() ); }
+
+      // heterogeneous lookup
+      template<typename M>
+      static auto findView( M& m, key_view_type const& k ) -> decltype(m.begin())
+      { return findView( m, k, ViewLookup_t() ); }
+
+      // try_emplace: native if supported; otherwise a single probe at the
+      // lower bound of an ordered map, or find() followed by emplace()
+      template<typename KeyArg, typename Make>
+      static InsertResult_t tryEmplace( MapType& m, KeyArg&& k, Make& make )
+      { return tryEmplace( m, std::forward<KeyArg>(k), make, HasTryEmplace<MapType>(), IsOrderedMap<MapType>() ); }
+
+      // try_emplace of a key view: look the view up, construct the key only
+      // to insert it
+      template<typename Make>
+      static InsertResult_t tryEmplaceView( MapType& m, key_view_type const& k, Make& make )
+      { return tryEmplaceView( m, k, make, ViewLookup_t() ); }
+
+    private:
+      template<typename M, bool Ordered = IsOrderedMap<M>::value>
+      struct IsSortedByLess : std::false_type {};
+      template<typename M>
+      struct IsSortedByLess<M, true> : std::is_same< typename M::key_compare, std::less<K> > {};
+      typedef IsSortedByLess<MapType> IsSorted_t;
+
+      static void reserve(MapType& m, std::size_t n, std::true_type) { m.reserve(n); }
+      static void reserve(MapType&  , std::size_t  , std::false_type) {}
+      static void rehash(MapType& m, std::size_t n, std::true_type)  { m.rehash(n); }
+      static void rehash(MapType&  , std::size_t  , std::false_type) {}
+      template<typename CanRehash>
+      static void shrinkToFit(MapType& m, std::true_type, CanRehash)        { m.shrink_to_fit(); }
+      static void shrinkToFit(MapType& m, std::false_type, std::true_type)  { m.rehash(0); }
+      static void shrinkToFit(MapType&  , std::false_type, std::false_type) {}
+      static float maxLoadFactor(MapType const& m, std::true_type)  { return m.max_load_factor(); }
+      static float maxLoadFactor(MapType const&  , std::false_type) { return 0; }
+      static void maxLoadFactor(MapType& m, float z, std::true_type) { m.max_load_factor(z); }
+      static void maxLoadFactor(MapType&  , float  , std::false_type) {}
+      static std::size_t bucketCount(MapType const& m, std::true_type)  { return m.bucket_count(); }
+      static std::size_t bucketCount(MapType const&  , std::false_type) { return 0; }
+
+      static bool sumMapped(MapType const& m, V& sum, std::true_type) { sum = m.sum_mapped();  return true; }
+      static bool sumMapped(MapType const&  , V&    , std::false_type) { return false; }
+      static bool scaleMapped(MapType& m, V const& n, std::true_type) { m.scale_mapped(n);  return true; }
+      static bool scaleMapped(MapType&  , V const&  , std::false_type) { return false; }
+      static bool equalMapped(MapType const& m, MapType const* o, V const& precision, bool& equal, std::true_type)
+      { equal = o != NULL && m.equal_mapped(*o, precision);  return true; }
+      static bool equalMapped(MapType const&  , MapType const*  , V const&          , bool&      , std::false_type)
+      { return false; }
+
+      // add_mapped(): forwarded if supported; otherwise, for arithmetic
+      // mapped values, a linear merge with hinted inserts (ordered maps) or a
+      // loop of native lookups
+      struct NativeAdd {};
+      struct MergeAdd {};
+      struct LoopAdd {};
+      typedef typename std::conditional< HasAddMapped<MapType>::value, NativeAdd,
+	      typename std::conditional< !std::is_arithmetic<V>::value, std::false_type,
+	      typename std::conditional< IsOrderedMap<MapType>::value, MergeAdd,
+					 LoopAdd >::type >::type >::type AddMapped_t;
+
+      static bool addMapped(MapType& m, MapType const& o, V const& factor, NativeAdd)
+      { return m.add_mapped(o, factor); }
+      static bool addMapped(MapType& m, MapType const& o, V const& factor, MergeAdd)
+      {
+	typename MapType::key_compare const comp( m.key_comp() );
+	typename MapType::iterator i( m.begin() );
+	for( typename MapType::const_iterator j(o.begin()), e(o.end()); j != e; ++j )
+	  {
+	    while( i != m.end() && comp(i->first, j->first) )
+	      ++i;
+	    if( i != m.end() && !comp(j->first, i->first) )
+	      i->second += j->second * factor;
+	    else
+	      i = m.emplace_hint( i, j->first, j->second * factor );
+	  }
+	return true;
+      }
+      static bool addMapped(MapType& m, MapType const& o, V const& factor, LoopAdd)
+      {
+	for( typename MapType::const_iterator j(o.begin()), e(o.end()); j != e; ++j )
+	  m[j->first] += j->second * factor;
+	return true;
+      }
+      static bool addMapped(MapType&  , MapType const&  , V const&       , std::false_type) { return false; }
+
+      struct NativeAddMany {};
+      struct LoopAddMany {};
+      typedef typename std::conditional< HasAddMany<MapType>::value, NativeAddMany,
+	      typename std::conditional< std::is_arithmetic<V>::value, LoopAddMany,
+					 std::false_type >::type >::type AddMany_t;
+
+      static bool addMany(MapType& m, K const* const* keys, V const* deltas, std::size_t n,
+			  V const& factor, V* results, NativeAddMany)
+      { m.add_many( keys, deltas, n, factor, results );  return true; }
+      static bool addMany(MapType& m, K const* const* keys, V const* deltas, std::size_t n,
+			  V const& factor, V* results, LoopAddMany)
+      {
+	for( std::size_t i = 0; i < n; ++i )
+	  {
+	    V& v( m[*keys[i]] );
+	    v += deltas[i] * factor;
+	    if( results != NULL )
+	      results[i] = v;
+	  }
+	return true;
+      }
+      static bool addMany(MapType&  , K const* const*     , V const*       , std::size_t  ,
+			  V const&       , V*        , std::false_type) { return false; }
+
+      static void getMany(MapType const& m, K const* const* keys, std::size_t n, V* out, V const& missing,
+			  std::true_type)
+      { m.get_many( keys, n, out, missing ); }
+      static void getMany(MapType const& m, K const* const* keys, std::size_t n, V* out, V const& missing,
+			  std::false_type)
+      {
+	for( std::size_t i = 0; i < n; ++i )
+	  {
+	    typename MapType::const_iterator j( m.find(*keys[i]) );
+	    out[i] = j == m.end() ? missing : j->second;
+	  }
+      }
+
+      struct NativeEraseIf {};
+      struct IteratorEraseIf {};
+      struct KeyEraseIf {};
+      typedef typename std::conditional< HasEraseIf<MapType>::value, NativeEraseIf,
+	      typename std::conditional< HasIteratorErase<MapType>::value, IteratorEraseIf,
+					 KeyEraseIf >::type >::type EraseIf_t;
+
+      template<typename Pred>
+      static std::size_t eraseIf( MapType& m, Pred& pred, NativeEraseIf )
+      { return m.erase_if( std::ref(pred) ); }
+      template<typename Pred>
+      static std::size_t eraseIf( MapType& m, Pred& pred, IteratorEraseIf )
+      {
+	std::size_t erased(0);
+	for( typename MapType::iterator i(m.begin()); i != m.end(); )
+	  if( pred( static_cast<typename MapType::value_type const&>(*i) ) )
+	    {
+	      i = m.erase( typename MapType::const_iterator(i) );
+	      ++erased;
+	    }
+	  else
+	    ++i;
+	return erased;
+      }
+      template<typename Pred>
+      static std::size_t eraseIf( MapType& m, Pred& pred, KeyEraseIf )
+      {
+	std::vector<K> keys;
+	for( typename MapType::const_iterator i(m.begin()), e(m.end()); i != e; ++i )
+	  if( pred(*i) )
+	    keys.push_back( i->first );
+	std::size_t erased(0);
+	for( typename std::vector<K>::const_iterator k(keys.begin()); k != keys.end(); ++k )
+	  erased += m.erase( *k );
+	return erased;
+      }
+
+      static std::size_t memoryUsage(MapType const& m, std::true_type) { return m.memory_usage(); }
+      static std::size_t memoryUsage(MapType const& m, std::false_type)
+      {
+	const std::size_t links( IsOrderedMap<MapType>::value ? 4 : 2 );
+	return m.size() * ( sizeof(typename MapType::value_type) + links * sizeof(void*) ) +
+	  bucketCount( m ) * sizeof(void*);
+      }
+
+      static bool equals(MapType const& m, MapType const& o, NativeEquals) { return m.equal_mapped(o, V()); }
+      static bool equals(MapType const& m, MapType const& o, std::true_type)
+      {
+	typename MapType::key_compare const comp( m.key_comp() );
+	for( typename MapType::const_iterator i(m.begin()), j(o.begin()), e(m.end()); i != e; ++i, ++j )
+	  if( comp(i->first, j->first) || comp(j->first, i->first) || !(i->second == j->second) )
+	    return false;
+	return true;
+      }
+      static bool equals(MapType const& m, MapType const& o, std::false_type)
+      {
+	for( typename MapType::const_iterator i(m.begin()), e(m.end()); i != e; ++i )
+	  {
+	    typename MapType::const_iterator j( o.find(i->first) );
+	    if( j == o.end() || !(j->second == i->second) )
+	      return false;
+	  }
+	return true;
+      }
+
+      typedef typename ViewLookup<MapType, key_view_type>::type ViewLookup_t;
+      typedef CompatibleKeyLookup<MapType, key_view_type> CompatibleLookup_t;
+
+      template<typename M>
+      static auto findView( M& m, key_view_type const& k, NativeViewLookup ) -> decltype(m.begin())
+      { return m.find(k); }
+      template<typename M>
+      static auto findView( M& m, key_view_type const& k, CompatibleViewLookup ) -> decltype(m.begin())
+      { return m.find( k, typename CompatibleLookup_t::hasher(), typename CompatibleLookup_t::key_equal() ); }
+      template<typename M>
+      static auto findView( M& m, key_view_type const& k, MaterializedViewLookup ) -> decltype(m.begin())
+      { return m.find( KeyView<K>::materialize(k) ); }
+
+      template<typename Make, typename Lookup>
+      static InsertResult_t tryEmplaceView( MapType& m, key_view_type const& k, Make& make, Lookup )
+      {
+	iterator i( findView(m, k, Lookup()) );
+	if( i != m.end() )
+	  return InsertResult_t( i, false );
+	return m.emplace( K(KeyView<K>::materialize(k)), make() );
+      }
+      template<typename Make>
+      static InsertResult_t tryEmplaceView( MapType& m, key_view_type const& k, Make& make, MaterializedViewLookup )
+      { return tryEmplace( m, K(KeyView<K>::materialize(k)), make ); }
+
+      // Converts to the mapped value by calling make. Passing it to a native
+      // try_emplace() delays the construction of the value until the map has
+      // decided to create a new element.
+      template<typename Make>
+      struct LazyMapped
+      {
+	explicit LazyMapped( Make& make ) : make_(&make) {}
+	operator V() const { return (*make_)(); }
+      private:
+	Make* make_;
+      };
+
+      template<typename KeyArg, typename Make, typename Ordered>
+      static InsertResult_t tryEmplace( MapType& m, KeyArg&& k, Make& make, std::true_type, Ordered )
+      { return m.try_emplace( std::forward<KeyArg>(k), LazyMapped<Make>(make) ); }
+
+      template<typename KeyArg, typename Make>
+      static InsertResult_t tryEmplace( MapType& m, KeyArg&& k, Make& make, std::false_type, std::true_type )
+      {
+	iterator i( m.lower_bound(k) );
+	if( i != m.end() && !m.key_comp()(k, i->first) )
+	  return InsertResult_t( i, false );
+	return InsertResult_t( m.emplace_hint(i, std::forward<KeyArg>(k), make()), true );
+      }
+
+      template<typename KeyArg, typename Make>
+      static InsertResult_t tryEmplace( MapType& m, KeyArg&& k, Make& make, std::false_type, std::false_type )
+      {
+	iterator i( m.find(k) );
+	if( i != m.end() )
+	  return InsertResult_t( i, false );
+	return m.emplace( std::forward<KeyArg>(k), make() );
+      }
+    };
+
+  }; // namespace details
+
+}; // namespace MapTypeErasure
+
+#endif // __ANY_MAP_MAP_OPS_HPP__
@@ -0,0 +1,198 @@
+#ifndef __ANY_MAP_MAP_TRAITS_HPP__
+#define __ANY_MAP_MAP_TRAITS_HPP__
+
+/*!
+ * @file _MapTraits.hpp
+ * @brief Compile-time detection of the optional parts of a map's interface.
+ *
+ * AnyMap::MapModel uses these traits to forward a call natively when the
+ * underlying map supports it and to fall back to an equivalent sequence of
+ * required calls otherwise.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace MapTypeErasure
+{
+  namespace details
+  {
+    template <typename T>
+    struct AlwaysVoid { typedef void type; };
+
+    /*! @brief True if MapType has try_emplace(key_type&&, Args...). */
+    template <typename MapType, typename = void>
+    struct HasTryEmplace : std::false_type {};
+
+    template <typename MapType>
+    struct HasTryEmplace<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().try_emplace( std::declval<typename MapType::key_type>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType is ordered, i.e. has lower_bound(key_type const&),
+     *  key_comp() and emplace_hint(iterator, Args...). */
+    template <typename MapType, typename = void>
+    struct IsOrderedMap : std::false_type {};
+
+    template <typename MapType>
+    struct IsOrderedMap<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().lower_bound( std::declval<typename MapType::key_type const&>() ),
+      std::declval<MapType const&>().key_comp(),
+      std::declval<MapType&>().emplace_hint( std::declval<MapType&>().begin(),
+					     std::declval<typename MapType::value_type>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has reserve(size_type). */
+    template <typename MapType, typename = void>
+    struct HasReserve : std::false_type {};
+
+    template <typename MapType>
+    struct HasReserve<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().reserve( std::declval<typename MapType::size_type>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has rehash(size_type). */
+    template <typename MapType, typename = void>
+    struct HasRehash : std::false_type {};
+
+    template <typename MapType>
+    struct HasRehash<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().rehash( std::declval<typename MapType::size_type>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has shrink_to_fit(). */
+    template <typename MapType, typename = void>
+    struct HasShrinkToFit : std::false_type {};
+
+    template <typename MapType>
+    struct HasShrinkToFit<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().shrink_to_fit()
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has max_load_factor() const and
+     *  max_load_factor(float). */
+    template <typename MapType, typename = void>
+    struct HasMaxLoadFactor : std::false_type {};
+
+    template <typename MapType>
+    struct HasMaxLoadFactor<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType const&>().max_load_factor(),
+      std::declval<MapType&>().max_load_factor( 1.0f )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has bucket_count() const. */
+    template <typename MapType, typename = void>
+    struct HasBucketCount : std::false_type {};
+
+    template <typename MapType>
+    struct HasBucketCount<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType const&>().bucket_count()
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has sum_mapped() const. */
+    template <typename MapType, typename = void>
+    struct HasSumMapped : std::false_type {};
+
+    template <typename MapType>
+    struct HasSumMapped<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType const&>().sum_mapped()
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has scale_mapped(mapped_type const&). */
+    template <typename MapType, typename = void>
+    struct HasScaleMapped : std::false_type {};
+
+    template <typename MapType>
+    struct HasScaleMapped<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().scale_mapped( std::declval<typename MapType::mapped_type const&>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has add_mapped(MapType const&,
+     *  mapped_type const&). */
+    template <typename MapType, typename = void>
+    struct HasAddMapped : std::false_type {};
+
+    template <typename MapType>
+    struct HasAddMapped<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().add_mapped( std::declval<MapType const&>(),
+					   std::declval<typename MapType::mapped_type const&>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has equal_mapped(MapType const&,
+     *  mapped_type const&) const. */
+    template <typename MapType, typename = void>
+    struct HasEqualMapped : std::false_type {};
+
+    template <typename MapType>
+    struct HasEqualMapped<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType const&>().equal_mapped( std::declval<MapType const&>(),
+						   std::declval<typename MapType::mapped_type const&>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has add_many(key_type const* const*,
+     *  mapped_type const*, std::size_t, mapped_type const&, mapped_type*). */
+    template <typename MapType, typename = void>
+    struct HasAddMany : std::false_type {};
+
+    template <typename MapType>
+    struct HasAddMany<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().add_many( std::declval<typename MapType::key_type const* const*>(),
+					 std::declval<typename MapType::mapped_type const*>(),
+					 std::size_t(),
+					 std::declval<typename MapType::mapped_type const&>(),
+					 std::declval<typename MapType::mapped_type*>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has get_many(key_type const* const*,
+     *  std::size_t, mapped_type*, mapped_type const&) const. */
+    template <typename MapType, typename = void>
+    struct HasGetMany : std::false_type {};
+
+    template <typename MapType>
+    struct HasGetMany<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType const&>().get_many( std::declval<typename MapType::key_type const* const*>(),
+					       std::size_t(),
+					       std::declval<typename MapType::mapped_type*>(),
+					       std::declval<typename MapType::mapped_type const&>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has erase_if(Predicate), removing the elements
+     *  for which the predicate of a value_type const& is true. */
+    template <typename MapType, typename = void>
+    struct HasEraseIf : std::false_type {};
+
+    template <typename MapType>
+    struct HasEraseIf<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().erase_if( std::declval<bool (*)(typename MapType::value_type const&)>() )
+      )>::type> : std::true_type {};
+
+    /*! @brief True if MapType has erase(const_iterator) returning the iterator
+     *  which follows the erased element. */
+    template <typename MapType, typename = void>
+    struct HasIteratorErase : std::false_type {};
+
+    template <typename MapType>
+    struct HasIteratorErase<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType&>().erase( std::declval<typename MapType::const_iterator>() )
+      )>::type> : std::is_same< decltype(
+	std::declval<MapType&>().erase( std::declval<typename MapType::const_iterator>() ) ),
+				typename MapType::iterator > {};
+
+    /*! @brief True if MapType has memory_usage() const, returning the bytes
+     *  it has allocated. */
+    template <typename MapType, typename = void>
+    struct HasMemoryUsage : std::false_type {};
+
+    template <typename MapType>
+    struct HasMemoryUsage<MapType, typename AlwaysVoid<decltype(
+      std::declval<MapType const&>().memory_usage()
+      )>::type> : std::true_type {};
+
+  }; // namespace details
+
+}; // namespace MapTypeErasure
+
+#endif // __ANY_MAP_MAP_TRAITS_HPP__
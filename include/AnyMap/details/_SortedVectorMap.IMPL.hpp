@@ -0,0 +1,283 @@
+#ifndef __SORTED_VECTOR_MAP_IMPL_HPP__
+#define __SORTED_VECTOR_MAP_IMPL_HPP__
+
+// Included from SortedVectorMap.hpp; the include below is for form and for
+// the editors' autocompletion (see _Counter.IMPL.hpp).
+#include "AnyMap/SortedVectorMap.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+namespace MapTypeErasure
+{
+  //------------- Constructors, Destructor, Assignment -------------------------
+
+  template <typename K, typename V, typename Compare>
+  SortedVectorMap<K, V, Compare>::SortedVectorMap( key_compare const& comp )
+    : data_(NULL), size_(0), capacity_(0), comp_(comp)
+  {}
+
+  template <typename K, typename V, typename Compare>
+  template <typename InputIterator>
+  SortedVectorMap<K, V, Compare>::SortedVectorMap( InputIterator first, InputIterator last )
+    : data_(NULL), size_(0), capacity_(0), comp_()
+  {
+    insert( first, last );
+  }
+
+  template <typename K, typename V, typename Compare>
+  SortedVectorMap<K, V, Compare>::SortedVectorMap( SortedVectorMap const& other )
+    : data_(NULL), size_(0), capacity_(0), comp_(other.comp_)
+  {
+    reserve( other.size_ );
+    for( ; size_ < other.size_; ++size_ )
+      new (data_ + size_) value_type( other.data_[size_] );
+  }
+
+  template <typename K, typename V, typename Compare>
+  SortedVectorMap<K, V, Compare>::SortedVectorMap( SortedVectorMap && other )
+    : data_(NULL), size_(0), capacity_(0), comp_(other.comp_)
+  {
+    swap( other );
+  }
+
+  template <typename K, typename V, typename Compare>
+  SortedVectorMap<K, V, Compare>::~SortedVectorMap()
+  {
+    clear();
+    if( data_ != NULL )
+      alloc_.deallocate( data_, capacity_ );
+  }
+
+  template <typename K, typename V, typename Compare>
+  SortedVectorMap<K, V, Compare>& SortedVectorMap<K, V, Compare>::operator=( SortedVectorMap const& other )
+  {
+    if( this != &other ) {
+      SortedVectorMap tmp( other );
+      swap( tmp );
+    }
+    return *this;
+  }
+
+  template <typename K, typename V, typename Compare>
+  SortedVectorMap<K, V, Compare>& SortedVectorMap<K, V, Compare>::operator=( SortedVectorMap && other )
+  {
+    swap( other );
+    return *this;
+  }
+
+  template <typename K, typename V, typename Compare>
+  void SortedVectorMap<K, V, Compare>::swap( SortedVectorMap& other )
+  {
+    using std::swap;
+    swap( data_, other.data_ );
+    swap( size_, other.size_ );
+    swap( capacity_, other.capacity_ );
+    swap( comp_, other.comp_ );
+  }
+
+  //-------------------------- Size and Capacity -------------------------------
+
+  template <typename K, typename V, typename Compare>
+  void SortedVectorMap<K, V, Compare>::reserve( size_type n )
+  {
+    if( n > capacity_ )
+      reallocate( n );
+  }
+
+  template <typename K, typename V, typename Compare>
+  void SortedVectorMap<K, V, Compare>::shrink_to_fit()
+  {
+    if( size_ < capacity_ )
+      reallocate( size_ );
+  }
+
+  //------------------------------- Lookup -------------------------------------
+
+  template <typename K, typename V, typename Compare>
+  V& SortedVectorMap<K, V, Compare>::at( K const& k )
+  {
+    iterator i( find(k) );
+    if( i == end() )
+      throw std::out_of_range( "SortedVectorMap::at: key not found" );
+    return i->second;
+  }
+
+  template <typename K, typename V, typename Compare>
+  V const& SortedVectorMap<K, V, Compare>::at( K const& k ) const
+  {
+    const_iterator i( find(k) );
+    if( i == end() )
+      throw std::out_of_range( "SortedVectorMap::at: key not found" );
+    return i->second;
+  }
+
+  template <typename K, typename V, typename Compare>
+  typename SortedVectorMap<K, V, Compare>::iterator SortedVectorMap<K, V, Compare>::find( K const& k )
+  {
+    iterator i( lower_bound(k) );
+    return i == end() || comp_(k, i->first) ? end() : i;
+  }
+
+  template <typename K, typename V, typename Compare>
+  typename SortedVectorMap<K, V, Compare>::const_iterator SortedVectorMap<K, V, Compare>::find( K const& k ) const
+  {
+    const_iterator i( lower_bound(k) );
+    return i == end() || comp_(k, i->first) ? end() : i;
+  }
+
+  template <typename K, typename V, typename Compare>
+  typename SortedVectorMap<K, V, Compare>::iterator SortedVectorMap<K, V, Compare>::lower_bound( K const& k )
+  {
+    Compare const& comp( comp_ );
+    return std::lower_bound( begin(), end(), k,
+			     [&comp](value_type const& v, K const& key) { return comp(v.first, key); } );
+  }
+
+  template <typename K, typename V, typename Compare>
+  typename SortedVectorMap<K, V, Compare>::const_iterator SortedVectorMap<K, V, Compare>::lower_bound( K const& k ) const
+  {
+    Compare const& comp( comp_ );
+    return std::lower_bound( begin(), end(), k,
+			     [&comp](value_type const& v, K const& key) { return comp(v.first, key); } );
+  }
+
+  //------------------------------ Modifiers -----------------------------------
+
+  template <typename K, typename V, typename Compare>
+  template <typename InputIterator>
+  void SortedVectorMap<K, V, Compare>::insert( InputIterator first, InputIterator last )
+  {
+    for( ; first != last; ++first )
+      insert( *first );
+  }
+
+  template <typename K, typename V, typename Compare>
+  template <typename... Args>
+  typename SortedVectorMap<K, V, Compare>::iterator
+  SortedVectorMap<K, V, Compare>::emplace_hint( const_iterator hint, Args&&... args )
+  {
+    value_type val( std::forward<Args>(args)... );
+    // The hint is right if the element goes between hint - 1 and hint.
+    if( (hint == end() || comp_(val.first, hint->first)) &&
+	(hint == begin() || comp_((hint - 1)->first, val.first)) )
+      return insertAt( hint - begin(), val.first, std::move(val.second) );
+    return tryEmplaceImpl( val.first, std::move(val.second) ).first;
+  }
+
+  template <typename K, typename V, typename Compare>
+  template <typename... Args>
+  std::pair<typename SortedVectorMap<K, V, Compare>::iterator, bool>
+  SortedVectorMap<K, V, Compare>::try_emplace( K const& k, Args&&... args )
+  {
+    return tryEmplaceImpl( k, std::forward<Args>(args)... );
+  }
+
+  template <typename K, typename V, typename Compare>
+  template <typename... Args>
+  std::pair<typename SortedVectorMap<K, V, Compare>::iterator, bool>
+  SortedVectorMap<K, V, Compare>::try_emplace( K && k, Args&&... args )
+  {
+    return tryEmplaceImpl( std::move(k), std::forward<Args>(args)... );
+  }
+
+  template <typename K, typename V, typename Compare>
+  typename SortedVectorMap<K, V, Compare>::size_type SortedVectorMap<K, V, Compare>::erase( K const& k )
+  {
+    const_iterator i( find(k) );
+    if( i == end() )
+      return 0;
+    erase( i );
+    return 1;
+  }
+
+  template <typename K, typename V, typename Compare>
+  typename SortedVectorMap<K, V, Compare>::iterator SortedVectorMap<K, V, Compare>::erase( const_iterator i )
+  {
+    const size_type index( i - begin() );
+    data_[index].~value_type();
+    for( size_type j = index + 1; j < size_; ++j )
+      relocate( data_ + j, data_ + j - 1 );
+    --size_;
+    return data_ + index;
+  }
+
+  template <typename K, typename V, typename Compare>
+  template <typename Predicate>
+  typename SortedVectorMap<K, V, Compare>::size_type SortedVectorMap<K, V, Compare>::erase_if( Predicate pred )
+  {
+    size_type kept(0);
+    for( size_type i = 0; i < size_; ++i )
+      if( pred( static_cast<value_type const&>(data_[i]) ) )
+	data_[i].~value_type();
+      else
+	{
+	  if( kept != i )
+	    relocate( data_ + i, data_ + kept );
+	  ++kept;
+	}
+    const size_type erased( size_ - kept );
+    size_ = kept;
+    return erased;
+  }
+
+  template <typename K, typename V, typename Compare>
+  void SortedVectorMap<K, V, Compare>::clear()
+  {
+    for( size_type i = 0; i < size_; ++i )
+      data_[i].~value_type();
+    size_ = 0;
+  }
+
+  //------------------------------- Private ------------------------------------
+
+  template <typename K, typename V, typename Compare>
+  template <typename KeyArg, typename... Args>
+  std::pair<typename SortedVectorMap<K, V, Compare>::iterator, bool>
+  SortedVectorMap<K, V, Compare>::tryEmplaceImpl( KeyArg && k, Args&&... args )
+  {
+    iterator i( lower_bound(k) );
+    if( i != end() && !comp_(k, i->first) )
+      return std::make_pair( i, false );
+    return std::make_pair( insertAt( i - begin(), std::forward<KeyArg>(k), std::forward<Args>(args)... ), true );
+  }
+
+  template <typename K, typename V, typename Compare>
+  template <typename KeyArg, typename... Args>
+  typename SortedVectorMap<K, V, Compare>::iterator
+  SortedVectorMap<K, V, Compare>::insertAt( size_type i, KeyArg && k, Args&&... args )
+  {
+    if( size_ == capacity_ )
+      reallocate( capacity_ == 0 ? 4 : capacity_ * 2 );
+    for( size_type j = size_; j > i; --j )
+      relocate( data_ + j - 1, data_ + j );
+    new (data_ + i) value_type( std::piecewise_construct,
+				std::forward_as_tuple( std::forward<KeyArg>(k) ),
+				std::forward_as_tuple( std::forward<Args>(args)... ) );
+    ++size_;
+    return data_ + i;
+  }
+
+  template <typename K, typename V, typename Compare>
+  void SortedVectorMap<K, V, Compare>::reallocate( size_type capacity )
+  {
+    value_type* data( capacity > 0 ? alloc_.allocate(capacity) : NULL );
+    for( size_type i = 0; i < size_; ++i )
+      relocate( data_ + i, data + i );
+    if( data_ != NULL )
+      alloc_.deallocate( data_, capacity_ );
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  template <typename K, typename V, typename Compare>
+  void SortedVectorMap<K, V, Compare>::relocate( value_type* from, value_type* to )
+  {
+    // The key is const in value_type and has to be copied.
+    new (to) value_type( from->first, std::move(from->second) );
+    from->~value_type();
+  }
+
+}; // namespace MapTypeErasure
+
+#endif // __SORTED_VECTOR_MAP_IMPL_HPP__
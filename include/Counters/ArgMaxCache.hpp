@@ -0,0 +1,125 @@
+#ifndef __ARG_MAX_CACHE_H__
+#define __ARG_MAX_CACHE_H__
+
+#include "Counters/NumCache.hpp"
+
+#include <boost/optional.hpp>
+
+namespace Counters
+{
+  /*!
+   * @brief A cache of the argument with the greatest number (e.g. the value
+   * with the greatest count in a Counter), with the caching policies of
+   * NumCache.
+   *
+   * - Setting and Synchronization \n
+   *   set() and setEmpty() store the argument and its number (or the absence
+   *   of any argument) and mark the cache synchronized.
+   * - Cached Value Manipulation \n
+   *   update() and remove() report a change of the number of one argument.
+   *   Under Counters::CACHE_POLICY_PERSISTENT policy the cache stays
+   *   synchronized whenever the new maximum can be known from the change
+   *   alone: the updated argument becomes the maximum, or the maximum grows.
+   *   Otherwise (a decrease or removal of the maximum, or the
+   *   Counters::CACHE_POLICY_RELAXED policy), the cache is desynchronized.
+   *   scale() and shift() apply a change to all the numbers, which keeps the
+   *   argument under either policy when the order of the numbers is kept.
+   * - Retrieval \n
+   *   As in NumCache, get() and getMax() are only meaningful if isSynched().
+   *
+   * @param T Type of the arguments; must be copyable and equality comparable
+   * (but need not be default constructible).
+   * @param NumType A numeric type with *, + and comparison operators.
+   */
+  template <typename T, typename NumType>
+  class ArgMaxCache
+  {
+    boost::optional<T> arg_;
+    NumType max_;
+    NumCachePolicy cachePolicy_;
+    bool synched_;
+
+  public:
+    /*!
+     * @brief Constructs a cache with the given policy.
+     * @param cachePolicy Caching policy the cache is set to.
+     * @param synched If TRUE, the cache is synchronized with no argument
+     * (e.g. for an empty Counter).
+     */
+    explicit ArgMaxCache(NumCachePolicy cachePolicy = CACHE_POLICY_RELAXED, bool synched = false)
+      : arg_(), max_(), cachePolicy_(cachePolicy), synched_(synched) {}
+
+    /*! @brief Stores the argument with the greatest number and marks the
+     *  cache as synched. */
+    void set(T const& arg, NumType max) {
+      arg_ = arg;
+      max_ = max;
+      synched_ = true;
+    }
+
+    /*! @brief Records that there are no arguments and marks the cache as
+     *  synched. */
+    void setEmpty(void) {
+      arg_ = boost::none;
+      synched_ = true;
+    }
+
+    /*! @brief Retrieves the cached argument; must not be called if
+     *  isEmpty(). */
+    T const& get(void) const { return *arg_; }
+
+    /*! @brief Retrieves the cached maximum. */
+    NumType getMax(void) const { return max_; }
+
+    /*! @brief Checks whether the cache is synched with no argument. */
+    bool isEmpty(void) const { return !arg_; }
+
+    /*! @brief Sets the caching policy. */
+    void setCachePolicy(NumCachePolicy cachePolicy) { cachePolicy_ = cachePolicy; }
+
+    /*! @brief Returns the current caching policy. */
+    NumCachePolicy getCachePolicy(void) const { return cachePolicy_; }
+
+    /*! @brief Checks if the cached argument is synched. */
+    bool isSynched(void) const { return synched_; }
+
+    /*! @brief Marks the cache unsynched. */
+    void reset(void) {
+      synched_ = false;
+    }
+
+    /*! @name Modification of Cached Argument
+     *  @{
+     */
+    /*! @brief Reports that the number of arg is now num. */
+    void update(T const& arg, NumType num) {
+      if( ! synched_ ) return;
+      if( cachePolicy_ != CACHE_POLICY_PERSISTENT )  synched_ = false;
+      else if( arg_ && arg == *arg_ ) {
+	if( num >= max_ )                            max_ = num;
+	else                                         synched_ = false;
+      }
+      else if( !arg_ || num > max_ )                 set( arg, num );
+    }
+
+    /*! @brief Reports that arg no longer has a number. */
+    void remove(T const& arg) {
+      if( cachePolicy_ != CACHE_POLICY_PERSISTENT || !arg_ || arg == *arg_ )
+	synched_ = false;
+    }
+
+    /*! @brief Reports that all numbers are multiplied by n. */
+    void scale(NumType n) {
+      if( n > 0 )                                    max_ *= n;
+      else                                           synched_ = false;
+    }
+
+    /*! @brief Reports that n is added to all numbers. */
+    void shift(NumType n) {
+      max_ += n;
+    }
+    /*! @} */
+  };
+};
+
+#endif // __ARG_MAX_CACHE_H__
@@ -0,0 +1,399 @@
+/*! @file BinaryFormat.hpp
+  @brief A binary file format for Counters and CounterMaps which can be
+  memory-mapped and queried in place.
+
+  A file holds the arrays of a FrozenCounterMap (a Counter is stored as a
+  map with a single row and no keys), each aligned to 8 bytes, after a fixed
+  header:
+
+  | Section        | Contents                                               |
+  |----------------|--------------------------------------------------------|
+  | header         | details::BinaryHeader: magic, version, sizes, offsets  |
+  | keys           | the sorted keys (see BinaryEncoding), maps only        |
+  | offsets        | uint64_t[rows + 1], the first value of each row        |
+  | totals         | double[rows], the total count of each row              |
+  | values         | the values of all the rows, sorted within each row     |
+  | counts         | double[values]                                         |
+  | probabilities  | double[values], optional                               |
+
+  The numbers are stored in the byte order of the writer; a reader with
+  another byte order rejects the file. Keys and values may be of any
+  arithmetic type or std::basic_string (see BinaryEncoding for other types).
+
+  MappedCounterMap and MappedCounter map a file read-only and answer the
+  lookups directly from the mapped pages, without parsing or copying
+  anything. The pages are shared (MAP_SHARED), so processes which map the
+  same file, e.g. workers forked after the file was mapped, share one copy
+  in the page cache. Requires POSIX mmap().
+
+  @author Yuriy Skobov
+ */
+
+#ifndef __COUNTERS_BINARY_FORMAT_H__
+#define __COUNTERS_BINARY_FORMAT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+#include "Counters/FrozenCounterMap.hpp"
+#include "Counters/details/_MappedFile.hpp"
+#include "AnyMap/details/_KeyView.hpp"
+
+namespace Counters
+{
+  /*!
+   * @brief Describes how a column of n elements of type T (the keys or the
+   * values) is stored in a binary file, and how elements are read in place.
+   *
+   * Specializations provide:
+   * - view_type: the type in which elements are read in place; must be
+   *   MapTypeErasure::KeyView<T>::type, so that it converts back to T and
+   *   compares with the lookups' arguments;
+   * - static uint32_t tag(): identifies the encoding, checked by the readers;
+   * - static uint64_t columnSize(T const* x, std::size_t n): bytes written
+   *   by writeColumn();
+   * - static void writeColumn(std::ostream& os, T const* x, std::size_t n);
+   * - static bool validColumn(char const* column, uint64_t n, uint64_t size):
+   *   checks a column of size bytes (cheaply, without a pass over it);
+   * - static view_type read(char const* column, uint64_t n, uint64_t i).
+   *
+   * Arithmetic types are stored as arrays, strings as an array of n + 1
+   * offsets followed by their characters.
+   */
+  template <typename T, typename Enable = void>
+  struct BinaryEncoding;
+
+  template <typename T>
+  struct BinaryEncoding<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  {
+    typedef T view_type;
+
+    static std::uint32_t tag(void)
+    { return (std::is_floating_point<T>::value ? 3u : std::is_signed<T>::value ? 2u : 1u) << 8 | sizeof(T); }
+    static std::uint64_t columnSize( T const*, std::size_t n ) { return n * sizeof(T); }
+    static void writeColumn( std::ostream& os, T const* x, std::size_t n )
+    { os.write( reinterpret_cast<char const*>(x), n * sizeof(T) ); }
+    static bool validColumn( char const*, std::uint64_t n, std::uint64_t size )
+    { return n <= size / sizeof(T); }
+    static view_type read( char const* column, std::uint64_t, std::uint64_t i )
+    { return reinterpret_cast<T const*>(column)[i]; }
+  };
+
+  template <typename C, typename Traits, typename Alloc>
+  struct BinaryEncoding< std::basic_string<C, Traits, Alloc> >
+  {
+    typedef std::basic_string<C, Traits, Alloc> String_t;
+    typedef typename MapTypeErasure::KeyView<String_t>::type view_type;
+
+    static std::uint32_t tag(void) { return 4u << 8 | sizeof(C); }
+    static std::uint64_t columnSize( String_t const* x, std::size_t n );
+    static void writeColumn( std::ostream& os, String_t const* x, std::size_t n );
+    static bool validColumn( char const* column, std::uint64_t n, std::uint64_t size );
+    static view_type read( char const* column, std::uint64_t n, std::uint64_t i )
+    {
+      std::uint64_t const* const offsets( reinterpret_cast<std::uint64_t const*>(column) );
+      C const* const chars( reinterpret_cast<C const*>( offsets + n + 1 ) );
+      return view_type( chars + offsets[i], offsets[i + 1] - offsets[i] );
+    }
+  };
+
+  namespace details
+  {
+    /*! @brief The header of the binary files. The offsets are from the
+     *  beginning of the file. */
+    struct BinaryHeader
+    {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t byteOrder;
+      std::uint32_t flags;
+      std::uint32_t keyTag;
+      std::uint32_t valueTag;
+      std::uint32_t reserved;
+      std::uint64_t rows;
+      std::uint64_t values;
+      double total;
+      std::uint64_t keysOffset;
+      std::uint64_t offsetsOffset;
+      std::uint64_t totalsOffset;
+      std::uint64_t valuesOffset;
+      std::uint64_t countsOffset;
+      std::uint64_t probabilitiesOffset;
+      std::uint64_t fileSize;
+    };
+
+    enum BinaryFlags
+    {
+      BINARY_COUNTER       = 1,  // a single row and no keys
+      BINARY_PROBABILITIES = 2   // the probabilities section is present
+    };
+
+    static const std::uint32_t BINARY_VERSION = 1;
+    static const std::uint32_t BINARY_BYTE_ORDER = 0x01020304;
+
+    /*! @brief The rows of a binary file, read in place. */
+    template <typename V>
+    class BinaryRows
+    {
+    public:
+      typedef CountersCount_t Count_t;
+      typedef BinaryEncoding<V> Encoding_t;
+      typedef typename Encoding_t::view_type ValueView_t;
+
+      BinaryRows() : data_(NULL), header_(NULL) {}
+
+      typedef bool (*ColumnCheck_t)( char const*, std::uint64_t, std::uint64_t );
+
+      /*! @brief Checks the header and the sizes of the sections of the
+       *  size bytes at data, the keys with validKeys; keyTag is 0 (and
+       *  validKeys NULL) for a Counter. */
+      bool attach( char const* data, std::size_t size, std::uint32_t keyTag, ColumnCheck_t validKeys );
+      bool isOpen(void) const { return header_ != NULL; }
+
+      BinaryHeader const& header(void) const { return *header_; }
+      char const* section( std::uint64_t offset ) const { return data_ + offset; }
+
+      std::uint64_t rows(void) const { return header_ == NULL ? 0 : header_->rows; }
+      std::uint64_t values(void) const { return header_ == NULL ? 0 : header_->values; }
+      Count_t total(void) const { return header_ == NULL ? 0 : header_->total; }
+      bool hasProbabilities(void) const { return header_ != NULL && (header_->flags & BINARY_PROBABILITIES); }
+
+      std::uint64_t rowBegin( std::uint64_t row ) const { return offsets_()[row]; }
+      std::uint64_t rowEnd( std::uint64_t row ) const { return offsets_()[row + 1]; }
+      Count_t rowTotal( std::uint64_t row ) const
+      { return reinterpret_cast<Count_t const*>( section(header_->totalsOffset) )[row]; }
+      ValueView_t value( std::uint64_t i ) const
+      { return Encoding_t::read( section(header_->valuesOffset), header_->values, i ); }
+      Count_t count( std::uint64_t i ) const
+      { return reinterpret_cast<Count_t const*>( section(header_->countsOffset) )[i]; }
+
+      // value index of val in the row, or values() if absent
+      std::uint64_t find( std::uint64_t row, ValueView_t const& val ) const;
+      Count_t probability( std::uint64_t row, std::uint64_t i ) const;
+      // index of the greatest count of the row (values() if empty)
+      std::uint64_t max( std::uint64_t row ) const;
+
+    private:
+      std::uint64_t const* offsets_(void) const
+      { return reinterpret_cast<std::uint64_t const*>( section(header_->offsetsOffset) ); }
+
+      char const* data_;
+      BinaryHeader const* header_;
+    };
+
+    // Writes the header and the sections (no keys if flags has BINARY_COUNTER).
+    template <typename K, typename V, typename Size>
+    bool writeBinary( std::ostream& os, std::uint32_t flags, K const* keys, std::size_t rows,
+		      Size const* offsets, CountersCount_t const* totals,
+		      V const* values, std::size_t valueCount, CountersCount_t const* counts,
+		      CountersCount_t const* probabilities, CountersCount_t total );
+  };
+
+  /*!  @name Writers
+   *   The writers stream the file to os and return os.good().
+   *   @{
+   */
+  /*! @brief Writes the FrozenCounterMap, with its probabilities if they were
+   *  precomputed. */
+  template <typename K, typename V>
+  bool writeBinary( std::ostream& os, FrozenCounterMap<K, V> const& frozen );
+  /*! @brief Writes the CounterMap (frozen first, see FrozenCounterMap). */
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool writeBinary( std::ostream& os, CounterMap<K, V, RowMap, OuterMap> const& counterMap,
+		    bool withProbabilities = false );
+  /*! @brief Writes the Counter, its values sorted. */
+  template <typename V, typename CoreMap>
+  bool writeBinary( std::ostream& os, Counter<V, CoreMap> const& counter,
+		    bool withProbabilities = false );
+  /*!  @} */
+
+  /*!
+   * @brief A CounterMap stored in the binary format, mapped read-only and
+   * queried in place.
+   *
+   * The lookups are those of FrozenCounterMap (binary searches over the keys
+   * and over the values of a row); the mapped pages are never written, so
+   * any number of threads may query a MappedCounterMap concurrently. Copies
+   * share the mapping, which is released with the last of them.
+   *
+   * @param K Key type of the mapping, as written.
+   * @param V Value type of the rows, as written.
+   */
+  template <typename K, typename V>
+  class MappedCounterMap
+  {
+  public:
+    typedef K Key_t;
+    typedef V Value_t;
+    typedef CountersCount_t Count_t;
+    typedef std::size_t Size_t;
+    /*! @brief The type in which the keys are read. */
+    typedef typename BinaryEncoding<K>::view_type KeyView_t;
+    /*! @brief The type in which the values are read. */
+    typedef typename BinaryEncoding<V>::view_type ValueView_t;
+
+    /*! @brief Constructs a closed (and empty) mapping. */
+    MappedCounterMap() {}
+
+    /*! @brief Maps the file written by writeBinary(). Returns false if it
+     *  cannot be mapped or is not a CounterMap<K, V> file of this version. */
+    bool open( std::string const& path );
+    /*! @brief Uses the size bytes at data, which must be aligned to 8 bytes
+     *  and outlive the mapping. Returns false as open() does. */
+    bool attach( void const* data, std::size_t size );
+    /*! @brief Checks whether a file is mapped. */
+    bool isOpen(void) const { return rows_.isOpen(); }
+
+    /*!  @name Lookup
+     *   See the corresponding methods of CounterMap.
+     *   @{
+     */
+    bool contains( K const& key ) const { return findRow( KeyView_t(key) ) != size(); }
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, bool>::type
+    contains( KeyLike const& key ) const { return findRow( KeyView_t(key) ) != size(); }
+
+    bool contains( K const& key, V const& val ) const
+    { return findValue( KeyView_t(key), ValueView_t(val) ) != rows_.values(); }
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, bool>::type
+    contains( KeyArg const& key, ValArg const& val ) const
+    { return findValue( KeyView_t(key), ValueView_t(val) ) != rows_.values(); }
+
+    Size_t size(void) const { return rows_.rows(); }
+    Size_t size( K const& key ) const;
+    bool empty(void) const { return size() == 0; }
+
+    Count_t getCount( K const& key, V const& val ) const
+    { return countAt( findValue( KeyView_t(key), ValueView_t(val) ) ); }
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, Count_t>::type
+    getCount( KeyArg const& key, ValArg const& val ) const
+    { return countAt( findValue( KeyView_t(key), ValueView_t(val) ) ); }
+
+    Count_t totalCount(void) const { return rows_.total(); }
+    Count_t totalCount( K const& key ) const { return rowTotal( findRow( KeyView_t(key) ) ); }
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, Count_t>::type
+    totalCount( KeyLike const& key ) const { return rowTotal( findRow( KeyView_t(key) ) ); }
+
+    V maxValue( K const& key ) const;
+    /*!  @} */
+
+    /*! @brief See FrozenCounterMap::getProbability(). */
+    Count_t getProbability( K const& key, V const& val ) const;
+    /*! @brief Checks whether the file holds precomputed probabilities. */
+    bool hasProbabilities(void) const { return rows_.hasProbabilities(); }
+
+    /*! @brief The i-th key in sorted order, read in place. */
+    KeyView_t key( Size_t i ) const
+    { return BinaryEncoding<K>::read( rows_.section( rows_.header().keysOffset ), size(), i ); }
+
+    /*! @brief Sets the counts of the file in counterMap (in addition to the
+     *  counts it has) and returns it. */
+    template <typename CounterMap_t>
+    CounterMap_t thaw( CounterMap_t counterMap = CounterMap_t() ) const;
+
+  private:
+    Size_t findRow( KeyView_t const& key ) const;
+    std::uint64_t findValue( KeyView_t const& key, ValueView_t const& val ) const;
+    Count_t rowTotal( Size_t row ) const { return row == size() ? 0 : rows_.rowTotal(row); }
+    Count_t countAt( std::uint64_t i ) const { return i == rows_.values() ? 0 : rows_.count(i); }
+
+    std::shared_ptr<details::MappedFile> file_;
+    details::BinaryRows<V> rows_;
+  };
+
+  /*!
+   * @brief A Counter stored in the binary format, mapped read-only and
+   * queried in place. See MappedCounterMap.
+   *
+   * @param V Value type of the counter, as written.
+   */
+  template <typename V>
+  class MappedCounter
+  {
+  public:
+    typedef V Value_t;
+    typedef CountersCount_t Count_t;
+    typedef std::size_t Size_t;
+    /*! @brief The type in which the values are read. */
+    typedef typename BinaryEncoding<V>::view_type ValueView_t;
+
+    /*! @brief Constructs a closed (and empty) counter. */
+    MappedCounter() {}
+
+    /*! @brief See MappedCounterMap::open(). */
+    bool open( std::string const& path );
+    /*! @brief See MappedCounterMap::attach(). */
+    bool attach( void const* data, std::size_t size );
+    /*! @brief Checks whether a file is mapped. */
+    bool isOpen(void) const { return rows_.isOpen(); }
+
+    /*!  @name Lookup
+     *   See the corresponding methods of Counter.
+     *   @{
+     */
+    bool contains( V const& val ) const { return find( ValueView_t(val) ) != size(); }
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, bool>::type
+    contains( ValueLike const& val ) const { return find( ValueView_t(val) ) != size(); }
+
+    Size_t size(void) const { return rows_.values(); }
+    bool empty(void) const { return size() == 0; }
+
+    Count_t getCount( V const& val ) const { return countAt( find( ValueView_t(val) ) ); }
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, Count_t>::type
+    getCount( ValueLike const& val ) const { return countAt( find( ValueView_t(val) ) ); }
+
+    Count_t totalCount(void) const { return rows_.total(); }
+    V maxValue(void) const;
+    /*!  @} */
+
+    /*! @brief The count of the value divided by the total count, or 0. */
+    Count_t getProbability( V const& val ) const;
+    /*! @brief Checks whether the file holds precomputed probabilities. */
+    bool hasProbabilities(void) const { return rows_.hasProbabilities(); }
+
+    /*! @brief The i-th value in sorted order, read in place. */
+    ValueView_t value( Size_t i ) const { return rows_.value(i); }
+    /*! @brief The count of value(i). */
+    Count_t count( Size_t i ) const { return rows_.count(i); }
+
+    /*! @brief Sets the counts of the file in counter (in addition to the
+     *  counts it has) and returns it. */
+    template <typename Counter_t>
+    Counter_t thaw( Counter_t counter = Counter_t() ) const;
+
+  private:
+    std::uint64_t find( ValueView_t const& val ) const { return isOpen() ? rows_.find( 0, val ) : 0; }
+    Count_t countAt( std::uint64_t i ) const { return i == size() ? 0 : rows_.count(i); }
+
+    std::shared_ptr<details::MappedFile> file_;
+    details::BinaryRows<V> rows_;
+  };
+
+  /*!  @name Loaders
+   *   Read a file written by writeBinary() into a mutable Counter or
+   *   CounterMap, setting its counts (see MappedCounterMap::thaw()). Return
+   *   false, leaving the destination unchanged, if the file cannot be read.
+   *   @{
+   */
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool loadBinary( std::string const& path, CounterMap<K, V, RowMap, OuterMap>& counterMap );
+  template <typename V, typename CoreMap>
+  bool loadBinary( std::string const& path, Counter<V, CoreMap>& counter );
+  /*!  @} */
+
+};
+
+#include "Counters/details/_BinaryFormat.IMPL.hpp"
+
+#endif // __COUNTERS_BINARY_FORMAT_H__
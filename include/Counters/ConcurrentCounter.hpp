@@ -0,0 +1,137 @@
+/*! @file ConcurrentCounter.hpp
+  @brief A Counter which can be updated from several threads at once.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __CONCURRENT_COUNTER_H__
+#define __CONCURRENT_COUNTER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#include <boost/functional/hash.hpp>
+
+#include "Counters/Counter.hpp"
+#include "Counters/CounterFactories.hpp"
+
+namespace Counters
+{
+  /*!
+   * @brief A counter for concurrent updates: the values are striped across a
+   * fixed number of shards, each of which is a Counter guarded by its own
+   * mutex.
+   *
+   * Every method may be called from any thread. The updates and lookups of a
+   * value lock only the shard of the value, so threads which update
+   * different shards do not wait for each other. totalCount() locks nothing:
+   * it adds up the totals of the shards, each of which is kept in an atomic
+   * variable, and is therefore only approximately consistent while the
+   * counter is being updated (it may miss the updates in progress). snapshot()
+   * copies the counts into a plain Counter for the read side; it locks one
+   * shard at a time, so each shard is copied in a consistent state.
+   *
+   * The shards are created by a CounterFactory, so they can use the AnyMap
+   * backends, provided that the factory is safe to use from several threads.
+   * A factory whose Counters use memory it owns (see
+   * CounterFactory::ownsCounterMemory(), e.g. ArenaCounterFactory, whose Arena
+   * is not thread-safe) is replaced by a DefaultCounterFactory.
+   *
+   * @param V Value type whose counts are stored.
+   * @param Hash Hash function for V, used to choose the shards.
+   */
+  template <typename V, typename Hash = boost::hash<V> >
+  class ConcurrentCounter
+  {
+  public:
+    /*! @brief The counter type of the shards and of snapshots. */
+    typedef Counter<V> Counter_t;
+    typedef typename Counter_t::Count_t Count_t;
+    typedef typename Counter_t::Size_t Size_t;
+
+    /*!  @name Constructors
+     *   @{
+     */
+    /*!
+     * @brief Constructs an empty counter.
+     * @param shards Number of shards (at least 1); a few times the number of
+     * updating threads keeps the contention low.
+     * @param counterFactory The factory which creates the shards and the
+     * snapshots; replaced by a DefaultCounterFactory if it owns the memory of
+     * its Counters (see the class description).
+     */
+    explicit ConcurrentCounter( Size_t shards = 64,
+				CounterFactory<V> const& counterFactory = DefaultCounterFactory<V>() );
+    ~ConcurrentCounter();
+    /*!  @} */
+
+    /*!  @name Modifiers
+     *   Atomic with respect to the other methods for the same value.
+     *   @{
+     */
+    /*! @brief Increments the count of val by count. See Counter::incrementCount(). */
+    void incrementCount( V const& val, Count_t count );
+    /*! @brief Increments each value in the range by count. Each increment is
+     *  atomic; the range as a whole is not. */
+    template <typename InputIterator>
+    void incrementAll( InputIterator first, InputIterator last, Count_t count );
+    /*! @brief Sets the count of val. See Counter::setCount(). */
+    void setCount( V const& val, Count_t count );
+    /*! @brief Removes val and its count. */
+    void remove( V const& val );
+    /*! @} */
+
+    /*!  @name Lookup
+     *   @{
+     */
+    /*! @brief Checks whether val is in the counter. */
+    bool contains( V const& val ) const;
+    /*! @brief Returns the count of val, or 0 if it is not in the counter. */
+    Count_t getCount( V const& val ) const;
+    /*! @brief Returns the sum of the counts, without locking (see the class
+     *  description). */
+    Count_t totalCount(void) const;
+    /*! @brief Returns the number of values in the counter; locks the shards
+     *  one at a time. */
+    Size_t size(void) const;
+    /*! @brief Returns the number of shards. */
+    Size_t shards(void) const { return shardCount_; }
+    /*! @brief Copies the counts into a Counter created by the factory; locks
+     *  the shards one at a time. */
+    Counter_t snapshot(void) const;
+    /*! @} */
+
+  private:
+    ConcurrentCounter( ConcurrentCounter const& );
+    ConcurrentCounter& operator=( ConcurrentCounter const& );
+
+    struct Shard
+    {
+      mutable std::mutex mutex;
+      Counter_t counter;
+      // The total of the counter, readable without the mutex. Written only
+      // with the mutex held.
+      std::atomic<Count_t> total;
+      // keeps the hot members of neighbouring shards in separate cache lines
+      char padding[64];
+
+      Shard() : total(0) {}
+      void add( Count_t delta )
+      { total.store( total.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed ); }
+    };
+
+    Shard& shardOf( V const& val ) const;
+
+    std::unique_ptr<CounterFactory<V> const> counterFactory_;
+    Size_t shardCount_;
+    std::unique_ptr<Shard[]> shards_;
+    Hash hash_;
+  };
+
+};
+
+#include "Counters/details/_ConcurrentCounter.IMPL.hpp"
+
+#endif // __CONCURRENT_COUNTER_H__
@@ -0,0 +1,130 @@
+/*! @file ConcurrentCounterMap.hpp
+  @brief A CounterMap which can be updated from several threads at once.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __CONCURRENT_COUNTER_MAP_H__
+#define __CONCURRENT_COUNTER_MAP_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#include <boost/functional/hash.hpp>
+
+#include "Counters/CounterMap.hpp"
+#include "Counters/CounterFactories.hpp"
+
+namespace Counters
+{
+  /*!
+   * @brief A map of counters for concurrent updates: the keys are striped
+   * across a fixed number of shards, each of which is a CounterMap guarded by
+   * its own mutex. All the counts of a key are in the same shard.
+   *
+   * As with ConcurrentCounter, every method may be called from any thread,
+   * updates and lookups lock the shard of their key only, totalCount() locks
+   * nothing and is approximately consistent during updates, and snapshot()
+   * copies the shards, one at a time, into a plain CounterMap.
+   *
+   * @param K Key type for the Counter mapping.
+   * @param V Value type for the mapped Counter objects.
+   * @param Hash Hash function for K, used to choose the shards.
+   */
+  template <typename K, typename V, typename Hash = boost::hash<K> >
+  class ConcurrentCounterMap
+  {
+  public:
+    /*! @brief The map type of the shards and of snapshots. */
+    typedef CounterMap<K, V> CounterMap_t;
+    typedef typename CounterMap_t::Count_t Count_t;
+    typedef typename CounterMap_t::Size_t Size_t;
+
+    /*!  @name Constructors
+     *   @{
+     */
+    /*!
+     * @brief Constructs an empty map.
+     * @param shards Number of shards (at least 1); a few times the number of
+     * updating threads keeps the contention low.
+     * @param counterFactory The factory which creates the rows of the shards
+     * and of the snapshots; it is shared by all of them, and so must be safe
+     * to use from several threads. A factory which owns the memory of its
+     * Counters (see CounterFactory::ownsCounterMemory(), e.g.
+     * ArenaCounterFactory, whose Arena is not thread-safe) is replaced by a
+     * DefaultCounterFactory.
+     */
+    explicit ConcurrentCounterMap( Size_t shards = 64,
+				   CounterFactory<V> const& counterFactory = DefaultCounterFactory<V>() );
+    ~ConcurrentCounterMap();
+    /*!  @} */
+
+    /*!  @name Modifiers
+     *   Atomic with respect to the other methods for the same key.
+     *   @{
+     */
+    /*! @brief Increments the count of val under key by count. */
+    void incrementCount( K const& key, V const& val, Count_t count );
+    /*! @brief Sets the count of val under key. */
+    void setCount( K const& key, V const& val, Count_t count );
+    /*! @brief Removes the key and its Counter. */
+    void remove( K const& key );
+    /*! @brief Removes val from the Counter of the key. */
+    void remove( K const& key, V const& val );
+    /*! @} */
+
+    /*!  @name Lookup
+     *   @{
+     */
+    /*! @brief Checks whether the key has a Counter. */
+    bool contains( K const& key ) const;
+    /*! @brief Checks whether the Counter of the key contains val. */
+    bool contains( K const& key, V const& val ) const;
+    /*! @brief Returns the count of val under key, or 0. */
+    Count_t getCount( K const& key, V const& val ) const;
+    /*! @brief Returns the total count of the Counter of the key, or 0. */
+    Count_t totalCount( K const& key ) const;
+    /*! @brief Returns the sum of all the counts, without locking (see the
+     *  class description). */
+    Count_t totalCount(void) const;
+    /*! @brief Returns the number of keys; locks the shards one at a time. */
+    Size_t size(void) const;
+    /*! @brief Returns the number of shards. */
+    Size_t shards(void) const { return shardCount_; }
+    /*! @brief Copies the Counters into a CounterMap; locks the shards one at
+     *  a time. */
+    CounterMap_t snapshot(void) const;
+    /*! @} */
+
+  private:
+    ConcurrentCounterMap( ConcurrentCounterMap const& );
+    ConcurrentCounterMap& operator=( ConcurrentCounterMap const& );
+
+    // See ConcurrentCounter::Shard.
+    struct Shard
+    {
+      mutable std::mutex mutex;
+      CounterMap_t counterMap;
+      std::atomic<Count_t> total;
+      char padding[64];
+
+      Shard() : total(0) {}
+      void add( Count_t delta )
+      { total.store( total.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed ); }
+    };
+
+    Shard& shardOf( K const& key ) const;
+
+    std::shared_ptr<CounterFactory<V> const> counterFactory_;
+    Size_t shardCount_;
+    std::unique_ptr<Shard[]> shards_;
+    Hash hash_;
+  };
+
+};
+
+#include "Counters/details/_ConcurrentCounterMap.IMPL.hpp"
+
+#endif // __CONCURRENT_COUNTER_MAP_H__
@@ -0,0 +1,236 @@
+/*! @file CountMinSketch.hpp
+  @brief A fixed-size sketch for approximate counting of any number of keys.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __COUNT_MIN_SKETCH_H__
+#define __COUNT_MIN_SKETCH_H__
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/optional.hpp>
+
+namespace Counters
+{
+  /*!
+   * @brief A Count-Min sketch (Cormode and Muthukrishnan, 2005): a table of
+   * depth() rows of width() counts, where each key is hashed to one cell per
+   * row. Adding to the count of a key adds to each of its cells, and the
+   * estimated count of a key is the smallest of its cells. The memory used is
+   * fixed by the width and the depth, however many distinct keys are counted.
+   *
+   * For a stream of non-negative increments with the total N, the estimate of
+   * every key:
+   * - never underestimates its true count;
+   * - overestimates it by at most epsilon() * N = e / width() * N with a
+   *   probability of at least 1 - delta() = 1 - exp(-depth()).
+   * E.g. a width of 2719 and a depth of 5 bound the error by 0.1% of N with a
+   * probability of 99.3%, in 13595 counts. With conservative update, an
+   * increment only raises the cells of the key to its new estimate, which
+   * keeps both bounds and makes the estimates tighter in practice. Negative
+   * increments and erasing keys (which subtracts their estimates) are
+   * supported, but void the bounds: they may cause underestimates.
+   *
+   * The sketch is a backend for Counter (see CountMinCounterFactory) and
+   * implements the map interface used by MapTypeErasure::AnyMap, but it
+   * stores no keys:
+   * - iteration visits no elements, size() is 0 and empty() is true;
+   * - find() (and count()) report keys with a non-zero estimate;
+   * - lookups return an iterator to an element held by the sketch, which
+   *   carries the key and its estimate. Changes to its mapped value are added
+   *   to the cells of the key on the next call to the sketch, which also
+   *   invalidates the iterator; Counter only writes through such iterators
+   *   right after the lookup;
+   * - sum_mapped(), scale_mapped(), add_mapped() and equal_mapped() give
+   *   Counter the total count, scaling, merging (operator+=()) and comparison
+   *   (operator==() and equals()) of sketches natively. Only sketches with the
+   *   same width, depth and seed can be added, or be equal; a sketch never
+   *   equals a map of another type.
+   *
+   * @param K Key type.
+   * @param V Mapped (count) type; must support +, -, *, < and conversion
+   * from 0.
+   * @param Hash Hash function for K.
+   */
+  template <typename K, typename V, typename Hash = boost::hash<K> >
+  class CountMinSketch
+  {
+  public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K const, V> value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Hash hasher;
+    typedef value_type& reference;
+    typedef value_type const& const_reference;
+    typedef value_type* iterator;
+    typedef value_type const* const_iterator;
+
+    /*!  @name Constructors, Assignment, and Swap
+     *   @{
+     */
+    /*!
+     * @brief Constructs a sketch of zero counts.
+     * @param width Number of cells per row (at least 1); bounds the error.
+     * @param depth Number of rows (at least 1); bounds the probability of
+     * exceeding the error bound.
+     * @param conservative Whether to use conservative update.
+     * @param seed Seed of the cell hashes; sketches are only mergeable if
+     * their seeds are equal.
+     */
+    explicit CountMinSketch( size_type width = 2719, size_type depth = 5,
+			     bool conservative = false, std::size_t seed = 0 );
+    /*! @brief Copies the counts and the parameters. */
+    CountMinSketch( CountMinSketch const& other );
+    /*! @brief Steals the counts of other. */
+    CountMinSketch( CountMinSketch && other );
+    /*! @brief Copies the counts and the parameters. */
+    CountMinSketch& operator=( CountMinSketch const& other );
+    /*! @brief Steals the counts of other. */
+    CountMinSketch& operator=( CountMinSketch && other );
+    /*! @brief Swaps contents with another sketch in constant time. */
+    void swap( CountMinSketch& other );
+    /*!  @} */
+
+    /*!  @name Size and Parameters
+     *   @{
+     */
+    /*! @brief TRUE: the sketch stores no keys. */
+    bool empty() const { return true; }
+    /*! @brief 0: the sketch stores no keys. */
+    size_type size() const { return 0; }
+    /*! @brief The greatest number of distinct keys, which is unbounded. */
+    size_type max_size() const;
+    size_type width() const { return width_; }
+    size_type depth() const { return depth_; }
+    bool conservative() const { return conservative_; }
+    std::size_t seed() const { return seed_; }
+    /*! @brief The error bound relative to the total count, e / width(). */
+    double epsilon() const;
+    /*! @brief The probability of exceeding the error bound, exp(-depth()). */
+    double delta() const;
+    /*! @brief The bytes allocated by the sketch (its cells). */
+    size_type memory_usage() const { return cells_.capacity() * sizeof(V); }
+    /*!  @} */
+
+    /*!  @name Lookup
+     *   @{
+     */
+    /*! @brief Returns the estimate of k, which may be modified. */
+    V& operator[]( K const& k ) { return try_emplace(k).first->second; }
+    /*! @brief Returns the estimate of k; throws std::out_of_range if it is 0. */
+    V const& at( K const& k ) const;
+    /*! @overload at( K const& k ) const */
+    V& at( K const& k ) { return const_cast<V&>( static_cast<CountMinSketch const&>(*this).at(k) ); }
+    /*! @brief Returns an iterator to k and its estimate, or end() if the
+     *  estimate is 0. */
+    iterator find( K const& k ) { return const_cast<iterator>( static_cast<CountMinSketch const&>(*this).find(k) ); }
+    /*! @overload find( K const& k ) */
+    const_iterator find( K const& k ) const;
+    /*! @brief 1 if the estimate of k is not 0, 0 otherwise. */
+    size_type count( K const& k ) const { return estimate(k) == V(0) ? 0 : 1; }
+    /*! @brief The estimated count of k. */
+    V estimate( K const& k ) const;
+    /*!  @} */
+
+    /*!  @name Iterators
+     *   The range is always empty.
+     *   @{
+     */
+    iterator       begin()       { return NULL; }
+    const_iterator begin() const { return NULL; }
+    iterator         end()       { return NULL; }
+    const_iterator   end() const { return NULL; }
+    /*!  @} */
+
+    /*!  @name Modifiers
+     *   The inserting modifiers add the mapped value to the count of a key
+     *   with an estimate of 0; they do nothing for the other keys.
+     *   @{
+     */
+    std::pair<iterator, bool> insert( value_type const& val )
+    { return try_emplace( val.first, val.second ); }
+    template <typename InputIterator>
+    void insert( InputIterator first, InputIterator last );
+    template <typename KeyArg, typename MappedArg>
+    std::pair<iterator, bool> emplace( KeyArg && k, MappedArg && v )
+    { return try_emplace( K(std::forward<KeyArg>(k)), std::forward<MappedArg>(v) ); }
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace( K const& k, Args&&... args );
+    /*! @brief Adds count to the count of k. */
+    void add( K const& k, V const& count );
+    /*! @brief Subtracts the estimate of k from its cells.
+     *  @return 1 if the estimate was not 0, 0 otherwise. */
+    size_type erase( K const& k );
+    /*! @brief Sets all counts to 0. */
+    void clear();
+    /*!  @} */
+
+    /*!  @name Native Bulk Arithmetic
+     *   See MapTypeErasure::AnyMap::sum_mapped().
+     *   @{
+     */
+    /*! @brief The total of the increments (not of the estimates). */
+    V sum_mapped() const;
+    /*! @brief Multiplies all counts by n. */
+    void scale_mapped( V const& n );
+    /*! @brief Adds factor times the counts of other, if it has the same width,
+     *  depth and seed.
+     *  @return TRUE if the sketches were added. */
+    bool add_mapped( CountMinSketch const& other, V const& factor );
+    /*! @brief Whether other has the same width, depth and seed, and each of
+     *  its cells, and its total, differ from those of this sketch by less
+     *  than precision (or are equal if precision is 0). */
+    bool equal_mapped( CountMinSketch const& other, V const& precision ) const;
+    /*!  @} */
+
+  private:
+    // Two hashes of a key; the cell of the key in row r is (first + r *
+    // second) modulo width_ (Kirsch and Mitzenmacher's double hashing).
+    typedef std::pair<boost::uint64_t, boost::uint64_t> Probe_t;
+    Probe_t probe( K const& k ) const;
+    size_type cell( Probe_t const& p, size_type row ) const
+    { return row * width_ + (p.first + row * p.second) % width_; }
+    V estimate( Probe_t const& p ) const;
+    void addCells( Probe_t const& p, V const& count ) const;
+    static bool within( V const& a, V const& b, V const& precision )
+    { return V(0) < precision ? (a < b ? b - a : a - b) < precision : !(a < b) && !(b < a); }
+    // Adds the pending change of the element returned by the last lookup.
+    void commit() const;
+    // Makes the element returned by lookups hold k and its estimate.
+    value_type* issue( K const& k, V const& estimate ) const;
+    // Drops the element returned by lookups without committing it.
+    void discard() const;
+
+    size_type width_;
+    size_type depth_;
+    bool conservative_;
+    std::size_t seed_;
+    hasher hash_;
+    // depth_ rows of width_ cells each
+    mutable std::vector<V> cells_;
+    mutable V total_;
+    // The element returned by lookups lives in one of the two slots, so that
+    // the next one can be constructed from a key referring to it.
+    mutable boost::optional<value_type> slots_[2];
+    mutable int slot_;
+    // The estimate of the key when the element was issued.
+    mutable V issued_;
+  };
+
+  /*! @brief Swaps the contents of the sketches. */
+  template <typename K, typename V, typename Hash>
+  void swap( CountMinSketch<K, V, Hash>& a, CountMinSketch<K, V, Hash>& b )
+  { a.swap(b); }
+
+};
+
+#include "Counters/details/_CountMinSketch.IMPL.hpp"
+
+#endif // __COUNT_MIN_SKETCH_H__
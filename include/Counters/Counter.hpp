@@ -11,10 +11,17 @@
 #include <ostream>
 #include <limits>
 #include <cmath>
+#include <memory>
 #include <utility>
+#include <type_traits>
+#include <vector>
 
 #include "AnyMap/AnyMap.hpp"
+#include "AnyMap/StaticMap.hpp"
 #include "Counters/NumCache.hpp"
+#include "Counters/ArgMaxCache.hpp"
+#include "Counters/CounterExpression.hpp"
+#include "Counters/Kernels.hpp"
 
 
 namespace Counters
@@ -24,11 +31,11 @@ namespace Counters
   typedef double CountersCount_t;
 #endif //COUNT_T_DEF
   
-  template <typename V>
+  template <typename V, typename CoreMap = MapTypeErasure::AnyMap<V, CountersCount_t> >
   class Counter;
 
-  template <typename V>
-  std::ostream& operator<<(std::ostream&, const Counter<V>&);
+  template <typename V, typename CoreMap>
+  std::ostream& operator<<(std::ostream&, const Counter<V, CoreMap>&);
 
   /*!
    * @brief A counter with templated key types intended for use as a probability 
@@ -57,9 +64,39 @@ namespace Counters
    *
    * For cache details, see NumCache.
    *
+   * Scaling (operator*=(), operator/=() and therefore normalize()) takes
+   * constant time: the counter keeps a multiplicative scale which is applied
+   * to the stored counts when they are read through getCount(), totalCount(),
+   * and the other lookups. The scale is folded into the stored counts (one
+   * pass over the counter) before iteration with begin(), before operations
+   * which combine this counter with another (operator+=(), operator==(), ...),
+   * and when the scale becomes too large or too small to be applied safely.
+   * Folding changes the stored counts but not the counts reported by the
+   * counter, so it is done from const methods as well.
+   *
+   * Maps which do not store a count per value, such as CountMinSketch (see
+   * CountMinCounterFactory), provide the total, the scaling and the addition
+   * of two such maps natively (see AnyMap's native bulk arithmetic); the
+   * counter uses these instead of iterating over the map when they are
+   * available. Counters whose maps have the same type are added with a
+   * single pass over both maps, a merge if they are ordered.
+   *
+   * A Counter is not safe for concurrent use, even through const methods,
+   * which update the caches and fold the scale; see ConcurrentCounter.
+   *
+   * The map is an AnyMap by default, so that the map type can be chosen at
+   * run time (e.g. by a CounterFactory). Where it is known at compile time,
+   * CoreMap can instead be a MapTypeErasure::StaticMap (see StaticCounter),
+   * which holds the map directly: the lookups and updates then make no
+   * virtual calls and allocate no iterators. Counters with different
+   * CoreMaps convert to each other explicitly (see the converting
+   * constructor).
+   *
    * @param V Value type whose counts are stored.
+   * @param CoreMap Type of the map holding the counts: an AnyMap<V, Count_t>
+   * or a MapTypeErasure::StaticMap of a map from V to Count_t.
    */
-  template<typename V>
+  template<typename V, typename CoreMap>
   class Counter
   {
   public:
@@ -69,7 +106,7 @@ namespace Counters
     /*! @brief Type used for stored counts (currently double). */
     typedef CountersCount_t Count_t;
     /*! @brief Type of map used to maintain value-count associations. */
-    typedef MapTypeErasure::AnyMap<V, Count_t> CoreMap_t;
+    typedef CoreMap CoreMap_t;
     /*! @brief The type to which the iterators dereference (should be 
      *  std::pair<V, double>). */
     typedef typename CoreMap_t::value_type IteratorValue_t;
@@ -77,6 +114,12 @@ namespace Counters
     typedef typename CoreMap_t::const_iterator ConstIterator;
     /*! @brief Unsigned integer type that can represent any non-negative value.*/
     typedef typename CoreMap_t::size_type Size_t;
+    /*! @brief A value and its count as returned by topK(). */
+    typedef std::pair<V, Count_t> ValueCount_t;
+    /*! @brief The lazy product of a counter and a number (see operator*()). */
+    typedef ScaledCounter<Counter> Scaled_t;
+    /*! @brief The lazy sum of two counters (see operator+()). */
+    typedef CounterSum<Scaled_t, Scaled_t> Sum_t;
 
     /*! @name Constructors, Destructor, Assignment, and Swap
      *  @{
@@ -90,6 +133,18 @@ namespace Counters
 
     /*! @brief Constructs the Counter with the given map, copying or moving it.*/
     explicit Counter( CoreMap_t coreMap );
+    /*!
+     * @brief Copies a Counter with another type of map, including its cache.
+     *
+     * A StaticMap converts to an AnyMap by copying the underlying map as a
+     * whole, which keeps its type; other maps are copied element by element
+     * into a default-constructed CoreMap_t.
+     */
+    template <typename OtherMap>
+    explicit Counter( Counter<V, OtherMap> const& other );
+    /*! @brief Evaluates the expression (see operator+()). */
+    template <typename E>
+    Counter( CounterExpression<E, Counter> const& e );
     /*!
      * @brief Increments all the elements in the range by the given count.
      *
@@ -108,7 +163,8 @@ namespace Counters
 
     /*!
      * @brief Standard Assignment. Copies the values and their associated counts
-     * as well as the cache.
+     * as well as the cache. The delta tracking of this counter is kept (see
+     * setDeltaTracking()), the assignment being logged as a modification.
      * @param rhs Original counter to be copied.
      * @return This counter.
      */
@@ -116,12 +172,21 @@ namespace Counters
 
     /*!
      * @brief Move Assignment. Steals the resources from a temporary Counter rhs 
-     * equating this Counter to it.
+     * equating this Counter to it. Both keep their delta tracking, as in
+     * operator=(Counter const&).
      * @param rhs Oirignal counter to be equated to.
      * @return This counter.
      */
     Counter& operator=( Counter && rhs );
 
+    /*!
+     * @brief Evaluates the expression into this counter (see operator+()).
+     * @param e Expression of counters, which may include this one.
+     * @return This counter.
+     */
+    template <typename E>
+    Counter& operator=( CounterExpression<E, Counter> const& e );
+
     /*!
      * @brief Swaps contents with another Counter in constant time (assuming
      * constant time swap of the underlying maps.
@@ -151,6 +216,17 @@ namespace Counters
      * @param count Count by which the count under val is incremented.
      */
     void incrementCount( V && val, Count_t count );
+
+    /*!
+     * @brief Heterogeneous incrementCount(): val is any value which can be
+     * looked up in the underlying map without constructing a V (see
+     * MapTypeErasure::KeyView). A V is only constructed if val is new.
+     * @param val Value whose count is incremented.
+     * @param count Count by which the count under val is incremented.
+     */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value>::type
+    incrementCount( ValueLike const& val, Count_t count );
     
     /*!
      * @brief Increments all values in the range by the given count.
@@ -166,6 +242,18 @@ namespace Counters
     template <typename InputIterator>
     void incrementAll( InputIterator first, InputIterator last, Count_t count );
 
+    /*!
+     * @brief Increments the count of each value of the batch by its count,
+     * as incrementCount() does for each item in order.
+     *
+     * The batch crosses the type erasure of the underlying map once per
+     * block of values (see MapTypeErasure::AnyMap::add_many()) instead of
+     * once per value, and the caches are updated once per block.
+     * @param items The values and the counts by which they are incremented.
+     * @param n The number of items.
+     */
+    void incrementMany( std::pair<V, Count_t> const* items, std::size_t n );
+
     /*!
      * @brief Set the count associated with the given key to the given value.  If
      * the key is not in the counter, it is added.
@@ -182,6 +270,15 @@ namespace Counters
      */
     void setCount( V && val, Count_t count );
 
+    /*!
+     * @brief Heterogeneous setCount(). See incrementCount(ValueLike const&, Count_t).
+     * @param val Value whose count is set.
+     * @param count Value to which the count under 'val' is set.
+     */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value>::type
+    setCount( ValueLike const& val, Count_t count );
+
     /*!
      * @brief Scales the counts stored in the counter so that they add up to 1.
      *
@@ -196,6 +293,38 @@ namespace Counters
      * @param val Value to be removed along with its count.
      */
     void remove( V const& val );
+
+    /*!
+     * @brief Removes the values whose counts are less than the threshold.
+     *
+     * The values are removed in a single pass of the underlying map (see
+     * MapTypeErasure::AnyMap::erase_if()) rather than one remove() at a time.
+     * The total cache stays synchronized; the max cache stays synchronized
+     * under the persistent policy, since the greatest count is not removed.
+     * @param threshold The smallest count kept.
+     * @return The number of values removed.
+     */
+    Size_t prune( Count_t threshold );
+
+    /*!
+     * @brief Keeps only the k values with the greatest counts.
+     *
+     * Selects the k-th greatest count in O(size()) time and additional
+     * memory and removes the smaller counts in a single pass of the
+     * underlying map, as prune() does. Values whose counts tie with the k-th
+     * greatest one are kept or removed arbitrarily, as in topK().
+     * @param k The number of values kept.
+     * @return The number of values removed.
+     */
+    Size_t pruneToTopK( Size_t k );
+
+    /*!
+     * @brief Removes all the values; the underlying map, the cache policy
+     * and the delta tracking are kept, and a tracking counter logs the
+     * removals of the values its map visits (none for a CountMinSketch,
+     * which is emptied all the same).
+     */
+    void clear(void);
     /*! @} */
     
     /*!  @name Size and Capacity
@@ -216,6 +345,24 @@ namespace Counters
      * @return The maxiumum number of values the underlying map can store.
      */
     Size_t maxSize(void) const;
+    /*!
+     * @brief Prepares the underlying map to hold n values without rehashing.
+     * Has no effect on maps without reserve() (e.g. std::map).
+     * @param n The number of values the counter is expected to hold.
+     */
+    void reserve(Size_t n);
+    /*!
+     * @brief Releases the capacity of the underlying map which is not needed
+     * for the values currently stored. See AnyMap::shrink_to_fit().
+     */
+    void shrinkToFit(void);
+    /*!
+     * @brief Returns the bytes used by the counter: the counter itself and
+     * the memory of the underlying map (see
+     * MapTypeErasure::AnyMap::memory_usage(), estimated for maps without a
+     * memory_usage() of their own), and the delta log if tracking.
+     */
+    std::size_t memoryUsage(void) const;
     /*! @} */
     
     /*!  @name Lookup
@@ -227,6 +374,16 @@ namespace Counters
      */
     bool contains( V const& val ) const;
 
+    /*!
+     * @brief Heterogeneous contains(): checks for val without constructing a
+     * V. See MapTypeErasure::KeyView.
+     * @param val Value whose existence in the counter is checked.
+     * @return TRUE if value is already in the counter, FALSE otherwise.
+     */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, bool>::type
+    contains( ValueLike const& val ) const;
+
     /*!
      * @brief Returns the count associated with the given value. If the value is 
      * not contained in the counter, returns 0.
@@ -235,6 +392,25 @@ namespace Counters
      */
     Count_t getCount( V const& val ) const;
 
+    /*!
+     * @brief Heterogeneous getCount(): looks val up without constructing a V.
+     * See MapTypeErasure::KeyView.
+     * @param val Value whose associated count is requested.
+     * @return The count associated with 'val' or 0.
+     */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, Count_t>::type
+    getCount( ValueLike const& val ) const;
+
+    /*!
+     * @brief Looks the values up in batch: sets out[i] to getCount(vals[i])
+     * for each i in [0, n). See incrementMany().
+     * @param vals The values whose counts are requested.
+     * @param n The number of values.
+     * @param out The n counts.
+     */
+    void getMany( V const* vals, std::size_t n, Count_t* out ) const;
+
     /*!
      * @brief Returns the sum of all the counts stored in the counter.
      *
@@ -250,9 +426,27 @@ namespace Counters
     /*!
      * @brief Returns the value associated with the greatest count in the
      * counter.
-     * @return The key whose associated count is the greatest in the counter.
+     *
+     * The value is cached: repeated calls take constant time until the counts
+     * change. How modifications affect the cache depends on the max caching
+     * policy (see setMaxCachePolicy()). If several values share the greatest
+     * count, any one of them may be returned.
+     * @return The key whose associated count is the greatest in the counter,
+     * or V() if the counter is empty.
      */
     V maxValue(void) const;
+
+    /*!
+     * @brief Returns the k values with the greatest counts.
+     *
+     * Selects the values in one pass of internal iteration with a bounded
+     * heap, in O(size() log k) time and O(k) additional memory, without
+     * copying or sorting the whole counter. Ties are broken arbitrarily.
+     * @param k The number of values requested.
+     * @return The min(k, size()) values with the greatest counts and their
+     * counts, in the order of decreasing counts.
+     */
+    std::vector<ValueCount_t> topK( Size_t k ) const;
     /*! @} */
     
     /*!  @name Traversal
@@ -260,7 +454,8 @@ namespace Counters
     /*!
      * @brief Returns the iterator over the counter which points to the first 
      * value in this counter (or an iterator equaling that returned by 'end()' 
-     * if the counter is empty.
+     * if the counter is empty. Folds a pending scale into the stored counts
+     * (see the class description).
      * @return An iterator over the values of the counter.
      */
     ConstIterator begin(void) const;
@@ -269,6 +464,30 @@ namespace Counters
      * @return An iterator just past the last value in the counter.
      */
     ConstIterator end(void) const;
+
+    /*!
+     * @brief Calls f(val, count) for each value and its count, with the
+     * internal iteration of the underlying map (a single virtual call, see
+     * MapTypeErasure::AnyMap::for_each()). Unlike begin(), does not fold
+     * the scale of the counts into the map.
+     */
+    template <typename F>
+    void forEach( F f ) const;
+
+    /*!
+     * @brief Calls f(count, otherCount) with the counts of each value of
+     * the smaller of this counter and o in both counters (0 where a counter
+     * does not have the value). Each value is visited once.
+     *
+     * Counters whose maps are both sorted (see
+     * MapTypeErasure::AnyMap::is_sorted()) are merged when the merge costs
+     * less than the lookups; otherwise the values of the smaller counter are
+     * looked up in the larger one in batches (see getMany()). This is the
+     * traversal of the vector operations of Counters.hpp (dot(), cosine(),
+     * ...).
+     */
+    template <typename OtherMap, typename F>
+    void forEachJoint( Counter<V, OtherMap> const& o, F f ) const;
     /*! @} */
 
     /*!  @name Equality
@@ -276,7 +495,9 @@ namespace Counters
     /*!
      * @brief Compares counters based on the values and their associated counts.
      * Uses equality operator to compare counts - see equals() for approximate
-     * equality.
+     * equality. Maps which do not visit their counts, such as CountMinSketch,
+     * are compared natively: two sketches by their cells, and a sketch never
+     * equals a counter with another type of map.
      * @param o Other counter to be compared.
      * @return TRUE if the counters contain the same set of values with the same
      * associated counts, FALSE otherwise.
@@ -321,9 +542,102 @@ namespace Counters
      */
     NumCachePolicy getCachePolicy(void) const;
     /*!
-     * @brief Sets the cache to "unsynchronized". Does not affect the policy.
+     * @brief Sets the caches (of the total and of maxValue()) to
+     * "unsynchronized". Does not affect the policies.
      */
     void resetCache(void) const;
+    /*!
+     * @brief Sets the summation algorithm of totalCount() (naive by default,
+     * which uses the native sum of the map if it has one, see
+     * MapTypeErasure::AnyMap::sum_mapped()), and resets the cache of the
+     * total. The algorithm applies when the total is computed from the
+     * counts, not to the updates of a synchronized cache.
+     */
+    void setSummationPolicy(SummationPolicy summation) const;
+    /*! @brief Reports the summation algorithm of totalCount(). */
+    SummationPolicy getSummationPolicy(void) const;
+    /*!
+     * @brief Sets the caching policy of maxValue().
+     *
+     * With Counters::CACHE_POLICY_RELAXED (the default), any modification of
+     * the counts desynchronizes the cache, and the next maxValue() scans the
+     * counter. With Counters::CACHE_POLICY_PERSISTENT, incrementCount() and
+     * setCount() keep the cache synchronized unless they decrease the greatest
+     * count, and remove() unless it removes the value with the greatest count.
+     * Scaling by a positive number and adding a number to all counts keep it
+     * synchronized under either policy. See ArgMaxCache.
+     * @param cachePolicy Mode to which caching policy is set:
+     * Counters::CACHE_POLICY_PERSISTENT or Counters::CACHE_POLICY_RELAXED.
+     */
+    void setMaxCachePolicy(NumCachePolicy cachePolicy) const;
+    /*!
+     * @brief Reports current caching policy of maxValue().
+     * @return Counters::CACHE_POLICY_PERSISTENT or
+     * Counters::CACHE_POLICY_RELAXED.
+     */
+    NumCachePolicy getMaxCachePolicy(void) const;
+    /*!  @} */
+
+    /*! @name Instrumentation
+     *  @{ */
+    /*!
+     * @brief Returns how often totalCount() found its cache synched (hits)
+     * or rescanned the counts (misses), and how often modifications
+     * desynchronized the cache. Recorded only if COUNTERS_CACHE_STATS is
+     * defined (see NumCacheStats).
+     */
+    NumCacheStats getTotalCacheStats(void) const;
+    /*!
+     * @brief Turns the instrumentation of the map of the counts on or off
+     * (see MapTypeErasure::AnyMap::set_instrumented()).
+     * @return FALSE if the CoreMap is not an AnyMap.
+     */
+    bool setMapInstrumented(bool on);
+    /*!
+     * @brief Sets stats to the statistics of the map of the counts (see
+     * MapTypeErasure::MapStats).
+     * @return FALSE if the map is not instrumented.
+     */
+    bool getMapStats(MapTypeErasure::MapStats& stats) const;
+    /*!  @} */
+
+    /*! @name Delta Tracking
+     *  A tracking counter keeps a log of the changes of its counts since the
+     *  last checkpoint: a counter of the amount by which each value touched
+     *  since then has changed. Nodes which count separately can then send
+     *  their deltas (see writeDelta()) to an aggregator instead of their
+     *  whole counters, and the aggregator merges them with applyDelta() in
+     *  time proportional to their sizes.
+     *
+     *  Every modifier is logged. The modifiers of single values and of
+     *  other counters (operator+=(), prune(), ...) log the values they
+     *  change; those which change every count (scaling, normalize() and
+     *  adding a number to all counts) log the whole counter, as do the
+     *  assignments, which keep the tracking of the assigned counter. The log
+     *  is copied and moved by the constructors, and swapped with the counts.
+     *  @{ */
+    /*!
+     * @brief Turns delta tracking on, the first checkpoint being the current
+     * counts, or off, dropping the log. Turning it on again has no effect.
+     */
+    void setDeltaTracking(bool on);
+    /*! @brief TRUE if the counter keeps a log of its changes. */
+    bool isDeltaTracking(void) const { return deltaLog_ != NULL; }
+    /*!
+     * @brief Returns the changes since the last checkpoint and starts a new
+     * checkpoint at the current counts.
+     * @return The amount by which the count of each changed value has
+     * changed; values whose changes cancelled out are left out. Empty if the
+     * counter is not tracking.
+     */
+    Counter extractDelta(void);
+    /*!
+     * @brief Adds the changes of another counter (see extractDelta()),
+     * removing the values whose counts they bring to 0.
+     * @param delta The changes to be added.
+     * @return This counter.
+     */
+    Counter& applyDelta(Counter const& delta);
     /*!  @} */
 
     //---------------- Arithmetic Operators ---------------------
@@ -374,21 +688,32 @@ namespace Counters
     Counter& operator/=(Count_t count);
 
     /*!
-     * @brief Adds all counts of the two counters in a new counter.
+     * @brief Adds all counts of the two counters.
+     *
+     * The result is a lazy expression (see CounterExpression), evaluated when
+     * it is converted to a Counter or added to one; the lazy operators of
+     * two counters and of a counter and a number (+, -, * and /) combine
+     * into larger expressions, which are evaluated without temporary
+     * counters. The operators of temporary counters instead reuse and return
+     * them.
      * @param o Other counter to be added with this counter.
-     * @return New counter whose counts are the sums of the counts under the same
-     * key in the two counters.
+     * @return Expression whose counts are the sums of the counts under the
+     * same key in the two counters.
      */
-    Counter operator+(const Counter& o) const;
+    Sum_t operator+(const Counter& o) const &;
+    /*! @overload operator+(const Counter& o) const & */
+    Counter operator+(const Counter& o) &&;
 
     /*!
-     * @brief Produces a new counter whose each count under a key 'k' is the 
-     * difference (this->getCount(k) - o.getCount(k)).
+     * @brief Produces the differences (this->getCount(k) - o.getCount(k)) of
+     * the counts of the two counters, lazily (see operator+()).
      * @param o Other counter to be subtracted from this counter.
-     * @return New counter whose counts are the differences of the counts under
-     * the same keys in the two counters.
+     * @return Expression whose counts are the differences of the counts
+     * under the same keys in the two counters.
      */
-    Counter operator-(const Counter& o) const;
+    Sum_t operator-(const Counter& o) const &;
+    /*! @overload operator-(const Counter& o) const & */
+    Counter operator-(const Counter& o) &&;
 
     /*!
      * @brief Produces a new counter by increasing each count of this counter by
@@ -397,7 +722,9 @@ namespace Counters
      * @return The new counter whose each count is 'val' greater than the 
      * corresponding count in this counter.
      */
-    Counter operator+(Count_t count) const;
+    Counter operator+(Count_t count) const &;
+    /*! @overload operator+(Count_t count) const & */
+    Counter operator+(Count_t count) &&;
 
     /*!
      * @brief Produces a new counter by decreasing each count of this counter by
@@ -406,34 +733,105 @@ namespace Counters
      * @return The new counter whose each count is 'val' less than the 
      * corresponding count in this counter.
      */
-    Counter operator-(Count_t count) const;
+    Counter operator-(Count_t count) const &;
+    /*! @overload operator-(Count_t count) const & */
+    Counter operator-(Count_t count) &&;
 
     /*!
-     * @brief Produces a new counter by multiplying each count of this counter by
-     * 'val'.
+     * @brief Multiplies each count of this counter by 'val', lazily (see
+     * operator+()).
      * @param count The value by which each count is multiplied.
-     * @return The new counter whose each count is 'val' times greater than the
+     * @return Expression whose each count is 'val' times greater than the
      * corresponding count in this counter.
      */
-    Counter operator*(Count_t count) const;
+    Scaled_t operator*(Count_t count) const &;
+    /*! @overload operator*(Count_t count) const & */
+    Counter operator*(Count_t count) &&;
 
     /*!
-     * @brief Produces a new counter by dividing each count of this counter by 
-     * 'val'.
+     * @brief Divides each count of this counter by 'val', lazily (see
+     * operator+()).
      * @param count The value by which each count is divided.
-     * @return The new counter whose each count is 'val' times less than the
+     * @return Expression whose each count is 'val' times less than the
      * corresponding count in this counter.
      */
-    Counter operator/(Count_t count) const;
+    Scaled_t operator/(Count_t count) const &;
+    /*! @overload operator/(Count_t count) const & */
+    Counter operator/(Count_t count) &&;
+
+    /*! @brief Adds the result of the expression to this counter, one counter
+     *  of the expression at a time (see operator+()).
+     *  @return This counter. */
+    template <typename E>
+    Counter& operator+=(const CounterExpression<E, Counter>& e);
+
+    /*! @brief Subtracts the result of the expression from this counter (see
+     *  operator+=(const CounterExpression<E, Counter>&)).
+     *  @return This counter. */
+    template <typename E>
+    Counter& operator-=(const CounterExpression<E, Counter>& e);
     /*! @} */
 
   private:
+    // Multiplies the stored counts by scale_ and resets it to 1.
+    void applyScale(void) const;
+    // Adds factor times the counts of o (operator+=(), operator-=() and the
+    // counter expressions).
+    Counter& addCounter(const Counter& o, Count_t factor);
+    template <typename> friend class ScaledCounter;
+
+    // Copies the map of a Counter with another CoreMap (see the converting
+    // constructor).
+    template <typename M>
+    static CoreMap_t convertMap( MapTypeErasure::StaticMap<M> const& m, std::true_type )
+    { return CoreMap_t( m.map() ); }
+    template <typename OtherMap>
+    static CoreMap_t convertMap( OtherMap const& m, std::false_type );
+
+    template <typename, typename> friend class Counter;
+    template <typename, typename, typename, typename> friend class CounterMap;
+
+    // The batches are passed to the underlying map in blocks of pointers to
+    // the values (so that CounterMap::incrementMany() can pass its items
+    // without copying them) of at most BATCH_BLOCK values.
+    enum { BATCH_BLOCK = 64 };
+    void incrementBlock( V const* const* vals, Count_t const* counts, std::size_t n );
+    void getBlock( V const* const* vals, std::size_t n, Count_t* out ) const;
+    // Erases the values whose counts c satisfy erase(c) with a single
+    // erase_if() and updates the caches; keepsMax tells whether the cached
+    // greatest count is certainly kept.
+    // Negated, the erased counts are added to log unless it is NULL.
+    template <typename Pred>
+    Size_t eraseCounts( Pred erase, bool keepsMax, Counter* log );
+    // prune() logging into log (see CounterMap::prune())
+    Size_t prune( Count_t threshold, Counter* log );
+    void logCount( V const& val, Count_t count )
+    { if( deltaLog_ ) deltaLog_->incrementCount( val, count ); }
+    // forEachJoint() strategies: f(count here, count in o)
+    template <typename OtherMap, typename F>
+    void mergeJoint( Counter<V, OtherMap> const& o, F& f ) const;
+    // f(count here, count in larger) for each value of this counter
+    template <typename OtherMap, typename F>
+    void probeJoint( Counter<V, OtherMap> const& larger, F f ) const;
+
+    // The stored counts times scale_ are the counts of the counter (see the
+    // class description); both are mutable so that const methods can fold
+    // the scale.
+    mutable CoreMap_t coreMap_;
+    mutable Count_t scale_;
+
+    // total cache (mutable so that the caching policy can be set on const
+    // counters):
+    typedef NumCache<Count_t> CountCache;
+    mutable CountCache cachedTotal_;
+    mutable SummationPolicy summation_;
 
-    CoreMap_t coreMap_;
+    // maxValue() cache:
+    typedef ArgMaxCache<V, Count_t> MaxCache;
+    mutable MaxCache cachedMax_;
 
-    // total cache:
-    typedef NumCache<Count_t> CountCache;
-    CountCache *cachedTotal_;
+    // The changes since the last checkpoint, NULL unless tracking.
+    std::unique_ptr<Counter> deltaLog_;
 
 #ifdef __COUNTER_DEBUG__
   public:
@@ -441,11 +839,50 @@ namespace Counters
   private:
 #endif
     bool isTotalSynched(void) const;
+    bool isMaxSynched(void) const;
+    Count_t getScale(void) const { return scale_; }
 
   private:
 
   };
 
+  /*! @name Counter Expression Operators
+   *  Lazy combinations of counters and expressions (see Counter::operator+()).
+   *  @{
+   */
+  template <typename V, typename M, typename E>
+  CounterSum<ScaledCounter< Counter<V, M> >, E>
+  operator+( Counter<V, M> const& a, CounterExpression<E, Counter<V, M> > const& b )
+  { return CounterSum<ScaledCounter< Counter<V, M> >, E>( a * 1, b.self() ); }
+
+  template <typename V, typename M, typename E>
+  CounterSum<E, ScaledCounter< Counter<V, M> > >
+  operator+( CounterExpression<E, Counter<V, M> > const& a, Counter<V, M> const& b )
+  { return CounterSum<E, ScaledCounter< Counter<V, M> > >( a.self(), b * 1 ); }
+
+  template <typename V, typename M, typename E>
+  CounterSum<ScaledCounter< Counter<V, M> >, E>
+  operator-( Counter<V, M> const& a, CounterExpression<E, Counter<V, M> > const& b )
+  { return CounterSum<ScaledCounter< Counter<V, M> >, E>( a * 1, b.self().scaled(-1) ); }
+
+  template <typename V, typename M, typename E>
+  CounterSum<E, ScaledCounter< Counter<V, M> > >
+  operator-( CounterExpression<E, Counter<V, M> > const& a, Counter<V, M> const& b )
+  { return CounterSum<E, ScaledCounter< Counter<V, M> > >( a.self(), b * -1 ); }
+
+  template <typename V, typename M>
+  ScaledCounter< Counter<V, M> > operator*( typename Counter<V, M>::Count_t count, Counter<V, M> const& a )
+  { return a * count; }
+  /*! @} */
+
+  /*!
+   * @brief A Counter which holds a map of type MapType directly (see
+   * MapTypeErasure::StaticMap), for code in which the map type is known at
+   * compile time.
+   */
+  template <typename V, typename MapType = boost::unordered_map<V, CountersCount_t> >
+  using StaticCounter = Counter< V, MapTypeErasure::StaticMap<MapType> >;
+
 };
 
 #include "Counters/details/_Counter.IMPL.hpp"
@@ -0,0 +1,142 @@
+/*! @file CounterExpression.hpp
+  @brief Lazy linear combinations of Counters, built by Counter's arithmetic
+  operators.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __COUNTER_EXPRESSION_H__
+#define __COUNTER_EXPRESSION_H__
+
+namespace Counters
+{
+  /*!
+   * @brief The base of the lazy Counter expressions E (which derive from it)
+   * evaluating to Counters of type C.
+   *
+   * Counter's operators +, - (of two Counters), * and / (by a number) return
+   * expressions rather than Counters, and the expressions combine: e.g.
+   * a*0.7 + b*0.2 + c*0.1 is a sum of three scaled Counters without any
+   * temporary Counter. The expression is evaluated when it is converted to a
+   * Counter (constructed from, or assigned to one), which copies the first
+   * Counter, applies its factor in constant time (see Counter's scaling),
+   * and adds the others to the copy, one pass each; or when it is added to
+   * (or subtracted from) a Counter, which adds each Counter of the
+   * expression to it in place.
+   *
+   * Expressions refer to the Counters they combine, so they must be
+   * evaluated before these are modified or destroyed; in particular, they
+   * should not be kept in variables declared with auto.
+   *
+   * An expression E provides:
+   * - C evaluate() const: a new Counter holding the result;
+   * - void addTo(C& dest, Count_t factor) const: adds factor times the
+   *   result to dest;
+   * - bool refersTo(C const* c) const: whether c is one of the operands;
+   * - E scaled(Count_t factor) const: the expression times factor.
+   */
+  template <typename E, typename C>
+  struct CounterExpression
+  {
+    /*! @brief The type of the Counter the expression evaluates to. */
+    typedef C Counter_t;
+    /*! @brief Type used for the counts. */
+    typedef typename C::Count_t Count_t;
+
+    /*! @brief The expression itself. */
+    E const& self(void) const { return static_cast<E const&>(*this); }
+  };
+
+  /*!
+   * @brief A Counter times a number, the operand of the other expressions.
+   */
+  template <typename C>
+  class ScaledCounter : public CounterExpression<ScaledCounter<C>, C>
+  {
+  public:
+    typedef typename C::Count_t Count_t;
+
+    ScaledCounter( C const& counter, Count_t factor ) : counter_(&counter), factor_(factor) {}
+
+    C evaluate(void) const
+    {
+      C result( *counter_ );
+      if( factor_ != 1 )
+	result *= factor_;
+      return result;
+    }
+
+    void addTo( C& dest, Count_t factor ) const { dest.addCounter( *counter_, factor * factor_ ); }
+    bool refersTo( C const* counter ) const { return counter_ == counter; }
+    ScaledCounter scaled( Count_t factor ) const { return ScaledCounter( *counter_, factor_ * factor ); }
+
+  private:
+    C const* counter_;
+    Count_t factor_;
+  };
+
+  /*!
+   * @brief The sum of two expressions (differences are sums with a scaled
+   * right operand).
+   */
+  template <typename L, typename R>
+  class CounterSum : public CounterExpression<CounterSum<L, R>, typename L::Counter_t>
+  {
+  public:
+    typedef typename L::Counter_t Counter_t;
+    typedef typename L::Count_t Count_t;
+
+    CounterSum( L const& left, R const& right ) : left_(left), right_(right) {}
+
+    Counter_t evaluate(void) const
+    {
+      Counter_t result( left_.evaluate() );
+      right_.addTo( result, 1 );
+      return result;
+    }
+
+    void addTo( Counter_t& dest, Count_t factor ) const
+    {
+      left_.addTo( dest, factor );
+      right_.addTo( dest, factor );
+    }
+
+    bool refersTo( Counter_t const* counter ) const
+    { return left_.refersTo(counter) || right_.refersTo(counter); }
+
+    CounterSum scaled( Count_t factor ) const
+    { return CounterSum( left_.scaled(factor), right_.scaled(factor) ); }
+
+  private:
+    L left_;
+    R right_;
+  };
+
+  /*! @name Operators of the Counter Expressions
+   *  See the corresponding operators of Counter.
+   *  @{
+   */
+  template <typename E1, typename E2, typename C>
+  CounterSum<E1, E2> operator+( CounterExpression<E1, C> const& a, CounterExpression<E2, C> const& b )
+  { return CounterSum<E1, E2>( a.self(), b.self() ); }
+
+  template <typename E1, typename E2, typename C>
+  CounterSum<E1, E2> operator-( CounterExpression<E1, C> const& a, CounterExpression<E2, C> const& b )
+  { return CounterSum<E1, E2>( a.self(), b.self().scaled(-1) ); }
+
+  template <typename E, typename C>
+  E operator*( CounterExpression<E, C> const& a, typename C::Count_t factor )
+  { return a.self().scaled( factor ); }
+
+  template <typename E, typename C>
+  E operator*( typename C::Count_t factor, CounterExpression<E, C> const& a )
+  { return a.self().scaled( factor ); }
+
+  template <typename E, typename C>
+  E operator/( CounterExpression<E, C> const& a, typename C::Count_t divisor )
+  { return a.self().scaled( 1.0 / divisor ); }
+  /*! @} */
+
+};
+
+#endif // __COUNTER_EXPRESSION_H__
@@ -8,59 +8,232 @@
 #define __COUNTER_FACTORIES_H__
 
 #include "Counters/Counter.hpp"
+#include "Counters/SpaceSavingMap.hpp"
+#include "Counters/CountMinSketch.hpp"
 #include "AnyMap/AnyMap.hpp"
+#include "AnyMap/Arena.hpp"
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <functional>
+#include <memory>
 
 namespace Counters
 {
 
-  /*! @brief A pure virtual type for creating Counters. */
-  template <typename V>
+  /*! @brief A pure virtual type for creating Counters (with maps of type
+   *  CoreMap, see Counter). */
+  template <typename V, typename CoreMap = MapTypeErasure::AnyMap<V, CountersCount_t> >
   struct CounterFactory
   {
+    virtual ~CounterFactory() {}
     /*! @brief Constructs and returns a Counter object. */
-    virtual Counter<V> createCounter(void) const = 0;
+    virtual Counter<V, CoreMap> createCounter(void) const = 0;
     /*! @brief Clones the factory. Caller responsible for deletion. */
-    virtual CounterFactory<V> *clone(void) const = 0;
+    virtual CounterFactory<V, CoreMap> *clone(void) const = 0;
+    /*! @brief Whether the created Counters use memory owned by the factory,
+     *  and so must not outlive it (see CounterMap::operator+=(CounterMap&&)). */
+    virtual bool ownsCounterMemory(void) const { return false; }
   };
 
   /*! @brief A factory type which creates default Counter objects. */
-  template <typename V>
-  struct DefaultCounterFactory : public CounterFactory<V>
+  template <typename V, typename CoreMap = MapTypeErasure::AnyMap<V, CountersCount_t> >
+  struct DefaultCounterFactory : public CounterFactory<V, CoreMap>
   {
-    Counter<V> createCounter(void) const {
-      return Counter<V>(); }
-    DefaultCounterFactory<V> *clone(void) const {
-      return new DefaultCounterFactory<V>(*this); }
+    /*! @brief Creates Counters reserved for reserveSize values (see
+     *  Counter::reserve()). */
+    explicit DefaultCounterFactory( typename Counter<V, CoreMap>::Size_t reserveSize = 0 )
+      : reserveSize_(reserveSize) {}
+
+    Counter<V, CoreMap> createCounter(void) const {
+      Counter<V, CoreMap> counter;
+      if( reserveSize_ > 0 ) counter.reserve( reserveSize_ );
+      return counter; }
+    DefaultCounterFactory<V, CoreMap> *clone(void) const {
+      return new DefaultCounterFactory<V, CoreMap>(*this); }
+
+  private:
+    typename Counter<V, CoreMap>::Size_t reserveSize_;
   };
 
   /*! @brief A factory type which creates copies of the specified Counter object. */
-  template <typename V>
-  struct CopyCounterFactory : public CounterFactory<V>
+  template <typename V, typename CoreMap = MapTypeErasure::AnyMap<V, CountersCount_t> >
+  struct CopyCounterFactory : public CounterFactory<V, CoreMap>
   {
-    CopyCounterFactory( Counter<V> counter ) : source_(std::move(counter)) {}
+    CopyCounterFactory( Counter<V, CoreMap> counter ) : source_(std::move(counter)) {}
     
-    Counter<V> createCounter(void) const {
-      return Counter<V>(source_); }
-    CopyCounterFactory<V> *clone(void) const {
-      return new CopyCounterFactory<V>(*this); }
+    Counter<V, CoreMap> createCounter(void) const {
+      return Counter<V, CoreMap>(source_); }
+    CopyCounterFactory<V, CoreMap> *clone(void) const {
+      return new CopyCounterFactory<V, CoreMap>(*this); }
     
   private:
-    Counter<V> source_;
+    Counter<V, CoreMap> source_;
   };
 
   /*! @brief A factory type which creates Counter objects which have a map of type
-   *  CoreMap at their core. 
+   *  CoreMap at their core. E.g. with CoreMap set to 
+   *  MapTypeErasure::FlatHashMap<V, Counter<V>::Count_t>, the Counters keep
+   *  their counts in a single contiguous array.
    */
   template <typename V, typename CoreMap>
   struct MapTypeCounterFactory : public CounterFactory<V>
   {
+    /*! @brief Creates Counters reserved for reserveSize values (see
+     *  Counter::reserve()). */
+    explicit MapTypeCounterFactory( typename Counter<V>::Size_t reserveSize = 0 )
+      : reserveSize_(reserveSize) {}
+
     Counter<V> createCounter(void) const
     {
-      return Counter<V>( typename MapTypeErasure::AnyMap<V, typename Counter<V>::Count_t>( CoreMap() ) );
+      Counter<V> counter( (typename MapTypeErasure::AnyMap<V, typename Counter<V>::Count_t>( CoreMap() )) );
+      if( reserveSize_ > 0 ) counter.reserve( reserveSize_ );
+      return counter;
     }
 
     MapTypeCounterFactory<V, CoreMap> *clone(void) const {
       return new MapTypeCounterFactory<V, CoreMap>(*this); }
+
+  private:
+    typename Counter<V>::Size_t reserveSize_;
+  };
+
+  /*! @brief A factory type which creates heavy-hitter Counter objects: the
+   *  Counters keep at most capacity values, approximating their counts with
+   *  the Space-Saving algorithm (see SpaceSavingMap for the error bounds).
+   *  Combine with Counter::topK() to track the most frequent values of a
+   *  stream in bounded memory.
+   */
+  template <typename V>
+  struct SpaceSavingCounterFactory : public CounterFactory<V>
+  {
+    /*! @brief Creates Counters which hold at most capacity values. */
+    explicit SpaceSavingCounterFactory( typename Counter<V>::Size_t capacity )
+      : capacity_(capacity) {}
+
+    Counter<V> createCounter(void) const
+    {
+      typedef SpaceSavingMap<V, typename Counter<V>::Count_t> CoreMap_t;
+      return Counter<V>( (typename MapTypeErasure::AnyMap<V, typename Counter<V>::Count_t>( CoreMap_t(capacity_) )) );
+    }
+
+    SpaceSavingCounterFactory<V> *clone(void) const {
+      return new SpaceSavingCounterFactory<V>(*this); }
+
+  private:
+    typename Counter<V>::Size_t capacity_;
+  };
+
+  /*! @brief A factory type which creates approximate Counter objects in fixed
+   *  memory: the Counters estimate the counts of any number of values with a
+   *  Count-Min sketch of the given width and depth (see CountMinSketch for
+   *  the error bounds). They support incrementCount(), setCount(),
+   *  getCount(), contains(), totalCount(), scaling and operator+=() of
+   *  Counters from the same factory, but store no values: they are empty()
+   *  and iterate over nothing.
+   */
+  template <typename V>
+  struct CountMinCounterFactory : public CounterFactory<V>
+  {
+    /*! @brief Creates Counters with sketches of depth rows of width counts,
+     *  with conservative update if conservative is TRUE. Counters can only be
+     *  added if their factories had the same width, depth and seed. */
+    CountMinCounterFactory( typename Counter<V>::Size_t width, typename Counter<V>::Size_t depth,
+			    bool conservative = false, std::size_t seed = 0 )
+      : width_(width), depth_(depth), conservative_(conservative), seed_(seed) {}
+
+    Counter<V> createCounter(void) const
+    {
+      typedef CountMinSketch<V, typename Counter<V>::Count_t> CoreMap_t;
+      return Counter<V>( (typename MapTypeErasure::AnyMap<V, typename Counter<V>::Count_t>(
+	CoreMap_t(width_, depth_, conservative_, seed_) )) );
+    }
+
+    CountMinCounterFactory<V> *clone(void) const {
+      return new CountMinCounterFactory<V>(*this); }
+
+  private:
+    typename Counter<V>::Size_t width_;
+    typename Counter<V>::Size_t depth_;
+    bool conservative_;
+    std::size_t seed_;
+  };
+
+  /*! @brief A factory type which creates Counter objects whose map nodes are
+   *  allocated from a shared MapTypeErasure::Arena. The factory keeps the
+   *  arena alive; the Counters it creates (but not their copies, which use
+   *  the heap) must be destroyed before the last copy of the factory. A
+   *  CounterMap owning the factory guarantees this for its rows (see
+   *  makeArenaCounterMap()). The copies of the factory (e.g. those of the
+   *  CounterMaps sharing it) allocate from the same arena, which is not
+   *  thread safe, so they must not create Counters on different threads at
+   *  the same time.
+   */
+  template <typename V>
+  struct ArenaCounterFactory : public CounterFactory<V>
+  {
+    typedef typename Counter<V>::Count_t Count_t;
+    /*! @brief Type of the maps of the created Counters. */
+    typedef boost::unordered_map<V, Count_t, boost::hash<V>, std::equal_to<V>,
+				 MapTypeErasure::ArenaAllocator< std::pair<V const, Count_t> > > CoreMap_t;
+
+    /*! @brief Creates Counters which allocate from the arena. */
+    explicit ArenaCounterFactory( std::shared_ptr<MapTypeErasure::Arena> arena
+				  = std::make_shared<MapTypeErasure::Arena>() )
+      : arena_(std::move(arena)) {}
+
+    Counter<V> createCounter(void) const
+    {
+      return Counter<V>( (typename MapTypeErasure::AnyMap<V, Count_t>(
+	CoreMap_t( 0, typename CoreMap_t::hasher(), typename CoreMap_t::key_equal(),
+		   typename CoreMap_t::allocator_type( arena_.get() ) ) )) );
+    }
+
+    ArenaCounterFactory<V> *clone(void) const {
+      return new ArenaCounterFactory<V>(*this); }
+
+    bool ownsCounterMemory(void) const { return true; }
+
+    /*! @brief The arena of the created Counters. */
+    std::shared_ptr<MapTypeErasure::Arena> const& arena(void) const { return arena_; }
+
+  private:
+    std::shared_ptr<MapTypeErasure::Arena> arena_;
+  };
+
+  /*! @brief A factory type which creates the Counters of another factory
+   *  with their maps instrumented (see Counter::setMapInstrumented()). The
+   *  rows of a CounterMap built with it can be compared by their
+   *  Counter::getMapStats(), e.g. to find the rows which are looked up the
+   *  most.
+   */
+  template <typename V>
+  struct InstrumentedCounterFactory : public CounterFactory<V>
+  {
+    /*! @brief Instruments the Counters of a copy of the factory. */
+    explicit InstrumentedCounterFactory( CounterFactory<V> const& factory = DefaultCounterFactory<V>() )
+      : factory_( factory.clone() ) {}
+
+    InstrumentedCounterFactory( InstrumentedCounterFactory const& o )
+      : factory_( o.factory_->clone() ) {}
+
+    Counter<V> createCounter(void) const
+    {
+      Counter<V> counter( factory_->createCounter() );
+      counter.setMapInstrumented( true );
+      return counter;
+    }
+
+    InstrumentedCounterFactory<V> *clone(void) const {
+      return new InstrumentedCounterFactory<V>(*this); }
+
+    bool ownsCounterMemory(void) const { return factory_->ownsCounterMemory(); }
+
+  private:
+    InstrumentedCounterFactory& operator=( InstrumentedCounterFactory const& );
+
+    std::unique_ptr< CounterFactory<V> > factory_;
   };
 
 };
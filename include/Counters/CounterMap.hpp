@@ -7,39 +7,89 @@
 #ifndef __COUNTER_MAP_H__
 #define __COUNTER_MAP_H__
 
+#include <cstddef>
+#include <memory>
 #include <ostream>
+#include <tuple>
 #include <utility>
+#include <type_traits>
+#include <vector>
 
 #include "Counters/Counter.hpp"
 #include "Counters/CounterFactories.hpp"
 #include "Counters/NumCache.hpp"
+#include "Counters/ExecutionPolicy.hpp"
 #include "AnyMap/AnyMap.hpp"
 
 namespace Counters
 {
-  template <typename K, typename V>
+  template <typename K, typename V,
+	    typename RowMap = MapTypeErasure::AnyMap<V, CountersCount_t>,
+	    typename OuterMap = MapTypeErasure::AnyMap<K, Counter<V, RowMap> > >
   class CounterMap;
 
-  template <typename K, typename V> CounterMap<K, V> operator+(CounterMap<K, V> const&, CounterMap<K, V> const&);
-  template <typename K, typename V> CounterMap<K, V> operator+(CounterMap<K, V>     &&, CounterMap<K, V> const&);
-  template <typename K, typename V> CounterMap<K, V> operator+(CounterMap<K, V>     &&, CounterMap<K, V>     &&);
-  template <typename K, typename V> CounterMap<K, V> operator+(CounterMap<K, V> const&, CounterMap<K, V>     &&);
-  template <typename K, typename V> CounterMap<K, V> operator-(CounterMap<K, V> const&, CounterMap<K, V> const&);
-  template <typename K, typename V> CounterMap<K, V> operator-(CounterMap<K, V>     &&, CounterMap<K, V> const&);
-  template <typename K, typename V> CounterMap<K, V> operator-(CounterMap<K, V>     &&, CounterMap<K, V>     &&);
+  template <typename K, typename V, typename Hash>
+  class CounterMapReduction;
+
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator+(CounterMap<K, V, R, O> const&, CounterMap<K, V, R, O> const&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator+(CounterMap<K, V, R, O>     &&, CounterMap<K, V, R, O> const&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator+(CounterMap<K, V, R, O>     &&, CounterMap<K, V, R, O>     &&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator+(CounterMap<K, V, R, O> const&, CounterMap<K, V, R, O>     &&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator-(CounterMap<K, V, R, O> const&, CounterMap<K, V, R, O> const&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator-(CounterMap<K, V, R, O>     &&, CounterMap<K, V, R, O> const&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator-(CounterMap<K, V, R, O>     &&, CounterMap<K, V, R, O>     &&);
   
-  template <typename K, typename V> CounterMap<K, V> operator*(CounterMap<K, V> const&, typename CounterMap<K, V>::Count_t);
-  template <typename K, typename V> CounterMap<K, V> operator*(CounterMap<K, V>     &&, typename CounterMap<K, V>::Count_t);
-  template <typename K, typename V> CounterMap<K, V> operator*(typename CounterMap<K, V>::Count_t, CounterMap<K, V> const&);
-  template <typename K, typename V> CounterMap<K, V> operator*(typename CounterMap<K, V>::Count_t, CounterMap<K, V>     &&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator*(CounterMap<K, V, R, O> const&, typename CounterMap<K, V, R, O>::Count_t);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator*(CounterMap<K, V, R, O>     &&, typename CounterMap<K, V, R, O>::Count_t);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator*(typename CounterMap<K, V, R, O>::Count_t, CounterMap<K, V, R, O> const&);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator*(typename CounterMap<K, V, R, O>::Count_t, CounterMap<K, V, R, O>     &&);
+
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator/(CounterMap<K, V, R, O> const&, typename CounterMap<K, V, R, O>::Count_t);
+  template <typename K, typename V, typename R, typename O> CounterMap<K, V, R, O> operator/(CounterMap<K, V, R, O>     &&, typename CounterMap<K, V, R, O>::Count_t);
 
-  template <typename K, typename V> CounterMap<K, V> operator/(CounterMap<K, V> const&, typename CounterMap<K, V>::Count_t);
-  template <typename K, typename V> CounterMap<K, V> operator/(CounterMap<K, V>     &&, typename CounterMap<K, V>::Count_t);
+  /*!
+   * @brief True if a (KeyArg, ValArg) pair can be used for a heterogeneous
+   * lookup in a CounterMap<K, V, RowMap, OuterMap>: each of them is either exactly of its
+   * parameter type or key-like (see MapTypeErasure::IsKeyLike), and at least
+   * one is key-like. KeyArg and ValArg may be references, as deduced for
+   * forwarding references.
+   */
+  template <typename K, typename V, typename KeyArg, typename ValArg,
+	    typename Key = typename std::remove_cv<typename std::remove_reference<KeyArg>::type>::type,
+	    typename Val = typename std::remove_cv<typename std::remove_reference<ValArg>::type>::type>
+  struct IsCounterMapLookup : std::integral_constant<bool,
+    ( MapTypeErasure::IsKeyLike<K, Key>::value || std::is_same<typename std::decay<Key>::type, K>::value ) &&
+    ( MapTypeErasure::IsKeyLike<V, Val>::value || std::is_same<typename std::decay<Val>::type, V>::value ) &&
+    ( MapTypeErasure::IsKeyLike<K, Key>::value || MapTypeErasure::IsKeyLike<V, Val>::value )> {};
+
+  /*!
+   * @brief A bound on the memory of a CounterMap, enforced by evicting its
+   * smallest counts (see CounterMap::setEvictionPolicy()).
+   */
+  struct EvictionPolicy
+  {
+    /*! @brief An eviction policy with the memory budget (0 disables the
+     *  eviction), the fraction of the budget kept by an eviction, and the
+     *  number of modifications between the checks of the budget. */
+    explicit EvictionPolicy( std::size_t budget = 0, double retained = 0.75, std::size_t interval = 4096 )
+      : memoryBudget(budget), retainedFraction(retained), checkInterval(interval) {}
+
+    /*! @brief The greatest memoryUsage() in bytes, not counting the delta
+     *  log and the reverse index (see CounterMap::setDeltaTracking() and
+     *  CounterMap::setReverseIndex()), or 0 for no bound. */
+    std::size_t memoryBudget;
+    /*! @brief An eviction shrinks the CounterMap to this fraction of the
+     *  budget, so that the next one is not due right away. */
+    double retainedFraction;
+    /*! @brief The budget is checked on every checkInterval-th modification,
+     *  since memoryUsage() visits all the rows. */
+    std::size_t checkInterval;
+  };
 
   /*!
    * @brief Outputs the CounterMap in a human readable format.
    */
-  template <typename K, typename V> std::ostream& operator<<(std::ostream&, CounterMap<K, V> const&);
+  template <typename K, typename V, typename R, typename O> std::ostream& operator<<(std::ostream&, CounterMap<K, V, R, O> const&);
   
   /*!
    * @brief A mapping of keys to Counter values intended for use as a conditional
@@ -47,7 +97,7 @@ namespace Counters
    *
    * The CounterMap is essentially a map (this implementation uses AnyMap as the
    * underlying map). The key type of this map is the CounterMap template's K type
-   * parameter. The mapped type of the map is the Counter<V> type.
+   * parameter. The mapped type of the map is the Counter<V, RowMap> type.
    *
    * Additionally to keeping the key-counter association, the CounterMap keeps a 
    * cache. This cache stores the total count (the sum of all the counts stored in
@@ -59,10 +109,18 @@ namespace Counters
    * For cache details, see NumCache (note, that CounterMap always uses 
    * Counters::CACHE_POLICY_RELAXED for the caching policy).
    *
+   * Both maps are AnyMaps by default. Where their types are known at compile
+   * time, RowMap and OuterMap can be MapTypeErasure::StaticMaps instead (see
+   * StaticCounterMap), which removes the virtual calls from the lookups and
+   * updates of the rows and of their counts (see Counter). The rows are then
+   * created by a CounterFactory<V, RowMap>.
+   *
    * @param K Key type for the Counter mapping.
    * @param V Value type for the mapped Counter objects.
+   * @param RowMap Type of the maps of the mapped Counters (see Counter).
+   * @param OuterMap Type of the map from the keys to the Counters.
    */
-  template <typename K, typename V>
+  template <typename K, typename V, typename RowMap, typename OuterMap>
   class CounterMap
   {
   public:
@@ -71,13 +129,13 @@ namespace Counters
     /*! @brief Type parameter V a.k.a. type of values stored by the mapped counters.*/
     typedef V Value_t;
     /*! @brief Type of Counters associated with the top-level keys. */
-    typedef Counter<V> Counter_t;
+    typedef Counter<V, RowMap> Counter_t;
     /*! @brief Type used by the mapped Counter objects to store counts. */
     typedef typename Counter_t::Count_t Count_t;
     /*! @brief Type of map used to maintain the key-counter associations. */
-    typedef MapTypeErasure::AnyMap<K, Counter_t> CoreMap_t;
+    typedef OuterMap CoreMap_t;
     /*! @brief The type to which the iterators dereference (should be
-     *  std::pair<K, Counters::Counter<V> >). */
+     *  std::pair<K, Counters::Counter<V, RowMap> >). */
     typedef typename CoreMap_t::value_type IteratorValue_t;
     /*! @brief A constant iterator for the underlying map. */
     typedef typename CoreMap_t::const_iterator ConstIterator;
@@ -87,7 +145,8 @@ namespace Counters
     /*!  @name Constructors, Destructor, Assignment, and Swap
      *   @{
      */
-    /*! @brief Standard copy constructor. */
+    /*! @brief Standard copy constructor. The copy shares the CounterFactory
+     *  of other. */
     CounterMap( CounterMap const & other );
     /*! @brief Move copy constructor. */
     CounterMap( CounterMap && other );
@@ -100,13 +159,31 @@ namespace Counters
      */
     explicit CounterMap( CoreMap_t coreMap
 			 = CoreMap_t(),
-			 CounterFactory<V> const & counterFactory
-			 = DefaultCounterFactory<V>() );
+			 CounterFactory<V, RowMap> const & counterFactory
+			 = DefaultCounterFactory<V, RowMap>() );
+    /*!
+     * @brief Constructs the CounterMap with the specified underlying map and a
+     * shared counter factory.
+     * @param coreMap The map used to hold the key-counter associations.
+     * @param counterFactory The factory used to create new Counter objects; it
+     * is shared rather than duplicated (as it is by copies of CounterMaps).
+     */
+    CounterMap( CoreMap_t coreMap,
+		std::shared_ptr<CounterFactory<V, RowMap> const> counterFactory );
+    /*!
+     * @brief Copies a CounterMap with other types of maps, including the
+     * caches. The rows are converted as by the converting constructor of
+     * Counter, into a default-constructed CoreMap_t. The copy shares the
+     * CounterFactory of other if the rows have the same type, and uses a
+     * DefaultCounterFactory otherwise.
+     */
+    template <typename OtherRowMap, typename OtherOuterMap>
+    explicit CounterMap( CounterMap<K, V, OtherRowMap, OtherOuterMap> const& other );
     ~CounterMap();
     
     /*!
      * @brief Standard Assignment. Copies the keys and their associated Counter 
-     * objects as well as the cache and CounterFactory.
+     * objects as well as the cache, and shares the CounterFactory of rhs.
      * @param rhs Original CounterMap to be copied.
      * @return This CounterMap.
      */
@@ -148,6 +225,32 @@ namespace Counters
     void incrementCount(K     && key, V     && val, Count_t count);
     /*! @overload incrementCount(K const& key, V const& val, Count_t count); */
     void incrementCount(K const& key, V     && val, Count_t count);
+    /*!
+     * @brief Heterogeneous incrementCount(): the key and the value may be given
+     * as any types which can be looked up without constructing a K or a V (see
+     * MapTypeErasure::KeyView), e.g. string slices. Keys and values are only
+     * constructed when they are inserted. The arguments are forwarded, so
+     * that a K or V given with a key-like argument is moved if it is an
+     * rvalue, and so that such calls do not compete with the overloads
+     * taking rvalues.
+     */
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value>::type
+    incrementCount(KeyArg&& key, ValArg&& val, Count_t count);
+
+    /*!
+     * @brief Increments the counts of the key-value pairs of the batch, as
+     * incrementCount() does for each item in order.
+     *
+     * Each run of consecutive items with the same key looks the Counter of
+     * the key up once and increments its values with
+     * Counter::incrementMany(), so batches grouped by key (e.g. sorted) find
+     * each Counter once.
+     * @param items The keys, values and the counts by which they are
+     * incremented.
+     * @param n The number of items.
+     */
+    void incrementMany(std::tuple<K, V, Count_t> const* items, std::size_t n);
 
     /*!
      * @brief Sets the count associated with the key-value pair to the given count.
@@ -166,6 +269,11 @@ namespace Counters
     void setCount(K     && key, V     && val, Count_t count);
     /*! @overload setCount(K const& key, V const& val, Count_t count); */
     void setCount(K const& key, V     && val, Count_t count);
+    /*! @brief Heterogeneous setCount(). See 
+     *  incrementCount(KeyArg&& key, ValArg&& val, Count_t count). */
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value>::type
+    setCount(KeyArg&& key, ValArg&& val, Count_t count);
 
     /*!
      * @brief Removes the key and its associated Counter.
@@ -180,10 +288,36 @@ namespace Counters
      */
     void remove(K const& key, V const& val);
 
+    /*!
+     * @brief Removes all the keys; the underlying map type and the factory
+     * are kept.
+     */
+    void clear(void);
+
+    /*!
+     * @brief Removes the small counts and the small rows.
+     *
+     * Prunes every Counter (see Counter::prune()), then removes the rows
+     * which are empty or whose total is less than minRowTotal, each in a
+     * single pass of the underlying map.
+     * @param minRowTotal The smallest total of a row kept, after its counts
+     * are pruned.
+     * @param minCount The smallest count kept.
+     * @return The number of key-value pairs removed, including those of the
+     * removed rows.
+     */
+    Size_t prune(Count_t minRowTotal, Count_t minCount);
+
     /*!
      * @brief Calls normalize on each of the stored counters.
      */
     void conditionalNormalize(void);
+
+    /*!
+     * @brief Calls normalize on the stored counters, in parallel according
+     * to the policy.
+     */
+    void conditionalNormalize(ExecutionPolicy const& policy);
     /*!  @} */
 
     /*!  @name Lookup
@@ -205,6 +339,18 @@ namespace Counters
      */
     bool contains(K const& key, V const& val) const;
 
+    /*! @brief Heterogeneous contains(K const& key): looks the key up without
+     *  constructing a K. See MapTypeErasure::KeyView. */
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, bool>::type
+    contains(KeyLike const& key) const;
+
+    /*! @brief Heterogeneous contains(K const& key, V const& val). See
+     *  MapTypeErasure::KeyView. */
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, bool>::type
+    contains(KeyArg const& key, ValArg const& val) const;
+
     /*!
      * @brief Reports the number of top level keys in the mapping.
      * @return Number of top level keys in the mapping.
@@ -225,6 +371,31 @@ namespace Counters
      */
     bool empty(void) const;
 
+    /*!
+     * @brief Prepares the underlying map to hold n keys without rehashing. To
+     * presize the Counter objects created for new keys, construct the
+     * CounterMap with a factory which reserves them (e.g.
+     * DefaultCounterFactory(size)).
+     * @param n The number of keys the mapping is expected to hold.
+     */
+    void reserve(Size_t n);
+
+    /*!
+     * @brief Releases the capacity which is not needed for the stored keys and
+     * values, both in the underlying map and in all the mapped Counter objects.
+     */
+    void shrinkToFit(void);
+
+    /*!
+     * @brief Returns the bytes used by the CounterMap: the CounterMap
+     * itself, the underlying map and the Counters with their maps (see
+     * Counter::memoryUsage()), the delta log if tracking and the reverse
+     * index if indexing. The factory,
+     * which is shared, is not counted; neither is what an Arena keeps in its
+     * free lists.
+     */
+    std::size_t memoryUsage(void) const;
+
     /*!
      * @brief Reports the count associated with the given key-value pair.
      * @param key Key whose Counter is querried for the count of 'val'.
@@ -234,18 +405,187 @@ namespace Counters
      */
     CounterMap::Count_t getCount(K const& key, V const& val) const;
 
+    /*! @brief Heterogeneous getCount(). Neither a K nor a V is constructed.
+     *  See MapTypeErasure::KeyView. */
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, Count_t>::type
+    getCount(KeyArg const& key, ValArg const& val) const;
+
+    /*!
+     * @brief Looks the key-value pairs up in batch: sets out[i] to
+     * getCount(pairs[i].first, pairs[i].second) for each i in [0, n),
+     * looking a Counter up once per run of consecutive pairs with its key
+     * (see incrementMany()).
+     * @param pairs The key-value pairs whose counts are requested.
+     * @param n The number of pairs.
+     * @param out The n counts.
+     */
+    void getMany(std::pair<K, V> const* pairs, std::size_t n, Count_t* out) const;
+
     /*!
      * @brief Reports the sum of all counts stored in the CounterMap.
      * @return Sum of all counts in all the Counter objects stored in the mapping.
      */
     CounterMap::Count_t totalCount(void) const;
 
+    /*!
+     * @brief Reports the sum of all counts stored in the CounterMap, adding up
+     * the rows in parallel. Depending on ExecutionPolicy::summation, the
+     * result is either identical to that of totalCount(void) or differs from
+     * it only by the summation order. Either way the result is cached.
+     * @return Sum of all counts in all the Counter objects stored in the mapping.
+     */
+    CounterMap::Count_t totalCount(ExecutionPolicy const& policy) const;
+
     /*!
      * @brief Reports the total count of the Counter associated with 'key'.
      * @return Sum of all counts stored in the Counter associated with 'key' or 0 if
      * no such Counter exists.
      */
     CounterMap::Count_t totalCount(K const& key) const;
+
+    /*!
+     * @brief Reports the value with the greatest count in the Counter
+     * associated with 'key'. See Counter::maxValue() for its caching.
+     * @return The value with the greatest count under 'key' or V() if no such
+     * Counter exists.
+     */
+    V maxValue(K const& key) const;
+
+    /*!
+     * @brief Reports the k values with the greatest counts in the Counter
+     * associated with 'key'. See Counter::topK().
+     * @return The values and their counts in the order of decreasing counts,
+     * or an empty vector if no such Counter exists.
+     */
+    std::vector<typename Counter_t::ValueCount_t> topK(K const& key, Size_t k) const;
+    /*!  @} */
+
+    /*!  @name Eviction
+     *   A CounterMap with a memory budget checks its memoryUsage() every
+     *   EvictionPolicy::checkInterval calls of incrementCount(), setCount()
+     *   and incrementMany(), and evicts its smallest counts when it is over
+     *   the budget. Copies keep the policy.
+     *   @{
+     */
+    /*!
+     * @brief Sets the eviction policy; EvictionPolicy() (the default) turns
+     * the eviction off.
+     */
+    void setEvictionPolicy(EvictionPolicy const& policy);
+
+    /*! @brief Returns the eviction policy. */
+    EvictionPolicy const& getEvictionPolicy(void) const { return eviction_; }
+
+    /*!
+     * @brief Evicts the smallest counts if memoryUsage() is over the budget
+     * of the eviction policy, until it is under retainedFraction of the
+     * budget.
+     *
+     * Each round removes, from all the rows at once, the counts less than a
+     * threshold chosen so that about the needed fraction of the counts is
+     * kept, and of the counts tied at the threshold only as many as needed,
+     * in no particular order (so that mostly equal counts are not all
+     * evicted at once). It then drops the empty rows and releases the
+     * spare capacity (see shrinkToFit()).
+     * @return The number of key-value pairs removed.
+     */
+    Size_t enforceMemoryBudget(void);
+    /*!  @} */
+
+    /*!  @name Delta Tracking
+     *   A tracking CounterMap keeps a log of the changes of its counts since
+     *   the last checkpoint, as Counter does: a CounterMap of the amount by
+     *   which each key-value pair touched since then has changed, holding
+     *   only the rows of the touched keys. Every modifier is logged,
+     *   including the evictions; those which change every count (scaling,
+     *   conditionalNormalize() and clear()) log the whole map. Nodes send
+     *   their deltas (see writeDelta()) instead of their whole maps, and the
+     *   aggregator merges them with applyDelta(), in time proportional to
+     *   the sizes of the deltas. The log is copied, moved and swapped with
+     *   the counts.
+     *   @{
+     */
+    /*!
+     * @brief Turns delta tracking on, the first checkpoint being the current
+     * counts, or off, dropping the log. Turning it on again has no effect.
+     */
+    void setDeltaTracking(bool on);
+
+    /*! @brief TRUE if the CounterMap keeps a log of its changes. */
+    bool isDeltaTracking(void) const { return deltaLog_ != NULL; }
+
+    /*!
+     * @brief Returns the changes since the last checkpoint and starts a new
+     * checkpoint at the current counts.
+     * @return The amount by which the count of each changed key-value pair
+     * has changed; pairs whose changes cancelled out and rows left without
+     * changes are left out. Empty if the CounterMap is not tracking.
+     */
+    CounterMap extractDelta(void);
+
+    /*!
+     * @brief Adds the changes of another CounterMap (see extractDelta()),
+     * removing the pairs whose counts they bring to 0 and the rows left
+     * empty.
+     * @param delta The changes to be added.
+     * @return This CounterMap.
+     */
+    CounterMap& applyDelta(CounterMap const& delta);
+    /*!  @} */
+
+    /*!  @name Reverse Index
+     *   A CounterMap with a reverse index keeps, next to its rows, their
+     *   transpose: for each value, its counts in the rows holding it, keyed
+     *   by the keys of those rows, and their sum, its marginal count. The
+     *   index is updated by every modifier, in time proportional to the
+     *   pairs they change (the whole map for scaling and
+     *   conditionalNormalize()), so that marginalCount() takes constant time
+     *   and rowsContaining() time proportional to its result, instead of
+     *   visiting every row. The marginals are kept as persistent totals (see
+     *   Counters::CACHE_POLICY_PERSISTENT), which accumulate round-off with
+     *   non-integral counts. The index is copied, moved and swapped with the
+     *   counts.
+     *   @{
+     */
+    /*!
+     * @brief Builds the reverse index of the current counts, or drops it.
+     * Turning it on again has no effect.
+     */
+    void setReverseIndex(bool on);
+
+    /*! @brief TRUE if the CounterMap keeps a reverse index. */
+    bool hasReverseIndex(void) const { return reverseIndex_ != NULL; }
+
+    /*!
+     * @brief Returns the sum of the counts of val over all the rows, in
+     * constant time with a reverse index and visiting every row without.
+     */
+    Count_t marginalCount(V const& val) const;
+
+    /*!
+     * @brief Returns the keys of the rows which contain val (see
+     * contains(K const&, V const&)), in no particular order. Takes time
+     * proportional to their number with a reverse index and visits every row
+     * without.
+     */
+    std::vector<K> rowsContaining(V const& val) const;
+
+    /*!
+     * @brief Returns the column of val in the reverse index: the counts of
+     * val keyed by the keys of the rows containing it. Its totalCount() is
+     * the marginal count of val; dividing by it gives P(K | val).
+     * @return The column or NULL if no row contains val or the CounterMap
+     * keeps no reverse index.
+     */
+    Counter<K> const * getColumn(V const& val) const;
+
+    /*!
+     * @brief Returns the transpose of this CounterMap, whose row of each
+     * value holds its counts keyed by the keys of the rows containing it;
+     * built in a single pass over the rows.
+     */
+    CounterMap<V, K> transpose(void) const;
     /*!  @} */
 
     /*!  @name Counters
@@ -256,9 +596,14 @@ namespace Counters
      * @return A pointer to a Counter associated with the given key or the NULL 
      * pointer if no such Counter exists in the mapping.
      */
-    Counter<V> const * const getCounter(K const& key) const;
+    Counter<V, RowMap> const * const getCounter(K const& key) const;
     /*! @overload getCounter(K const& key) const */
-    Counter<V> const * const getCounter(K     && key) const;
+    Counter<V, RowMap> const * const getCounter(K     && key) const;
+    /*! @brief Heterogeneous getCounter(): looks the key up without
+     *  constructing a K. See MapTypeErasure::KeyView. */
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, Counter<V, RowMap> const *>::type
+    getCounter(KeyLike const& key) const;
     /*!  @} */
 
     /*!  @name Traversal
@@ -314,6 +659,14 @@ namespace Counters
      */
     bool equals(const CounterMap& other, 
 		Count_t precision=std::numeric_limits<Count_t>::epsilon()) const;
+
+    /*!
+     * @brief equals(), comparing the rows in parallel according to the policy.
+     * The other CounterMap is only looked up in, from several threads at a
+     * time.
+     */
+    bool equals(const CounterMap& other, ExecutionPolicy const& policy,
+		Count_t precision=std::numeric_limits<Count_t>::epsilon()) const;
     /*!  @} */
 
     /*!  @name Arithmetic Operators
@@ -329,6 +682,18 @@ namespace Counters
      * @return This modified CounterMap.
      */
     CounterMap& operator+=(CounterMap const& rhs);
+    /*!
+     * @brief Adds the counts of a CounterMap which is about to be discarded.
+     *
+     * The Counters of the keys missing from this CounterMap are moved into it
+     * rather than copied, so merging maps with few common keys costs about
+     * one insertion per key. The Counters are copied instead when they may
+     * depend on the factory of rhs (see CounterFactory::ownsCounterMemory())
+     * and the two CounterMaps do not share it. rhs is left empty.
+     * @param rhs The CounterMap whose values are to be added to this CounterMap.
+     * @return This modified CounterMap.
+     */
+    CounterMap& operator+=(CounterMap&& rhs);
     /*!
      * @brief Decrements each count by the amount stored in the other CounterMap.
      *
@@ -345,13 +710,13 @@ namespace Counters
      * @brief Adds all the counts in two CounterMaps to produce a new CounterMap.
      * @return New CounterMap whose counts are the sums of the two CounterMaps.
      */
-    friend CounterMap operator+ <K, V>(CounterMap const&, CounterMap const&);
-    /*! @overload operator+ <K, V>(CounterMap const&, CounterMap const&) */
-    friend CounterMap operator+ <K, V>(CounterMap     &&, CounterMap const&);
-    /*! @overload operator+ <K, V>(CounterMap const&, CounterMap const&) */
-    friend CounterMap operator+ <K, V>(CounterMap     &&, CounterMap     &&);
-    /*! @overload operator+ <K, V>(CounterMap const&, CounterMap const&) */
-    friend CounterMap operator+ <K, V>(CounterMap const&, CounterMap     &&);
+    friend CounterMap operator+ <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&);
+    /*! @overload operator+ <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&) */
+    friend CounterMap operator+ <K, V, RowMap, OuterMap>(CounterMap     &&, CounterMap const&);
+    /*! @overload operator+ <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&) */
+    friend CounterMap operator+ <K, V, RowMap, OuterMap>(CounterMap     &&, CounterMap     &&);
+    /*! @overload operator+ <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&) */
+    friend CounterMap operator+ <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap     &&);
 
     /*!
      * @brief Subtracts all the counts of the CounterMap on the right of the operator
@@ -359,12 +724,12 @@ namespace Counters
      * @return New CounterMap whose counts are the differences of the two CounterMaps'
      * counts.
      */
-    friend CounterMap operator- <K, V>(CounterMap const&, CounterMap const&);
-    /*! @overload operator- <K, V>(CounterMap const&, CounterMap const&) */
-    friend CounterMap operator- <K, V>(CounterMap     &&, CounterMap const&);
-    /*! @overload operator- <K, V>(CounterMap const&, CounterMap const&) */
-    friend CounterMap operator- <K, V>(CounterMap     &&, CounterMap     &&);
-    /*! @overload operator- <K, V>(CounterMap const&, CounterMap const&) */
+    friend CounterMap operator- <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&);
+    /*! @overload operator- <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&) */
+    friend CounterMap operator- <K, V, RowMap, OuterMap>(CounterMap     &&, CounterMap const&);
+    /*! @overload operator- <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&) */
+    friend CounterMap operator- <K, V, RowMap, OuterMap>(CounterMap     &&, CounterMap     &&);
+    /*! @overload operator- <K, V, RowMap, OuterMap>(CounterMap const&, CounterMap const&) */
 
     /*!
      * @brief Multiplies every count stored in this CounterMap by num.
@@ -380,19 +745,31 @@ namespace Counters
      */
     CounterMap& operator/=(Count_t num);
 
+    /*!
+     * @brief operator*=(), scaling the rows in parallel according to the policy.
+     * @return This CounterMap.
+     */
+    CounterMap& multiply(ExecutionPolicy const& policy, Count_t num);
+
+    /*!
+     * @brief operator/=(), scaling the rows in parallel according to the policy.
+     * @return This CounterMap.
+     */
+    CounterMap& divide(ExecutionPolicy const& policy, Count_t num);
+
     /*!
      * @brief Multiplies all the counts of the CounterMap by the number.
      * @param cm CounterMap whose counts are multiplied.
      * @param num Number by which all the counts are multiplied.
      * @return New CounterMap whose counts num times those of cm.
      */
-    friend CounterMap operator* <K, V>(CounterMap<K, V> const& cm, Count_t num);
-    /*! @overload operator*(CounterMap<K, V> const& cm, Count_t num) */
-    friend CounterMap operator* <K, V>(CounterMap<K, V>     && cm, Count_t num);
-    /*! @overload operator*(CounterMap<K, V> const& cm, Count_t num) */
-    friend CounterMap operator* <K, V>(Count_t num, CounterMap<K, V> const& cm);
-    /*! @overload operator*(CounterMap<K, V> const& cm, Count_t num) */
-    friend CounterMap operator* <K, V>(Count_t num, CounterMap<K, V>     && cm);
+    friend CounterMap operator* <K, V, RowMap, OuterMap>(CounterMap<K, V, RowMap, OuterMap> const& cm, Count_t num);
+    /*! @overload operator*(CounterMap<K, V, RowMap, OuterMap> const& cm, Count_t num) */
+    friend CounterMap operator* <K, V, RowMap, OuterMap>(CounterMap<K, V, RowMap, OuterMap>     && cm, Count_t num);
+    /*! @overload operator*(CounterMap<K, V, RowMap, OuterMap> const& cm, Count_t num) */
+    friend CounterMap operator* <K, V, RowMap, OuterMap>(Count_t num, CounterMap<K, V, RowMap, OuterMap> const& cm);
+    /*! @overload operator*(CounterMap<K, V, RowMap, OuterMap> const& cm, Count_t num) */
+    friend CounterMap operator* <K, V, RowMap, OuterMap>(Count_t num, CounterMap<K, V, RowMap, OuterMap>     && cm);
 
     /*!
      * @brief Divides all the counts of the CounterMap by the number.
@@ -400,9 +777,9 @@ namespace Counters
      * @param num Number by which all the counts are divided.
      * @return New CounterMap whose counts 1.0/num times those of cm.
      */
-    friend CounterMap operator/ <K, V>(CounterMap<K, V> const& cm, Count_t num);
-    /*! @overload operator/(CounterMap<K, V> const& cm, Count_t num) */
-    friend CounterMap operator/ <K, V>(CounterMap<K, V>     && cm, Count_t num);
+    friend CounterMap operator/ <K, V, RowMap, OuterMap>(CounterMap<K, V, RowMap, OuterMap> const& cm, Count_t num);
+    /*! @overload operator/(CounterMap<K, V, RowMap, OuterMap> const& cm, Count_t num) */
+    friend CounterMap operator/ <K, V, RowMap, OuterMap>(CounterMap<K, V, RowMap, OuterMap>     && cm, Count_t num);
 
     /*!  @} */
     
@@ -413,21 +790,169 @@ namespace Counters
      * @param key Key whose Counter's existence is ensured.
      * @return Counter associated with the given key.
      */
-    Counter<V>& ensureCounter(K const& key);
+    Counter<V, RowMap>& ensureCounter(K const& key);
+
+    /*! @overload ensureCounter(K const& key) */
+    Counter<V, RowMap>& ensureCounter(K     && key);
 
     /*! @overload ensureCounter(K const& key) */
-    Counter<V>& ensureCounter(K     && key);
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, Counter<V, RowMap>&>::type
+    ensureCounter(KeyLike const& key);
 
   private:
-    CoreMap_t coreMap_;
+    // Converts to a Counter created by the factory. Passed to
+    // CoreMap_t::try_emplace() so that a counter is only created (and then
+    // moved into the map) when the key is missing.
+    struct NewCounter
+    {
+      explicit NewCounter( CounterFactory<V, RowMap> const& factory ) : factory_(&factory) {}
+      operator Counter<V, RowMap>() const { return factory_->createCounter(); }
+    private:
+      CounterFactory<V, RowMap> const* factory_;
+    };
+
+    // Moves the rows of the worker maps into the key ranges it merges.
+    template <typename, typename, typename> friend class CounterMapReduction;
+    // Converting constructor.
+    template <typename, typename, typename, typename> friend class CounterMap;
+
+    // The factory of a CounterMap converted to this type (see the
+    // converting constructor).
+    typedef std::shared_ptr<CounterFactory<V, RowMap> const> FactoryPtr_t;
+    static FactoryPtr_t convertFactory( FactoryPtr_t const& factory ) { return factory; }
+    template <typename OtherFactoryPtr>
+    static FactoryPtr_t convertFactory( OtherFactoryPtr const& )
+    { return FactoryPtr_t( new DefaultCounterFactory<V, RowMap>() ); }
+
+    // Counts a modification, enforcing the memory budget every checkInterval
+    // modifications (see EvictionPolicy).
+    void checkMemoryBudget(void)
+    {
+      if( eviction_.memoryBudget != 0 && ++modificationsSinceCheck_ >= eviction_.checkInterval )
+	{
+	  modificationsSinceCheck_ = 0;
+	  enforceMemoryBudget();
+	}
+    }
+
+    // prune(), removing the counts of each row with rowPrune(row, pruned),
+    // which logs the removed counts into pruned unless it is NULL and
+    // returns their number.
+    template <typename RowPrune>
+    Size_t pruneRows(Count_t minRowTotal, RowPrune rowPrune);
+
+    // memoryUsage() without the delta log, which evictions add to, and the
+    // reverse index.
+    std::size_t rowsMemoryUsage(void) const;
+
+    // Adds count to the log of the count of val in the row of key.
+    template <typename KeyArg, typename ValArg>
+    void logCount(KeyArg const& key, ValArg const& val, Count_t count)
+    {
+      if( deltaLog_ )
+	deltaLog_->ensureCounter(key).incrementCount(val, count);
+    }
+    // Adds factor times every row to the log.
+    void logRows(Count_t factor);
+
+    // The reverse index (see setReverseIndex()).
+    typedef CounterMap<V, K> ReverseIndex_t;
+    // Adds the counts of this CounterMap into the rows of index.
+    void transposeInto(ReverseIndex_t& index) const;
+    // Adds count to the count of key in the column of val of the index.
+    template <typename KeyArg, typename ValArg>
+    void indexCount(KeyArg const& key, ValArg const& val, Count_t count)
+    {
+      if( reverseIndex_ )
+	reverseIndex_->incrementCount(val, key, count);
+    }
+    // Sets the count of key in the column of val of the index.
+    template <typename KeyArg, typename ValArg>
+    void indexSetCount(KeyArg const& key, ValArg const& val, Count_t count)
+    {
+      if( reverseIndex_ )
+	reverseIndex_->setCount(val, key, count);
+    }
+    // Removes key from the column of val of the index, and the column if it
+    // is left empty.
+    void unindex(K const& key, V const& val);
+    // Sets the counts of every row in the index (after conditionalNormalize()).
+    void reindexRows(void);
+
+    // Calls task(row) for every row, running the blocks of rows of the
+    // policy in parallel.
+    template <typename RowTask>
+    void parallelForEachRow(ExecutionPolicy const& policy, RowTask task);
+    // Calls task(block, first, last), where [first, last) are the pointers
+    // to the rows of the block-th block, for every block of rows of the
+    // policy, in parallel.
+    template <typename BlockTask>
+    void parallelForEachBlock(ExecutionPolicy const& policy, BlockTask task) const;
+
+    // Moves a Counter into CoreMap_t::try_emplace() (see operator+=()).
+    struct MovedCounter
+    {
+      explicit MovedCounter( Counter<V, RowMap>& counter ) : counter_(&counter) {}
+      operator Counter<V, RowMap>() const { return std::move(*counter_); }
+    private:
+      Counter<V, RowMap>* counter_;
+    };
+
+    // Shared by the copies of this CounterMap. The factories are const, but
+    // not stateless: an ArenaCounterFactory allocates the rows it creates
+    // from its Arena, so the copies must not insert rows from different
+    // threads. Declared before coreMap_ so that the Counters are destroyed
+    // before the factory, which may own their memory.
+    FactoryPtr_t counterFactory_;
 
-    CounterFactory<V> *counterFactory_;
+    CoreMap_t coreMap_;
     
     // total cache:
     typedef NumCache<Count_t> CountCache;
-    CountCache *cachedTotal_;
+    mutable CountCache cachedTotal_;
+
+    EvictionPolicy eviction_;
+    std::size_t modificationsSinceCheck_;
+
+    // The changes since the last checkpoint, NULL unless tracking.
+    std::unique_ptr<CounterMap> deltaLog_;
+
+    // The transpose of the counts, NULL unless indexing.
+    std::unique_ptr<ReverseIndex_t> reverseIndex_;
   };
 
+  /*!
+   * @brief Creates an empty CounterMap which allocates its rows and the map
+   * nodes of their Counters from the arena (see ArenaCounterFactory).
+   *
+   * The arena is kept alive by the CounterMap and its copies. Destroying the
+   * CounterMap returns the nodes to the arena's free lists rather than to the
+   * heap, and the arena then releases its chunks at once, so discarding a
+   * model costs a few calls to free() instead of one per node. Copies of the
+   * rows allocate from the heap, but copies of the CounterMap share its
+   * factory, and so create their new rows in the same arena. The arena is not
+   * thread safe: neither the CounterMap and its copies, nor the other
+   * CounterMaps sharing the arena, may be modified from different threads
+   * at the same time. Rows moved out of the CounterMap must not outlive it.
+   * @param arena The arena used; may be shared with other CounterMaps.
+   */
+  template <typename K, typename V>
+  CounterMap<K, V> makeArenaCounterMap( std::shared_ptr<MapTypeErasure::Arena> arena
+					= std::make_shared<MapTypeErasure::Arena>() );
+
+  /*!
+   * @brief A CounterMap which holds a map of type OuterMapType from the keys
+   * to StaticCounters with maps of type RowMapType (see
+   * MapTypeErasure::StaticMap), for code in which the map types are known at
+   * compile time.
+   */
+  template <typename K, typename V,
+	    typename RowMapType = boost::unordered_map<V, CountersCount_t>,
+	    typename OuterMapType = boost::unordered_map<K, StaticCounter<V, RowMapType> > >
+  using StaticCounterMap = CounterMap< K, V, MapTypeErasure::StaticMap<RowMapType>,
+				       MapTypeErasure::StaticMap<OuterMapType> >;
+
 };
 
 #include "Counters/details/_CounterMap.IMPL.hpp"
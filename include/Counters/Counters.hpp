@@ -2,15 +2,110 @@
   @brief A set of handy templated functions for the Counter and CounterMap
   objects.
 
+  Vector operations treat counters as sparse vectors indexed by their values
+  (dot(), l2Norm(), cosine(), l1Distance(), l2Distance()), or, divided by
+  their total counts, as probability distributions (entropy(),
+  klDivergence(), jsDivergence(), in nats; the counts should not be
+  negative).
+
+  Pairs of Counters are traversed with Counter::forEachJoint(), which visits
+  the values of the smaller counter only, merging sorted maps or looking the
+  values up in the larger counter in batches. DenseCounters over the same
+  vocabulary are compared with the vectorized kernels of Kernels.hpp. The
+  CounterMap overloads compare two rows of a map, a missing row being an
+  empty counter.
+
   @author Yuriy Skobov
 */
 
 #ifndef __COUNTERS_h__
 #define __COUNTERS_h__
 
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+#include "Counters/DenseCounter.hpp"
+
 namespace Counters
 {
+  /*!  @name Vector Operations
+   *   @{
+   */
+  /*! @brief Returns the sum of the products of the counts of the values of
+   *  both counters. */
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t dot( Counter<V, MapA> const& a, Counter<V, MapB> const& b );
+  /*! @brief Returns the Euclidean norm of the counts. */
+  template <typename V, typename CoreMap>
+  CountersCount_t l2Norm( Counter<V, CoreMap> const& a );
+  /*! @brief Returns dot(a, b) / (l2Norm(a) * l2Norm(b)), or 0 if either
+   *  norm is 0. */
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t cosine( Counter<V, MapA> const& a, Counter<V, MapB> const& b );
+  /*! @brief Returns the sum of the absolute differences of the counts. */
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t l1Distance( Counter<V, MapA> const& a, Counter<V, MapB> const& b );
+  /*! @brief Returns the Euclidean distance between the counts. */
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t l2Distance( Counter<V, MapA> const& a, Counter<V, MapB> const& b );
+  /*! @brief Returns the entropy of the distribution of the counter, or 0 if
+   *  its total count is 0. */
+  template <typename V, typename CoreMap>
+  CountersCount_t entropy( Counter<V, CoreMap> const& p );
+  /*! @brief Returns the Kullback-Leibler divergence of the distribution of q
+   *  from the distribution of p, which is infinite if q lacks a value of p,
+   *  or 0 if either total count is 0. */
+  template <typename V, typename MapP, typename MapQ>
+  CountersCount_t klDivergence( Counter<V, MapP> const& p, Counter<V, MapQ> const& q );
+  /*! @brief Returns the Jensen-Shannon divergence between the distributions
+   *  of p and q (at most log(2)), or 0 if either total count is 0. */
+  template <typename V, typename MapP, typename MapQ>
+  CountersCount_t jsDivergence( Counter<V, MapP> const& p, Counter<V, MapQ> const& q );
+  /*! @} */
+
+  /*!  @name Dense Vector Operations
+   *   See the Counter overloads. Counters over different vocabularies are
+   *   compared as Counters (see DenseCounter::toCounter()).
+   *   @{
+   */
+  template <typename V>
+  CountersCount_t dot( DenseCounter<V> const& a, DenseCounter<V> const& b );
+  template <typename V>
+  CountersCount_t l2Norm( DenseCounter<V> const& a );
+  template <typename V>
+  CountersCount_t cosine( DenseCounter<V> const& a, DenseCounter<V> const& b );
+  template <typename V>
+  CountersCount_t l1Distance( DenseCounter<V> const& a, DenseCounter<V> const& b );
+  template <typename V>
+  CountersCount_t l2Distance( DenseCounter<V> const& a, DenseCounter<V> const& b );
+  template <typename V>
+  CountersCount_t entropy( DenseCounter<V> const& p );
+  template <typename V>
+  CountersCount_t klDivergence( DenseCounter<V> const& p, DenseCounter<V> const& q );
+  template <typename V>
+  CountersCount_t jsDivergence( DenseCounter<V> const& p, DenseCounter<V> const& q );
+  /*! @} */
+
+  /*!  @name Row Operations
+   *   The vector operations between the Counters of the keys a and b (or p
+   *   and q) of the CounterMap.
+   *   @{
+   */
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t dot( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b );
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t cosine( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b );
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t l1Distance( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b );
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t l2Distance( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b );
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t klDivergence( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& p, K const& q );
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t jsDivergence( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& p, K const& q );
+  /*! @} */
 
 };
 
+#include "Counters/details/_Counters.IMPL.hpp"
+
 #endif // __COUNTERS_h__
@@ -0,0 +1,220 @@
+/*! @file DeltaFormat.hpp
+  @brief A compact wire format for the deltas of Counters and CounterMaps
+  (see Counter::extractDelta()), for sending the changes of a model between
+  processes instead of the whole model.
+
+  A delta is written as a stream of bytes:
+
+  | Section     | Contents                                                  |
+  |-------------|-----------------------------------------------------------|
+  | header      | the magic "CDLT", version, flags and DeltaCountEncoding,  |
+  |             | then the step if the counts are quantized                 |
+  | tags        | the tags of the value type and, maps only, the key type   |
+  | dictionary  | the number of distinct values, then the values            |
+  | rows        | the number of rows, then for each row its key (maps only),|
+  |             | its number of entries and the entries                     |
+  | entry       | the gap from the dictionary index of the previous entry   |
+  |             | of the row (from 0 for the first), then the count         |
+
+  Integers are varints (7 bits per byte, the low bits first, as in LEB128),
+  the signed ones zigzag-coded first, so that small numbers take one byte.
+  Floating-point numbers are little-endian; the format does not depend on
+  the byte order of the writer. Each value is written once, in the
+  dictionary, however many rows change its count; the entries of a row are
+  sorted by dictionary index, so that they mostly take one byte plus the
+  count. Keys and values may be of any arithmetic type or std::basic_string
+  (see DeltaEncoding for other types).
+
+  A Counter is written as a single row without a key. A stream may hold
+  several deltas one after another: readDelta() reads exactly one.
+
+  @author Yuriy Skobov
+ */
+
+#ifndef __COUNTERS_DELTA_FORMAT_H__
+#define __COUNTERS_DELTA_FORMAT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+
+namespace Counters
+{
+  /*! @brief How the counts of a delta are written (see DeltaOptions). */
+  enum DeltaCountEncoding
+    {
+      /*! @brief Exactly, in 8 bytes. */
+      DELTA_COUNTS_DOUBLE = 0,
+      /*! @brief Rounded to floats, in 4 bytes. */
+      DELTA_COUNTS_FLOAT = 1,
+      /*! @brief Rounded to the nearest multiple of the step, written as a
+       *  varint multiple: exact for integral counts and a step of 1. */
+      DELTA_COUNTS_STEPS = 2
+    };
+
+  /*!
+   * @brief The options of writeDelta(). Counts which round to 0 are left out
+   * of the delta. The rounding errors are not carried over to the next
+   * delta: with DELTA_COUNTS_STEPS, a step of at most the smallest change
+   * which matters keeps the aggregated counts within (number of deltas)
+   * times half a step of the exact ones.
+   */
+  struct DeltaOptions
+  {
+    /*! @brief Options writing the counts with the encoding, quantized to the
+     *  step for DELTA_COUNTS_STEPS. */
+    explicit DeltaOptions( DeltaCountEncoding encoding = DELTA_COUNTS_DOUBLE, CountersCount_t quantum = 1 )
+      : counts(encoding), step(quantum) {}
+
+    DeltaCountEncoding counts;
+    /*! @brief The quantum of DELTA_COUNTS_STEPS; must be positive. */
+    CountersCount_t step;
+  };
+
+  namespace details
+  {
+    // Writes the bytes of a delta to a stream buffer, remembering failures.
+    class DeltaWriter
+    {
+    public:
+      explicit DeltaWriter( std::ostream& os ) : buffer_( os.rdbuf() ), good_( os.good() && buffer_ != NULL ) {}
+
+      void byte( std::uint8_t b )
+      {
+	if( good_ && buffer_->sputc( static_cast<char>(b) ) == std::char_traits<char>::eof() )
+	  good_ = false;
+      }
+      void varint( std::uint64_t x );
+      void zigzag( std::int64_t x )
+      { varint( (static_cast<std::uint64_t>(x) << 1) ^ static_cast<std::uint64_t>(x >> 63) ); }
+      // The low n bytes of x, little-endian.
+      void fixed( std::uint64_t x, unsigned n );
+      void bytes( char const* data, std::size_t n )
+      {
+	if( good_ && static_cast<std::size_t>( buffer_->sputn( data, n ) ) != n )
+	  good_ = false;
+      }
+      bool good(void) const { return good_; }
+
+    private:
+      std::streambuf* buffer_;
+      bool good_;
+    };
+
+    // Reads the bytes of a delta from a stream buffer; every read returns
+    // false at the end of the stream or on malformed input.
+    class DeltaReader
+    {
+    public:
+      explicit DeltaReader( std::istream& is ) : buffer_( is.good() ? is.rdbuf() : NULL ) {}
+
+      bool byte( std::uint8_t& b )
+      {
+	if( buffer_ == NULL ) return false;
+	const std::char_traits<char>::int_type c( buffer_->sbumpc() );
+	if( c == std::char_traits<char>::eof() ) return false;
+	b = static_cast<std::uint8_t>( std::char_traits<char>::to_char_type(c) );
+	return true;
+      }
+      bool varint( std::uint64_t& x );
+      bool zigzag( std::int64_t& x )
+      {
+	std::uint64_t u;
+	if( !varint(u) ) return false;
+	x = static_cast<std::int64_t>( u >> 1 ) ^ -static_cast<std::int64_t>( u & 1 );
+	return true;
+      }
+      bool fixed( std::uint64_t& x, unsigned n );
+      bool bytes( char* data, std::size_t n )
+      { return buffer_ != NULL && static_cast<std::size_t>( buffer_->sgetn( data, n ) ) == n; }
+
+    private:
+      std::streambuf* buffer_;
+    };
+  };
+
+  /*!
+   * @brief Describes how a key or a value of type T is written in a delta.
+   *
+   * Specializations provide:
+   * - static uint32_t tag(): identifies the encoding, checked by the readers;
+   * - static void write(details::DeltaWriter& w, T const& x);
+   * - static bool read(details::DeltaReader& r, T& x): false if the input
+   *   is malformed or does not fit T.
+   *
+   * Integers are varints, floating-point numbers little-endian, and strings
+   * their length followed by their characters (varints if wider than one
+   * byte). The tags are those of BinaryEncoding.
+   */
+  template <typename T, typename Enable = void>
+  struct DeltaEncoding;
+
+  template <typename T>
+  struct DeltaEncoding<T, typename std::enable_if<std::is_integral<T>::value>::type>
+  {
+    static std::uint32_t tag(void) { return (std::is_signed<T>::value ? 2u : 1u) << 8 | sizeof(T); }
+    static void write( details::DeltaWriter& w, T const& x );
+    static bool read( details::DeltaReader& r, T& x );
+  };
+
+  template <typename T>
+  struct DeltaEncoding<T, typename std::enable_if<std::is_floating_point<T>::value &&
+						  (sizeof(T) == 4 || sizeof(T) == 8)>::type>
+  {
+    static std::uint32_t tag(void) { return 3u << 8 | sizeof(T); }
+    static void write( details::DeltaWriter& w, T const& x );
+    static bool read( details::DeltaReader& r, T& x );
+  };
+
+  template <typename C, typename Traits, typename Alloc>
+  struct DeltaEncoding< std::basic_string<C, Traits, Alloc> >
+  {
+    typedef std::basic_string<C, Traits, Alloc> String_t;
+
+    static std::uint32_t tag(void) { return 4u << 8 | sizeof(C); }
+    static void write( details::DeltaWriter& w, String_t const& x );
+    static bool read( details::DeltaReader& r, String_t& x );
+  };
+
+  /*!  @name Delta Writers
+   *   Write a delta (see Counter::extractDelta() and
+   *   CounterMap::extractDelta()) and return FALSE if os failed or if a
+   *   count cannot be quantized (a step which is not positive, or a
+   *   multiple beyond 2^62).
+   *   @{
+   */
+  template <typename V, typename CoreMap>
+  bool writeDelta( std::ostream& os, Counter<V, CoreMap> const& delta,
+		   DeltaOptions const& options = DeltaOptions() );
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool writeDelta( std::ostream& os, CounterMap<K, V, RowMap, OuterMap> const& delta,
+		   DeltaOptions const& options = DeltaOptions() );
+  /*!  @} */
+
+  /*!  @name Delta Readers
+   *   Read one delta written by writeDelta() into delta, replacing its
+   *   counts; it can then be merged with Counter::applyDelta() or
+   *   CounterMap::applyDelta(). delta is emptied with its clear(), which
+   *   keeps its map type, factory and settings, then filled with
+   *   setCount(). Return FALSE, leaving delta unchanged, if the input is
+   *   not a delta of the same types.
+   *   @{
+   */
+  template <typename V, typename CoreMap>
+  bool readDelta( std::istream& is, Counter<V, CoreMap>& delta );
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool readDelta( std::istream& is, CounterMap<K, V, RowMap, OuterMap>& delta );
+  /*!  @} */
+
+};
+
+#include "Counters/details/_DeltaFormat.IMPL.hpp"
+
+#endif // __COUNTERS_DELTA_FORMAT_H__
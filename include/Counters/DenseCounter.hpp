@@ -0,0 +1,202 @@
+/*!@file DenseCounter.hpp
+ * @brief A counter which stores its counts in an array indexed by the ids of
+ * a shared Vocabulary.
+ *
+ * @author Yuriy Skobov
+ */
+
+#ifndef __DENSE_COUNTER_H__
+#define __DENSE_COUNTER_H__
+
+#include <ostream>
+#include <limits>
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "Counters/Counter.hpp"
+#include "Counters/Kernels.hpp"
+#include "Counters/NumCache.hpp"
+#include "Counters/Vocabulary.hpp"
+
+
+namespace Counters
+{
+  template <typename V>
+  class DenseCounter;
+
+  template <typename V>
+  std::ostream& operator<<(std::ostream&, const DenseCounter<V>&);
+
+  /*!
+   * @brief A counter whose counts are stored in a contiguous array indexed by
+   * the ids which a Vocabulary assigns to the values.
+   *
+   * Lookups by value cost one vocabulary lookup and an array access; lookups by
+   * id (see the "By Id" group) cost only the array access. Sums, scaling,
+   * normalization, maxValue(), equals() and the arithmetic with counters over
+   * the same vocabulary are vectorized scans over the array (see Kernels.hpp).
+   * The summation algorithm of totalCount() can be chosen with
+   * setSummationPolicy(). This suits counters over a
+   * vocabulary which most of them use (e.g. unigram counts, or the rows of a
+   * model over a small tag set). For sparse rows over a large vocabulary, see
+   * InternedCounterMap.
+   *
+   * Unlike Counter, a DenseCounter does not distinguish between a value which
+   * is not in the counter and a value whose count is 0: contains() checks for
+   * a non-zero count, and size() counts the non-zero counts.
+   *
+   * The total count is cached as in Counter (see NumCache).
+   *
+   * Counters which are combined (+=, -=, equals(), ...) should share the
+   * vocabulary; otherwise the values of the other counter are looked up by
+   * value.
+   *
+   * @param V Value type whose counts are stored.
+   */
+  template <typename V>
+  class DenseCounter
+  {
+  public:
+    /*! @brief Type parameter V a.k.a. type of values whose counts are stored. */
+    typedef V Value_t;
+    /*! @brief Type used for stored counts (currently double). */
+    typedef CountersCount_t Count_t;
+    /*! @brief Type of the vocabulary mapping the values to ids. */
+    typedef Vocabulary<V> Vocabulary_t;
+    /*! @brief Type of the ids of the values. */
+    typedef typename Vocabulary_t::Id_t Id_t;
+    /*! @brief Unsigned integer type that can represent any non-negative value.*/
+    typedef std::size_t Size_t;
+
+    /*! @name Constructors, Assignment, and Swap
+     *  @{ */
+    /*!
+     * @brief Constructs an empty counter over the vocabulary.
+     * @param vocabulary Vocabulary shared with other counters; a new one is
+     * created if none is given.
+     */
+    explicit DenseCounter( std::shared_ptr<Vocabulary_t> vocabulary
+			   = std::shared_ptr<Vocabulary_t>( new Vocabulary_t() ) );
+    /*! @brief Swaps contents with another DenseCounter in constant time. */
+    void swap( DenseCounter& other );
+    /*! @} */
+
+    /*! @name Modifiers
+     *  @{ */
+    /*! @brief Increments the count of the value, interning the value if
+     *  needed. */
+    void incrementCount( V const& val, Count_t count );
+    /*! @brief Heterogeneous incrementCount(). See Vocabulary::intern(). */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value>::type
+    incrementCount( ValueLike const& val, Count_t count );
+    /*! @brief Sets the count of the value, interning the value if needed. */
+    void setCount( V const& val, Count_t count );
+    /*! @brief Scales the counts so that they add up to 1 (or sets them all to
+     *  0 if they add up to 0). Synchronizes the cache. */
+    void normalize(void);
+    /*! @brief Sets the count of the value to 0. */
+    void remove( V const& val );
+    /*! @brief Sets all counts to 0. Keeps the array. */
+    void clear(void);
+    /*! @} */
+
+    /*! @name By Id
+     *  @{ */
+    /*! @brief Increments the count under the id. */
+    void incrementCountById( Id_t id, Count_t count );
+    /*! @brief Sets the count under the id. */
+    void setCountById( Id_t id, Count_t count );
+    /*! @brief Returns the count under the id (0 if the id is past the array). */
+    Count_t getCountById( Id_t id ) const
+    { return id < counts_.size() ? counts_[id] : 0; }
+    /*! @brief Returns the array of counts, indexed by id. Its size may be less
+     *  than the size of the vocabulary; missing counts are 0. */
+    std::vector<Count_t> const& counts(void) const { return counts_; }
+    /*! @} */
+
+    /*! @name Size and Lookup
+     *  @{ */
+    /*! @brief Returns true if all counts are 0. */
+    bool empty(void) const { return size() == 0; }
+    /*! @brief Returns the number of non-zero counts. Linear in the size of the
+     *  array. */
+    Size_t size(void) const;
+    /*! @brief Checks whether the count of the value is non-zero. */
+    bool contains( V const& val ) const { return getCount(val) != 0; }
+    /*! @brief Returns the count of the value, or 0. */
+    Count_t getCount( V const& val ) const;
+    /*! @brief Heterogeneous getCount(). See Vocabulary::find(). */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, Count_t>::type
+    getCount( ValueLike const& val ) const;
+    /*! @brief Returns the sum of all counts. See Counter::totalCount(). */
+    Count_t totalCount(void) const;
+    /*! @brief Returns the value with the greatest count, or V() if the counter
+     *  is empty. */
+    V maxValue(void) const;
+    /*! @brief Returns the vocabulary of the counter. */
+    std::shared_ptr<Vocabulary_t> const& vocabulary(void) const { return vocabulary_; }
+    /*! @brief Copies the non-zero counts into a Counter. */
+    Counter<V> toCounter(void) const;
+    /*! @} */
+
+    /*! @name Equality
+     *  @{ */
+    /*! @brief Compares the non-zero counts of the counters. */
+    bool operator==( DenseCounter const& o ) const { return equals(o, 0); }
+    /*! @brief Equivalent to !(this->operator==(o)). */
+    bool operator!=( DenseCounter const& o ) const { return !equals(o, 0); }
+    /*! @brief Checks whether the counts of every value differ by less than
+     *  precision (or are equal if precision is 0). */
+    bool equals( DenseCounter const& other, Count_t precision =
+		 std::numeric_limits<Count_t>::epsilon() ) const;
+    /*! @} */
+
+    /*! @name Caching Policy
+     *  @{ */
+    /*! @brief Sets caching policy. See Counter::setCachePolicy(). */
+    void setCachePolicy(NumCachePolicy cachePolicy) const { cachedTotal_.setCachePolicy(cachePolicy); }
+    /*! @brief Reports current caching policy. */
+    NumCachePolicy getCachePolicy(void) const { return cachedTotal_.getCachePolicy(); }
+    /*! @brief Sets the cache to "unsynchronized". Does not affect the policy. */
+    void resetCache(void) const { cachedTotal_.reset(); }
+    /*! @brief Sets the summation algorithm of totalCount() (naive by default),
+     *  and resets the cache. */
+    void setSummationPolicy(SummationPolicy summation) const { summation_ = summation; cachedTotal_.reset(); }
+    /*! @brief Reports the summation algorithm of totalCount(). */
+    SummationPolicy getSummationPolicy(void) const { return summation_; }
+    /*! @} */
+
+    /*! @name Arithmetic Operators
+     *  @{ */
+    /*! @brief Adds the counts of the other counter to this counter. */
+    DenseCounter& operator+=( DenseCounter const& o );
+    /*! @brief Subtracts the counts of the other counter from this counter. */
+    DenseCounter& operator-=( DenseCounter const& o );
+    /*! @brief Multiplies each count by the number. */
+    DenseCounter& operator*=( Count_t count );
+    /*! @brief Divides each count by the number. */
+    DenseCounter& operator/=( Count_t count ) { return operator*=(1.0/count); }
+    /*! @} */
+
+  private:
+    void addScaled( DenseCounter const& o, Count_t scale );
+    Count_t& ensureCount( Id_t id );
+
+    std::shared_ptr<Vocabulary_t> vocabulary_;
+    std::vector<Count_t> counts_;
+
+    // total cache:
+    typedef NumCache<Count_t> CountCache;
+    mutable CountCache cachedTotal_;
+    mutable SummationPolicy summation_;
+  };
+
+};
+
+#include "Counters/details/_DenseCounter.IMPL.hpp"
+
+#endif //__DENSE_COUNTER_H__
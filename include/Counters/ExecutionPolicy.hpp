@@ -0,0 +1,71 @@
+/*! @file ExecutionPolicy.hpp
+  @brief Parameters of the parallel row-wise operations of CounterMap.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __EXECUTION_POLICY_H__
+#define __EXECUTION_POLICY_H__
+
+#include <cstddef>
+#include <thread>
+
+namespace Counters
+{
+  /*!
+   * @brief Selects how the row-wise operations of a CounterMap which take an
+   * ExecutionPolicy (e.g. CounterMap::totalCount(ExecutionPolicy const&)) are
+   * run.
+   *
+   * The rows are split into blocks of grain consecutive rows (in the order in
+   * which the map iterates over them), and the blocks are processed by up to
+   * threads threads. Maps with fewer than two blocks, and policies with a
+   * single thread, use the sequential implementations.
+   */
+  struct ExecutionPolicy
+  {
+    /*! @brief The order in which the parallel reductions add up the counts. */
+    enum Summation
+    {
+      /*! The totals of the rows are added in the order of the sequential
+       *  implementation, so the result is identical to it. */
+      SEQUENTIAL_ORDER,
+      /*! Each block is summed separately, and the sums of the blocks are
+       *  added in order. The result depends on grain, but not on the number
+       *  of threads. */
+      BLOCKED
+    };
+
+    /*!
+     * @param threads The number of threads; 0 uses one per hardware thread.
+     * @param grain The number of rows per block (at least 1).
+     * @param summation See Summation.
+     */
+    explicit ExecutionPolicy( std::size_t threads = 0, std::size_t grain = 1024,
+			      Summation summation = SEQUENTIAL_ORDER )
+      : threads( threads > 0 ? threads : hardwareThreads() ),
+	grain( grain > 0 ? grain : 1 ),
+	summation( summation )
+    {}
+
+    /*! @brief A policy which runs the sequential implementations. */
+    static ExecutionPolicy sequential(void) { return ExecutionPolicy(1); }
+
+    /*! @brief Whether n rows are processed in parallel. */
+    bool isParallel( std::size_t n ) const { return threads > 1 && n > grain; }
+
+    std::size_t threads;
+    std::size_t grain;
+    Summation summation;
+
+  private:
+    static std::size_t hardwareThreads(void)
+    {
+      unsigned const n( std::thread::hardware_concurrency() );
+      return n > 0 ? n : 1;
+    }
+  };
+
+};
+
+#endif // __EXECUTION_POLICY_H__
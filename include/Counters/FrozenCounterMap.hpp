@@ -0,0 +1,277 @@
+/*! @file FrozenCounterMap.hpp
+  @brief An immutable, read-optimized snapshot of a CounterMap.
+
+  @author Yuriy Skobov
+ */
+
+#ifndef __FROZEN_COUNTER_MAP_H__
+#define __FROZEN_COUNTER_MAP_H__
+
+#include <cstddef>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include "Counters/CounterMap.hpp"
+#include "AnyMap/details/_KeyView.hpp"
+
+namespace Counters
+{
+  template <typename K, typename V>
+  class FrozenCounterMap;
+
+  /*! @brief Outputs the FrozenCounterMap in the format of CounterMap. */
+  template <typename K, typename V>
+  std::ostream& operator<<( std::ostream& os, FrozenCounterMap<K, V> const& frozen );
+
+  /*!
+   * @brief A read-only copy of a CounterMap laid out in contiguous arrays
+   * (compressed sparse rows).
+   *
+   * The keys are stored sorted in one array; the values of all the rows are
+   * stored in another, row after row, each row sorted, with their counts in a
+   * parallel array. An offsets array delimits the rows. A lookup is therefore
+   * a binary search over the keys and one over the values of the row: no
+   * virtual call, no allocation and no pointer chasing besides the keys' and
+   * values' own (e.g. the characters of strings). The totals of the rows and
+   * of the whole mapping are computed once, at construction, and so are the
+   * normalized counts (the probabilities of the values given the key) when
+   * requested.
+   *
+   * Nothing is modified after construction (there are no caches), so any
+   * number of threads may query the same FrozenCounterMap concurrently
+   * without locking.
+   *
+   * The lookups mirror those of CounterMap, including the heterogeneous ones
+   * (see MapTypeErasure::KeyView). Both K and V must be ordered by operator<,
+   * which must agree with the same operator on their key views. The rows of
+   * the frozen CounterMap must store a count per value (i.e. not be backed by
+   * a CountMinSketch).
+   *
+   * @param K Key type of the mapping.
+   * @param V Value type of the rows.
+   */
+  template <typename K, typename V>
+  class FrozenCounterMap
+  {
+  public:
+    /*! @brief Type parameter K a.k.a. type of top-level keys in the mapping. */
+    typedef K Key_t;
+    /*! @brief Type parameter V a.k.a. type of values counted in each row. */
+    typedef V Value_t;
+    /*! @brief Type used to store counts. */
+    typedef CountersCount_t Count_t;
+    /*! @brief Unsigned integer type that can represent any non-negative value. */
+    typedef std::size_t Size_t;
+
+    /*!
+     * @brief A row of the mapping: the sorted values of a key with their
+     * counts. Rows are views of the arrays of the FrozenCounterMap and are
+     * valid as long as it is.
+     */
+    class Row
+    {
+    public:
+      /*! @brief An empty row. */
+      Row() : values_(NULL), counts_(NULL), probabilities_(NULL), size_(0), total_(0) {}
+
+      /*! @brief The number of values in the row. */
+      Size_t size(void) const { return size_; }
+      /*! @brief Checks if the row has no values. */
+      bool empty(void) const { return size_ == 0; }
+      /*! @brief The i-th value of the row, in the order of the values. */
+      V const& value( Size_t i ) const { return values_[i]; }
+      /*! @brief The count of the i-th value of the row. */
+      Count_t count( Size_t i ) const { return counts_[i]; }
+      /*! @brief The sorted values of the row. */
+      V const* values(void) const { return values_; }
+      /*! @brief The counts of the values of the row. */
+      Count_t const* counts(void) const { return counts_; }
+      /*! @brief The precomputed probabilities of the values, or NULL if
+       *  they were not requested. */
+      Count_t const* probabilities(void) const { return probabilities_; }
+      /*! @brief The total count of the row. */
+      Count_t totalCount(void) const { return total_; }
+
+      /*! @brief The index of the value in the row, or size() if absent. */
+      Size_t find( V const& val ) const { return findView( ValView_t(val) ); }
+      /*! @brief Heterogeneous find(). */
+      template <typename ValueLike>
+      typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, Size_t>::type
+      find( ValueLike const& val ) const { return findView( ValView_t(val) ); }
+
+      /*! @brief The count of the value, or 0 if absent. */
+      Count_t getCount( V const& val ) const { return countAt( find(val) ); }
+      /*! @brief Heterogeneous getCount(). */
+      template <typename ValueLike>
+      typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, Count_t>::type
+      getCount( ValueLike const& val ) const { return countAt( find(val) ); }
+
+      /*! @brief The count of the value divided by the total count of the row
+       *  (precomputed if requested), or 0 if the value is absent. */
+      Count_t getProbability( V const& val ) const { return probabilityAt( find(val) ); }
+      /*! @brief Heterogeneous getProbability(). */
+      template <typename ValueLike>
+      typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, Count_t>::type
+      getProbability( ValueLike const& val ) const { return probabilityAt( find(val) ); }
+
+      /*! @brief The value with the greatest count (the first in the order of
+       *  the values if several), or V() if the row is empty. */
+      V maxValue(void) const;
+
+    private:
+      friend class FrozenCounterMap;
+      typedef typename MapTypeErasure::KeyView<V>::type ValView_t;
+
+      Row( V const* values, Count_t const* counts, Count_t const* probabilities,
+	   Size_t size, Count_t total )
+	: values_(values), counts_(counts), probabilities_(probabilities), size_(size), total_(total) {}
+
+      Size_t findView( ValView_t const& val ) const;
+      Count_t countAt( Size_t i ) const { return i == size_ ? 0 : counts_[i]; }
+      Count_t probabilityAt( Size_t i ) const;
+
+      V const* values_;
+      Count_t const* counts_;
+      Count_t const* probabilities_;
+      Size_t size_;
+      Count_t total_;
+    };
+
+    /*!  @name Constructors and Swap
+     *   @{
+     */
+    /*! @brief Constructs an empty mapping. */
+    FrozenCounterMap() : offsets_(1, 0), total_(0), withProbabilities_(false) {}
+    /*!
+     * @brief Copies the counts of the CounterMap (of any backend).
+     * @param counterMap The mapping to freeze.
+     * @param withProbabilities Whether to precompute the probabilities of the
+     * values given the keys (one more count per value).
+     */
+    template <typename RowMap, typename OuterMap>
+    explicit FrozenCounterMap( CounterMap<K, V, RowMap, OuterMap> const& counterMap,
+			       bool withProbabilities = false );
+
+    /*! @brief Swaps contents with another FrozenCounterMap in constant time. */
+    void swap( FrozenCounterMap& other );
+    /*!  @} */
+
+    /*!  @name Lookup
+     *   See the corresponding methods of CounterMap.
+     *   @{
+     */
+    bool contains( K const& key ) const { return findRow( KeyView_t(key) ) != keys_.size(); }
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, bool>::type
+    contains( KeyLike const& key ) const { return findRow( KeyView_t(key) ) != keys_.size(); }
+
+    bool contains( K const& key, V const& val ) const;
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, bool>::type
+    contains( KeyArg const& key, ValArg const& val ) const;
+
+    Size_t size(void) const { return keys_.size(); }
+    Size_t size( K const& key ) const { return getRow(key).size(); }
+    bool empty(void) const { return keys_.empty(); }
+
+    Count_t getCount( K const& key, V const& val ) const { return getRow(key).getCount(val); }
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, Count_t>::type
+    getCount( KeyArg const& key, ValArg const& val ) const { return getRow(key).getCount(val); }
+
+    Count_t totalCount(void) const { return total_; }
+    Count_t totalCount( K const& key ) const { return getRow(key).totalCount(); }
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, Count_t>::type
+    totalCount( KeyLike const& key ) const { return getRow(key).totalCount(); }
+
+    V maxValue( K const& key ) const { return getRow(key).maxValue(); }
+    /*!  @} */
+
+    /*!
+     * @brief Reports the probability of the value given the key, i.e. the
+     * count of the pair divided by the total count of the row, or 0 if
+     * there is no such pair. Precomputed if requested at construction.
+     */
+    Count_t getProbability( K const& key, V const& val ) const { return getRow(key).getProbability(val); }
+    /*! @brief Heterogeneous getProbability(). */
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, Count_t>::type
+    getProbability( KeyArg const& key, ValArg const& val ) const { return getRow(key).getProbability(val); }
+    /*! @brief Checks whether the probabilities were precomputed. */
+    bool hasProbabilities(void) const { return withProbabilities_; }
+
+    /*!  @name Rows
+     *   @{
+     */
+    /*! @brief Returns the row of the key, which is empty if there is no
+     *  such key. */
+    Row getRow( K const& key ) const { return row( findRow( KeyView_t(key) ) ); }
+    /*! @brief Heterogeneous getRow(). */
+    template <typename KeyLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, Row>::type
+    getRow( KeyLike const& key ) const { return row( findRow( KeyView_t(key) ) ); }
+
+    /*! @brief The sorted keys; the i-th key is that of row(i). */
+    std::vector<K> const& keys(void) const { return keys_; }
+    /*! @brief The i-th row in the order of the keys, or an empty row if i is
+     *  not less than size(). */
+    Row row( Size_t i ) const;
+    /*!  @} */
+
+    /*!  @name Arrays
+     *   The arrays of the layout, e.g. to write them out (see writeBinary()).
+     *   @{
+     */
+    /*! @brief offsets()[i] is the index in values() of the first value of
+     *  row(i); offsets()[size()] is the number of values. */
+    std::vector<Size_t> const& offsets(void) const { return offsets_; }
+    /*! @brief The values of all the rows, row after row. */
+    std::vector<V> const& values(void) const { return values_; }
+    /*! @brief The counts of values(). */
+    std::vector<Count_t> const& counts(void) const { return counts_; }
+    /*! @brief The probabilities of values(), empty unless they were
+     *  precomputed. */
+    std::vector<Count_t> const& probabilities(void) const { return probabilities_; }
+    /*! @brief The total counts of the rows. */
+    std::vector<Count_t> const& rowTotals(void) const { return rowTotals_; }
+    /*!  @} */
+
+    /*!
+     * @brief Copies the counts into a CounterMap, e.g. to update them.
+     * @return The CounterMap created with the specified factory.
+     */
+    template <typename CounterMap_t>
+    CounterMap_t thaw( CounterMap_t counterMap = CounterMap_t() ) const;
+
+  private:
+    typedef typename MapTypeErasure::KeyView<K>::type KeyView_t;
+
+    Size_t findRow( KeyView_t const& key ) const;
+
+    std::vector<K> keys_;
+    // offsets_[i] is the index of the first value of row i in values_,
+    // offsets_[size()] the number of values
+    std::vector<Size_t> offsets_;
+    std::vector<V> values_;
+    std::vector<Count_t> counts_;
+    // empty unless requested
+    std::vector<Count_t> probabilities_;
+    std::vector<Count_t> rowTotals_;
+    Count_t total_;
+    bool withProbabilities_;
+  };
+
+  /*! @brief Returns a FrozenCounterMap with the counts of the CounterMap. See
+   *  FrozenCounterMap(). */
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  FrozenCounterMap<K, V> freeze( CounterMap<K, V, RowMap, OuterMap> const& counterMap,
+				 bool withProbabilities = false )
+  { return FrozenCounterMap<K, V>( counterMap, withProbabilities ); }
+
+};
+
+#include "Counters/details/_FrozenCounterMap.IMPL.hpp"
+
+#endif //__FROZEN_COUNTER_MAP_H__
@@ -0,0 +1,205 @@
+/*! @file InternedCounterMap.hpp
+  @brief A CounterMap whose rows count vocabulary ids instead of values.
+
+  @author Yuriy Skobov
+ */
+
+#ifndef __INTERNED_COUNTER_MAP_H__
+#define __INTERNED_COUNTER_MAP_H__
+
+#include <memory>
+#include <ostream>
+#include <type_traits>
+
+#include "Counters/CounterMap.hpp"
+#include "Counters/CounterFactories.hpp"
+#include "Counters/Vocabulary.hpp"
+#include "AnyMap/SortedVectorMap.hpp"
+
+namespace Counters
+{
+  /*!
+   * @brief A mapping of keys to counters over values which are stored once, in
+   * a Vocabulary shared by all the rows (and possibly other counter maps).
+   *
+   * Internally this is a CounterMap<K, Id_t> whose Counter rows are keyed by
+   * the vocabulary ids of the values. The public interface takes and returns
+   * the values themselves; the rows and their ids are available through
+   * getCounter() and vocabulary() for code which works with ids directly.
+   *
+   * By default the rows are backed by MapTypeErasure::SortedVectorMap, so a
+   * lookup in a row is a binary search over integers and a row costs about
+   * sizeof(std::pair<Id_t, Count_t>) per value. Any CounterFactory<Id_t> can be
+   * passed instead (e.g. a MapTypeCounterFactory over a FlatHashMap for large
+   * rows).
+   *
+   * @param K Key type for the Counter mapping.
+   * @param V Value type for the mapped Counter objects.
+   */
+  template <typename K, typename V>
+  class InternedCounterMap
+  {
+  public:
+    /*! @brief Type parameter K a.k.a. type of top-level keys in the mapping. */
+    typedef K Key_t;
+    /*! @brief Type parameter V a.k.a. type of values counted in each row. */
+    typedef V Value_t;
+    /*! @brief Type of the vocabulary mapping the values to ids. */
+    typedef Vocabulary<V> Vocabulary_t;
+    /*! @brief Type of the ids of the values. */
+    typedef typename Vocabulary_t::Id_t Id_t;
+    /*! @brief Type of the underlying counter map over ids. */
+    typedef CounterMap<K, Id_t> IdCounterMap_t;
+    /*! @brief Type of the rows (counters over ids). */
+    typedef typename IdCounterMap_t::Counter_t Row_t;
+    /*! @brief Type used to store counts. */
+    typedef typename IdCounterMap_t::Count_t Count_t;
+    /*! @brief Unsigned integer type that can represent any non-negative value. */
+    typedef typename IdCounterMap_t::Size_t Size_t;
+    /*! @brief A constant iterator over the keys and their rows. */
+    typedef typename IdCounterMap_t::ConstIterator ConstIterator;
+    /*! @brief The default type of the rows' maps. */
+    typedef MapTypeErasure::SortedVectorMap<Id_t, Count_t> DefaultRowMap_t;
+
+    /*!  @name Constructors and Swap
+     *   @{
+     */
+    /*!
+     * @brief Constructs an empty mapping.
+     * @param vocabulary Vocabulary of the values, possibly shared; a new one is
+     * created if none is given.
+     * @param coreMap The map used to hold the key-row associations.
+     * @param rowFactory The factory used to create new rows.
+     */
+    explicit InternedCounterMap( std::shared_ptr<Vocabulary_t> vocabulary
+				 = std::shared_ptr<Vocabulary_t>( new Vocabulary_t() ),
+				 typename IdCounterMap_t::CoreMap_t coreMap
+				 = typename IdCounterMap_t::CoreMap_t(),
+				 CounterFactory<Id_t> const& rowFactory
+				 = MapTypeCounterFactory<Id_t, DefaultRowMap_t>() );
+
+    /*! @brief Swaps contents with another InternedCounterMap in constant time. */
+    void swap( InternedCounterMap& other );
+    /*!  @} */
+
+    /*!  @name Modifiers
+     *   @{
+     */
+    /*! @brief Increments the count of the key-value pair, interning the value
+     *  if needed. See CounterMap::incrementCount(). */
+    void incrementCount( K const& key, V const& val, Count_t count )
+    { idCounterMap_.incrementCount( key, vocabulary_->intern(val), count ); }
+    /*! @overload incrementCount(K const& key, V const& val, Count_t count) */
+    void incrementCount( K && key, V const& val, Count_t count )
+    { idCounterMap_.incrementCount( std::move(key), vocabulary_->intern(val), count ); }
+    /*! @brief Heterogeneous incrementCount(): the key and the value may be any
+     *  types which can be looked up without constructing a K or a V (see
+     *  MapTypeErasure::KeyView). */
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value>::type
+    incrementCount( KeyArg const& key, ValArg const& val, Count_t count )
+    { idCounterMap_.incrementCount( key, vocabulary_->intern(val), count ); }
+
+    /*! @brief Sets the count of the key-value pair, interning the value if
+     *  needed. */
+    void setCount( K const& key, V const& val, Count_t count )
+    { idCounterMap_.setCount( key, vocabulary_->intern(val), count ); }
+
+    /*! @brief Removes the key and its row. */
+    void remove( K const& key ) { idCounterMap_.remove( key ); }
+
+    /*! @brief Removes the count of the key-value pair if it exists. The value
+     *  stays in the vocabulary. */
+    void remove( K const& key, V const& val );
+
+    /*! @brief Normalizes each of the rows. */
+    void conditionalNormalize(void) { idCounterMap_.conditionalNormalize(); }
+    /*!  @} */
+
+    /*!  @name Lookup
+     *   @{
+     */
+    /*! @brief Checks whether the key exists in the mapping. */
+    bool contains( K const& key ) const { return idCounterMap_.contains( key ); }
+    /*! @brief Checks whether the key-value pair exists in the mapping. */
+    bool contains( K const& key, V const& val ) const;
+    /*! @brief Reports the number of top level keys in the mapping. */
+    Size_t size(void) const { return idCounterMap_.size(); }
+    /*! @brief Reports the number of values in the row of the key. */
+    Size_t size( K const& key ) const { return idCounterMap_.size( key ); }
+    /*! @brief Checks if there are any keys in the mapping. */
+    bool empty(void) const { return idCounterMap_.empty(); }
+    /*! @brief Reports the count of the key-value pair, or 0. */
+    Count_t getCount( K const& key, V const& val ) const;
+    /*! @brief Heterogeneous getCount(). Neither a K nor a V is constructed. */
+    template <typename KeyArg, typename ValArg>
+    typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, Count_t>::type
+    getCount( KeyArg const& key, ValArg const& val ) const;
+    /*! @brief Reports the sum of all counts. */
+    Count_t totalCount(void) const { return idCounterMap_.totalCount(); }
+    /*! @brief Reports the total count of the row of the key. */
+    Count_t totalCount( K const& key ) const { return idCounterMap_.totalCount( key ); }
+    /*! @brief Returns the value with the greatest count in the row of the key,
+     *  or V() if there is no such row. */
+    V maxValue( K const& key ) const;
+    /*!  @} */
+
+    /*!  @name Rows and Vocabulary
+     *   @{
+     */
+    /*! @brief Returns a pointer to the row of the key (a counter over the ids
+     *  of the values) or NULL. */
+    Row_t const * getCounter( K const& key ) const { return idCounterMap_.getCounter( key ); }
+    /*! @brief Returns a Counter over the values of the row of the key. */
+    Counter<V> getValueCounter( K const& key ) const;
+    /*! @brief Returns the vocabulary of the values. */
+    std::shared_ptr<Vocabulary_t> const& vocabulary(void) const { return vocabulary_; }
+    /*! @brief Returns the underlying counter map over ids. */
+    IdCounterMap_t const& idCounterMap(void) const { return idCounterMap_; }
+    /*!  @} */
+
+    /*!  @name Traversal
+     *   @{
+     */
+    /*! @brief Iterator to the first key and its row. */
+    ConstIterator begin(void) const { return idCounterMap_.begin(); }
+    /*! @brief Iterator past the last key and its row. */
+    ConstIterator end(void) const { return idCounterMap_.end(); }
+    /*!  @} */
+
+    /*!  @name Equality and Arithmetic Operators
+     *   @{
+     */
+    /*! @brief Checks whether the counts of the mappings differ by less than
+     *  precision (or are equal if precision is 0). When the vocabularies
+     *  differ, the rows are compared by value. */
+    bool equals( InternedCounterMap const& other,
+		 Count_t precision = std::numeric_limits<Count_t>::epsilon() ) const;
+    /*! @brief Exact comparison, see equals(). */
+    bool operator==( InternedCounterMap const& other ) const { return equals( other, 0 ); }
+    /*! @brief Equivalent to !(this->operator==(other)). */
+    bool operator!=( InternedCounterMap const& other ) const { return !equals( other, 0 ); }
+    /*! @brief Adds the counts of the other mapping. Cheapest when the
+     *  vocabulary is shared. */
+    InternedCounterMap& operator+=( InternedCounterMap const& rhs );
+    /*! @brief Multiplies every count by num. */
+    InternedCounterMap& operator*=( Count_t num ) { idCounterMap_ *= num;  return *this; }
+    /*! @brief Divides every count by num. */
+    InternedCounterMap& operator/=( Count_t num ) { idCounterMap_ /= num;  return *this; }
+    /*!  @} */
+
+  private:
+    std::shared_ptr<Vocabulary_t> vocabulary_;
+    IdCounterMap_t idCounterMap_;
+  };
+
+  /*! @brief Outputs the InternedCounterMap with its values in a human readable
+   *  format. */
+  template <typename K, typename V>
+  std::ostream& operator<<( std::ostream& os, InternedCounterMap<K, V> const& counterMap );
+
+};
+
+#include "Counters/details/_InternedCounterMap.IMPL.hpp"
+
+#endif //__INTERNED_COUNTER_MAP_H__
@@ -0,0 +1,486 @@
+/*! @file Kernels.hpp
+  @brief Arithmetic kernels over contiguous arrays of counts, and the
+  summation policies of the totals.
+
+  The kernels use AVX2 when the processor supports it (checked once, at the
+  first call) and portable loops otherwise. Define COUNTERS_NO_SIMD to always
+  use the portable loops.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __COUNTERS_KERNELS_H__
+#define __COUNTERS_KERNELS_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#if !defined(COUNTERS_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COUNTERS_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace Counters
+{
+  /*!
+   * @brief The summation algorithm, e.g. of DenseCounter::totalCount() and
+   * Counter::totalCount().
+   *
+   * The naive sum of n counts may be off by about n times the rounding error
+   * of one addition, the pairwise sum by about log(n) times, and the Kahan
+   * (Neumaier) sum by about one rounding error, whatever n.
+   */
+  enum SummationPolicy
+  {
+    SUMMATION_NAIVE,     /*!< Several running sums (one per vector lane). The fastest. */
+    SUMMATION_PAIRWISE,  /*!< Naive sums of blocks, added pairwise. About as fast. */
+    SUMMATION_KAHAN      /*!< Compensated summation. A few times slower. */
+  };
+
+  namespace kernels
+  {
+    /*! @brief Returns the sum of x[0], ..., x[n-1]. */
+    inline double sum( double const* x, std::size_t n, SummationPolicy policy = SUMMATION_NAIVE );
+    /*! @brief Multiplies x[0], ..., x[n-1] by a. */
+    inline void scale( double* x, std::size_t n, double a );
+    /*! @brief Adds a * x[i] to y[i] for i < n. */
+    inline void axpy( double* y, double const* x, std::size_t n, double a );
+    /*! @brief Returns the index of the first greatest non-zero element of x,
+     *  or n if all the elements are 0. */
+    inline std::size_t argmaxNonZero( double const* x, std::size_t n );
+    /*! @brief Checks whether |x[i] - y[i]| < precision for i < n (or whether
+     *  x[i] == y[i] if precision is 0). */
+    inline bool equalWithin( double const* x, double const* y, std::size_t n, double precision );
+    /*! @brief Returns the sum of x[i] * y[i] for i < n. */
+    inline double dot( double const* x, double const* y, std::size_t n );
+    /*! @brief Returns the sum of |x[i]| for i < n. */
+    inline double absSum( double const* x, std::size_t n );
+    /*! @brief Returns the sum of |x[i] - y[i]| for i < n. */
+    inline double l1Distance( double const* x, double const* y, std::size_t n );
+    /*! @brief Returns the sum of (x[i] - y[i])^2 for i < n. */
+    inline double squaredDistance( double const* x, double const* y, std::size_t n );
+
+    /*! @brief A sum of values added one at a time, with the algorithm of
+     *  sum(): for counts which are not in an array (e.g. in Counter). */
+    class Summation
+    {
+    public:
+      explicit Summation( SummationPolicy policy = SUMMATION_NAIVE )
+	: policy_(policy), sum_(0), compensation_(0), blockSize_(0), blocks_(0) {}
+      /*! @brief Adds x to the sum. */
+      inline void add( double x );
+      /*! @brief Returns the sum of the values added so far. */
+      inline double result(void) const;
+    private:
+      SummationPolicy policy_;
+      // the sum (of the current block, for the pairwise sum) and its Kahan
+      // compensation
+      double sum_, compensation_;
+      std::size_t blockSize_;
+      // the number of completed blocks; levels_[k] holds the sum of 2^k of
+      // them if bit k is set
+      std::size_t blocks_;
+      double levels_[ std::numeric_limits<std::size_t>::digits ];
+    };
+
+    namespace details
+    {
+      // Pairwise sums add up naive sums of blocks of this many elements.
+      static const std::size_t PAIRWISE_BLOCK = 128;
+
+      inline double naiveSumPortable( double const* x, std::size_t n )
+      {
+	double s0(0), s1(0), s2(0), s3(0);
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  { s0 += x[i]; s1 += x[i+1]; s2 += x[i+2]; s3 += x[i+3]; }
+	for( ; i < n; ++i )
+	  s0 += x[i];
+	return (s0 + s1) + (s2 + s3);
+      }
+
+      inline void scalePortable( double* x, std::size_t n, double a )
+      { for( std::size_t i = 0; i < n; ++i ) x[i] *= a; }
+
+      inline void axpyPortable( double* y, double const* x, std::size_t n, double a )
+      { for( std::size_t i = 0; i < n; ++i ) y[i] += a * x[i]; }
+
+      inline std::size_t argmaxNonZeroPortable( double const* x, std::size_t n )
+      {
+	std::size_t max(n);
+	for( std::size_t i = 0; i < n; ++i )
+	  if( x[i] != 0 && (max == n || x[i] > x[max]) )
+	    max = i;
+	return max;
+      }
+
+      inline bool equalWithinPortable( double const* x, double const* y, std::size_t n, double precision )
+      {
+	for( std::size_t i = 0; i < n; ++i )
+	  {
+	    const double diff( std::fabs( x[i] - y[i] ) );
+	    if( precision == 0 ? diff != 0 : diff >= precision )
+	      return false;
+	  }
+	return true;
+      }
+
+      inline double dotPortable( double const* x, double const* y, std::size_t n )
+      {
+	double s0(0), s1(0), s2(0), s3(0);
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  { s0 += x[i] * y[i]; s1 += x[i+1] * y[i+1]; s2 += x[i+2] * y[i+2]; s3 += x[i+3] * y[i+3]; }
+	for( ; i < n; ++i )
+	  s0 += x[i] * y[i];
+	return (s0 + s1) + (s2 + s3);
+      }
+
+      inline double absSumPortable( double const* x, std::size_t n )
+      {
+	double s(0);
+	for( std::size_t i = 0; i < n; ++i )
+	  s += std::fabs( x[i] );
+	return s;
+      }
+
+      inline double l1DistancePortable( double const* x, double const* y, std::size_t n )
+      {
+	double s(0);
+	for( std::size_t i = 0; i < n; ++i )
+	  s += std::fabs( x[i] - y[i] );
+	return s;
+      }
+
+      inline double squaredDistancePortable( double const* x, double const* y, std::size_t n )
+      {
+	double s(0);
+	for( std::size_t i = 0; i < n; ++i )
+	  s += (x[i] - y[i]) * (x[i] - y[i]);
+	return s;
+      }
+
+#ifdef COUNTERS_KERNELS_AVX2
+      inline bool hasAvx2()
+      {
+	static const bool avx2( __builtin_cpu_supports("avx2") );
+	return avx2;
+      }
+
+      __attribute__((target("avx2")))
+      inline double horizontalSum( __m256d v )
+      {
+	__m128d s( _mm_add_pd( _mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1) ) );
+	return _mm_cvtsd_f64( _mm_add_sd( s, _mm_unpackhi_pd(s, s) ) );
+      }
+
+      __attribute__((target("avx2")))
+      inline double naiveSumAvx2( double const* x, std::size_t n )
+      {
+	__m256d s0( _mm256_setzero_pd() ), s1( s0 ), s2( s0 ), s3( s0 );
+	std::size_t i(0);
+	for( ; i + 16 <= n; i += 16 )
+	  {
+	    s0 = _mm256_add_pd( s0, _mm256_loadu_pd(x + i) );
+	    s1 = _mm256_add_pd( s1, _mm256_loadu_pd(x + i + 4) );
+	    s2 = _mm256_add_pd( s2, _mm256_loadu_pd(x + i + 8) );
+	    s3 = _mm256_add_pd( s3, _mm256_loadu_pd(x + i + 12) );
+	  }
+	for( ; i + 4 <= n; i += 4 )
+	  s0 = _mm256_add_pd( s0, _mm256_loadu_pd(x + i) );
+	double sum( horizontalSum( _mm256_add_pd( _mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3) ) ) );
+	for( ; i < n; ++i )
+	  sum += x[i];
+	return sum;
+      }
+
+      // Multiplies and adds separately (no FMA), so that the results are the
+      // same as those of the portable loops.
+      __attribute__((target("avx2")))
+      inline void scaleAvx2( double* x, std::size_t n, double a )
+      {
+	const __m256d va( _mm256_set1_pd(a) );
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  _mm256_storeu_pd( x + i, _mm256_mul_pd( _mm256_loadu_pd(x + i), va ) );
+	for( ; i < n; ++i )
+	  x[i] *= a;
+      }
+
+      __attribute__((target("avx2")))
+      inline void axpyAvx2( double* y, double const* x, std::size_t n, double a )
+      {
+	const __m256d va( _mm256_set1_pd(a) );
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  _mm256_storeu_pd( y + i, _mm256_add_pd( _mm256_loadu_pd(y + i),
+						  _mm256_mul_pd( va, _mm256_loadu_pd(x + i) ) ) );
+	for( ; i < n; ++i )
+	  y[i] += a * x[i];
+      }
+
+      // Finds the greatest non-zero element with vector compares, then its
+      // first occurrence.
+      __attribute__((target("avx2")))
+      inline std::size_t argmaxNonZeroAvx2( double const* x, std::size_t n )
+      {
+	const __m256d zero( _mm256_setzero_pd() );
+	const __m256d lowest( _mm256_set1_pd( -std::numeric_limits<double>::infinity() ) );
+	__m256d vmax( lowest ), nonZero( zero );
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  {
+	    const __m256d v( _mm256_loadu_pd(x + i) );
+	    const __m256d isNonZero( _mm256_cmp_pd( v, zero, _CMP_NEQ_OQ ) );
+	    nonZero = _mm256_or_pd( nonZero, isNonZero );
+	    vmax = _mm256_max_pd( vmax, _mm256_blendv_pd( lowest, v, isNonZero ) );
+	  }
+	double lanes[4];
+	_mm256_storeu_pd( lanes, vmax );
+	bool any( _mm256_movemask_pd(nonZero) != 0 );
+	double max( std::max( std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]) ) );
+	for( ; i < n; ++i )
+	  if( x[i] != 0 && (!any || x[i] > max) )
+	    { max = x[i]; any = true; }
+	if( !any )
+	  return n;
+	for( i = 0; i < n; ++i )
+	  if( x[i] != 0 && x[i] == max )
+	    return i;
+	return n;
+      }
+
+      __attribute__((target("avx2")))
+      inline bool equalWithinAvx2( double const* x, double const* y, std::size_t n, double precision )
+      {
+	const __m256d absMask( _mm256_castsi256_pd( _mm256_set1_epi64x( 0x7FFFFFFFFFFFFFFFLL ) ) );
+	const __m256d vprecision( _mm256_set1_pd(precision) );
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  {
+	    const __m256d diff( _mm256_and_pd( absMask, _mm256_sub_pd( _mm256_loadu_pd(x + i),
+								       _mm256_loadu_pd(y + i) ) ) );
+	    const __m256d bad( precision == 0 ? _mm256_cmp_pd( diff, _mm256_setzero_pd(), _CMP_NEQ_UQ )
+			                      : _mm256_cmp_pd( diff, vprecision, _CMP_GE_OQ ) );
+	    if( _mm256_movemask_pd(bad) != 0 )
+	      return false;
+	  }
+	return equalWithinPortable( x + i, y + i, n - i, precision );
+      }
+
+      __attribute__((target("avx2")))
+      inline double dotAvx2( double const* x, double const* y, std::size_t n )
+      {
+	__m256d s0( _mm256_setzero_pd() ), s1( s0 );
+	std::size_t i(0);
+	for( ; i + 8 <= n; i += 8 )
+	  {
+	    s0 = _mm256_add_pd( s0, _mm256_mul_pd( _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i) ) );
+	    s1 = _mm256_add_pd( s1, _mm256_mul_pd( _mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4) ) );
+	  }
+	for( ; i + 4 <= n; i += 4 )
+	  s0 = _mm256_add_pd( s0, _mm256_mul_pd( _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i) ) );
+	double sum( horizontalSum( _mm256_add_pd(s0, s1) ) );
+	for( ; i < n; ++i )
+	  sum += x[i] * y[i];
+	return sum;
+      }
+
+      __attribute__((target("avx2")))
+      inline double absSumAvx2( double const* x, std::size_t n )
+      {
+	const __m256d absMask( _mm256_castsi256_pd( _mm256_set1_epi64x( 0x7FFFFFFFFFFFFFFFLL ) ) );
+	__m256d s( _mm256_setzero_pd() );
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  s = _mm256_add_pd( s, _mm256_and_pd( absMask, _mm256_loadu_pd(x + i) ) );
+	return horizontalSum(s) + absSumPortable( x + i, n - i );
+      }
+
+      __attribute__((target("avx2")))
+      inline double l1DistanceAvx2( double const* x, double const* y, std::size_t n )
+      {
+	const __m256d absMask( _mm256_castsi256_pd( _mm256_set1_epi64x( 0x7FFFFFFFFFFFFFFFLL ) ) );
+	__m256d s( _mm256_setzero_pd() );
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  s = _mm256_add_pd( s, _mm256_and_pd( absMask, _mm256_sub_pd( _mm256_loadu_pd(x + i),
+								       _mm256_loadu_pd(y + i) ) ) );
+	return horizontalSum(s) + l1DistancePortable( x + i, y + i, n - i );
+      }
+
+      __attribute__((target("avx2")))
+      inline double squaredDistanceAvx2( double const* x, double const* y, std::size_t n )
+      {
+	__m256d s( _mm256_setzero_pd() );
+	std::size_t i(0);
+	for( ; i + 4 <= n; i += 4 )
+	  {
+	    const __m256d d( _mm256_sub_pd( _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i) ) );
+	    s = _mm256_add_pd( s, _mm256_mul_pd( d, d ) );
+	  }
+	return horizontalSum(s) + squaredDistancePortable( x + i, y + i, n - i );
+      }
+#endif // COUNTERS_KERNELS_AVX2
+
+      inline double naiveSum( double const* x, std::size_t n )
+      {
+#ifdef COUNTERS_KERNELS_AVX2
+	if( hasAvx2() ) return naiveSumAvx2( x, n );
+#endif
+	return naiveSumPortable( x, n );
+      }
+
+      inline double pairwiseSum( double const* x, std::size_t n )
+      {
+	if( n <= PAIRWISE_BLOCK )
+	  return naiveSum( x, n );
+	const std::size_t half( (n / 2 + PAIRWISE_BLOCK - 1) / PAIRWISE_BLOCK * PAIRWISE_BLOCK );
+	return pairwiseSum( x, half ) + pairwiseSum( x + half, n - half );
+      }
+
+      // Neumaier's variant, which also compensates when an element is
+      // greater than the running sum.
+      inline void kahanAdd( double& sum, double& compensation, double x )
+      {
+	const double t( sum + x );
+	if( std::fabs(sum) >= std::fabs(x) )
+	  compensation += (sum - t) + x;
+	else
+	  compensation += (x - t) + sum;
+	sum = t;
+      }
+
+      inline double kahanSum( double const* x, std::size_t n )
+      {
+	double sum(0), compensation(0);
+	for( std::size_t i = 0; i < n; ++i )
+	  kahanAdd( sum, compensation, x[i] );
+	return sum + compensation;
+      }
+    };
+
+    //------------------------------ Dispatch ----------------------------------
+
+    inline double sum( double const* x, std::size_t n, SummationPolicy policy )
+    {
+      switch( policy )
+	{
+	case SUMMATION_PAIRWISE: return details::pairwiseSum( x, n );
+	case SUMMATION_KAHAN:    return details::kahanSum( x, n );
+	default:                 return details::naiveSum( x, n );
+	}
+    }
+
+    inline void scale( double* x, std::size_t n, double a )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::scaleAvx2( x, n, a );
+#endif
+      details::scalePortable( x, n, a );
+    }
+
+    inline void axpy( double* y, double const* x, std::size_t n, double a )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::axpyAvx2( y, x, n, a );
+#endif
+      details::axpyPortable( y, x, n, a );
+    }
+
+    inline std::size_t argmaxNonZero( double const* x, std::size_t n )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::argmaxNonZeroAvx2( x, n );
+#endif
+      return details::argmaxNonZeroPortable( x, n );
+    }
+
+    inline bool equalWithin( double const* x, double const* y, std::size_t n, double precision )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::equalWithinAvx2( x, y, n, precision );
+#endif
+      return details::equalWithinPortable( x, y, n, precision );
+    }
+
+    inline double dot( double const* x, double const* y, std::size_t n )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::dotAvx2( x, y, n );
+#endif
+      return details::dotPortable( x, y, n );
+    }
+
+    inline double absSum( double const* x, std::size_t n )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::absSumAvx2( x, n );
+#endif
+      return details::absSumPortable( x, n );
+    }
+
+    inline double l1Distance( double const* x, double const* y, std::size_t n )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::l1DistanceAvx2( x, y, n );
+#endif
+      return details::l1DistancePortable( x, y, n );
+    }
+
+    inline double squaredDistance( double const* x, double const* y, std::size_t n )
+    {
+#ifdef COUNTERS_KERNELS_AVX2
+      if( details::hasAvx2() ) return details::squaredDistanceAvx2( x, y, n );
+#endif
+      return details::squaredDistancePortable( x, y, n );
+    }
+
+    //----------------------------- Summation ----------------------------------
+
+    // The pairwise sum adds up the blocks like a binary counter: a completed
+    // block is added to the sums of 1, 2, 4, ... blocks before it, as
+    // pairwiseSum() does for an array.
+    void Summation::add( double x )
+    {
+      switch( policy_ )
+	{
+	case SUMMATION_KAHAN:
+	  details::kahanAdd( sum_, compensation_, x );
+	  break;
+	case SUMMATION_PAIRWISE:
+	  sum_ += x;
+	  if( ++blockSize_ == details::PAIRWISE_BLOCK )
+	    {
+	      std::size_t k(0);
+	      for( ; (blocks_ >> k) & 1; ++k )
+		sum_ = levels_[k] + sum_;
+	      levels_[k] = sum_;
+	      ++blocks_;
+	      sum_ = 0;
+	      blockSize_ = 0;
+	    }
+	  break;
+	default:
+	  sum_ += x;
+	}
+    }
+
+    double Summation::result(void) const
+    {
+      if( policy_ == SUMMATION_KAHAN )
+	return sum_ + compensation_;
+      double sum( sum_ );
+      if( policy_ == SUMMATION_PAIRWISE )
+	for( std::size_t k = 0; (blocks_ >> k) != 0; ++k )
+	  if( (blocks_ >> k) & 1 )
+	    sum = levels_[k] + sum;
+      return sum;
+    }
+  };
+
+};
+
+#endif // __COUNTERS_KERNELS_H__
@@ -6,6 +6,28 @@ namespace Counters
   enum NumCachePolicy { CACHE_POLICY_PERSISTENT = 1 << 0,
 			CACHE_POLICY_RELAXED    = 1 << 1 };
 
+  /*!
+   * @brief How often a NumCache was read synched (hits) or unsynched
+   * (misses, i.e. the cached value had to be recomputed), and how often it
+   * went from synched to unsynched (invalidations).
+   *
+   * Only recorded if COUNTERS_CACHE_STATS is defined; otherwise all the
+   * counts stay 0 and the caches carry no counters.
+   */
+  struct NumCacheStats
+  {
+    NumCacheStats() : hits(0), misses(0), invalidations(0) {}
+
+    /*! @brief Returns the fraction of the reads which were hits, or 0 if
+     *  there were none. */
+    double hitRate(void) const
+    { return hits + misses == 0 ? 0 : double(hits) / (hits + misses); }
+
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long invalidations;
+  };
+
   /*!
    * @brief A simple Cache template with two modes of caching.
    *
@@ -32,6 +54,10 @@ namespace Counters
    *   parameter NumType is returned. It is therefore important in most 
    *   situations to call isSynched() before calling the get() method.
    *
+   * - Statistics \n
+   *   With COUNTERS_CACHE_STATS defined, lookup() and the desynchronizations
+   *   are counted (see getStats()).
+   *
    * @param NumType A numeric type which has +=, -=, *=, /=, and = operators.
    */
   template <typename NumType>
@@ -40,13 +66,16 @@ namespace Counters
     NumType value_;
     NumCachePolicy cachePolicy_;
     bool synched_;
+#ifdef COUNTERS_CACHE_STATS
+    mutable NumCacheStats stats_;
+#endif
 
   public:
     /*!
      * @brief Creates a default unsynched cache with a relaxed policy
      * (Counters::CACHE_POLICY_RELAXED)
      */
-    NumCache() : cachePolicy_(CACHE_POLICY_RELAXED), synched_(false), value_() {}
+    NumCache() : value_(), cachePolicy_(CACHE_POLICY_RELAXED), synched_(false) {}
 
     /*!
      * @brief Constructs a synched cache with the given value and policy.
@@ -83,6 +112,39 @@ namespace Counters
       return synched_ ? value_ : NumType();
     }
 
+    /*!
+     * @brief Retrieves the stored value into value if the cache is synched.
+     * This is the read which the statistics count as a hit or a miss.
+     * @return TRUE if synched, FALSE (leaving value unchanged) otherwise.
+     */
+    bool lookup(NumType& value) const {
+#ifdef COUNTERS_CACHE_STATS
+      ++( synched_ ? stats_.hits : stats_.misses );
+#endif
+      if( synched_ ) value = value_;
+      return synched_;
+    }
+
+    /*!
+     * @brief Returns the statistics of the cache (all 0 unless
+     * COUNTERS_CACHE_STATS is defined). Copies of the cache start with the
+     * statistics of the original.
+     */
+    NumCacheStats getStats(void) const {
+#ifdef COUNTERS_CACHE_STATS
+      return stats_;
+#else
+      return NumCacheStats();
+#endif
+    }
+
+    /*! @brief Clears the statistics. */
+    void resetStats(void) {
+#ifdef COUNTERS_CACHE_STATS
+      stats_ = NumCacheStats();
+#endif
+    }
+
     /*!
      * @brief Sets the caching policy.
      * @param cachePolicy The policy to set the caching policy to
@@ -113,7 +175,7 @@ namespace Counters
      * @brief Marks the cache unsynched.
      */
     void reset(void) {
-      synched_ = false;
+      invalidate();
     }
     
     /*! @name Modification of Cached Value
@@ -125,27 +187,47 @@ namespace Counters
     /*! @brief Adds n to stored value or marks cache unsynched. */
     void operator+=(NumType n) {
       if( cachePolicy_ == CACHE_POLICY_PERSISTENT )    value_ += n;
-      else                                           synched_  = false;
+      else                                           invalidate();
     }
 
     /*! @brief Subtracts n from stored value or marks cache unsynched. */
     void operator-=(NumType n) {
       if( cachePolicy_ == CACHE_POLICY_PERSISTENT )    value_ -= n;
-      else                                           synched_  = false;
+      else                                           invalidate();
     }
 
     /*! @brief Multiplies stored value by n or marks cache unsynched. */
     void operator*=(NumType n) {
       if( cachePolicy_ == CACHE_POLICY_PERSISTENT )    value_ *= n;
-      else                                           synched_  = false;
+      else                                           invalidate();
     }
 
     /*! @brief Divides stored value by n or marks cache unsynched. */
     void operator/=(NumType n) {
       if( cachePolicy_ == CACHE_POLICY_PERSISTENT )    value_ /= n;
-      else                                           synched_  = false;
+      else                                           invalidate();
     }
     /*! @} */
+
+    /*!
+     * @brief Multiplies the stored value by n under either caching policy.
+     *
+     * Unlike operator*=(), this keeps a relaxed cache synched: it is meant for
+     * caches of sums whose every term is scaled by n, where scaling the sum
+     * is as accurate as summing the scaled terms. An unsynched cache stays
+     * unsynched.
+     */
+    void scale(NumType n) {
+      value_ *= n;
+    }
+
+  private:
+    void invalidate(void) {
+#ifdef COUNTERS_CACHE_STATS
+      if( synched_ ) ++stats_.invalidations;
+#endif
+      synched_ = false;
+    }
   };
 };
 
@@ -0,0 +1,190 @@
+/*! @file SpaceSavingMap.hpp
+  @brief A map of bounded size for approximate counting of heavy hitters.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __SPACE_SAVING_MAP_H__
+#define __SPACE_SAVING_MAP_H__
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace Counters
+{
+  /*!
+   * @brief A hash map of counts which holds at most capacity() entries,
+   * evicting the entry with the smallest count as in the Space-Saving
+   * algorithm (Metwally, Agrawal and El Abbadi, 2005).
+   *
+   * The map is a backend for Counter (see SpaceSavingCounterFactory) and
+   * implements the map interface used by MapTypeErasure::AnyMap. When a new
+   * key is inserted into a full map, the entry with the smallest count is
+   * erased and its count is added to the mapped value of the new entry. As
+   * Counter::incrementCount() inserts new values with a count of 0 and then
+   * increments them, a new value inherits the count of the value it evicts.
+   *
+   * For a stream of non-negative increments with the total N, this
+   * guarantees that:
+   * - the count of each value in the map overestimates its true count by at
+   *   most N / capacity(), and never underestimates it;
+   * - every value whose true count is greater than N / capacity() is in the
+   *   map;
+   * - the counts in the map add up to N.
+   * Negative increments are stored, but void these guarantees.
+   *
+   * The entry with the smallest count is found with a min-heap of count
+   * snapshots which is refreshed lazily on eviction, because the counts are
+   * modified in place through the references to the mapped values. Insertion
+   * into a full map therefore costs amortized O(log capacity()); lookups and
+   * updates of existing values cost the same as in boost::unordered_map.
+   * Erasing a key is linear in capacity().
+   *
+   * @param K Key type.
+   * @param V Mapped (count) type; must support + and <.
+   * @param Hash Hash function for K.
+   * @param Pred Equality predicate for K.
+   */
+  template <typename K, typename V,
+	    typename Hash = boost::hash<K>, typename Pred = std::equal_to<K> >
+  class SpaceSavingMap
+  {
+    typedef boost::unordered_map<K, V, Hash, Pred> Map_t;
+
+  public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef typename Map_t::value_type value_type;
+    typedef typename Map_t::size_type size_type;
+    typedef typename Map_t::difference_type difference_type;
+    typedef Hash hasher;
+    typedef Pred key_equal;
+    typedef value_type& reference;
+    typedef value_type const& const_reference;
+    typedef typename Map_t::iterator iterator;
+    typedef typename Map_t::const_iterator const_iterator;
+
+    /*!  @name Constructors, Assignment, and Swap
+     *   @{
+     */
+    /*! @brief Constructs an empty map which holds at most capacity entries
+     *  (capacity must be positive). */
+    explicit SpaceSavingMap( size_type capacity = 1024 );
+    /*! @brief Copies the entries and the capacity. */
+    SpaceSavingMap( SpaceSavingMap const& other );
+    /*! @brief Steals the entries of other. */
+    SpaceSavingMap( SpaceSavingMap && other );
+    /*! @brief Copies the entries and the capacity. */
+    SpaceSavingMap& operator=( SpaceSavingMap const& other );
+    /*! @brief Steals the entries of other. */
+    SpaceSavingMap& operator=( SpaceSavingMap && other );
+    /*! @brief Swaps contents with another map in constant time. */
+    void swap( SpaceSavingMap& other );
+    /*!  @} */
+
+    /*!  @name Size and Capacity
+     *   @{
+     */
+    bool empty() const { return map_.empty(); }
+    size_type size() const { return map_.size(); }
+    /*! @brief The greatest number of entries, i.e. capacity(). */
+    size_type max_size() const { return capacity_; }
+    /*! @brief The greatest number of entries held before evictions start. */
+    size_type capacity() const { return capacity_; }
+    size_type bucket_count() const { return map_.bucket_count(); }
+    /*! @brief Prepares the map to hold min(n, capacity()) entries without
+     *  rehashing. */
+    void reserve( size_type n );
+    /*! @brief The number of entries evicted so far. */
+    size_type evictions() const { return evictions_; }
+    /*! @brief The smallest count in a full map (the greatest possible error
+     *  of any count), or V() if the map is not full. */
+    V min_count() const;
+    /*!  @} */
+
+    /*!  @name Lookup
+     *   @{
+     */
+    /*! @brief Returns the mapped value of k, inserting k (possibly evicting
+     *  another entry) if needed. */
+    V& operator[]( K const& k ) { return try_emplace(k).first->second; }
+    /*! @overload operator[]( K const& k ) */
+    V& operator[]( K && k ) { return try_emplace(std::move(k)).first->second; }
+    V& at( K const& k ) { return map_.at(k); }
+    V const& at( K const& k ) const { return map_.at(k); }
+    iterator find( K const& k ) { return map_.find(k); }
+    const_iterator find( K const& k ) const { return map_.find(k); }
+    size_type count( K const& k ) const { return map_.count(k); }
+    /*!  @} */
+
+    /*!  @name Iterators
+     *   @{
+     */
+    iterator       begin()       { return map_.begin(); }
+    const_iterator begin() const { return map_.begin(); }
+    iterator         end()       { return map_.end(); }
+    const_iterator   end() const { return map_.end(); }
+    /*!  @} */
+
+    /*!  @name Modifiers
+     *   The inserting modifiers evict the entry with the smallest count from
+     *   a full map and add its count to the mapped value of the new entry.
+     *   @{
+     */
+    std::pair<iterator, bool> insert( value_type const& val )
+    { return tryEmplaceImpl( val.first, val.second ); }
+    std::pair<iterator, bool> insert( value_type && val )
+    { return tryEmplaceImpl( val.first, std::move(val.second) ); }
+    template <typename InputIterator>
+    void insert( InputIterator first, InputIterator last );
+    template <typename KeyArg, typename MappedArg>
+    std::pair<iterator, bool> emplace( KeyArg && k, MappedArg && v )
+    { return tryEmplaceImpl( std::forward<KeyArg>(k), std::forward<MappedArg>(v) ); }
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace( K const& k, Args&&... args )
+    { return tryEmplaceImpl( k, std::forward<Args>(args)... ); }
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace( K && k, Args&&... args )
+    { return tryEmplaceImpl( std::move(k), std::forward<Args>(args)... ); }
+    size_type erase( K const& k );
+    void clear();
+    /*!  @} */
+
+  private:
+    // A count as of the last time the entry was pushed or refreshed.
+    typedef std::pair<V, value_type*> Snapshot_t;
+    struct SnapshotGreater
+    {
+      bool operator()( Snapshot_t const& a, Snapshot_t const& b ) const
+      { return b.first < a.first; }
+    };
+
+    template <typename KeyArg, typename... Args>
+    std::pair<iterator, bool> tryEmplaceImpl( KeyArg && k, Args&&... args );
+    // Erases the entry with the smallest count and returns that count.
+    V evict();
+    // Refreshes the snapshots until the top of the heap is current.
+    void settleHeap() const;
+    void rebuildHeap();
+
+    Map_t map_;
+    mutable std::vector<Snapshot_t> heap_;
+    size_type capacity_;
+    size_type evictions_;
+  };
+
+  /*! @brief Swaps the contents of the maps. */
+  template <typename K, typename V, typename Hash, typename Pred>
+  void swap( SpaceSavingMap<K, V, Hash, Pred>& a, SpaceSavingMap<K, V, Hash, Pred>& b )
+  { a.swap(b); }
+
+};
+
+#include "Counters/details/_SpaceSavingMap.IMPL.hpp"
+
+#endif // __SPACE_SAVING_MAP_H__
@@ -0,0 +1,156 @@
+/*! @file TextIngestion.hpp
+  @brief Counting the words, n-grams and word transitions of large texts.
+
+  The text is read through a memory mapping of the file (or large buffered
+  reads from a stream), split into whitespace-separated tokens without
+  allocating anything per token, and counted directly into the Counter or
+  CounterMap through their heterogeneous lookups, which only construct a
+  string when a new key or value is inserted. Large texts are split into
+  chunks which are counted in parallel, each thread into a map of its own,
+  and merged at the end (see CounterMapReduction).
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __COUNTERS_TEXT_INGESTION_H__
+#define __COUNTERS_TEXT_INGESTION_H__
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+
+namespace Counters
+{
+  /*! @brief Parameters of the text ingestion. */
+  struct IngestionOptions
+  {
+    /*!
+     * @param order The n of the n-grams: the CounterMaps count the
+     * transitions from the n - 1 preceding tokens to the next one (so the
+     * order of a CounterMap must be at least 2), the Counters count the
+     * n-grams. The tokens of an n-gram (or of a context) are joined with
+     * single spaces.
+     * @param lowercase Whether the ASCII letters of the tokens are lowercased.
+     * @param threads The number of threads; 0 uses one per hardware thread.
+     * @param chunkSize The granularity of the parallel work, in bytes (the
+     * chunks are cut at whitespace), and the size of the buffer of stream
+     * reads.
+     */
+    explicit IngestionOptions( std::size_t order = 2, bool lowercase = false,
+			       std::size_t threads = 1, std::size_t chunkSize = std::size_t(16) << 20 )
+      : order( order > 0 ? order : 1 ),
+	lowercase( lowercase ),
+	threads( threads ),
+	chunkSize( chunkSize > 0 ? chunkSize : 1 )
+    {}
+
+    std::size_t order;
+    bool lowercase;
+    std::size_t threads;
+    std::size_t chunkSize;
+  };
+
+  /*! @brief Calls f(boost::string_view) for every whitespace-separated token
+   *  of [begin, end) (the tokens of operator>>, in the "C" locale). */
+  template <typename F>
+  void forEachToken( char const* begin, char const* end, F f );
+
+  /*!
+   * @brief Splits texts into n-grams of tokens.
+   *
+   * The tokens are views of the text, unless they are lowercased, in which
+   * case they are copied into buffers of the scanner which are reused from
+   * token to token; the joined n-grams and contexts are built in another
+   * reused buffer. The views passed to the callbacks are therefore only
+   * valid during the call.
+   */
+  class NgramScanner
+  {
+  public:
+    /*! @brief See IngestionOptions. */
+    explicit NgramScanner( std::size_t order, bool lowercase = false );
+
+    /*!
+     * @brief Calls f(context, token) for every token which starts in
+     * [begin, end) and is preceded by order - 1 tokens in [base, end), the
+     * context being these tokens joined.
+     *
+     * [begin, end) should start and end at whitespace (or at the ends of
+     * the text). The tokens of [base, begin) are only context, so that
+     * consecutive chunks of a text can be scanned separately.
+     */
+    template <typename F>
+    void transitions( char const* base, char const* begin, char const* end, F f );
+
+    /*! @brief Calls f(ngram) for every n-gram (the order tokens joined)
+     *  whose last token starts in [begin, end). See transitions(). */
+    template <typename F>
+    void ngrams( char const* base, char const* begin, char const* end, F f );
+
+  private:
+    template <typename F>
+    void scan( char const* base, char const* begin, char const* end, F f );
+    void push( boost::string_view token );
+    boost::string_view join( std::size_t first, std::size_t count );
+
+    std::size_t order_;
+    bool lowercase_;
+    std::size_t pushed_;
+    // the last order tokens, oldest first
+    std::vector<boost::string_view> window_;
+    // the lowercased copies of the tokens of the window (a ring)
+    std::vector<std::string> lowered_;
+    std::string joined_;
+  };
+
+  /*!  @name Ingestion
+   *   Add the counts of a text (see IngestionOptions) to a CounterMap (the
+   *   transitions to the tokens from the tokens preceding them) or to a
+   *   Counter (the n-grams). K and V must support heterogeneous lookups by
+   *   boost::string_view (e.g. std::string, see MapTypeErasure::KeyView).
+   *
+   *   The parallel ingestion counts into CounterMaps with the default
+   *   CounterFactory (and into Counters with the default map), which are
+   *   then added to the destination.
+   *   @{
+   */
+  /*! @brief Counts the text [begin, end), in parallel if it is larger than
+   *  a chunk and threads is not 1. */
+  template <typename K, typename V>
+  void ingestText( char const* begin, char const* end, CounterMap<K, V>& counterMap,
+		   IngestionOptions const& options = IngestionOptions() );
+  template <typename V, typename CoreMap>
+  void ingestText( char const* begin, char const* end, Counter<V, CoreMap>& counter,
+		   IngestionOptions const& options = IngestionOptions() );
+
+  /*! @brief Counts the text of the stream, read sequentially in buffers of
+   *  chunkSize bytes. Returns false if the stream fails before its end. */
+  template <typename K, typename V>
+  bool ingestStream( std::istream& is, CounterMap<K, V>& counterMap,
+		     IngestionOptions const& options = IngestionOptions() );
+  template <typename V, typename CoreMap>
+  bool ingestStream( std::istream& is, Counter<V, CoreMap>& counter,
+		     IngestionOptions const& options = IngestionOptions() );
+
+  /*! @brief Counts the text of the file, memory-mapped (and counted as by
+   *  ingestText()) or, if it cannot be mapped, read as a stream. Returns
+   *  false if the file cannot be read. */
+  template <typename K, typename V>
+  bool ingestFile( std::string const& path, CounterMap<K, V>& counterMap,
+		   IngestionOptions const& options = IngestionOptions() );
+  template <typename V, typename CoreMap>
+  bool ingestFile( std::string const& path, Counter<V, CoreMap>& counter,
+		   IngestionOptions const& options = IngestionOptions() );
+  /*!  @} */
+
+};
+
+#include "Counters/details/_TextIngestion.IMPL.hpp"
+
+#endif // __COUNTERS_TEXT_INGESTION_H__
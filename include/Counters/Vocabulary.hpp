@@ -0,0 +1,132 @@
+/*! @file Vocabulary.hpp
+  @brief A mapping of values to dense integer ids.
+
+  @author Yuriy Skobov
+*/
+
+#ifndef __VOCABULARY_H__
+#define __VOCABULARY_H__
+
+#include "AnyMap/AnyMap.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace Counters
+{
+  /*!
+   * @brief Assigns dense integer ids (0, 1, 2, ...) to values in the order in
+   * which they are first interned, and maps the ids back to the values.
+   *
+   * A Vocabulary is meant to be shared (see std::shared_ptr) by the counters
+   * whose values come from the same set, e.g. all the rows of an
+   * InternedCounterMap or a set of DenseCounter objects. Each value is then
+   * stored and hashed once, and the counters only handle integer ids.
+   *
+   * Values are looked up with the heterogeneous lookups of AnyMap, so that
+   * interning a std::string from a string slice only constructs a string for
+   * new values. Ids are never reassigned: a Vocabulary only grows.
+   *
+   * @param T Type of the interned values.
+   */
+  template <typename T>
+  class Vocabulary
+  {
+  public:
+    /*! @brief Type of the interned values. */
+    typedef T Value_t;
+    /*! @brief Type of the ids. */
+    typedef boost::uint32_t Id_t;
+    /*! @brief Unsigned integer type that can represent any non-negative value.*/
+    typedef std::size_t Size_t;
+
+    /*! @brief Id returned by find() for values which are not interned. */
+    static const Id_t NOT_FOUND = static_cast<Id_t>(-1);
+
+    /*! @brief Constructs an empty vocabulary. */
+    Vocabulary() : ids_( boost::unordered_map<T, Id_t>() ) {}
+
+    /*!
+     * @brief Returns the id of the value, assigning the next id to it if it
+     * has not been interned yet.
+     * @param val Value to be interned.
+     * @return The id of the value.
+     */
+    Id_t intern( T const& val )
+    {
+      typename Ids_t::iterator i( ids_.try_emplace( val, static_cast<Id_t>(values_.size()) ).first );
+      if( i->second == values_.size() )
+	values_.push_back( &i->first );
+      return i->second;
+    }
+
+    /*! @brief Heterogeneous intern(): a T is only constructed if val is new.
+     *  See MapTypeErasure::KeyView. */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<T, ValueLike>::value, Id_t>::type
+    intern( ValueLike const& val )
+    {
+      typename Ids_t::iterator i( ids_.try_emplace( val, static_cast<Id_t>(values_.size()) ).first );
+      if( i->second == values_.size() )
+	values_.push_back( &i->first );
+      return i->second;
+    }
+
+    /*!
+     * @brief Looks up the id of the value without interning it.
+     * @param val Value whose id is requested.
+     * @return The id of the value or NOT_FOUND.
+     */
+    Id_t find( T const& val ) const
+    {
+      typename Ids_t::const_iterator i( ids_.find(val) );
+      return i == ids_.end() ? NOT_FOUND : i->second;
+    }
+
+    /*! @brief Heterogeneous find(). See MapTypeErasure::KeyView. */
+    template <typename ValueLike>
+    typename std::enable_if<MapTypeErasure::IsKeyLike<T, ValueLike>::value, Id_t>::type
+    find( ValueLike const& val ) const
+    {
+      typename Ids_t::const_iterator i( ids_.find(val) );
+      return i == ids_.end() ? NOT_FOUND : i->second;
+    }
+
+    /*!
+     * @brief Returns the value with the given id.
+     * @param id An id returned by intern(); must be less than size().
+     * @return The value with the id.
+     */
+    T const& value( Id_t id ) const { return *values_[id]; }
+
+    /*! @brief Returns the number of interned values, which is also the next
+     *  id to be assigned. */
+    Size_t size(void) const { return values_.size(); }
+
+    /*! @brief Checks whether any values have been interned. */
+    bool empty(void) const { return values_.empty(); }
+
+    /*! @brief Prepares the vocabulary to hold n values without rehashing. */
+    void reserve( Size_t n ) { ids_.reserve(n);  values_.reserve(n); }
+
+  private:
+    // Vocabularies hold pointers to their own elements and cannot be copied.
+    Vocabulary( Vocabulary const& );
+    Vocabulary& operator=( Vocabulary const& );
+
+    // The map is node based, so values_ can point to its keys.
+    typedef MapTypeErasure::AnyMap<T, Id_t> Ids_t;
+    Ids_t ids_;
+    std::vector<T const*> values_;
+  };
+
+  template <typename T>
+  const typename Vocabulary<T>::Id_t Vocabulary<T>::NOT_FOUND;
+
+};
+
+#endif // __VOCABULARY_H__
@@ -0,0 +1,416 @@
+#ifndef __COUNTERS_BINARY_FORMAT_IMPL_HPP__
+#define __COUNTERS_BINARY_FORMAT_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/BinaryFormat.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace Counters
+{
+  //----------------------------- Encodings ------------------------------------
+
+  template <typename C, typename Traits, typename Alloc>
+  std::uint64_t BinaryEncoding< std::basic_string<C, Traits, Alloc> >::columnSize( String_t const* x, std::size_t n )
+  {
+    std::uint64_t chars(0);
+    for( std::size_t i = 0; i < n; ++i )
+      chars += x[i].size();
+    return (n + 1) * sizeof(std::uint64_t) + chars * sizeof(C);
+  }
+
+  template <typename C, typename Traits, typename Alloc>
+  void BinaryEncoding< std::basic_string<C, Traits, Alloc> >::writeColumn( std::ostream& os, String_t const* x, std::size_t n )
+  {
+    std::vector<std::uint64_t> offsets( 1, 0 );
+    offsets.reserve( n + 1 );
+    for( std::size_t i = 0; i < n; ++i )
+      offsets.push_back( offsets.back() + x[i].size() );
+    os.write( reinterpret_cast<char const*>( offsets.data() ), offsets.size() * sizeof(std::uint64_t) );
+    for( std::size_t i = 0; i < n; ++i )
+      os.write( reinterpret_cast<char const*>( x[i].data() ), x[i].size() * sizeof(C) );
+  }
+
+  template <typename C, typename Traits, typename Alloc>
+  bool BinaryEncoding< std::basic_string<C, Traits, Alloc> >::validColumn( char const* column, std::uint64_t n,
+									   std::uint64_t size )
+  {
+    if( n >= size / sizeof(std::uint64_t) )
+      return false;
+    std::uint64_t const* const offsets( reinterpret_cast<std::uint64_t const*>(column) );
+    const std::uint64_t chars( size - (n + 1) * sizeof(std::uint64_t) );
+    if( offsets[0] != 0 || offsets[n] > chars / sizeof(C) )
+      return false;
+    // non-decreasing offsets keep every string of read() within the column
+    for( std::uint64_t i = 0; i < n; ++i )
+      if( offsets[i] > offsets[i + 1] )
+	return false;
+    return true;
+  }
+
+  namespace details
+  {
+    //---------------------------- BinaryRows ----------------------------------
+
+    static const char BINARY_MAGIC[8] = { 'C', 'O', 'U', 'N', 'T', 'E', 'R', 'S' };
+
+    template <typename V>
+    bool BinaryRows<V>::attach( char const* data, std::size_t size, std::uint32_t keyTag, ColumnCheck_t validKeys )
+    {
+      data_ = NULL;
+      header_ = NULL;
+      if( data == NULL || reinterpret_cast<std::uintptr_t>(data) % 8 != 0 || size < sizeof(BinaryHeader) )
+	return false;
+
+      BinaryHeader const& h( *reinterpret_cast<BinaryHeader const*>(data) );
+      const bool counter( keyTag == 0 );
+      if( std::memcmp( h.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC) ) != 0 ||
+	  h.version != BINARY_VERSION || h.byteOrder != BINARY_BYTE_ORDER || h.fileSize != size ||
+	  h.keyTag != keyTag || h.valueTag != Encoding_t::tag() ||
+	  counter != ((h.flags & BINARY_COUNTER) != 0) || (counter && h.rows != 1) )
+	return false;
+
+      // every section starts at an aligned offset and fits before the next
+      const std::uint64_t words( size / sizeof(std::uint64_t) );
+      const bool probabilities( (h.flags & BINARY_PROBABILITIES) != 0 );
+      const std::uint64_t end( probabilities ? h.probabilitiesOffset : size );
+      const std::uint64_t sections[] = { counter ? h.offsetsOffset : h.keysOffset, h.offsetsOffset,
+					 h.totalsOffset, h.valuesOffset, h.countsOffset, end, size };
+      for( std::size_t i = 0; i + 1 < sizeof(sections) / sizeof(sections[0]); ++i )
+	if( sections[i] % 8 != 0 || sections[i] > sections[i + 1] )
+	  return false;
+      if( sections[0] < sizeof(BinaryHeader) || h.rows >= words || h.values > words ||
+	  h.offsetsOffset + (h.rows + 1) * sizeof(std::uint64_t) > h.totalsOffset ||
+	  h.totalsOffset + h.rows * sizeof(Count_t) > h.valuesOffset ||
+	  h.countsOffset + h.values * sizeof(Count_t) > end ||
+	  (probabilities && h.probabilitiesOffset + h.values * sizeof(Count_t) > size) ||
+	  !Encoding_t::validColumn( data + h.valuesOffset, h.values, h.countsOffset - h.valuesOffset ) ||
+	  (!counter && !validKeys( data + h.keysOffset, h.rows, h.offsetsOffset - h.keysOffset )) )
+	return false;
+
+      std::uint64_t const* const offsets( reinterpret_cast<std::uint64_t const*>( data + h.offsetsOffset ) );
+      if( offsets[0] != 0 || offsets[h.rows] != h.values )
+	return false;
+      // non-decreasing offsets keep every row within the values
+      for( std::uint64_t row = 0; row < h.rows; ++row )
+	if( offsets[row] > offsets[row + 1] )
+	  return false;
+
+      data_ = data;
+      header_ = &h;
+      return true;
+    }
+
+    template <typename V>
+    std::uint64_t BinaryRows<V>::find( std::uint64_t row, ValueView_t const& val ) const
+    {
+      std::uint64_t first( rowBegin(row) ), n( rowEnd(row) - first );
+      while( n > 0 )
+	{
+	  const std::uint64_t half( n / 2 );
+	  if( value(first + half) < val )
+	    {
+	      first += half + 1;
+	      n -= half + 1;
+	    }
+	  else
+	    n = half;
+	}
+      return first == rowEnd(row) || val < value(first) ? values() : first;
+    }
+
+    template <typename V>
+    typename BinaryRows<V>::Count_t BinaryRows<V>::probability( std::uint64_t row, std::uint64_t i ) const
+    {
+      if( hasProbabilities() )
+	return reinterpret_cast<Count_t const*>( section(header_->probabilitiesOffset) )[i];
+      const Count_t total( rowTotal(row) );
+      return total == 0 ? 0 : count(i) / total;
+    }
+
+    template <typename V>
+    std::uint64_t BinaryRows<V>::max( std::uint64_t row ) const
+    {
+      const std::uint64_t first( rowBegin(row) ), last( rowEnd(row) );
+      if( first == last )
+	return values();
+      std::uint64_t max( first );
+      for( std::uint64_t i = first + 1; i < last; ++i )
+	if( count(i) > count(max) )
+	  max = i;
+      return max;
+    }
+
+    //------------------------------ Writer ------------------------------------
+
+    inline std::uint64_t alignBinary( std::uint64_t n ) { return (n + 7) / 8 * 8; }
+
+    inline void padBinary( std::ostream& os, std::uint64_t n )
+    {
+      static const char zeros[8] = { 0 };
+      os.write( zeros, alignBinary(n) - n );
+    }
+
+    template <typename K, typename V, typename Size>
+    bool writeBinary( std::ostream& os, std::uint32_t flags, K const* keys, std::size_t rows,
+		      Size const* offsets, CountersCount_t const* totals,
+		      V const* values, std::size_t valueCount, CountersCount_t const* counts,
+		      CountersCount_t const* probabilities, CountersCount_t total )
+    {
+      BinaryHeader h;
+      std::memset( &h, 0, sizeof(h) );
+      std::memcpy( h.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC) );
+      h.version = BINARY_VERSION;
+      h.byteOrder = BINARY_BYTE_ORDER;
+      const bool counter( (flags & BINARY_COUNTER) != 0 );
+      h.flags = flags | (probabilities == NULL ? 0 : BINARY_PROBABILITIES);
+      h.keyTag = counter ? 0 : BinaryEncoding<K>::tag();
+      h.valueTag = BinaryEncoding<V>::tag();
+      h.rows = rows;
+      h.values = valueCount;
+      h.total = total;
+
+      const std::uint64_t keysSize( counter ? 0 : BinaryEncoding<K>::columnSize( keys, rows ) );
+      const std::uint64_t valuesSize( BinaryEncoding<V>::columnSize( values, valueCount ) );
+      std::uint64_t pos( sizeof(BinaryHeader) );
+      h.keysOffset = counter ? 0 : pos;
+      pos += alignBinary( keysSize );
+      h.offsetsOffset = pos;
+      pos += (rows + 1) * sizeof(std::uint64_t);
+      h.totalsOffset = pos;
+      pos += rows * sizeof(CountersCount_t);
+      h.valuesOffset = pos;
+      pos += alignBinary( valuesSize );
+      h.countsOffset = pos;
+      pos += valueCount * sizeof(CountersCount_t);
+      h.probabilitiesOffset = probabilities == NULL ? 0 : pos;
+      pos += probabilities == NULL ? 0 : valueCount * sizeof(CountersCount_t);
+      h.fileSize = pos;
+
+      os.write( reinterpret_cast<char const*>(&h), sizeof(h) );
+      if( !counter )
+	{
+	  BinaryEncoding<K>::writeColumn( os, keys, rows );
+	  padBinary( os, keysSize );
+	}
+      const std::vector<std::uint64_t> offsets64( offsets, offsets + rows + 1 );
+      os.write( reinterpret_cast<char const*>( offsets64.data() ), offsets64.size() * sizeof(std::uint64_t) );
+      os.write( reinterpret_cast<char const*>(totals), rows * sizeof(CountersCount_t) );
+      BinaryEncoding<V>::writeColumn( os, values, valueCount );
+      padBinary( os, valuesSize );
+      os.write( reinterpret_cast<char const*>(counts), valueCount * sizeof(CountersCount_t) );
+      if( probabilities != NULL )
+	os.write( reinterpret_cast<char const*>(probabilities), valueCount * sizeof(CountersCount_t) );
+      return os.good();
+    }
+  };
+
+  //------------------------------ Writers -------------------------------------
+
+  template <typename K, typename V>
+  bool writeBinary( std::ostream& os, FrozenCounterMap<K, V> const& frozen )
+  {
+    return details::writeBinary( os, 0, frozen.keys().data(), frozen.size(),
+				 frozen.offsets().data(), frozen.rowTotals().data(),
+				 frozen.values().data(), frozen.values().size(), frozen.counts().data(),
+				 frozen.hasProbabilities() ? frozen.probabilities().data() : NULL,
+				 frozen.totalCount() );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool writeBinary( std::ostream& os, CounterMap<K, V, RowMap, OuterMap> const& counterMap,
+		    bool withProbabilities )
+  {
+    return writeBinary( os, FrozenCounterMap<K, V>( counterMap, withProbabilities ) );
+  }
+
+  template <typename V, typename CoreMap>
+  bool writeBinary( std::ostream& os, Counter<V, CoreMap> const& counter, bool withProbabilities )
+  {
+    std::vector<std::pair<V, CountersCount_t> > sorted( counter.begin(), counter.end() );
+    std::sort( sorted.begin(), sorted.end() );
+    const CountersCount_t total( counter.totalCount() );
+    std::vector<V> values;
+    std::vector<CountersCount_t> counts, probabilities;
+    values.reserve( sorted.size() );
+    counts.reserve( sorted.size() );
+    for( typename std::vector<std::pair<V, CountersCount_t> >::iterator i(sorted.begin()); i != sorted.end(); ++i )
+      {
+	values.push_back( std::move(i->first) );
+	counts.push_back( i->second );
+	if( withProbabilities )
+	  probabilities.push_back( total == 0 ? 0 : i->second / total );
+      }
+    const std::uint64_t offsets[] = { 0, values.size() };
+    return details::writeBinary( os, details::BINARY_COUNTER, static_cast<V const*>(NULL), 1, offsets, &total,
+				 values.data(), values.size(), counts.data(),
+				 withProbabilities ? probabilities.data() : NULL, total );
+  }
+
+  //-------------------------- MappedCounterMap --------------------------------
+
+  template <typename K, typename V>
+  bool MappedCounterMap<K, V>::open( std::string const& path )
+  {
+    std::shared_ptr<details::MappedFile> file( new details::MappedFile() );
+    details::BinaryRows<V> rows;
+    if( !file->open(path) || !rows.attach( file->data(), file->size(), BinaryEncoding<K>::tag(), &BinaryEncoding<K>::validColumn ) )
+      return false;
+    file_.swap( file );
+    rows_ = rows;
+    return true;
+  }
+
+  template <typename K, typename V>
+  bool MappedCounterMap<K, V>::attach( void const* data, std::size_t size )
+  {
+    details::BinaryRows<V> rows;
+    if( !rows.attach( static_cast<char const*>(data), size, BinaryEncoding<K>::tag(), &BinaryEncoding<K>::validColumn ) )
+      return false;
+    file_.reset();
+    rows_ = rows;
+    return true;
+  }
+
+  template <typename K, typename V>
+  typename MappedCounterMap<K, V>::Size_t MappedCounterMap<K, V>::size( K const& key ) const
+  {
+    const Size_t row( findRow( KeyView_t(key) ) );
+    return row == size() ? 0 : rows_.rowEnd(row) - rows_.rowBegin(row);
+  }
+
+  template <typename K, typename V>
+  V MappedCounterMap<K, V>::maxValue( K const& key ) const
+  {
+    const Size_t row( findRow( KeyView_t(key) ) );
+    const std::uint64_t max( row == size() ? rows_.values() : rows_.max(row) );
+    return max == rows_.values() ? V() : V( MapTypeErasure::KeyView<V>::materialize( rows_.value(max) ) );
+  }
+
+  template <typename K, typename V>
+  typename MappedCounterMap<K, V>::Count_t
+  MappedCounterMap<K, V>::getProbability( K const& key, V const& val ) const
+  {
+    const Size_t row( findRow( KeyView_t(key) ) );
+    if( row == size() )
+      return 0;
+    const std::uint64_t i( rows_.find( row, ValueView_t(val) ) );
+    return i == rows_.values() ? 0 : rows_.probability( row, i );
+  }
+
+  template <typename K, typename V>
+  template <typename CounterMap_t>
+  CounterMap_t MappedCounterMap<K, V>::thaw( CounterMap_t counterMap ) const
+  {
+    counterMap.reserve( size() );
+    for( Size_t i = 0; i < size(); ++i )
+      {
+	const KeyView_t k( key(i) );
+	for( std::uint64_t j = rows_.rowBegin(i); j < rows_.rowEnd(i); ++j )
+	  counterMap.setCount( k, rows_.value(j), rows_.count(j) );
+      }
+    return counterMap;
+  }
+
+  template <typename K, typename V>
+  typename MappedCounterMap<K, V>::Size_t MappedCounterMap<K, V>::findRow( KeyView_t const& k ) const
+  {
+    Size_t first(0), n( size() );
+    while( n > 0 )
+      {
+	const Size_t half( n / 2 );
+	if( key(first + half) < k )
+	  {
+	    first += half + 1;
+	    n -= half + 1;
+	  }
+	else
+	  n = half;
+      }
+    return first == size() || k < key(first) ? size() : first;
+  }
+
+  template <typename K, typename V>
+  std::uint64_t MappedCounterMap<K, V>::findValue( KeyView_t const& key, ValueView_t const& val ) const
+  {
+    const Size_t row( findRow(key) );
+    return row == size() ? rows_.values() : rows_.find( row, val );
+  }
+
+  //---------------------------- MappedCounter ---------------------------------
+
+  template <typename V>
+  bool MappedCounter<V>::open( std::string const& path )
+  {
+    std::shared_ptr<details::MappedFile> file( new details::MappedFile() );
+    details::BinaryRows<V> rows;
+    if( !file->open(path) || !rows.attach( file->data(), file->size(), 0, NULL ) )
+      return false;
+    file_.swap( file );
+    rows_ = rows;
+    return true;
+  }
+
+  template <typename V>
+  bool MappedCounter<V>::attach( void const* data, std::size_t size )
+  {
+    details::BinaryRows<V> rows;
+    if( !rows.attach( static_cast<char const*>(data), size, 0, NULL ) )
+      return false;
+    file_.reset();
+    rows_ = rows;
+    return true;
+  }
+
+  template <typename V>
+  V MappedCounter<V>::maxValue(void) const
+  {
+    const std::uint64_t max( isOpen() ? rows_.max(0) : 0 );
+    return max == size() ? V() : V( MapTypeErasure::KeyView<V>::materialize( rows_.value(max) ) );
+  }
+
+  template <typename V>
+  typename MappedCounter<V>::Count_t MappedCounter<V>::getProbability( V const& val ) const
+  {
+    const std::uint64_t i( find( ValueView_t(val) ) );
+    return i == size() ? 0 : rows_.probability( 0, i );
+  }
+
+  template <typename V>
+  template <typename Counter_t>
+  Counter_t MappedCounter<V>::thaw( Counter_t counter ) const
+  {
+    counter.reserve( size() );
+    for( Size_t i = 0; i < size(); ++i )
+      counter.setCount( rows_.value(i), rows_.count(i) );
+    return counter;
+  }
+
+  //------------------------------ Loaders -------------------------------------
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool loadBinary( std::string const& path, CounterMap<K, V, RowMap, OuterMap>& counterMap )
+  {
+    MappedCounterMap<K, V> mapped;
+    if( !mapped.open(path) )
+      return false;
+    counterMap = mapped.thaw( std::move(counterMap) );
+    return true;
+  }
+
+  template <typename V, typename CoreMap>
+  bool loadBinary( std::string const& path, Counter<V, CoreMap>& counter )
+  {
+    MappedCounter<V> mapped;
+    if( !mapped.open(path) )
+      return false;
+    counter = mapped.thaw( std::move(counter) );
+    return true;
+  }
+
+};
+
+#endif // __COUNTERS_BINARY_FORMAT_IMPL_HPP__
@@ -0,0 +1,127 @@
+#ifndef __CONCURRENT_COUNTER_IMPL_HPP__
+#define __CONCURRENT_COUNTER_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/ConcurrentCounter.hpp"
+#include "Counters/details/_Sharding.hpp"
+
+namespace Counters
+{
+  //------------------------------ Constructors --------------------------------
+
+  template <typename V, typename Hash>
+  ConcurrentCounter<V, Hash>::ConcurrentCounter( Size_t shards,
+						 CounterFactory<V> const& counterFactory )
+    : counterFactory_( details::shardFactory( counterFactory ) ),
+      shardCount_( shards > 0 ? shards : 1 ),
+      shards_( new Shard[shardCount_] ),
+      hash_()
+  {
+    for( Size_t i = 0; i < shardCount_; ++i )
+      shards_[i].counter = counterFactory_->createCounter();
+  }
+
+  template <typename V, typename Hash>
+  ConcurrentCounter<V, Hash>::~ConcurrentCounter()
+  {}
+
+  //------------------------------- Modifiers ----------------------------------
+
+  template <typename V, typename Hash>
+  void ConcurrentCounter<V, Hash>::incrementCount( V const& val, Count_t count )
+  {
+    Shard& shard( shardOf(val) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.counter.incrementCount( val, count );
+    shard.add( count );
+  }
+
+  template <typename V, typename Hash>
+  template <typename InputIterator>
+  void ConcurrentCounter<V, Hash>::incrementAll( InputIterator first, InputIterator last,
+						 Count_t count )
+  {
+    for( ; first != last; ++first )
+      incrementCount( *first, count );
+  }
+
+  template <typename V, typename Hash>
+  void ConcurrentCounter<V, Hash>::setCount( V const& val, Count_t count )
+  {
+    Shard& shard( shardOf(val) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.add( count - shard.counter.getCount(val) );
+    shard.counter.setCount( val, count );
+  }
+
+  template <typename V, typename Hash>
+  void ConcurrentCounter<V, Hash>::remove( V const& val )
+  {
+    Shard& shard( shardOf(val) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.add( -shard.counter.getCount(val) );
+    shard.counter.remove( val );
+  }
+
+  //-------------------------------- Lookup ------------------------------------
+
+  template <typename V, typename Hash>
+  bool ConcurrentCounter<V, Hash>::contains( V const& val ) const
+  {
+    Shard& shard( shardOf(val) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    return shard.counter.contains( val );
+  }
+
+  template <typename V, typename Hash>
+  typename ConcurrentCounter<V, Hash>::Count_t ConcurrentCounter<V, Hash>::getCount( V const& val ) const
+  {
+    Shard& shard( shardOf(val) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    return shard.counter.getCount( val );
+  }
+
+  template <typename V, typename Hash>
+  typename ConcurrentCounter<V, Hash>::Count_t ConcurrentCounter<V, Hash>::totalCount(void) const
+  {
+    Count_t total(0);
+    for( Size_t i = 0; i < shardCount_; ++i )
+      total += shards_[i].total.load( std::memory_order_relaxed );
+    return total;
+  }
+
+  template <typename V, typename Hash>
+  typename ConcurrentCounter<V, Hash>::Size_t ConcurrentCounter<V, Hash>::size(void) const
+  {
+    Size_t size(0);
+    for( Size_t i = 0; i < shardCount_; ++i )
+      {
+	std::lock_guard<std::mutex> lock( shards_[i].mutex );
+	size += shards_[i].counter.size();
+      }
+    return size;
+  }
+
+  template <typename V, typename Hash>
+  typename ConcurrentCounter<V, Hash>::Counter_t ConcurrentCounter<V, Hash>::snapshot(void) const
+  {
+    Counter_t snapshot( counterFactory_->createCounter() );
+    for( Size_t i = 0; i < shardCount_; ++i )
+      {
+	std::lock_guard<std::mutex> lock( shards_[i].mutex );
+	snapshot += shards_[i].counter;
+      }
+    return snapshot;
+  }
+
+  //-------------------------------- Private -----------------------------------
+
+  template <typename V, typename Hash>
+  typename ConcurrentCounter<V, Hash>::Shard& ConcurrentCounter<V, Hash>::shardOf( V const& val ) const
+  {
+    return shards_[ details::shardIndex( hash_(val), shardCount_ ) ];
+  }
+
+};
+
+#endif // __CONCURRENT_COUNTER_IMPL_HPP__
@@ -0,0 +1,145 @@
+#ifndef __CONCURRENT_COUNTER_MAP_IMPL_HPP__
+#define __CONCURRENT_COUNTER_MAP_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/ConcurrentCounterMap.hpp"
+#include "Counters/details/_Sharding.hpp"
+
+namespace Counters
+{
+  //------------------------------ Constructors --------------------------------
+
+  template <typename K, typename V, typename Hash>
+  ConcurrentCounterMap<K, V, Hash>::ConcurrentCounterMap( Size_t shards,
+							  CounterFactory<V> const& counterFactory )
+    : counterFactory_( details::shardFactory( counterFactory ) ),
+      shardCount_( shards > 0 ? shards : 1 ),
+      shards_( new Shard[shardCount_] ),
+      hash_()
+  {
+    for( Size_t i = 0; i < shardCount_; ++i )
+      shards_[i].counterMap = CounterMap_t( typename CounterMap_t::CoreMap_t(), counterFactory_ );
+  }
+
+  template <typename K, typename V, typename Hash>
+  ConcurrentCounterMap<K, V, Hash>::~ConcurrentCounterMap()
+  {}
+
+  //------------------------------- Modifiers ----------------------------------
+
+  template <typename K, typename V, typename Hash>
+  void ConcurrentCounterMap<K, V, Hash>::incrementCount( K const& key, V const& val, Count_t count )
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.counterMap.incrementCount( key, val, count );
+    shard.add( count );
+  }
+
+  template <typename K, typename V, typename Hash>
+  void ConcurrentCounterMap<K, V, Hash>::setCount( K const& key, V const& val, Count_t count )
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.add( count - shard.counterMap.getCount(key, val) );
+    shard.counterMap.setCount( key, val, count );
+  }
+
+  template <typename K, typename V, typename Hash>
+  void ConcurrentCounterMap<K, V, Hash>::remove( K const& key )
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.add( -shard.counterMap.totalCount(key) );
+    shard.counterMap.remove( key );
+  }
+
+  template <typename K, typename V, typename Hash>
+  void ConcurrentCounterMap<K, V, Hash>::remove( K const& key, V const& val )
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.add( -shard.counterMap.getCount(key, val) );
+    shard.counterMap.remove( key, val );
+  }
+
+  //-------------------------------- Lookup ------------------------------------
+
+  template <typename K, typename V, typename Hash>
+  bool ConcurrentCounterMap<K, V, Hash>::contains( K const& key ) const
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    return shard.counterMap.contains( key );
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool ConcurrentCounterMap<K, V, Hash>::contains( K const& key, V const& val ) const
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    return shard.counterMap.contains( key, val );
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename ConcurrentCounterMap<K, V, Hash>::Count_t
+  ConcurrentCounterMap<K, V, Hash>::getCount( K const& key, V const& val ) const
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    return shard.counterMap.getCount( key, val );
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename ConcurrentCounterMap<K, V, Hash>::Count_t
+  ConcurrentCounterMap<K, V, Hash>::totalCount( K const& key ) const
+  {
+    Shard& shard( shardOf(key) );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    return shard.counterMap.totalCount( key );
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename ConcurrentCounterMap<K, V, Hash>::Count_t ConcurrentCounterMap<K, V, Hash>::totalCount(void) const
+  {
+    Count_t total(0);
+    for( Size_t i = 0; i < shardCount_; ++i )
+      total += shards_[i].total.load( std::memory_order_relaxed );
+    return total;
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename ConcurrentCounterMap<K, V, Hash>::Size_t ConcurrentCounterMap<K, V, Hash>::size(void) const
+  {
+    Size_t size(0);
+    for( Size_t i = 0; i < shardCount_; ++i )
+      {
+	std::lock_guard<std::mutex> lock( shards_[i].mutex );
+	size += shards_[i].counterMap.size();
+      }
+    return size;
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename ConcurrentCounterMap<K, V, Hash>::CounterMap_t ConcurrentCounterMap<K, V, Hash>::snapshot(void) const
+  {
+    CounterMap_t snapshot( typename CounterMap_t::CoreMap_t(), counterFactory_ );
+    for( Size_t i = 0; i < shardCount_; ++i )
+      {
+	std::lock_guard<std::mutex> lock( shards_[i].mutex );
+	snapshot += shards_[i].counterMap;
+      }
+    return snapshot;
+  }
+
+  //-------------------------------- Private -----------------------------------
+
+  template <typename K, typename V, typename Hash>
+  typename ConcurrentCounterMap<K, V, Hash>::Shard& ConcurrentCounterMap<K, V, Hash>::shardOf( K const& key ) const
+  {
+    return shards_[ details::shardIndex( hash_(key), shardCount_ ) ];
+  }
+
+};
+
+#endif // __CONCURRENT_COUNTER_MAP_IMPL_HPP__
@@ -0,0 +1,316 @@
+#ifndef __COUNT_MIN_SKETCH_IMPL_HPP__
+#define __COUNT_MIN_SKETCH_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/CountMinSketch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace Counters
+{
+  namespace details
+  {
+    // The finalizer of SplitMix64: spreads the bits of a (possibly identity)
+    // hash over the whole word.
+    inline boost::uint64_t mixHash( boost::uint64_t h )
+    {
+      h ^= h >> 30;  h *= 0xbf58476d1ce4e5b9ULL;
+      h ^= h >> 27;  h *= 0x94d049bb133111ebULL;
+      return h ^ (h >> 31);
+    }
+  };
+
+  //------------- Constructors, Assignment, Swap -------------------------------
+
+  template <typename K, typename V, typename Hash>
+  CountMinSketch<K, V, Hash>::CountMinSketch( size_type width, size_type depth,
+					      bool conservative, std::size_t seed )
+    : width_( width > 0 ? width : 1 ), depth_( depth > 0 ? depth : 1 ),
+      conservative_( conservative ), seed_( seed ), hash_(),
+      cells_( width_ * depth_, V(0) ), total_(0), slot_(0), issued_(0)
+  {}
+
+  template <typename K, typename V, typename Hash>
+  CountMinSketch<K, V, Hash>::CountMinSketch( CountMinSketch const& other )
+    : width_( other.width_ ), depth_( other.depth_ ),
+      conservative_( other.conservative_ ), seed_( other.seed_ ), hash_( other.hash_ ),
+      cells_(), total_(0), slot_(0), issued_(0)
+  {
+    other.commit();
+    cells_ = other.cells_;
+    total_ = other.total_;
+  }
+
+  template <typename K, typename V, typename Hash>
+  CountMinSketch<K, V, Hash>::CountMinSketch( CountMinSketch && other )
+    : width_( other.width_ ), depth_( other.depth_ ),
+      conservative_( other.conservative_ ), seed_( other.seed_ ), hash_( other.hash_ ),
+      cells_(), total_(0), slot_(0), issued_(0)
+  {
+    other.commit();
+    other.discard();
+    cells_.swap( other.cells_ );
+    std::swap( total_, other.total_ );
+    other.cells_.assign( width_ * depth_, V(0) );
+  }
+
+  template <typename K, typename V, typename Hash>
+  CountMinSketch<K, V, Hash>& CountMinSketch<K, V, Hash>::operator=( CountMinSketch const& other )
+  {
+    if( this != &other ) {
+      CountMinSketch tmp( other );
+      swap( tmp );
+    }
+    return *this;
+  }
+
+  template <typename K, typename V, typename Hash>
+  CountMinSketch<K, V, Hash>& CountMinSketch<K, V, Hash>::operator=( CountMinSketch && other )
+  {
+    swap( other );
+    return *this;
+  }
+
+  template <typename K, typename V, typename Hash>
+  void CountMinSketch<K, V, Hash>::swap( CountMinSketch& other )
+  {
+    using std::swap;
+    commit();
+    discard();
+    other.commit();
+    other.discard();
+    swap( width_, other.width_ );
+    swap( depth_, other.depth_ );
+    swap( conservative_, other.conservative_ );
+    swap( seed_, other.seed_ );
+    swap( hash_, other.hash_ );
+    cells_.swap( other.cells_ );
+    swap( total_, other.total_ );
+  }
+
+  //-------------------------- Size and Parameters -----------------------------
+
+  template <typename K, typename V, typename Hash>
+  typename CountMinSketch<K, V, Hash>::size_type CountMinSketch<K, V, Hash>::max_size() const
+  {
+    return std::numeric_limits<size_type>::max();
+  }
+
+  template <typename K, typename V, typename Hash>
+  double CountMinSketch<K, V, Hash>::epsilon() const
+  {
+    return std::exp(1.0) / width_;
+  }
+
+  template <typename K, typename V, typename Hash>
+  double CountMinSketch<K, V, Hash>::delta() const
+  {
+    return std::exp( -double(depth_) );
+  }
+
+  //------------------------------- Lookup -------------------------------------
+
+  template <typename K, typename V, typename Hash>
+  V const& CountMinSketch<K, V, Hash>::at( K const& k ) const
+  {
+    const_iterator i( find(k) );
+    if( i == end() )
+      throw std::out_of_range( "CountMinSketch::at: the estimate of the key is 0" );
+    return i->second;
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename CountMinSketch<K, V, Hash>::const_iterator CountMinSketch<K, V, Hash>::find( K const& k ) const
+  {
+    commit();
+    const V e( estimate( probe(k) ) );
+    return e == V(0) ? end() : issue( k, e );
+  }
+
+  template <typename K, typename V, typename Hash>
+  V CountMinSketch<K, V, Hash>::estimate( K const& k ) const
+  {
+    commit();
+    return estimate( probe(k) );
+  }
+
+  //------------------------------ Modifiers -----------------------------------
+
+  template <typename K, typename V, typename Hash>
+  template <typename InputIterator>
+  void CountMinSketch<K, V, Hash>::insert( InputIterator first, InputIterator last )
+  {
+    for( ; first != last; ++first )
+      insert( *first );
+  }
+
+  template <typename K, typename V, typename Hash>
+  template <typename... Args>
+  std::pair<typename CountMinSketch<K, V, Hash>::iterator, bool>
+  CountMinSketch<K, V, Hash>::try_emplace( K const& k, Args&&... args )
+  {
+    commit();
+    const Probe_t p( probe(k) );
+    V e( estimate(p) );
+    if( e != V(0) )
+      return std::pair<iterator, bool>( issue(k, e), false );
+    const V count( std::forward<Args>(args)... );
+    if( count != V(0) ) {
+      addCells( p, count );
+      e = estimate(p);
+    }
+    return std::pair<iterator, bool>( issue(k, e), true );
+  }
+
+  template <typename K, typename V, typename Hash>
+  void CountMinSketch<K, V, Hash>::add( K const& k, V const& count )
+  {
+    commit();
+    addCells( probe(k), count );
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename CountMinSketch<K, V, Hash>::size_type CountMinSketch<K, V, Hash>::erase( K const& k )
+  {
+    commit();
+    const Probe_t p( probe(k) );
+    const V e( estimate(p) );
+    if( e == V(0) )
+      return 0;
+    // Subtracting e from every cell of k (also under conservative update)
+    // takes its estimate to 0.
+    for( size_type row = 0; row < depth_; ++row )
+      cells_[cell(p, row)] -= e;
+    total_ -= e;
+    return 1;
+  }
+
+  template <typename K, typename V, typename Hash>
+  void CountMinSketch<K, V, Hash>::clear()
+  {
+    discard();
+    std::fill( cells_.begin(), cells_.end(), V(0) );
+    total_ = V(0);
+  }
+
+  //----------------------- Native Bulk Arithmetic -----------------------------
+
+  template <typename K, typename V, typename Hash>
+  V CountMinSketch<K, V, Hash>::sum_mapped() const
+  {
+    commit();
+    return total_;
+  }
+
+  template <typename K, typename V, typename Hash>
+  void CountMinSketch<K, V, Hash>::scale_mapped( V const& n )
+  {
+    commit();
+    discard();
+    for( typename std::vector<V>::iterator i(cells_.begin()); i != cells_.end(); ++i )
+      *i *= n;
+    total_ *= n;
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool CountMinSketch<K, V, Hash>::add_mapped( CountMinSketch const& other, V const& factor )
+  {
+    if( width_ != other.width_ || depth_ != other.depth_ || seed_ != other.seed_ )
+      return false;
+    commit();
+    discard();
+    other.commit();
+    for( size_type i = 0; i < cells_.size(); ++i )
+      cells_[i] += factor * other.cells_[i];
+    total_ += factor * other.total_;
+    return true;
+  }
+
+  template <typename K, typename V, typename Hash>
+  bool CountMinSketch<K, V, Hash>::equal_mapped( CountMinSketch const& other, V const& precision ) const
+  {
+    if( width_ != other.width_ || depth_ != other.depth_ || seed_ != other.seed_ )
+      return false;
+    commit();
+    other.commit();
+    if( ! within( total_, other.total_, precision ) )
+      return false;
+    for( size_type i = 0; i < cells_.size(); ++i )
+      if( ! within( cells_[i], other.cells_[i], precision ) )
+	return false;
+    return true;
+  }
+
+  //------------------------------- Private ------------------------------------
+
+  template <typename K, typename V, typename Hash>
+  typename CountMinSketch<K, V, Hash>::Probe_t CountMinSketch<K, V, Hash>::probe( K const& k ) const
+  {
+    const boost::uint64_t h( details::mixHash( hash_(k) + seed_ * 0x9e3779b97f4a7c15ULL ) );
+    // An odd step makes the cells of the rows distinct for power-of-two widths.
+    return Probe_t( h, details::mixHash(h) | 1 );
+  }
+
+  template <typename K, typename V, typename Hash>
+  V CountMinSketch<K, V, Hash>::estimate( Probe_t const& p ) const
+  {
+    V e( cells_[cell(p, 0)] );
+    for( size_type row = 1; row < depth_; ++row )
+      e = std::min( e, cells_[cell(p, row)] );
+    return e;
+  }
+
+  template <typename K, typename V, typename Hash>
+  void CountMinSketch<K, V, Hash>::addCells( Probe_t const& p, V const& count ) const
+  {
+    if( conservative_ && V(0) < count )
+      {
+	const V target( estimate(p) + count );
+	for( size_type row = 0; row < depth_; ++row )
+	  {
+	    V& c( cells_[cell(p, row)] );
+	    if( c < target ) c = target;
+	  }
+      }
+    else
+      for( size_type row = 0; row < depth_; ++row )
+	cells_[cell(p, row)] += count;
+    total_ += count;
+  }
+
+  template <typename K, typename V, typename Hash>
+  void CountMinSketch<K, V, Hash>::commit() const
+  {
+    if( slots_[slot_] && slots_[slot_]->second != issued_ )
+      {
+	addCells( probe(slots_[slot_]->first), slots_[slot_]->second - issued_ );
+	issued_ = slots_[slot_]->second;
+      }
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename CountMinSketch<K, V, Hash>::value_type*
+  CountMinSketch<K, V, Hash>::issue( K const& k, V const& estimate ) const
+  {
+    // k may be the key of the current element, so it is dropped only after
+    // the next one is constructed.
+    const int next( 1 - slot_ );
+    slots_[next].emplace( k, estimate );
+    slots_[slot_] = boost::none;
+    slot_ = next;
+    issued_ = estimate;
+    return &*slots_[slot_];
+  }
+
+  template <typename K, typename V, typename Hash>
+  void CountMinSketch<K, V, Hash>::discard() const
+  {
+    slots_[slot_] = boost::none;
+  }
+
+};
+
+#endif // __COUNT_MIN_SKETCH_IMPL_HPP__
@@ -9,374 +9,1043 @@
 // variables and STL typenamees included from the header.
 #include "Counters/Counter.hpp"
 
+#include <algorithm>
+#include <functional>
+
 namespace Counters
 {
   const static char* const MAPPING_DELIMITER = "=>";
 
+  // Counter::operator*=() folds the scale into the stored counts once it is
+  // outside [1/SCALE_FOLD_LIMIT, SCALE_FOLD_LIMIT], well before the products
+  // of the stored counts and the scale could overflow or lose precision.
+  const static CountersCount_t SCALE_FOLD_LIMIT = 1e64;
+
   //------------- Constructors, Destructor, Assignment -------------------------
 
-  template <typename V>
-  Counter<V>::Counter() 
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>::Counter() 
     : coreMap_(),
-      cachedTotal_( new CountCache(0, CACHE_POLICY_RELAXED, true) )
+      scale_(1),
+      cachedTotal_( 0, CACHE_POLICY_RELAXED, true ),
+      summation_( SUMMATION_NAIVE ),
+      cachedMax_( CACHE_POLICY_RELAXED, true )
   {}
 
-  template <typename V>
-  Counter<V>::Counter( Counter const& other )
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>::Counter( Counter const& other )
     : coreMap_( other.coreMap_ ),
-      cachedTotal_( new CountCache( *other.cachedTotal_ ) )
+      scale_( other.scale_ ),
+      cachedTotal_( other.cachedTotal_ ),
+      summation_( other.summation_ ),
+      cachedMax_( other.cachedMax_ ),
+      deltaLog_( other.deltaLog_ ? new Counter( *other.deltaLog_ ) : NULL )
   {
   }
 
-  template <typename V>
-  Counter<V>::Counter( Counter && other )
-    : coreMap_(), cachedTotal_(NULL)
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>::Counter( Counter && other )
+    : coreMap_(),
+      scale_(1),
+      cachedTotal_( 0, CACHE_POLICY_RELAXED, true ),
+      summation_( SUMMATION_NAIVE ),
+      cachedMax_( CACHE_POLICY_RELAXED, true )
   {
+    // Swapped rather than moved: moving a map held on the heap leaves the
+    // AnyMap of other without one, and other must stay a valid empty counter.
     swap( other );
   }
 
-  template <typename V>
-  Counter<V>::Counter( CoreMap_t coreMap )
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>::Counter( CoreMap_t coreMap )
     : coreMap_(std::move(coreMap)),
-      cachedTotal_( new CountCache(0, CACHE_POLICY_RELAXED, false) )
+      scale_(1),
+      cachedTotal_( 0, CACHE_POLICY_RELAXED, false ),
+      summation_( SUMMATION_NAIVE ),
+      cachedMax_( CACHE_POLICY_RELAXED, false )
   {}
 
-  template <typename V>
+  template <typename V, typename CoreMap>
+  template <typename OtherMap>
+  Counter<V, CoreMap>::Counter( Counter<V, OtherMap> const& other )
+    : coreMap_( (other.applyScale(),
+		 convertMap( other.coreMap_, MapTypeErasure::IsWrappedBy<OtherMap, CoreMap_t>() )) ),
+      scale_(1),
+      cachedTotal_( other.cachedTotal_ ),
+      summation_( other.summation_ ),
+      cachedMax_( other.cachedMax_ )
+  {}
+
+  template <typename V, typename CoreMap>
+  template <typename OtherMap>
+  typename Counter<V, CoreMap>::CoreMap_t
+  Counter<V, CoreMap>::convertMap( OtherMap const& m, std::false_type )
+  {
+    CoreMap_t result;
+    result.reserve( m.size() );
+    m.for_each( [&result](typename OtherMap::value_type const& v) { result.insert( IteratorValue_t(v.first, v.second) ); } );
+    return result;
+  }
+
+  template <typename V, typename CoreMap>
   template <typename InputIterator>
-  Counter<V>::Counter( InputIterator first, InputIterator last, Count_t count )
+  Counter<V, CoreMap>::Counter( InputIterator first, InputIterator last, Count_t count )
     : coreMap_(),
-      cachedTotal_( new CountCache(0, CACHE_POLICY_RELAXED, true) )
+      scale_(1),
+      cachedTotal_( 0, CACHE_POLICY_RELAXED, true ),
+      summation_( SUMMATION_NAIVE ),
+      cachedMax_( CACHE_POLICY_RELAXED, true )
   {
     incrementAll( first, last, count );
   }
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator=( Counter const & rhs )
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator=( Counter const & rhs )
   {
     if( this != &rhs ) {
+      if( deltaLog_ )
+	{
+	  deltaLog_->addCounter( *this, -1 );
+	  deltaLog_->addCounter( rhs, 1 );
+	}
       coreMap_ = rhs.coreMap_;
-      *cachedTotal_ = *rhs.cachedTotal_;
+      scale_ = rhs.scale_;
+      cachedTotal_ = rhs.cachedTotal_;
+      summation_ = rhs.summation_;
+      cachedMax_ = rhs.cachedMax_;
     }
     return *this;
   }
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator=( Counter<V> && rhs )
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator=( Counter<V, CoreMap> && rhs )
   {
+    if( this == &rhs )
+      return *this;
+    if( deltaLog_ )
+      {
+	deltaLog_->addCounter( *this, -1 );
+	deltaLog_->addCounter( rhs, 1 );
+      }
     swap( rhs );
+    // Each counter keeps its own tracking.
+    deltaLog_.swap( rhs.deltaLog_ );
     return *this;
   }
 
-  template <typename V>
-  void Counter<V>::swap( Counter<V>& other )
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::swap( Counter<V, CoreMap>& other )
   {
     coreMap_.swap( other.coreMap_ );
     { 
       using std::swap;
+      swap( scale_, other.scale_ );
       swap( cachedTotal_, other.cachedTotal_ );
+      swap( summation_, other.summation_ );
+      swap( cachedMax_, other.cachedMax_ );
     }
+    deltaLog_.swap( other.deltaLog_ );
   }
 
-  template <typename V>
-  Counter<V>::~Counter()
-  {
-    delete cachedTotal_;
-  }
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>::~Counter()
+  {}
 
   //--------------------------- Modifiers --------------------------------------
 
-  template <typename V>
-  void Counter<V>::incrementCount( V const& val, Count_t count )
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::incrementCount( V const& val, Count_t count )
+  {
+    typename CoreMap_t::iterator i( coreMap_.try_emplace(val, 0).first );
+    i->second += count / scale_;
+    cachedTotal_ += count;
+    cachedMax_.update( i->first, i->second * scale_ );
+    logCount( i->first, count );
+  }
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::incrementCount( V && val, Count_t count )
   {
-    coreMap_[val] += count;
-    *cachedTotal_ += count;
+    typename CoreMap_t::iterator i( coreMap_.try_emplace(std::move(val), 0).first );
+    i->second += count / scale_;
+    cachedTotal_ += count;
+    cachedMax_.update( i->first, i->second * scale_ );
+    logCount( i->first, count );
   }
 
-  template <typename V>
-  void Counter<V>::incrementCount( V && val, Count_t count )
+  template <typename V, typename CoreMap>
+  template <typename ValueLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value>::type
+  Counter<V, CoreMap>::incrementCount( ValueLike const& val, Count_t count )
   {
-    coreMap_[std::move(val)] += count;
-    *cachedTotal_ += count;
+    typename CoreMap_t::iterator i( coreMap_.try_emplace(val, 0).first );
+    i->second += count / scale_;
+    cachedTotal_ += count;
+    cachedMax_.update( i->first, i->second * scale_ );
+    logCount( i->first, count );
   }
 
-  template <typename V>
+  template <typename V, typename CoreMap>
   template <typename InputIterator>
-  void Counter<V>::incrementAll( InputIterator first, InputIterator last,
+  void Counter<V, CoreMap>::incrementAll( InputIterator first, InputIterator last,
 				 Count_t count )
   {
     for( ; first != last; ++first )
       incrementCount(*first, count);
   }
 
-  template <typename V>
-  void Counter<V>::setCount( V const& val, Count_t count )
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::incrementMany( std::pair<V, Count_t> const* items, std::size_t n )
+  {
+    V const* vals[BATCH_BLOCK];
+    Count_t counts[BATCH_BLOCK];
+    for( std::size_t first = 0; first < n; first += BATCH_BLOCK )
+      {
+	const std::size_t m( std::min<std::size_t>( BATCH_BLOCK, n - first ) );
+	for( std::size_t j = 0; j < m; ++j )
+	  {
+	    vals[j] = &items[first + j].first;
+	    counts[j] = items[first + j].second;
+	  }
+	incrementBlock( vals, counts, m );
+      }
+  }
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::incrementBlock( V const* const* vals, Count_t const* counts, std::size_t n )
   {
-    Count_t& storedCount = coreMap_[val];
-    *cachedTotal_ += (count - storedCount);
-    storedCount = count;
+    if( n == 0 )
+      return;
+    // The resulting counts are only needed to keep a persistent maximum.
+    const bool trackMax( cachedMax_.isSynched() && cachedMax_.getCachePolicy() == CACHE_POLICY_PERSISTENT );
+    Count_t results[BATCH_BLOCK];
+    coreMap_.add_many( vals, counts, n, 1 / scale_, trackMax ? results : NULL );
+    Count_t sum(0);
+    for( std::size_t i = 0; i < n; ++i )
+      sum += counts[i];
+    cachedTotal_ += sum;
+    if( trackMax )
+      for( std::size_t i = 0; i < n; ++i )
+	cachedMax_.update( *vals[i], results[i] * scale_ );
+    else
+      cachedMax_.reset();
+    if( deltaLog_ )
+      for( std::size_t i = 0; i < n; ++i )
+	deltaLog_->incrementCount( *vals[i], counts[i] );
   }
 
-  template <typename V>
-  void Counter<V>::setCount( V && val, Count_t count )
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::setCount( V const& val, Count_t count )
   {
-    Count_t& storedCount = coreMap_[val];
-    *cachedTotal_ += (count - storedCount);
-    storedCount = count;
+    typename CoreMap_t::iterator i( coreMap_.try_emplace(val, 0).first );
+    const Count_t old( i->second * scale_ );
+    cachedTotal_ += (count - old);
+    i->second = count / scale_;
+    cachedMax_.update( i->first, count );
+    logCount( i->first, count - old );
   }
 
-  template <typename V>
-  void Counter<V>::normalize(void)
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::setCount( V && val, Count_t count )
+  {
+    typename CoreMap_t::iterator i( coreMap_.try_emplace(val, 0).first );
+    const Count_t old( i->second * scale_ );
+    cachedTotal_ += (count - old);
+    i->second = count / scale_;
+    cachedMax_.update( i->first, count );
+    logCount( i->first, count - old );
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename ValueLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value>::type
+  Counter<V, CoreMap>::setCount( ValueLike const& val, Count_t count )
+  {
+    typename CoreMap_t::iterator i( coreMap_.try_emplace(val, 0).first );
+    const Count_t old( i->second * scale_ );
+    cachedTotal_ += (count - old);
+    i->second = count / scale_;
+    cachedMax_.update( i->first, count );
+    logCount( i->first, count - old );
+  }
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::normalize(void)
   {
     Count_t total( totalCount() );
     if( total != 0 )
       {
 	(*this) /= total;
-	cachedTotal_->set( 1.0 );
+	cachedTotal_.set( 1.0 );
       }
     else
       {
 	(*this) *= 0;
-	cachedTotal_->set( 0 );
+	cachedTotal_.set( 0 );
       }
   }
 
-  template <typename V>
-  void Counter<V>::remove( V const& val )
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::remove( V const& val )
   {
     typename CoreMap_t::const_iterator i(coreMap_.find(val));
     if( i != coreMap_.end() )
       {
-	*cachedTotal_ -= i->second;
+	cachedTotal_ -= i->second * scale_;
+	cachedMax_.remove( val );
+	logCount( val, -i->second * scale_ );
 	coreMap_.erase(i->first);
       }
   }
 
-  template <typename V>
-  bool Counter<V>::empty(void) const
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Size_t Counter<V, CoreMap>::prune( Count_t threshold )
+  {
+    return prune( threshold, deltaLog_.get() );
+  }
+
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Size_t Counter<V, CoreMap>::prune( Count_t threshold, Counter* log )
+  {
+    return eraseCounts( [threshold](Count_t count) { return count < threshold; },
+			!cachedMax_.isEmpty() && cachedMax_.getMax() >= threshold, log );
+  }
+
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Size_t Counter<V, CoreMap>::pruneToTopK( Size_t k )
+  {
+    if( k >= size() )
+      return 0;
+    if( k == 0 )
+      {
+	const Size_t n( size() );
+	clear();
+	return n;
+      }
+    std::vector<Count_t> counts;
+    counts.reserve( size() );
+    const Count_t scale( scale_ );
+    coreMap_.for_each( [&counts, scale](IteratorValue_t const& v) { counts.push_back( v.second * scale ); } );
+    std::nth_element( counts.begin(), counts.begin() + (k - 1), counts.end(), std::greater<Count_t>() );
+    const Count_t kth( counts[k - 1] );
+    // Of the counts equal to the k-th greatest, keep as many as there is
+    // room for next to the greater ones.
+    Size_t ties( k - std::count_if( counts.begin(), counts.begin() + (k - 1),
+				    [kth](Count_t c) { return c > kth; } ) );
+    return eraseCounts( [kth, &ties](Count_t count)
+			{
+			  if( count > kth ) return false;
+			  if( count == kth && ties > 0 ) { --ties;  return false; }
+			  return true;
+			},
+			!cachedMax_.isEmpty() && cachedMax_.getMax() > kth, deltaLog_.get() );
+  }
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::clear(void)
+  {
+    // Erased one by one for the log, then cleared for the maps which do
+    // not visit their counts (see CountMinSketch).
+    eraseCounts( [](Count_t) { return true; }, false, deltaLog_.get() );
+    coreMap_.clear();
+    scale_ = 1;
+    cachedTotal_.set( 0 );
+    cachedMax_.setEmpty();
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename Pred>
+  typename Counter<V, CoreMap>::Size_t Counter<V, CoreMap>::eraseCounts( Pred erase, bool keepsMax, Counter* log )
+  {
+    const Count_t scale( scale_ );
+    Count_t removed(0);
+    const Size_t erased( coreMap_.erase_if( [scale, &erase, &removed, log](IteratorValue_t const& v)
+					    {
+					      const Count_t count( v.second * scale );
+					      if( !erase(count) ) return false;
+					      removed += count;
+					      if( log != NULL )
+						log->incrementCount( v.first, -count );
+					      return true;
+					    } ) );
+    if( erased > 0 )
+      {
+	cachedTotal_ -= removed;
+	if( !keepsMax || cachedMax_.getCachePolicy() != CACHE_POLICY_PERSISTENT )
+	  cachedMax_.reset();
+      }
+    return erased;
+  }
+
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::empty(void) const
   {
     return coreMap_.empty();
   }
 
-  template <typename V>
-  typename Counter<V>::Size_t Counter<V>::size(void) const
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Size_t Counter<V, CoreMap>::size(void) const
   {
     return coreMap_.size();
   }
 
-  template <typename V>
-  typename Counter<V>::Size_t Counter<V>::maxSize(void) const
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Size_t Counter<V, CoreMap>::maxSize(void) const
   {
     return coreMap_.max_size();
   }
 
-  template <typename V>
-  bool Counter<V>::contains( V const& val ) const
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::reserve( Size_t n )
+  {
+    coreMap_.reserve(n);
+  }
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::shrinkToFit(void)
+  {
+    coreMap_.shrink_to_fit();
+  }
+
+  template <typename V, typename CoreMap>
+  std::size_t Counter<V, CoreMap>::memoryUsage(void) const
+  {
+    return sizeof(Counter) - sizeof(CoreMap_t) + coreMap_.memory_usage() +
+      (deltaLog_ ? deltaLog_->memoryUsage() : 0);
+  }
+
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::contains( V const& val ) const
   {
     return coreMap_.find(val) != coreMap_.end();
   }
 
-  template <typename V>
-  typename Counter<V>::Count_t Counter<V>::getCount( V const& val ) const
+  template <typename V, typename CoreMap>
+  template <typename ValueLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, bool>::type
+  Counter<V, CoreMap>::contains( ValueLike const& val ) const
+  {
+    return coreMap_.find(val) != coreMap_.end();
+  }
+
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Count_t Counter<V, CoreMap>::getCount( V const& val ) const
+  {
+    typename CoreMap_t::const_iterator i(coreMap_.find(val));
+    return i == coreMap_.end() ? 0 : i->second * scale_;
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename ValueLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, typename Counter<V, CoreMap>::Count_t>::type
+  Counter<V, CoreMap>::getCount( ValueLike const& val ) const
   {
     typename CoreMap_t::const_iterator i(coreMap_.find(val));
-    return i == coreMap_.end() ? 0 : i->second;
+    return i == coreMap_.end() ? 0 : i->second * scale_;
   }
 
-  template <typename V>
-  typename Counter<V>::Count_t Counter<V>::totalCount(void) const
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::getMany( V const* vals, std::size_t n, Count_t* out ) const
   {
-    if( ! cachedTotal_->isSynched() )
+    V const* block[BATCH_BLOCK];
+    for( std::size_t first = 0; first < n; first += BATCH_BLOCK )
       {
-	Count_t sum(0);
-	for( typename CoreMap_t::const_iterator i(coreMap_.begin()); i != coreMap_.end(); ++i )
-	  sum += i->second;
-	cachedTotal_->set( sum );
+	const std::size_t m( std::min<std::size_t>( BATCH_BLOCK, n - first ) );
+	for( std::size_t j = 0; j < m; ++j )
+	  block[j] = vals + first + j;
+	getBlock( block, m, out + first );
       }
-    return cachedTotal_->get();
   }
 
-  template <typename V>
-  V Counter<V>::maxValue(void) const
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::getBlock( V const* const* vals, std::size_t n, Count_t* out ) const
+  {
+    coreMap_.get_many( vals, n, out, 0 );
+    if( scale_ != 1 )
+      for( std::size_t i = 0; i < n; ++i )
+	out[i] *= scale_;
+  }
+
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Count_t Counter<V, CoreMap>::totalCount(void) const
   {
-    V const* maxVal(NULL);
-    Count_t max = std::numeric_limits<Count_t>::min();
-    for( typename CoreMap_t::const_iterator i(coreMap_.begin()); i != coreMap_.end(); ++i )
+    Count_t total(0);
+    if( cachedTotal_.lookup( total ) )
+      return total;
+    Count_t sum(0);
+    if( summation_ != SUMMATION_NAIVE )
       {
-	if( i->second > max ) {
-	  max = i->second;
-	  maxVal = &i->first;
-	}
+	kernels::Summation summation( summation_ );
+	coreMap_.for_each( [&summation](IteratorValue_t const& v) { summation.add( v.second ); } );
+	sum = summation.result();
       }
-    return maxVal == NULL ? V() : *maxVal;
+    else if( ! coreMap_.sum_mapped(sum) )
+      coreMap_.for_each( [&sum](IteratorValue_t const& v) { sum += v.second; } );
+    cachedTotal_.set( sum * scale_ );
+    return cachedTotal_.get();
   }
 
-  template <typename V>
-  bool Counter<V>::isTotalSynched() const
+  template <typename V, typename CoreMap>
+  V Counter<V, CoreMap>::maxValue(void) const
   {
-    return cachedTotal_->isSynched();
+    if( ! cachedMax_.isSynched() )
+      {
+	V const* maxVal(NULL);
+	Count_t max = std::numeric_limits<Count_t>::lowest();
+	const Count_t scale( scale_ );
+	coreMap_.for_each( [&maxVal, &max, scale](IteratorValue_t const& v)
+			   {
+			     if( maxVal == NULL || v.second * scale > max ) {
+			       max = v.second * scale;
+			       maxVal = &v.first;
+			     }
+			   } );
+	if( maxVal == NULL ) cachedMax_.setEmpty();
+	else                 cachedMax_.set( *maxVal, max );
+      }
+    return cachedMax_.isEmpty() ? V() : cachedMax_.get();
   }
 
-  template <typename V>
-  typename Counter<V>::ConstIterator Counter<V>::begin(void) const
+  template <typename V, typename CoreMap>
+  std::vector<typename Counter<V, CoreMap>::ValueCount_t> Counter<V, CoreMap>::topK( Size_t k ) const
   {
+    typedef std::pair<Count_t, V const*> Entry_t;
+    // Orders the heap so that the smallest of the k greatest counts is on top.
+    struct Greater
+    {
+      bool operator()( Entry_t const& a, Entry_t const& b ) const
+      { return a.first > b.first; }
+    };
+    std::vector<Entry_t> heap;
+    heap.reserve( std::min(k, size()) );
+    if( k > 0 )
+      {
+	const Count_t scale( scale_ );
+	coreMap_.for_each( [&heap, k, scale](IteratorValue_t const& v)
+			   {
+			     const Count_t count( v.second * scale );
+			     if( heap.size() < k )
+			       {
+				 heap.push_back( Entry_t(count, &v.first) );
+				 std::push_heap( heap.begin(), heap.end(), Greater() );
+			       }
+			     else if( count > heap.front().first )
+			       {
+				 std::pop_heap( heap.begin(), heap.end(), Greater() );
+				 heap.back() = Entry_t(count, &v.first);
+				 std::push_heap( heap.begin(), heap.end(), Greater() );
+			       }
+			   } );
+      }
+    std::sort_heap( heap.begin(), heap.end(), Greater() );
+    std::vector<ValueCount_t> top;
+    top.reserve( heap.size() );
+    for( typename std::vector<Entry_t>::const_iterator i(heap.begin()); i != heap.end(); ++i )
+      top.push_back( ValueCount_t( *i->second, i->first ) );
+    return top;
+  }
+
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::isTotalSynched() const
+  {
+    return cachedTotal_.isSynched();
+  }
+
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::isMaxSynched() const
+  {
+    return cachedMax_.isSynched();
+  }
+
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::ConstIterator Counter<V, CoreMap>::begin(void) const
+  {
+    applyScale();
     return coreMap_.begin();
   }
 
-  template <typename V>
-  typename Counter<V>::ConstIterator Counter<V>::end(void) const
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::ConstIterator Counter<V, CoreMap>::end(void) const
   {
     return coreMap_.end();
   }
 
-  template <typename V>
-  bool Counter<V>::operator==(const Counter<V>& o) const
+  template <typename V, typename CoreMap>
+  template <typename F>
+  void Counter<V, CoreMap>::forEach( F f ) const
+  {
+    const Count_t scale( scale_ );
+    coreMap_.for_each( [&f, scale](IteratorValue_t const& v) { f( v.first, v.second * scale ); } );
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename OtherMap, typename F>
+  void Counter<V, CoreMap>::forEachJoint( Counter<V, OtherMap> const& o, F f ) const
+  {
+    const std::size_t n( size() ), m( o.size() );
+    if( n == 0 || m == 0 )
+      return;
+    // A merge visits both maps; the lookups cost about log2 of the larger
+    // size each in a sorted map.
+    const std::size_t smaller( std::min(n, m) ), larger( std::max(n, m) );
+    std::size_t depth(1);
+    while( (std::size_t(1) << depth) <= larger && depth < 64 )
+      ++depth;
+    if( coreMap_.is_sorted() && o.coreMap_.is_sorted() && n + m < smaller * depth )
+      mergeJoint( o, f );
+    else if( n <= m )
+      probeJoint( o, f );
+    else
+      o.probeJoint( *this, [&f](Count_t count, Count_t otherCount) { f( otherCount, count ); } );
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename OtherMap, typename F>
+  void Counter<V, CoreMap>::mergeJoint( Counter<V, OtherMap> const& o, F& f ) const
   {
+    typedef typename Counter<V, OtherMap>::CoreMap_t OtherCore_t;
+    const bool mine( size() <= o.size() );
+    const std::less<V> less;
+    typename CoreMap_t::const_iterator i( coreMap_.begin() ), ie( coreMap_.end() );
+    typename OtherCore_t::const_iterator j( o.coreMap_.begin() ), je( o.coreMap_.end() );
+    while( i != ie && j != je )
+      {
+	if( less( i->first, j->first ) )
+	  {
+	    if( mine )
+	      f( i->second * scale_, Count_t(0) );
+	    ++i;
+	  }
+	else if( less( j->first, i->first ) )
+	  {
+	    if( !mine )
+	      f( Count_t(0), j->second * o.scale_ );
+	    ++j;
+	  }
+	else
+	  {
+	    f( i->second * scale_, j->second * o.scale_ );
+	    ++i;
+	    ++j;
+	  }
+      }
+    for( ; mine && i != ie; ++i )
+      f( i->second * scale_, Count_t(0) );
+    for( ; !mine && j != je; ++j )
+      f( Count_t(0), j->second * o.scale_ );
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename OtherMap, typename F>
+  void Counter<V, CoreMap>::probeJoint( Counter<V, OtherMap> const& larger, F f ) const
+  {
+    V const* vals[BATCH_BLOCK];
+    Count_t counts[BATCH_BLOCK], others[BATCH_BLOCK];
+    std::size_t m(0);
+    const Count_t scale( scale_ );
+    // The values stay in place during the traversal of the (const) map.
+    coreMap_.for_each( [&](IteratorValue_t const& v) {
+	vals[m] = &v.first;
+	counts[m] = v.second * scale;
+	if( ++m == BATCH_BLOCK )
+	  {
+	    larger.getBlock( vals, m, others );
+	    for( std::size_t i = 0; i < m; ++i )
+	      f( counts[i], others[i] );
+	    m = 0;
+	  }
+      } );
+    larger.getBlock( vals, m, others );
+    for( std::size_t i = 0; i < m; ++i )
+      f( counts[i], others[i] );
+  }
+
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::operator==(const Counter<V, CoreMap>& o) const
+  {
+    applyScale();
+    o.applyScale();
     return coreMap_ == o.coreMap_;
   }
 
-  template <typename V>
-  bool Counter<V>::operator!=(const Counter<V>& o) const
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::operator!=(const Counter<V, CoreMap>& o) const
   {
     return !(operator==(o));
   }
 
   //----------------------- Caching Policy ------------------------------------
 
-  template <typename V>
-  void Counter<V>::setCachePolicy(NumCachePolicy cachePolicy) const
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::setCachePolicy(NumCachePolicy cachePolicy) const
   {
-    cachedTotal_->setCachePolicy( cachePolicy );
+    cachedTotal_.setCachePolicy( cachePolicy );
   }
 
-  template <typename V>
-  NumCachePolicy Counter<V>::getCachePolicy(void) const
+  template <typename V, typename CoreMap>
+  NumCachePolicy Counter<V, CoreMap>::getCachePolicy(void) const
   {
-    return cachedTotal_->getCachePolicy();
+    return cachedTotal_.getCachePolicy();
   }
 
-  template <typename V>
-  void Counter<V>::resetCache(void) const
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::resetCache(void) const
   {
-    cachedTotal_->reset();
+    cachedTotal_.reset();
+    cachedMax_.reset();
   }
 
-  //----------------------- Arithmetic Operators ------------------------------
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::setSummationPolicy(SummationPolicy summation) const
+  {
+    summation_ = summation;
+    cachedTotal_.reset();
+  }
+
+  template <typename V, typename CoreMap>
+  SummationPolicy Counter<V, CoreMap>::getSummationPolicy(void) const
+  {
+    return summation_;
+  }
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::setMaxCachePolicy(NumCachePolicy cachePolicy) const
+  {
+    cachedMax_.setCachePolicy( cachePolicy );
+  }
+
+  template <typename V, typename CoreMap>
+  NumCachePolicy Counter<V, CoreMap>::getMaxCachePolicy(void) const
+  {
+    return cachedMax_.getCachePolicy();
+  }
+
+  //----------------------- Instrumentation -----------------------------------
+
+  namespace details
+  {
+    // Only AnyMaps can be instrumented.
+    template <typename K, typename V>
+    bool setInstrumented( MapTypeErasure::AnyMap<K, V>& map, bool on )
+    { map.set_instrumented( on );  return true; }
+    template <typename Map>
+    bool setInstrumented( Map&, bool ) { return false; }
+
+    template <typename K, typename V>
+    bool mapStats( MapTypeErasure::AnyMap<K, V> const& map, MapTypeErasure::MapStats& stats )
+    { return map.stats( stats ); }
+    template <typename Map>
+    bool mapStats( Map const&, MapTypeErasure::MapStats& ) { return false; }
+  };
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator+=(const Counter& o)
+  template <typename V, typename CoreMap>
+  NumCacheStats Counter<V, CoreMap>::getTotalCacheStats(void) const
   {
-    for( typename Counter<V>::ConstIterator i(o.begin()); i != o.end(); ++i )
-      incrementCount( i->first, i->second );
+    return cachedTotal_.getStats();
+  }
+
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::setMapInstrumented(bool on)
+  {
+    return details::setInstrumented( coreMap_, on );
+  }
+
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::getMapStats(MapTypeErasure::MapStats& stats) const
+  {
+    return details::mapStats( coreMap_, stats );
+  }
+
+  //----------------------- Delta Tracking ------------------------------------
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::setDeltaTracking(bool on)
+  {
+    if( !on )
+      deltaLog_.reset();
+    else if( !deltaLog_ )
+      deltaLog_.reset( new Counter() );
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::extractDelta(void)
+  {
+    Counter<V, CoreMap> delta;
+    if( deltaLog_ )
+      {
+	delta.swap( *deltaLog_ );
+	delta.eraseCounts( [](Count_t count) { return count == 0; }, false, NULL );
+      }
+    return delta;
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::applyDelta(Counter const& delta)
+  {
+    if( this == &delta )
+      return applyDelta( Counter<V, CoreMap>(delta) );
+    *this += delta;
+    delta.coreMap_.for_each( [this](IteratorValue_t const& v)
+			     {
+			       if( getCount( v.first ) == 0 )
+				 remove( v.first );
+			     } );
     return *this;
   }
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator-=(const Counter& o)
+  //----------------------- Arithmetic Operators ------------------------------
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator+=(const Counter& o)
+  {
+    return addCounter( o, 1 );
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator-=(const Counter& o)
   {
-    for( typename Counter<V>::ConstIterator i(o.begin()); i != o.end(); ++i )
-      incrementCount( i->first, -i->second );
+    return addCounter( o, -1 );
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::addCounter(const Counter& o, Count_t factor)
+  {
+    if( deltaLog_ )
+      {
+	// o is logged before it is added (it may be *this), and the log is
+	// detached meanwhile so that the increments below do not log it twice.
+	std::unique_ptr<Counter> log( std::move(deltaLog_) );
+	log->addCounter( o, factor );
+	addCounter( o, factor );
+	deltaLog_ = std::move( log );
+	return *this;
+      }
+    applyScale();
+    // A persistent total stays synched: it is updated with the total of o,
+    // which is read before the maps are added (o may be *this).
+    const bool keepTotal( cachedTotal_.isSynched() && cachedTotal_.getCachePolicy() == CACHE_POLICY_PERSISTENT );
+    const Count_t added( keepTotal ? factor * o.totalCount() : 0 );
+    if( coreMap_.add_mapped( o.coreMap_, factor * o.scale_ ) )
+      {
+	cachedMax_.reset();
+	if( keepTotal )
+	  cachedTotal_ += added;
+	else
+	  cachedTotal_.reset();
+	return *this;
+      }
+    const Count_t scale( factor * o.scale_ );
+    o.coreMap_.for_each( [this, scale](IteratorValue_t const& v) { incrementCount( v.first, v.second * scale ); } );
     return *this;
   }
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator+=(Count_t count)
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator+=(Count_t count)
   {
-    for( typename Counter<V>::CoreMap_t::iterator i(coreMap_.begin());
-	 i != coreMap_.end(); ++i )
-      i->second += count;
-    *cachedTotal_ += (count * size());
+    applyScale();
+    coreMap_.for_each_mut( [count](IteratorValue_t& v) { v.second += count; } );
+    if( deltaLog_ )
+      coreMap_.for_each( [this, count](IteratorValue_t const& v) { deltaLog_->incrementCount( v.first, count ); } );
+    cachedTotal_ += (count * size());
+    cachedMax_.shift( count );
     return *this;
   }
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator-=(Count_t count)
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator-=(Count_t count)
   { return operator+=(-count); }
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator*=(Count_t count)
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator*=(Count_t count)
   {
-    for( typename Counter<V>::CoreMap_t::iterator i(coreMap_.begin());
-	 i != coreMap_.end(); ++i )
-      i->second *= count;
-    *cachedTotal_ *= count;
+    if( deltaLog_ && count != 1 )
+      deltaLog_->addCounter( *this, count - 1 );
+    scale_ *= count;
+    // A zero scale cannot be divided out by later increments.
+    if( scale_ == 0 || std::fabs(scale_) > SCALE_FOLD_LIMIT ||
+	std::fabs(scale_) < 1 / SCALE_FOLD_LIMIT )
+      applyScale();
+    cachedTotal_.scale( count );
+    cachedMax_.scale( count );
     return *this;
   }
 
-  template <typename V>
-  Counter<V>& Counter<V>::operator/=(Count_t count)
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator/=(Count_t count)
   { return operator*=(1.0/count); }
 
-  template <typename V>
-  Counter<V> Counter<V>::operator+(const Counter<V>& o) const
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Sum_t Counter<V, CoreMap>::operator+(const Counter<V, CoreMap>& o) const &
   {
-    Counter<V> tmp(*this);
+    return Sum_t( Scaled_t(*this, 1), Scaled_t(o, 1) );
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator+(const Counter<V, CoreMap>& o) &&
+  {
+    Counter<V, CoreMap> tmp( std::move(*this) );
     tmp += o;
     return tmp;
   }
 
-  template <typename V>
-  Counter<V> Counter<V>::operator-(const Counter<V>& o) const
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Sum_t Counter<V, CoreMap>::operator-(const Counter<V, CoreMap>& o) const &
+  {
+    return Sum_t( Scaled_t(*this, 1), Scaled_t(o, -1) );
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator-(const Counter<V, CoreMap>& o) &&
   {
-    Counter<V> tmp(*this);
+    Counter<V, CoreMap> tmp( std::move(*this) );
     tmp -= o;
     return tmp;
   }
 
-  template <typename V>
-  Counter<V> Counter<V>::operator+(Count_t count) const
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator+(Count_t count) const &
   {
-    Counter<V> tmp(*this);
+    Counter<V, CoreMap> tmp(*this);
     tmp += count;
     return tmp;
   }
 
-  template <typename V>
-  Counter<V> Counter<V>::operator-(Count_t count) const
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator+(Count_t count) &&
+  {
+    Counter<V, CoreMap> tmp( std::move(*this) );
+    tmp += count;
+    return tmp;
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator-(Count_t count) const &
   { return operator+(-count); }
 
-  template <typename V>
-  Counter<V> Counter<V>::operator*(Count_t count) const
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator-(Count_t count) &&
+  { return std::move(*this).operator+(-count); }
+
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Scaled_t Counter<V, CoreMap>::operator*(Count_t count) const &
   {
-    Counter<V> tmp(*this);
+    return Scaled_t( *this, count );
+  }
+
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator*(Count_t count) &&
+  {
+    Counter<V, CoreMap> tmp( std::move(*this) );
     tmp *= count;
     return tmp;
   }
 
-  template <typename V>
-  Counter<V> Counter<V>::operator/(Count_t count) const
+  template <typename V, typename CoreMap>
+  typename Counter<V, CoreMap>::Scaled_t Counter<V, CoreMap>::operator/(Count_t count) const &
   { return operator*(1.0/count); }
 
+  template <typename V, typename CoreMap>
+  Counter<V, CoreMap> Counter<V, CoreMap>::operator/(Count_t count) &&
+  { return std::move(*this).operator*(1.0/count); }
+
+  //----------------------- Counter Expressions -------------------------------
+
+  template <typename V, typename CoreMap>
+  template <typename E>
+  Counter<V, CoreMap>::Counter( CounterExpression<E, Counter> const& e )
+    : Counter( e.self().evaluate() )
+  {}
+
+  template <typename V, typename CoreMap>
+  template <typename E>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator=( CounterExpression<E, Counter> const& e )
+  {
+    Counter<V, CoreMap> tmp( e.self().evaluate() );
+    if( deltaLog_ )
+      {
+	deltaLog_->addCounter( *this, -1 );
+	deltaLog_->addCounter( tmp, 1 );
+	tmp.deltaLog_ = std::move( deltaLog_ );
+      }
+    swap( tmp );
+    return *this;
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename E>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator+=( CounterExpression<E, Counter> const& e )
+  {
+    // The operands after this counter would otherwise see it modified.
+    if( e.self().refersTo(this) )
+      return *this += Counter<V, CoreMap>( e.self().evaluate() );
+    e.self().addTo( *this, 1 );
+    return *this;
+  }
+
+  template <typename V, typename CoreMap>
+  template <typename E>
+  Counter<V, CoreMap>& Counter<V, CoreMap>::operator-=( CounterExpression<E, Counter> const& e )
+  {
+    if( e.self().refersTo(this) )
+      return *this -= Counter<V, CoreMap>( e.self().evaluate() );
+    e.self().addTo( *this, -1 );
+    return *this;
+  }
+
   //-------------------- Counts Equal ------------------------------------------
 
-  template <typename V>
-  bool Counter<V>::equals( const Counter<V>& o, Count_t precision ) const
+  template <typename V, typename CoreMap>
+  bool Counter<V, CoreMap>::equals( const Counter<V, CoreMap>& o, Count_t precision ) const
   {
     if( this == &o ) return true;
-    if( size() != o.size() ) return false;
-    for( typename Counter<V>::CoreMap_t::const_iterator i(coreMap_.begin());
-	 i != coreMap_.end(); ++i)
+    // Maps which do not visit their counts (see CountMinSketch) are compared
+    // natively, once the scales are folded into them.
+    bool equal(false);
+    if( coreMap_.equal_mapped( o.coreMap_, precision, equal ) ||
+	o.coreMap_.equal_mapped( coreMap_, precision, equal ) )
       {
-	typename Counter<V>::CoreMap_t::const_iterator 
-	  oi( o.coreMap_.find( i->first ) );
-
-	if( oi == o.coreMap_.end() || 
-	    std::fabs(i->second - oi->second) >= precision )
+	if( scale_ != 1 || o.scale_ != 1 )
 	  {
-	    return false;
+	    applyScale();
+	    o.applyScale();
+	    coreMap_.equal_mapped( o.coreMap_, precision, equal );
 	  }
+	return equal;
+      }
+    if( size() != o.size() ) return false;
+    const Count_t scale( scale_ );
+    return coreMap_.all_of( [&o, precision, scale](IteratorValue_t const& v)
+			    {
+			      typename Counter<V, CoreMap>::CoreMap_t::const_iterator
+				oi( o.coreMap_.find( v.first ) );
+			      return oi != o.coreMap_.end() &&
+				std::fabs(v.second * scale - oi->second * o.scale_) < precision;
+			    } );
+  }
+
+  //----------------------------- Private -------------------------------------
+
+  template <typename V, typename CoreMap>
+  void Counter<V, CoreMap>::applyScale(void) const
+  {
+    if( scale_ != 1 )
+      {
+	const Count_t scale( scale_ );
+	if( ! coreMap_.scale_mapped(scale) )
+	  coreMap_.for_each_mut( [scale](IteratorValue_t& v) { v.second *= scale; } );
+	scale_ = 1;
       }
-    return true;
   }
 
   //-------------------- Output Operator ---------------------------------------
 
-  template <typename V>
-  std::ostream& operator<<(std::ostream& os, const Counter<V>& counter)
+  template <typename V, typename CoreMap>
+  std::ostream& operator<<(std::ostream& os, const Counter<V, CoreMap>& counter)
   {
     os << "[";
     if( counter.size() > 0 )
       {
-	typename Counter<V>::ConstIterator i(counter.begin());
+	typename Counter<V, CoreMap>::ConstIterator i(counter.begin());
 	os << i->first << MAPPING_DELIMITER << i->second;
 	for( ; ++i != counter.end(); )
 	  os << ", " << i->first << MAPPING_DELIMITER << i->second;
@@ -8,398 +8,1084 @@
 // Reason 2: EDE and Semantic autocompletion needs this to help with member
 // variables and STL typenamees included from the header.
 #include "Counters/CounterMap.hpp"
+#include "Counters/details/_Parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
 
 namespace Counters
 {
-  template <typename K, typename V>
-  CounterMap<K, V>::CounterMap( CounterMap<K, V> const & other )
-    : coreMap_(other.coreMap_),
-      counterFactory_(other.counterFactory_->clone()),
-      cachedTotal_(new CountCache(*other.cachedTotal_))
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>::CounterMap( CounterMap<K, V, RowMap, OuterMap> const & other )
+    : counterFactory_(other.counterFactory_),
+      coreMap_(other.coreMap_),
+      cachedTotal_(other.cachedTotal_),
+      eviction_(other.eviction_),
+      modificationsSinceCheck_(0),
+      deltaLog_(other.deltaLog_ ? new CounterMap(*other.deltaLog_) : NULL),
+      reverseIndex_(other.reverseIndex_ ? new ReverseIndex_t(*other.reverseIndex_) : NULL)
   {}
 
-  template <typename K, typename V>
-  CounterMap<K, V>::CounterMap( CounterMap<K, V> && other )
-    : coreMap_(),
-      counterFactory_(NULL),
-      cachedTotal_(NULL)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>::CounterMap( CounterMap<K, V, RowMap, OuterMap> && other )
+    : counterFactory_(),
+      coreMap_(),
+      cachedTotal_(),
+      eviction_(),
+      modificationsSinceCheck_(0)
   {
     swap(other);
   }
 
-  template <typename K, typename V>
-  CounterMap<K, V>::CounterMap( CoreMap_t coreMap, 
-				CounterFactory<V> const & counterFactory )
-    : coreMap_(std::move(coreMap)),
-      counterFactory_(counterFactory.clone()),
-      cachedTotal_(new CountCache(0, CACHE_POLICY_RELAXED, false))
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>::CounterMap( CoreMap_t coreMap, 
+				CounterFactory<V, RowMap> const & counterFactory )
+    : counterFactory_(counterFactory.clone()),
+      coreMap_(std::move(coreMap)),
+      cachedTotal_(0, CACHE_POLICY_RELAXED, false),
+      eviction_(),
+      modificationsSinceCheck_(0)
+  {}
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>::CounterMap( CoreMap_t coreMap,
+				std::shared_ptr<CounterFactory<V, RowMap> const> counterFactory )
+    : counterFactory_(std::move(counterFactory)),
+      coreMap_(std::move(coreMap)),
+      cachedTotal_(0, CACHE_POLICY_RELAXED, false),
+      eviction_(),
+      modificationsSinceCheck_(0)
   {}
   
-  template <typename K, typename V>
-  CounterMap<K, V>::~CounterMap()
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename OtherRowMap, typename OtherOuterMap>
+  CounterMap<K, V, RowMap, OuterMap>::CounterMap( CounterMap<K, V, OtherRowMap, OtherOuterMap> const& other )
+    : counterFactory_(convertFactory(other.counterFactory_)),
+      coreMap_(),
+      cachedTotal_(other.cachedTotal_),
+      eviction_(other.eviction_),
+      modificationsSinceCheck_(0)
   {
-    delete counterFactory_;
-    delete cachedTotal_;
+    typedef typename CounterMap<K, V, OtherRowMap, OtherOuterMap>::IteratorValue_t OtherValue_t;
+    coreMap_.reserve( other.size() );
+    other.coreMap_.for_each( [this](OtherValue_t const& v) { coreMap_.try_emplace( v.first, Counter_t(v.second) ); } );
   }
 
-  template <typename K, typename V>
-  CounterMap<K, V>& CounterMap<K, V>::operator=(CounterMap<K, V> const & other)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>::~CounterMap()
+  {}
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::operator=(CounterMap<K, V, RowMap, OuterMap> const & other)
   {
     coreMap_ = other.coreMap_;
-    counterFactory_ = other.counterFactory_->clone();
-    *cachedTotal_ = *other.cachedTotal_;
+    counterFactory_ = other.counterFactory_;
+    cachedTotal_ = other.cachedTotal_;
+    eviction_ = other.eviction_;
+    modificationsSinceCheck_ = 0;
+    if( this != &other )
+      {
+	deltaLog_.reset( other.deltaLog_ ? new CounterMap(*other.deltaLog_) : NULL );
+	reverseIndex_.reset( other.reverseIndex_ ? new ReverseIndex_t(*other.reverseIndex_) : NULL );
+      }
     return *this;
   }
 
-  template <typename K, typename V>
-  CounterMap<K, V>& CounterMap<K, V>::operator=(CounterMap<K, V> && other)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::operator=(CounterMap<K, V, RowMap, OuterMap> && other)
   {
     swap( other );
     return *this;
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::swap(CounterMap<K, V>& other )
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::swap(CounterMap<K, V, RowMap, OuterMap>& other )
   {
     coreMap_.swap(other.coreMap_);
     std::swap(counterFactory_, other.counterFactory_);
     std::swap(cachedTotal_, other.cachedTotal_);
+    std::swap(eviction_, other.eviction_);
+    std::swap(modificationsSinceCheck_, other.modificationsSinceCheck_);
+    deltaLog_.swap(other.deltaLog_);
+    reverseIndex_.swap(other.reverseIndex_);
   }
 
   //--------------------------- Modifiers ---------------------------------------
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::incrementCount(K const& key, V const& val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::incrementCount(K const& key, V const& val, Count_t count)
   {
+    checkMemoryBudget();
+    logCount(key, val, count);
+    indexCount(key, val, count);
     ensureCounter(key).incrementCount(val, count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::incrementCount(K && key, V const& val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::incrementCount(K && key, V const& val, Count_t count)
   {
+    checkMemoryBudget();
+    logCount(key, val, count);
+    indexCount(key, val, count);
     ensureCounter(std::move(key)).incrementCount(val, count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::incrementCount(K && key, V && val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::incrementCount(K && key, V && val, Count_t count)
   {
+    checkMemoryBudget();
+    logCount(key, val, count);
+    indexCount(key, val, count);
     ensureCounter(std::move(key)).incrementCount(std::move(val), count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::incrementCount(K const& key, V && val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::incrementCount(K const& key, V && val, Count_t count)
   {
+    checkMemoryBudget();
+    logCount(key, val, count);
+    indexCount(key, val, count);
     ensureCounter(key).incrementCount(std::move(val), count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
   
-  template <typename K, typename V>
-  void CounterMap<K, V>::setCount(K const& key, V const& val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::setCount(K const& key, V const& val, Count_t count)
   {
+    checkMemoryBudget();
+    if( deltaLog_ )
+      logCount(key, val, count - getCount(key, val));
+    indexSetCount(key, val, count);
     ensureCounter(key).setCount(val, count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::setCount(K && key, V const& val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::setCount(K && key, V const& val, Count_t count)
   {
+    checkMemoryBudget();
+    if( deltaLog_ )
+      logCount(key, val, count - getCount(key, val));
+    indexSetCount(key, val, count);
     ensureCounter(std::move(key)).setCount(val, count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::setCount(K && key, V && val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::setCount(K && key, V && val, Count_t count)
   {
+    checkMemoryBudget();
+    if( deltaLog_ )
+      logCount(key, val, count - getCount(key, val));
+    indexSetCount(key, val, count);
     ensureCounter(std::move(key)).setCount(std::move(val), count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
   
-  template <typename K, typename V>
-  void CounterMap<K, V>::setCount(K const& key, V && val, Count_t count)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::setCount(K const& key, V && val, Count_t count)
   {
+    checkMemoryBudget();
+    if( deltaLog_ )
+      logCount(key, val, count - getCount(key, val));
+    indexSetCount(key, val, count);
     ensureCounter(key).setCount(std::move(val), count);
-    cachedTotal_->reset();
+    cachedTotal_.reset();
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::remove(K const& key)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename KeyArg, typename ValArg>
+  typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value>::type
+  CounterMap<K, V, RowMap, OuterMap>::incrementCount(KeyArg&& key, ValArg&& val, Count_t count)
   {
-    if( coreMap_.erase(key) > 0 )
-      cachedTotal_->reset();
+    checkMemoryBudget();
+    logCount(key, val, count);
+    indexCount(key, val, count);
+    ensureCounter(std::forward<KeyArg>(key)).incrementCount(std::forward<ValArg>(val), count);
+    cachedTotal_.reset();
   }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::remove(K const& key, V const& val)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::incrementMany(std::tuple<K, V, Count_t> const* items, std::size_t n)
   {
-    typename CounterMap<K, V>::CoreMap_t::iterator i( coreMap_.find(key) );
-    if( i != coreMap_.end() )
-      i->second.remove(val);
+    checkMemoryBudget();
+    if( deltaLog_ )
+      deltaLog_->incrementMany(items, n);
+    if( reverseIndex_ )
+      for( std::size_t i = 0; i < n; ++i )
+	reverseIndex_->incrementCount( std::get<1>(items[i]), std::get<0>(items[i]), std::get<2>(items[i]) );
+    V const* vals[Counter_t::BATCH_BLOCK];
+    Count_t counts[Counter_t::BATCH_BLOCK];
+    for( std::size_t i = 0; i < n; )
+      {
+	K const& key( std::get<0>(items[i]) );
+	Counter_t& counter( ensureCounter(key) );
+	std::size_t m(0);
+	for( ; i < n && std::get<0>(items[i]) == key; ++i )
+	  {
+	    vals[m] = &std::get<1>(items[i]);
+	    counts[m] = std::get<2>(items[i]);
+	    if( ++m == Counter_t::BATCH_BLOCK )
+	      {
+		counter.incrementBlock( vals, counts, m );
+		m = 0;
+	      }
+	  }
+	counter.incrementBlock( vals, counts, m );
+      }
+    if( n > 0 )
+      cachedTotal_.reset();
   }
 
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename KeyArg, typename ValArg>
+  typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value>::type
+  CounterMap<K, V, RowMap, OuterMap>::setCount(KeyArg&& key, ValArg&& val, Count_t count)
+  {
+    checkMemoryBudget();
+    if( deltaLog_ )
+      logCount(key, val, count - getCount(key, val));
+    indexSetCount(key, val, count);
+    ensureCounter(std::forward<KeyArg>(key)).setCount(std::forward<ValArg>(val), count);
+    cachedTotal_.reset();
+  }
 
-  template <typename K, typename V>
-  void CounterMap<K, V>::conditionalNormalize(void)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::remove(K const& key)
+  {
+    if( deltaLog_ || reverseIndex_ )
+      {
+	Counter_t const* counter( getCounter(key) );
+	if( counter != NULL && deltaLog_ )
+	  deltaLog_->ensureCounter(key) -= *counter;
+	if( counter != NULL && reverseIndex_ )
+	  counter->forEach( [this, &key](V const& val, Count_t) { unindex(key, val); } );
+      }
+    if( coreMap_.erase(key) > 0 )
+      cachedTotal_.reset();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::remove(K const& key, V const& val)
   {
-    for( typename CounterMap<K, V>::CoreMap_t::iterator i( coreMap_.begin() );
-	 i != coreMap_.end(); ++i )
+    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::iterator i( coreMap_.find(key) );
+    if( i != coreMap_.end() )
       {
-	i->second.normalize();
+	if( deltaLog_ && i->second.contains(val) )
+	  logCount(key, val, -i->second.getCount(val));
+	if( reverseIndex_ && i->second.contains(val) )
+	  unindex(key, val);
+	i->second.remove(val);
       }
-    cachedTotal_->reset();
+  }
+
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::clear(void)
+  {
+    if( deltaLog_ )
+      logRows(-1);
+    if( reverseIndex_ )
+      reverseIndex_->clear();
+    coreMap_.clear();
+    cachedTotal_.reset();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Size_t
+  CounterMap<K, V, RowMap, OuterMap>::prune(Count_t minRowTotal, Count_t minCount)
+  {
+    return pruneRows( minRowTotal, [minCount](Counter_t& row, Counter_t* pruned) { return row.prune( minCount, pruned ); } );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename RowPrune>
+  typename CounterMap<K, V, RowMap, OuterMap>::Size_t
+  CounterMap<K, V, RowMap, OuterMap>::pruneRows(Count_t minRowTotal, RowPrune rowPrune)
+  {
+    Size_t removed(0);
+    CounterMap* const log( deltaLog_.get() );
+    const bool indexing( reverseIndex_ != NULL );
+    coreMap_.for_each_mut( [this, &removed, &rowPrune, log, indexing](IteratorValue_t& v)
+			   {
+			     if( log == NULL && !indexing )
+			       {
+				 removed += rowPrune( v.second, NULL );
+				 return;
+			       }
+			     // Logged into a row of the log only if something is removed.
+			     Counter_t pruned;
+			     removed += rowPrune( v.second, &pruned );
+			     if( pruned.empty() )
+			       return;
+			     if( log != NULL )
+			       log->ensureCounter(v.first) += pruned;
+			     if( indexing )
+			       pruned.forEach( [this, &v](V const& val, Count_t) { unindex(v.first, val); } );
+			   } );
+    coreMap_.erase_if( [this, &removed, minRowTotal, log, indexing](IteratorValue_t const& v)
+		       {
+			 if( !v.second.empty() && !(v.second.totalCount() < minRowTotal) )
+			   return false;
+			 removed += v.second.size();
+			 if( log != NULL && !v.second.empty() )
+			   log->ensureCounter(v.first) -= v.second;
+			 if( indexing )
+			   v.second.forEach( [this, &v](V const& val, Count_t) { unindex(v.first, val); } );
+			 return true;
+		       } );
+    cachedTotal_.reset();
+    return removed;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::conditionalNormalize(void)
+  {
+    if( deltaLog_ )
+      logRows(-1);
+    coreMap_.for_each_mut( [](IteratorValue_t& v) { v.second.normalize(); } );
+    if( deltaLog_ )
+      logRows(1);
+    if( reverseIndex_ )
+      reindexRows();
+    cachedTotal_.reset();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::conditionalNormalize(ExecutionPolicy const& policy)
+  {
+    if( !policy.isParallel( size() ) )
+      return conditionalNormalize();
+    if( deltaLog_ )
+      logRows(-1);
+    parallelForEachRow( policy, [](IteratorValue_t& v) { v.second.normalize(); } );
+    if( deltaLog_ )
+      logRows(1);
+    if( reverseIndex_ )
+      reindexRows();
+    cachedTotal_.reset();
   }
 
   //------------------- Lookup ---------------------
 
-  template <typename K, typename V>
-  bool CounterMap<K, V>::contains(K const& key) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool CounterMap<K, V, RowMap, OuterMap>::contains(K const& key) const
   {
     return coreMap_.count(key) > 0;
   }
 
-  template <typename K, typename V>
-  bool CounterMap<K, V>::contains(K const& key, V const& val) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool CounterMap<K, V, RowMap, OuterMap>::contains(K const& key, V const& val) const
   {
-    typename CounterMap<K, V>::CoreMap_t::const_iterator i( coreMap_.find(key) );
+    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator i( coreMap_.find(key) );
     return i == coreMap_.end() ? false : i->second.contains(val);
   }
 
-  template <typename K, typename V>
-  typename CounterMap<K, V>::Size_t CounterMap<K, V>::size(void) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename KeyLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, bool>::type
+  CounterMap<K, V, RowMap, OuterMap>::contains(KeyLike const& key) const
+  {
+    return coreMap_.count(key) > 0;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename KeyArg, typename ValArg>
+  typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, bool>::type
+  CounterMap<K, V, RowMap, OuterMap>::contains(KeyArg const& key, ValArg const& val) const
+  {
+    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator i( coreMap_.find(key) );
+    return i == coreMap_.end() ? false : i->second.contains(val);
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Size_t CounterMap<K, V, RowMap, OuterMap>::size(void) const
   {
     return coreMap_.size();
   }
 
-  template <typename K, typename V>
-  typename CounterMap<K, V>::Size_t CounterMap<K, V>::size(K const& key) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Size_t CounterMap<K, V, RowMap, OuterMap>::size(K const& key) const
   {
-    typename CounterMap<K, V>::Counter_t const *counter = getCounter(key);
+    typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const *counter = getCounter(key);
     return counter == NULL ? 0 : counter->size();
   }
 
-  template <typename K, typename V>
-  bool CounterMap<K, V>::empty(void) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool CounterMap<K, V, RowMap, OuterMap>::empty(void) const
   {
     return coreMap_.empty();
   }
 
-  template <typename K, typename V>
-  typename CounterMap<K, V>::Count_t CounterMap<K, V>::getCount(K const& key, V const& val) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::reserve(Size_t n)
+  {
+    coreMap_.reserve(n);
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::shrinkToFit(void)
+  {
+    coreMap_.for_each_mut( [](IteratorValue_t& v) { v.second.shrinkToFit(); } );
+    coreMap_.shrink_to_fit();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  std::size_t CounterMap<K, V, RowMap, OuterMap>::memoryUsage(void) const
+  {
+    return rowsMemoryUsage() + (deltaLog_ ? deltaLog_->memoryUsage() : 0) +
+      (reverseIndex_ ? reverseIndex_->memoryUsage() : 0);
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  std::size_t CounterMap<K, V, RowMap, OuterMap>::rowsMemoryUsage(void) const
+  {
+    // The nodes of the underlying map already count sizeof(Counter_t).
+    std::size_t usage( sizeof(CounterMap) - sizeof(CoreMap_t) + coreMap_.memory_usage() );
+    coreMap_.for_each( [&usage](IteratorValue_t const& v) { usage += v.second.memoryUsage() - sizeof(Counter_t); } );
+    return usage;
+  }
+
+  //------------------- Eviction ---------------------
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::setEvictionPolicy(EvictionPolicy const& policy)
+  {
+    eviction_ = policy;
+    modificationsSinceCheck_ = 0;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Size_t CounterMap<K, V, RowMap, OuterMap>::enforceMemoryBudget(void)
+  {
+    if( eviction_.memoryBudget == 0 )
+      return 0;
+    std::size_t usage( rowsMemoryUsage() );
+    if( usage <= eviction_.memoryBudget )
+      return 0;
+    const double target( eviction_.memoryBudget * eviction_.retainedFraction );
+    Size_t removed(0);
+    std::vector<Count_t> counts;
+    while( usage > target && !empty() )
+      {
+	counts.clear();
+	coreMap_.for_each( [&counts](IteratorValue_t const& v)
+			   {
+			     v.second.forEach( [&counts](V const&, Count_t c) { counts.push_back(c); } );
+			   } );
+	// Keep about the fraction of the counts which fits the target, and
+	// always remove at least one.
+	const std::size_t kept( std::min<std::size_t>( std::size_t( counts.size() * (target / usage) ), counts.size() - 1 ) );
+	Count_t largestEvicted( 0 );
+	Size_t ties(0);
+	if( !counts.empty() )
+	  {
+	    std::nth_element( counts.begin(), counts.begin() + kept, counts.end(), std::greater<Count_t>() );
+	    largestEvicted = counts[kept];
+	    // Of the counts equal to the largest evicted one, keep as many as
+	    // there is room for next to the greater ones (as
+	    // Counter::pruneToTopK() does), in the order of the rows.
+	    ties = kept - std::count_if( counts.begin(), counts.begin() + kept,
+					 [largestEvicted](Count_t c) { return c > largestEvicted; } );
+	  }
+	const Size_t rows( size() );
+	const Size_t round( pruneRows( -std::numeric_limits<Count_t>::infinity(),
+				       [largestEvicted, &ties](Counter_t& row, Counter_t* pruned)
+				       {
+					 return row.eraseCounts( [largestEvicted, &ties](Count_t count)
+								 {
+								   if( count > largestEvicted ) return false;
+								   if( count == largestEvicted && ties > 0 ) { --ties;  return false; }
+								   return true;
+								 }, false, pruned );
+				       } ) );
+	shrinkToFit();
+	usage = rowsMemoryUsage();
+	removed += round;
+	if( round == 0 && size() == rows )
+	  break;
+      }
+    return removed;
+  }
+
+  //------------------- Delta Tracking ---------------------
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::setDeltaTracking(bool on)
+  {
+    if( !on )
+      deltaLog_.reset();
+    else if( !deltaLog_ )
+      deltaLog_.reset( new CounterMap() );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> CounterMap<K, V, RowMap, OuterMap>::extractDelta(void)
+  {
+    CounterMap<K, V, RowMap, OuterMap> delta;
+    if( deltaLog_ )
+      {
+	delta.swap( *deltaLog_ );
+	delta.coreMap_.for_each_mut( [](IteratorValue_t& v)
+				     { v.second.eraseCounts( [](Count_t count) { return count == 0; }, false, NULL ); } );
+	delta.coreMap_.erase_if( [](IteratorValue_t const& v) { return v.second.empty(); } );
+	delta.cachedTotal_.reset();
+      }
+    return delta;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::applyDelta(CounterMap const& delta)
+  {
+    if( this == &delta )
+      return applyDelta( CounterMap<K, V, RowMap, OuterMap>(delta) );
+    if( deltaLog_ )
+      *deltaLog_ += delta;
+    delta.coreMap_.for_each( [this](IteratorValue_t const& v)
+			     {
+			       Counter_t& counter( ensureCounter(v.first) );
+			       counter.applyDelta( v.second );
+			       if( reverseIndex_ )
+				 v.second.forEach( [this, &v, &counter](V const& val, Count_t)
+						   {
+						     if( counter.contains(val) )
+						       indexSetCount(v.first, val, counter.getCount(val));
+						     else
+						       unindex(v.first, val);
+						   } );
+			       if( counter.empty() )
+				 coreMap_.erase( v.first );
+			     } );
+    cachedTotal_.reset();
+    return *this;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::logRows(Count_t factor)
+  {
+    CounterMap* const log( deltaLog_.get() );
+    coreMap_.for_each( [log, factor](IteratorValue_t const& v)
+		       { log->ensureCounter(v.first).addCounter( v.second, factor ); } );
+  }
+
+  //------------------- Reverse Index ---------------------
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::setReverseIndex(bool on)
+  {
+    if( !on )
+      reverseIndex_.reset();
+    else if( !reverseIndex_ )
+      {
+	// The columns keep their totals, the marginals, through the updates.
+	Counter<K> column;
+	column.setCachePolicy( CACHE_POLICY_PERSISTENT );
+	std::unique_ptr<ReverseIndex_t> index( new ReverseIndex_t( typename ReverseIndex_t::CoreMap_t(),
+								   CopyCounterFactory<K>( std::move(column) ) ) );
+	transposeInto( *index );
+	reverseIndex_ = std::move( index );
+      }
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Count_t CounterMap<K, V, RowMap, OuterMap>::marginalCount(V const& val) const
   {
-    typename CounterMap<K, V>::Counter_t const *counter = getCounter(key);
+    if( reverseIndex_ )
+      {
+	Counter<K> const* column( reverseIndex_->getCounter(val) );
+	return column == NULL ? 0 : column->totalCount();
+      }
+    Count_t sum(0);
+    coreMap_.for_each( [&sum, &val](IteratorValue_t const& v) { sum += v.second.getCount(val); } );
+    return sum;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  std::vector<K> CounterMap<K, V, RowMap, OuterMap>::rowsContaining(V const& val) const
+  {
+    std::vector<K> keys;
+    if( reverseIndex_ )
+      {
+	Counter<K> const* column( reverseIndex_->getCounter(val) );
+	if( column != NULL )
+	  {
+	    keys.reserve( column->size() );
+	    column->forEach( [&keys](K const& key, Count_t) { keys.push_back(key); } );
+	  }
+      }
+    else
+      coreMap_.for_each( [&keys, &val](IteratorValue_t const& v)
+			 {
+			   if( v.second.contains(val) )
+			     keys.push_back(v.first);
+			 } );
+    return keys;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  Counter<K> const * CounterMap<K, V, RowMap, OuterMap>::getColumn(V const& val) const
+  {
+    return reverseIndex_ ? reverseIndex_->getCounter(val) : NULL;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<V, K> CounterMap<K, V, RowMap, OuterMap>::transpose(void) const
+  {
+    CounterMap<V, K> result;
+    transposeInto( result );
+    return result;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::transposeInto(ReverseIndex_t& index) const
+  {
+    coreMap_.for_each( [&index](IteratorValue_t const& v)
+		       {
+			 v.second.forEach( [&index, &v](V const& val, Count_t c)
+					   { index.ensureCounter(val).incrementCount(v.first, c); } );
+		       } );
+    index.cachedTotal_.reset();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::unindex(K const& key, V const& val)
+  {
+    typename ReverseIndex_t::CoreMap_t::iterator i( reverseIndex_->coreMap_.find(val) );
+    if( i == reverseIndex_->coreMap_.end() )
+      return;
+    i->second.remove(key);
+    if( i->second.empty() )
+      reverseIndex_->coreMap_.erase(val);
+    reverseIndex_->cachedTotal_.reset();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::reindexRows(void)
+  {
+    coreMap_.for_each( [this](IteratorValue_t const& v)
+		       {
+			 v.second.forEach( [this, &v](V const& val, Count_t c) { indexSetCount(v.first, val, c); } );
+		       } );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Count_t CounterMap<K, V, RowMap, OuterMap>::getCount(K const& key, V const& val) const
+  {
+    typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const *counter = getCounter(key);
     return counter == NULL ? 0 : counter->getCount(val);
   }
 
-  template <typename K, typename V>
-  typename CounterMap<K, V>::Count_t CounterMap<K, V>::totalCount(void) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename KeyArg, typename ValArg>
+  typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, typename CounterMap<K, V, RowMap, OuterMap>::Count_t>::type
+  CounterMap<K, V, RowMap, OuterMap>::getCount(KeyArg const& key, ValArg const& val) const
   {
-    if( !cachedTotal_->isSynched() ) {
+    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator i( coreMap_.find(key) );
+    return i == coreMap_.end() ? 0 : i->second.getCount(val);
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  void CounterMap<K, V, RowMap, OuterMap>::getMany(std::pair<K, V> const* pairs, std::size_t n, Count_t* out) const
+  {
+    V const* vals[Counter_t::BATCH_BLOCK];
+    for( std::size_t i = 0; i < n; )
+      {
+	K const& key( pairs[i].first );
+	Counter_t const* counter( getCounter(key) );
+	std::size_t m(0);
+	for( ; i < n && pairs[i].first == key; ++i )
+	  {
+	    if( counter == NULL )
+	      {
+		out[i] = 0;
+		continue;
+	      }
+	    vals[m] = &pairs[i].second;
+	    if( ++m == Counter_t::BATCH_BLOCK )
+	      {
+		counter->getBlock( vals, m, out + i + 1 - m );
+		m = 0;
+	      }
+	  }
+	if( counter != NULL )
+	  counter->getBlock( vals, m, out + i - m );
+      }
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Count_t CounterMap<K, V, RowMap, OuterMap>::totalCount(void) const
+  {
+    if( !cachedTotal_.isSynched() ) {
       Count_t total(0);
-      for( typename CounterMap<K, V>::CoreMap_t::const_iterator i( coreMap_.begin() );
-	   i != coreMap_.end(); ++i )
-	{
-	  total += i->second.totalCount();
-	}
-      cachedTotal_->set(total);
+      coreMap_.for_each( [&total](IteratorValue_t const& v) { total += v.second.totalCount(); } );
+      cachedTotal_.set(total);
     }
-    return cachedTotal_->get();
+    return cachedTotal_.get();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Count_t CounterMap<K, V, RowMap, OuterMap>::totalCount(ExecutionPolicy const& policy) const
+  {
+    if( !policy.isParallel( size() ) || cachedTotal_.isSynched() )
+      return totalCount();
+    // The totals of the rows (SEQUENTIAL_ORDER) or of the blocks (BLOCKED).
+    std::vector<Count_t> totals( policy.summation == ExecutionPolicy::BLOCKED
+				 ? (size() + policy.grain - 1) / policy.grain : size() );
+    const bool blocked( policy.summation == ExecutionPolicy::BLOCKED );
+    parallelForEachBlock( policy, [&totals, &policy, blocked]
+			  (Size_t block, IteratorValue_t const* const* first, IteratorValue_t const* const* last) {
+	Count_t* out( &totals[ blocked ? block : block * policy.grain ] );
+	Count_t sum(0);
+	for( ; first != last; ++first )
+	  if( blocked ) sum += (*first)->second.totalCount();
+	  else *out++ = (*first)->second.totalCount();
+	if( blocked ) *out = sum;
+      } );
+    Count_t total(0);
+    for( typename std::vector<Count_t>::const_iterator i(totals.begin()); i != totals.end(); ++i )
+      total += *i;
+    cachedTotal_.set(total);
+    return total;
   }
   
-  template <typename K, typename V>
-  typename CounterMap<K, V>::Count_t CounterMap<K, V>::totalCount(K const& key) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::Count_t CounterMap<K, V, RowMap, OuterMap>::totalCount(K const& key) const
   {
-    typename CounterMap<K, V>::Counter_t const *counter = getCounter(key);
+    typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const *counter = getCounter(key);
     return counter == NULL ? 0 : counter->totalCount();
   }
 
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  V CounterMap<K, V, RowMap, OuterMap>::maxValue(K const& key) const
+  {
+    typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const *counter = getCounter(key);
+    return counter == NULL ? V() : counter->maxValue();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  std::vector<typename CounterMap<K, V, RowMap, OuterMap>::Counter_t::ValueCount_t>
+  CounterMap<K, V, RowMap, OuterMap>::topK(K const& key, Size_t k) const
+  {
+    typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const *counter = getCounter(key);
+    return counter == NULL ? std::vector<typename Counter_t::ValueCount_t>() : counter->topK(k);
+  }
+
   //--------------------- Counters ---------------------------------
   
-  template <typename K, typename V>
-  Counter<V> const * const CounterMap<K, V>::getCounter(K const& key) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  Counter<V, RowMap> const * const CounterMap<K, V, RowMap, OuterMap>::getCounter(K const& key) const
   {
-    typename CounterMap<K, V>::CoreMap_t::const_iterator i( coreMap_.find(key) );
+    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator i( coreMap_.find(key) );
     return i == coreMap_.end() ? NULL : &i->second;
   }
   
-  template <typename K, typename V>
-  Counter<V> const * const CounterMap<K, V>::getCounter(K && key) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  Counter<V, RowMap> const * const CounterMap<K, V, RowMap, OuterMap>::getCounter(K && key) const
   {
-    typename CounterMap<K, V>::CoreMap_t::const_iterator i( coreMap_.find(std::move(key)) );
+    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator i( coreMap_.find(std::move(key)) );
     return i == coreMap_.end() ? NULL : &i->second;
   }
 
-  template <typename K, typename V>
-  Counter<V>& CounterMap<K, V>::ensureCounter(K const& key)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename KeyLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, Counter<V, RowMap> const *>::type
+  CounterMap<K, V, RowMap, OuterMap>::getCounter(KeyLike const& key) const
   {
-    typename CounterMap<K, V>::CoreMap_t::iterator i( coreMap_.find(key) );
-    if( i != coreMap_.end() )
-      return i->second;
-    return 
-      coreMap_.insert(typename CounterMap<K, V>::CoreMap_t::value_type(key, 
-								       counterFactory_->createCounter())).first->second;
+    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator i( coreMap_.find(key) );
+    return i == coreMap_.end() ? NULL : &i->second;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  Counter<V, RowMap>& CounterMap<K, V, RowMap, OuterMap>::ensureCounter(K const& key)
+  {
+    return coreMap_.try_emplace( key, NewCounter(*counterFactory_) ).first->second;
   }
   
-  template <typename K, typename V>
-  Counter<V>& CounterMap<K, V>::ensureCounter(K && key)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  Counter<V, RowMap>& CounterMap<K, V, RowMap, OuterMap>::ensureCounter(K && key)
   {
-    typename CounterMap<K, V>::CoreMap_t::iterator i( coreMap_.find(key) );
-    if( i != coreMap_.end() )
-      return i->second;
-    return
-      coreMap_.insert(typename CounterMap<K, V>::CoreMap_t::value_type(std::move(key),
-								       counterFactory_->createCounter())).first->second;
+    return coreMap_.try_emplace( std::move(key), NewCounter(*counterFactory_) ).first->second;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename KeyLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<K, KeyLike>::value, Counter<V, RowMap>&>::type
+  CounterMap<K, V, RowMap, OuterMap>::ensureCounter(KeyLike const& key)
+  {
+    return coreMap_.try_emplace( key, NewCounter(*counterFactory_) ).first->second;
   }
   
   //--------------------- Traversal --------------------------------
 
-  template <typename K, typename V>
-  typename CounterMap<K, V>::ConstIterator CounterMap<K, V>::begin(void) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::ConstIterator CounterMap<K, V, RowMap, OuterMap>::begin(void) const
   {
     return coreMap_.begin();
   }
 
-  template <typename K, typename V>
-  typename CounterMap<K, V>::ConstIterator CounterMap<K, V>::end(void) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  typename CounterMap<K, V, RowMap, OuterMap>::ConstIterator CounterMap<K, V, RowMap, OuterMap>::end(void) const
   {
     return coreMap_.end();
   }
 
   //--------------------- Equality ---------------------------------
 
-  template <typename K, typename V>
-  bool CounterMap<K, V>::operator==(CounterMap const& other) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool CounterMap<K, V, RowMap, OuterMap>::operator==(CounterMap const& other) const
   {
     return coreMap_ == other.coreMap_;
   }
 
-  template <typename K, typename V>
-  bool CounterMap<K, V>::operator!=(CounterMap const& other) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool CounterMap<K, V, RowMap, OuterMap>::operator!=(CounterMap const& other) const
   {
     return !(operator==(other));
   }
 
-  template <typename K, typename V>
-  bool CounterMap<K, V>::equals(const CounterMap& other, Count_t precision) const
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool CounterMap<K, V, RowMap, OuterMap>::equals(const CounterMap& other, Count_t precision) const
   {
     if( this == &other )           return true;
     if( size() != other.size() )   return false;
-    for( typename CounterMap<K, V>::CoreMap_t::const_iterator i(coreMap_.begin());
-	 i != coreMap_.end(); ++i )
-      {
-	typename CounterMap<K, V>::CoreMap_t::const_iterator 
-	  oi( other.coreMap_.find( i->first ) );
-	
-	if( oi == other.coreMap_.end() || !i->second.equals( oi->second, precision ) )
-	  return false;
-      }
-    return true;
+    return coreMap_.all_of( [&other, precision](IteratorValue_t const& v)
+			    {
+			      typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator
+				oi( other.coreMap_.find( v.first ) );
+			      return oi != other.coreMap_.end() &&
+				v.second.equals( oi->second, precision );
+			    } );
   }
 
-  template <typename K, typename V>
-  CounterMap<K, V>& CounterMap<K, V>::operator+=(CounterMap const& rhs)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool CounterMap<K, V, RowMap, OuterMap>::equals(const CounterMap& other, ExecutionPolicy const& policy,
+				Count_t precision) const
   {
-    for( typename CounterMap<K, V>::ConstIterator i( rhs.begin() );
-	 i != rhs.end(); ++i )
-      {
-	ensureCounter(i->first) += i->second;
-      }
+    if( !policy.isParallel( size() ) ) return equals( other, precision );
+    if( this == &other )                return true;
+    if( size() != other.size() )        return false;
+    std::atomic<bool> equal(true);
+    parallelForEachBlock( policy, [&other, &equal, precision]
+			  (Size_t, IteratorValue_t const* const* first, IteratorValue_t const* const* last) {
+	for( ; first != last && equal.load(std::memory_order_relaxed); ++first )
+	  {
+	    typename CounterMap<K, V, RowMap, OuterMap>::CoreMap_t::const_iterator oi( other.coreMap_.find( (*first)->first ) );
+	    if( oi == other.coreMap_.end() || !(*first)->second.equals( oi->second, precision ) )
+	      equal.store( false, std::memory_order_relaxed );
+	  }
+      } );
+    return equal.load();
+  }
 
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::operator+=(CounterMap const& rhs)
+  {
+    if( deltaLog_ )
+      *deltaLog_ += rhs;
+    if( reverseIndex_ )
+      rhs.coreMap_.for_each( [this](IteratorValue_t const& v)
+			     { v.second.forEach( [this, &v](V const& val, Count_t c) { indexCount(v.first, val, c); } ); } );
+    rhs.coreMap_.for_each( [this](IteratorValue_t const& v) { ensureCounter(v.first) += v.second; } );
+    cachedTotal_.reset();
     return *this;
   }
 
-  template <typename K, typename V>
-  CounterMap<K, V>& CounterMap<K, V>::operator-=(CounterMap const& rhs)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::operator+=(CounterMap&& rhs)
   {
-    for( typename CounterMap<K, V>::ConstIterator i( rhs.begin() );
-	 i != rhs.end(); ++i )
+    if( this == &rhs )
+      return *this += static_cast<CounterMap const&>(rhs);
+    if( counterFactory_ != rhs.counterFactory_ && rhs.counterFactory_->ownsCounterMemory() )
+      *this += static_cast<CounterMap const&>(rhs);
+    else
       {
-	ensureCounter(i->first) -= i->second;
+	if( deltaLog_ )
+	  *deltaLog_ += static_cast<CounterMap const&>(rhs);
+	if( reverseIndex_ )
+	  rhs.coreMap_.for_each( [this](IteratorValue_t const& v)
+				 { v.second.forEach( [this, &v](V const& val, Count_t c) { indexCount(v.first, val, c); } ); } );
+	// Logged while rhs still has its rows: clear() would only see the
+	// moved-from Counters.
+	if( rhs.deltaLog_ )
+	  rhs.logRows(-1);
+	rhs.coreMap_.for_each_mut( [this](IteratorValue_t& v) {
+	  std::pair<typename CoreMap_t::iterator, bool> r( coreMap_.try_emplace( v.first, MovedCounter(v.second) ) );
+	    if( !r.second )
+	      r.first->second += v.second;
+	  } );
+	rhs.coreMap_.clear();
+	if( rhs.reverseIndex_ )
+	  rhs.reverseIndex_->clear();
+	rhs.cachedTotal_.reset();
+	cachedTotal_.reset();
+	return *this;
       }
+    rhs.clear();
+    cachedTotal_.reset();
+    return *this;
+  }
 
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::operator-=(CounterMap const& rhs)
+  {
+    if( deltaLog_ )
+      *deltaLog_ -= rhs;
+    if( reverseIndex_ )
+      rhs.coreMap_.for_each( [this](IteratorValue_t const& v)
+			     { v.second.forEach( [this, &v](V const& val, Count_t c) { indexCount(v.first, val, -c); } ); } );
+    rhs.coreMap_.for_each( [this](IteratorValue_t const& v) { ensureCounter(v.first) -= v.second; } );
+    cachedTotal_.reset();
     return *this;
   }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator+(CounterMap<K, V> const& lhs, CounterMap<K, V> const& rhs)
-  { CounterMap<K, V> tmp = lhs;  tmp += rhs; return tmp; }
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator+(CounterMap<K, V, RowMap, OuterMap> const& lhs, CounterMap<K, V, RowMap, OuterMap> const& rhs)
+  { CounterMap<K, V, RowMap, OuterMap> tmp = lhs;  tmp += rhs; return tmp; }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator+(CounterMap<K, V> && tmp, CounterMap<K, V> const& rhs)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator+(CounterMap<K, V, RowMap, OuterMap> && tmp, CounterMap<K, V, RowMap, OuterMap> const& rhs)
   { tmp += rhs; return std::move(tmp); }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator+(CounterMap<K, V> const& lhs, CounterMap<K, V> && tmp)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator+(CounterMap<K, V, RowMap, OuterMap> const& lhs, CounterMap<K, V, RowMap, OuterMap> && tmp)
   { tmp += lhs; return std::move(tmp); }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator+(CounterMap<K, V> && tmp, CounterMap<K, V> && rhs)
-  { tmp += rhs; return std::move(tmp); }
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator+(CounterMap<K, V, RowMap, OuterMap> && tmp, CounterMap<K, V, RowMap, OuterMap> && rhs)
+  { tmp += std::move(rhs); return std::move(tmp); }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator-(CounterMap<K, V> const& lhs, CounterMap<K, V> const& rhs)
-  { CounterMap<K, V> tmp = lhs; tmp -= rhs; return tmp; }
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator-(CounterMap<K, V, RowMap, OuterMap> const& lhs, CounterMap<K, V, RowMap, OuterMap> const& rhs)
+  { CounterMap<K, V, RowMap, OuterMap> tmp = lhs; tmp -= rhs; return tmp; }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator-(CounterMap<K, V> && tmp, CounterMap<K, V> const& rhs)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator-(CounterMap<K, V, RowMap, OuterMap> && tmp, CounterMap<K, V, RowMap, OuterMap> const& rhs)
   { tmp -= rhs; return std::move(tmp); }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator-(CounterMap<K, V> && tmp, CounterMap<K, V> && rhs)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator-(CounterMap<K, V, RowMap, OuterMap> && tmp, CounterMap<K, V, RowMap, OuterMap> && rhs)
   { tmp -= rhs; return std::move(tmp); }
 
-  template <typename K, typename V>
-  CounterMap<K, V>& CounterMap<K, V>::operator*=(typename CounterMap<K, V>::Count_t num)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::operator*=(typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
   {
-    for( typename CounterMap<K, V>::CoreMap_t::iterator i( coreMap_.begin() );
-	 i != coreMap_.end(); ++i )
-      {
-	i->second *= num;
-      }
-
+    if( deltaLog_ && num != 1 )
+      logRows(num - 1);
+    if( reverseIndex_ )
+      *reverseIndex_ *= num;
+    coreMap_.for_each_mut( [num](IteratorValue_t& v) { v.second *= num; } );
+    cachedTotal_.reset();
     return *this;
   }
 
-  template <typename K, typename V>
-  CounterMap<K, V>& CounterMap<K, V>::operator/=(typename CounterMap<K, V>::Count_t num)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::operator/=(typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
   { return operator*=( 1.0 / num ); }
 
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::multiply(ExecutionPolicy const& policy,
+					      typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
+  {
+    if( !policy.isParallel( size() ) )
+      return operator*=( num );
+    if( deltaLog_ && num != 1 )
+      logRows(num - 1);
+    if( reverseIndex_ )
+      reverseIndex_->multiply( policy, num );
+    parallelForEachRow( policy, [num](IteratorValue_t& v) { v.second *= num; } );
+    cachedTotal_.reset();
+    return *this;
+  }
 
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap>& CounterMap<K, V, RowMap, OuterMap>::divide(ExecutionPolicy const& policy,
+					    typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
+  { return multiply( policy, 1.0 / num ); }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator*(CounterMap<K, V> const& cm, typename CounterMap<K, V>::Count_t num)
-  { CounterMap<K, V> tmp = cm;  tmp *= num; return tmp; }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator*(CounterMap<K, V> && cm, typename CounterMap<K, V>::Count_t num)
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator*(CounterMap<K, V, RowMap, OuterMap> const& cm, typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
+  { CounterMap<K, V, RowMap, OuterMap> tmp = cm;  tmp *= num; return tmp; }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator*(CounterMap<K, V, RowMap, OuterMap> && cm, typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
   { cm *= num; return std::move(cm); }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator*(typename CounterMap<K, V>::Count_t num, CounterMap<K, V> const& cm)
-  { CounterMap<K, V> tmp = cm;  tmp *= num; return tmp; }
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator*(typename CounterMap<K, V, RowMap, OuterMap>::Count_t num, CounterMap<K, V, RowMap, OuterMap> const& cm)
+  { CounterMap<K, V, RowMap, OuterMap> tmp = cm;  tmp *= num; return tmp; }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator*(typename CounterMap<K, V>::Count_t num, CounterMap<K, V> && cm)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator*(typename CounterMap<K, V, RowMap, OuterMap>::Count_t num, CounterMap<K, V, RowMap, OuterMap> && cm)
   { cm *= num; return std::move(cm); }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator/(CounterMap<K, V> const& cm, typename CounterMap<K, V>::Count_t num)
-  { CounterMap<K, V> tmp = cm;  tmp /= num; return tmp; }
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator/(CounterMap<K, V, RowMap, OuterMap> const& cm, typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
+  { CounterMap<K, V, RowMap, OuterMap> tmp = cm;  tmp /= num; return tmp; }
 
-  template <typename K, typename V>
-  CounterMap<K, V> operator/(CounterMap<K, V> && cm, typename CounterMap<K, V>::Count_t num)
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CounterMap<K, V, RowMap, OuterMap> operator/(CounterMap<K, V, RowMap, OuterMap> && cm, typename CounterMap<K, V, RowMap, OuterMap>::Count_t num)
   { cm /= num; return std::move(cm); }
 
-  //----------------- Output Operator ------------------------
+  //----------------- Parallel Execution ---------------------
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename RowTask>
+  void CounterMap<K, V, RowMap, OuterMap>::parallelForEachRow(ExecutionPolicy const& policy, RowTask task)
+  {
+    std::vector<IteratorValue_t*> rows;
+    rows.reserve( size() );
+    coreMap_.for_each_mut( [&rows](IteratorValue_t& v) { rows.push_back( &v ); } );
+    Size_t const grain( policy.grain ), n( rows.size() );
+    details::parallelFor( (n + grain - 1) / grain, policy.threads, [&rows, &task, grain, n](Size_t block) {
+	for( Size_t i = block * grain, end = std::min( n, i + grain ); i < end; ++i )
+	  task( *rows[i] );
+      } );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  template <typename BlockTask>
+  void CounterMap<K, V, RowMap, OuterMap>::parallelForEachBlock(ExecutionPolicy const& policy, BlockTask task) const
+  {
+    std::vector<IteratorValue_t const*> rows;
+    rows.reserve( size() );
+    coreMap_.for_each( [&rows](IteratorValue_t const& v) { rows.push_back( &v ); } );
+    Size_t const grain( policy.grain ), n( rows.size() );
+    IteratorValue_t const* const* data( rows.data() );
+    details::parallelFor( (n + grain - 1) / grain, policy.threads, [data, &task, grain, n](Size_t block) {
+	task( block, data + block * grain, data + std::min( n, block * grain + grain ) );
+      } );
+  }
+
+  //----------------- Arena-Backed CounterMaps ---------------
 
   template <typename K, typename V>
-  std::ostream& operator<<(std::ostream& os, CounterMap<K, V> const& counterMap)
+  CounterMap<K, V> makeArenaCounterMap( std::shared_ptr<MapTypeErasure::Arena> arena )
+  {
+    typedef MapTypeErasure::ArenaAllocator< std::pair<K const, Counter<V> > > Allocator_t;
+    typedef boost::unordered_map<K, Counter<V>, boost::hash<K>, std::equal_to<K>, Allocator_t> Rows_t;
+    Rows_t rows( 0, typename Rows_t::hasher(), typename Rows_t::key_equal(), Allocator_t( arena.get() ) );
+    std::shared_ptr<CounterFactory<V> const> factory( new ArenaCounterFactory<V>( std::move(arena) ) );
+    return CounterMap<K, V>( typename CounterMap<K, V>::CoreMap_t( std::move(rows) ), std::move(factory) );
+  }
+
+  //----------------- Output Operator ------------------------
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  std::ostream& operator<<(std::ostream& os, CounterMap<K, V, RowMap, OuterMap> const& counterMap)
   {
     os << "[\n";
     if( counterMap.size() > 0 )
       {
-	typename CounterMap<K, V>::ConstIterator i(counterMap.begin());
+	typename CounterMap<K, V, RowMap, OuterMap>::ConstIterator i(counterMap.begin());
 	os << " " << i->first << MAPPING_DELIMITER << i->second << "\n";
 	for( ; ++i != counterMap.end(); )
 	  os << " " <<  i->first << MAPPING_DELIMITER << i->second << "\n";
@@ -0,0 +1,94 @@
+#ifndef __COUNTER_MAP_REDUCTION_IMPL_HPP__
+#define __COUNTER_MAP_REDUCTION_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/CounterMapReduction.hpp"
+#include "Counters/details/_Parallel.hpp"
+#include "Counters/details/_Sharding.hpp"
+
+namespace Counters
+{
+  template <typename K, typename V, typename Hash>
+  CounterMapReduction<K, V, Hash>::CounterMapReduction( Size_t workers, CounterMap_t const& prototype )
+    : prototype_( prototype ), locals_(), hash_()
+  {
+    prototype_.clear();
+    locals_.reserve( workers );
+    for( Size_t w = 0; w < workers; ++w )
+      locals_.push_back( emptyMap() );
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename CounterMapReduction<K, V, Hash>::CounterMap_t CounterMapReduction<K, V, Hash>::merge( Size_t threads )
+  {
+    typedef typename CounterMap_t::IteratorValue_t IteratorValue_t;
+    typedef typename CounterMap_t::MovedCounter MovedCounter;
+
+    Size_t const workers( locals_.size() );
+    if( threads == 0 )
+      threads = workers;
+    if( workers <= 1 || threads <= 1 )
+      {
+	CounterMap_t result( emptyMap() );
+	for( Size_t w = 0; w < workers; ++w )
+	  result += std::move( locals_[w] );
+	return result;
+      }
+
+    // parts[w * threads + p] is the key range p of worker w.
+    Size_t const ranges( threads );
+    std::vector<CounterMap_t> parts;
+    parts.reserve( workers * ranges );
+    for( Size_t i = 0; i < workers * ranges; ++i )
+      parts.push_back( emptyMap() );
+
+    details::parallelFor( workers, threads, [this, &parts, ranges](Size_t w) {
+	CounterMap_t* part( &parts[w * ranges] );
+	Hash const& hash( hash_ );
+	locals_[w].coreMap_.for_each_mut( [part, ranges, &hash](IteratorValue_t& v) {
+	    part[ details::shardIndex( hash(v.first), ranges ) ].coreMap_
+	      .try_emplace( v.first, MovedCounter(v.second) );
+	  } );
+	locals_[w].clear();
+      } );
+
+    // A round merges part w + step into part w for every w divisible by
+    // 2 * step, in all the key ranges at once.
+    for( Size_t step = 1; step < workers; step *= 2 )
+      {
+	Size_t const pairs( (workers - step + 2 * step - 1) / (2 * step) );
+	details::parallelFor( pairs * ranges, threads, [&parts, ranges, step](Size_t task) {
+	    Size_t const w( (task / ranges) * 2 * step ), p( task % ranges );
+	    parts[w * ranges + p] += std::move( parts[(w + step) * ranges + p] );
+	  } );
+      }
+
+    Size_t size(0);
+    for( Size_t p = 0; p < ranges; ++p )
+      size += parts[p].size();
+    CounterMap_t result( emptyMap() );
+    result.reserve( size );
+    for( Size_t p = 0; p < ranges; ++p )
+      result += std::move( parts[p] );
+    return result;
+  }
+
+  template <typename K, typename V, typename Hash>
+  typename CounterMapReduction<K, V, Hash>::CounterMap_t CounterMapReduction<K, V, Hash>::emptyMap(void) const
+  {
+    return prototype_;
+  }
+
+  template <typename K, typename V, typename Work>
+  CounterMap<K, V> parallelCount( std::size_t workers, Work work, CounterMap<K, V> const& prototype )
+  {
+    CounterMapReduction<K, V> reduction( workers, prototype );
+    details::parallelFor( workers, workers, [&reduction, &work](std::size_t w) {
+	work( w, reduction.local(w) );
+      } );
+    return reduction.merge();
+  }
+
+};
+
+#endif // __COUNTER_MAP_REDUCTION_IMPL_HPP__
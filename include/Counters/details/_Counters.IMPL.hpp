@@ -0,0 +1,359 @@
+#ifndef __COUNTERS_IMPL_HPP__
+#define __COUNTERS_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/Counters.hpp"
+#include "Counters/Kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace Counters
+{
+  namespace details
+  {
+    typedef CountersCount_t Count_t;
+
+    // The aggregates of the counts of one counter used by the distances.
+    struct VectorStats
+    {
+      VectorStats() : absSum(0), squares(0), nonZero(0), positive(0) {}
+      template <typename V>
+      void operator()( V const&, Count_t count )
+      {
+	absSum += std::fabs(count);
+	squares += count * count;
+	nonZero += count != 0;
+	positive += count > 0;
+      }
+      Count_t absSum, squares;
+      std::size_t nonZero, positive;
+    };
+
+    template <typename V, typename CoreMap>
+    VectorStats vectorStats( Counter<V, CoreMap> const& c )
+    {
+      VectorStats stats;
+      c.forEach( [&stats](V const& v, Count_t count) { stats( v, count ); } );
+      return stats;
+    }
+
+    // Joint traversals f(a, b) of the counts of two counters, passed to the
+    // formulas shared by Counter and DenseCounter.
+    template <typename V, typename MapA, typename MapB>
+    struct CounterJoint
+    {
+      Counter<V, MapA> const& a;
+      Counter<V, MapB> const& b;
+      template <typename F>
+      void operator()( F f ) const { a.forEachJoint( b, f ); }
+    };
+
+    struct DenseJoint
+    {
+      Count_t const* x;
+      Count_t const* y;
+      std::size_t n;
+      template <typename F>
+      void operator()( F f ) const
+      {
+	for( std::size_t i = 0; i < n; ++i )
+	  f( x[i], y[i] );
+      }
+    };
+
+    // Sum over the joint counts (p, q) of sums P and Q (with positiveP
+    // positive counts in p) of p/P * log((p/P) / (q/Q)).
+    template <typename Joint>
+    Count_t klDivergence( Count_t P, Count_t Q, std::size_t positiveP, Joint const& joint )
+    {
+      if( P <= 0 || Q <= 0 )
+	return 0;
+      Count_t sum(0);
+      std::size_t matched(0);
+      joint( [&](Count_t p, Count_t q) {
+	  if( p > 0 && q > 0 )
+	    {
+	      sum += p / P * std::log( (p / P) / (q / Q) );
+	      ++matched;
+	    }
+	} );
+      if( matched < positiveP )
+	return std::numeric_limits<Count_t>::infinity();
+      return std::max( Count_t(0), sum );
+    }
+
+    // The values of only one distribution add p * log(2) each, so only the
+    // values of both are needed.
+    template <typename Joint>
+    Count_t jsDivergence( Count_t P, Count_t Q, Joint const& joint )
+    {
+      if( P <= 0 || Q <= 0 )
+	return 0;
+      Count_t sum(0), sharedP(0), sharedQ(0);
+      joint( [&](Count_t p, Count_t q) {
+	  if( p > 0 && q > 0 )
+	    {
+	      p /= P;
+	      q /= Q;
+	      const Count_t m( p + q );
+	      sum += p * std::log( 2 * p / m ) + q * std::log( 2 * q / m );
+	      sharedP += p;
+	      sharedQ += q;
+	    }
+	} );
+      const Count_t apart( std::max( Count_t(0), 1 - sharedP ) + std::max( Count_t(0), 1 - sharedQ ) );
+      return std::max( Count_t(0), ( sum + std::log(Count_t(2)) * apart ) / 2 );
+    }
+
+    inline Count_t entropyTerm( Count_t count, Count_t total )
+    {
+      if( count <= 0 )
+	return 0;
+      const Count_t p( count / total );
+      return -p * std::log(p);
+    }
+
+    // The differences of the counts of the smaller counter are visited by
+    // the joint traversal; the counts which only the larger counter has add
+    // what its totals have beyond the visited counts (nothing if all of them
+    // were visited, keeping the distance of equal counters exactly 0).
+    template <typename V, typename MapA, typename MapB>
+    void jointDistances( Counter<V, MapA> const& a, Counter<V, MapB> const& b, Count_t& l1, Count_t& l2 )
+    {
+      const bool bLarger( a.size() <= b.size() );
+      const VectorStats larger( bLarger ? vectorStats(b) : vectorStats(a) );
+      Count_t abs(0), squares(0), seenAbs(0), seenSquares(0);
+      std::size_t seen(0);
+      a.forEachJoint( b, [&](Count_t x, Count_t y) {
+	  const Count_t d( x - y ), l( bLarger ? y : x );
+	  abs += std::fabs(d);
+	  squares += d * d;
+	  seenAbs += std::fabs(l);
+	  seenSquares += l * l;
+	  seen += l != 0;
+	} );
+      if( seen < larger.nonZero )
+	{
+	  abs += std::max( Count_t(0), larger.absSum - seenAbs );
+	  squares += std::max( Count_t(0), larger.squares - seenSquares );
+	}
+      l1 = abs;
+      l2 = std::sqrt(squares);
+    }
+
+    template <typename V>
+    bool sameVocabulary( DenseCounter<V> const& a, DenseCounter<V> const& b )
+    { return a.vocabulary() == b.vocabulary(); }
+
+    // The counts of the id range which only one of the arrays covers.
+    inline Count_t const* tail( std::vector<Count_t> const& x, std::size_t n ) { return x.data() + n; }
+
+    // The row of the key, or the empty counter.
+    template <typename K, typename V, typename RowMap, typename OuterMap>
+    typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const&
+    rowOrEmpty( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& key,
+		typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const& empty )
+    {
+      typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const* row( cm.getCounter(key) );
+      return row == NULL ? empty : *row;
+    }
+  };
+
+  //----------------------------- Counter --------------------------------------
+
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t dot( Counter<V, MapA> const& a, Counter<V, MapB> const& b )
+  {
+    CountersCount_t sum(0);
+    a.forEachJoint( b, [&sum](CountersCount_t x, CountersCount_t y) { sum += x * y; } );
+    return sum;
+  }
+
+  template <typename V, typename CoreMap>
+  CountersCount_t l2Norm( Counter<V, CoreMap> const& a )
+  {
+    return std::sqrt( details::vectorStats(a).squares );
+  }
+
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t cosine( Counter<V, MapA> const& a, Counter<V, MapB> const& b )
+  {
+    const CountersCount_t norms( l2Norm(a) * l2Norm(b) );
+    return norms == 0 ? 0 : dot(a, b) / norms;
+  }
+
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t l1Distance( Counter<V, MapA> const& a, Counter<V, MapB> const& b )
+  {
+    CountersCount_t l1, l2;
+    details::jointDistances( a, b, l1, l2 );
+    return l1;
+  }
+
+  template <typename V, typename MapA, typename MapB>
+  CountersCount_t l2Distance( Counter<V, MapA> const& a, Counter<V, MapB> const& b )
+  {
+    CountersCount_t l1, l2;
+    details::jointDistances( a, b, l1, l2 );
+    return l2;
+  }
+
+  template <typename V, typename CoreMap>
+  CountersCount_t entropy( Counter<V, CoreMap> const& p )
+  {
+    const CountersCount_t total( p.totalCount() );
+    CountersCount_t sum(0);
+    if( total > 0 )
+      p.forEach( [&sum, total](V const&, CountersCount_t count) { sum += details::entropyTerm( count, total ); } );
+    return sum;
+  }
+
+  template <typename V, typename MapP, typename MapQ>
+  CountersCount_t klDivergence( Counter<V, MapP> const& p, Counter<V, MapQ> const& q )
+  {
+    const details::CounterJoint<V, MapP, MapQ> joint = { p, q };
+    return details::klDivergence( p.totalCount(), q.totalCount(), details::vectorStats(p).positive, joint );
+  }
+
+  template <typename V, typename MapP, typename MapQ>
+  CountersCount_t jsDivergence( Counter<V, MapP> const& p, Counter<V, MapQ> const& q )
+  {
+    const details::CounterJoint<V, MapP, MapQ> joint = { p, q };
+    return details::jsDivergence( p.totalCount(), q.totalCount(), joint );
+  }
+
+  //--------------------------- DenseCounter -----------------------------------
+
+  template <typename V>
+  CountersCount_t dot( DenseCounter<V> const& a, DenseCounter<V> const& b )
+  {
+    if( !details::sameVocabulary(a, b) )
+      return dot( a.toCounter(), b.toCounter() );
+    return kernels::dot( a.counts().data(), b.counts().data(),
+			 std::min( a.counts().size(), b.counts().size() ) );
+  }
+
+  template <typename V>
+  CountersCount_t l2Norm( DenseCounter<V> const& a )
+  {
+    return std::sqrt( kernels::dot( a.counts().data(), a.counts().data(), a.counts().size() ) );
+  }
+
+  template <typename V>
+  CountersCount_t cosine( DenseCounter<V> const& a, DenseCounter<V> const& b )
+  {
+    const CountersCount_t norms( l2Norm(a) * l2Norm(b) );
+    return norms == 0 ? 0 : dot(a, b) / norms;
+  }
+
+  template <typename V>
+  CountersCount_t l1Distance( DenseCounter<V> const& a, DenseCounter<V> const& b )
+  {
+    if( !details::sameVocabulary(a, b) )
+      return l1Distance( a.toCounter(), b.toCounter() );
+    std::vector<CountersCount_t> const& x( a.counts() );
+    std::vector<CountersCount_t> const& y( b.counts() );
+    const std::size_t n( std::min( x.size(), y.size() ) );
+    std::vector<CountersCount_t> const& longer( x.size() > n ? x : y );
+    return kernels::l1Distance( x.data(), y.data(), n ) +
+      kernels::absSum( details::tail(longer, n), longer.size() - n );
+  }
+
+  template <typename V>
+  CountersCount_t l2Distance( DenseCounter<V> const& a, DenseCounter<V> const& b )
+  {
+    if( !details::sameVocabulary(a, b) )
+      return l2Distance( a.toCounter(), b.toCounter() );
+    std::vector<CountersCount_t> const& x( a.counts() );
+    std::vector<CountersCount_t> const& y( b.counts() );
+    const std::size_t n( std::min( x.size(), y.size() ) );
+    std::vector<CountersCount_t> const& longer( x.size() > n ? x : y );
+    CountersCount_t const* rest( details::tail(longer, n) );
+    return std::sqrt( kernels::squaredDistance( x.data(), y.data(), n ) +
+		      kernels::dot( rest, rest, longer.size() - n ) );
+  }
+
+  template <typename V>
+  CountersCount_t entropy( DenseCounter<V> const& p )
+  {
+    const CountersCount_t total( p.totalCount() );
+    CountersCount_t sum(0);
+    if( total > 0 )
+      for( std::size_t i = 0; i < p.counts().size(); ++i )
+	sum += details::entropyTerm( p.counts()[i], total );
+    return sum;
+  }
+
+  template <typename V>
+  CountersCount_t klDivergence( DenseCounter<V> const& p, DenseCounter<V> const& q )
+  {
+    if( !details::sameVocabulary(p, q) )
+      return klDivergence( p.toCounter(), q.toCounter() );
+    std::vector<CountersCount_t> const& x( p.counts() );
+    std::size_t positive(0);
+    for( std::size_t i = 0; i < x.size(); ++i )
+      positive += x[i] > 0;
+    const details::DenseJoint joint = { x.data(), q.counts().data(), std::min( x.size(), q.counts().size() ) };
+    return details::klDivergence( p.totalCount(), q.totalCount(), positive, joint );
+  }
+
+  template <typename V>
+  CountersCount_t jsDivergence( DenseCounter<V> const& p, DenseCounter<V> const& q )
+  {
+    if( !details::sameVocabulary(p, q) )
+      return jsDivergence( p.toCounter(), q.toCounter() );
+    const details::DenseJoint joint = { p.counts().data(), q.counts().data(),
+					std::min( p.counts().size(), q.counts().size() ) };
+    return details::jsDivergence( p.totalCount(), q.totalCount(), joint );
+  }
+
+  //---------------------------- CounterMap ------------------------------------
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t dot( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b )
+  {
+    const typename CounterMap<K, V, RowMap, OuterMap>::Counter_t empty;
+    return dot( details::rowOrEmpty(cm, a, empty), details::rowOrEmpty(cm, b, empty) );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t cosine( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b )
+  {
+    const typename CounterMap<K, V, RowMap, OuterMap>::Counter_t empty;
+    return cosine( details::rowOrEmpty(cm, a, empty), details::rowOrEmpty(cm, b, empty) );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t l1Distance( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b )
+  {
+    const typename CounterMap<K, V, RowMap, OuterMap>::Counter_t empty;
+    return l1Distance( details::rowOrEmpty(cm, a, empty), details::rowOrEmpty(cm, b, empty) );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t l2Distance( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& a, K const& b )
+  {
+    const typename CounterMap<K, V, RowMap, OuterMap>::Counter_t empty;
+    return l2Distance( details::rowOrEmpty(cm, a, empty), details::rowOrEmpty(cm, b, empty) );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t klDivergence( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& p, K const& q )
+  {
+    const typename CounterMap<K, V, RowMap, OuterMap>::Counter_t empty;
+    return klDivergence( details::rowOrEmpty(cm, p, empty), details::rowOrEmpty(cm, q, empty) );
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  CountersCount_t jsDivergence( CounterMap<K, V, RowMap, OuterMap> const& cm, K const& p, K const& q )
+  {
+    const typename CounterMap<K, V, RowMap, OuterMap>::Counter_t empty;
+    return jsDivergence( details::rowOrEmpty(cm, p, empty), details::rowOrEmpty(cm, q, empty) );
+  }
+
+};
+
+#endif // __COUNTERS_IMPL_HPP__
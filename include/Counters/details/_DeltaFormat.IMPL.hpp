@@ -0,0 +1,521 @@
+#ifndef __COUNTERS_DELTA_FORMAT_IMPL_HPP__
+#define __COUNTERS_DELTA_FORMAT_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/DeltaFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace Counters
+{
+  namespace details
+  {
+    static const char DELTA_MAGIC[4] = { 'C', 'D', 'L', 'T' };
+    static const std::uint8_t DELTA_VERSION = 1;
+    // flags: a Counter, written without keys
+    static const std::uint8_t DELTA_COUNTER = 1;
+
+    //------------------------- Writer and Reader ------------------------------
+
+    inline void DeltaWriter::varint( std::uint64_t x )
+    {
+      for( ; x >= 0x80; x >>= 7 )
+	byte( static_cast<std::uint8_t>( x | 0x80 ) );
+      byte( static_cast<std::uint8_t>(x) );
+    }
+
+    inline void DeltaWriter::fixed( std::uint64_t x, unsigned n )
+    {
+      for( unsigned i = 0; i < n; ++i )
+	byte( static_cast<std::uint8_t>( x >> (8 * i) ) );
+    }
+
+    inline bool DeltaReader::varint( std::uint64_t& x )
+    {
+      x = 0;
+      for( unsigned shift = 0; shift < 64; shift += 7 )
+	{
+	  std::uint8_t b;
+	  // the tenth byte holds the last bit
+	  if( !byte(b) || (shift == 63 && b > 1) )
+	    return false;
+	  x |= static_cast<std::uint64_t>( b & 0x7f ) << shift;
+	  if( (b & 0x80) == 0 )
+	    return true;
+	}
+      return false;
+    }
+
+    inline bool DeltaReader::fixed( std::uint64_t& x, unsigned n )
+    {
+      x = 0;
+      for( unsigned i = 0; i < n; ++i )
+	{
+	  std::uint8_t b;
+	  if( !byte(b) )
+	    return false;
+	  x |= static_cast<std::uint64_t>(b) << (8 * i);
+	}
+      return true;
+    }
+
+    //------------------------------ Counts ------------------------------------
+
+    // The count as written: the bits of a double or a float, or the zigzag
+    // multiple of the step. Returns false if it cannot be written.
+    inline bool quantizeDelta( CountersCount_t count, DeltaOptions const& options, std::uint64_t& q )
+    {
+      switch( options.counts )
+	{
+	case DELTA_COUNTS_DOUBLE:
+	  {
+	    const double d( count );
+	    std::memcpy( &q, &d, sizeof(d) );
+	    return true;
+	  }
+	case DELTA_COUNTS_FLOAT:
+	  {
+	    const float f( static_cast<float>(count) );
+	    std::uint32_t bits;
+	    std::memcpy( &bits, &f, sizeof(f) );
+	    q = bits;
+	    return true;
+	  }
+	case DELTA_COUNTS_STEPS:
+	  {
+	    const double multiple( std::round( count / options.step ) );
+	    if( !(std::fabs(multiple) < std::ldexp( 1.0, 62 )) )
+	      return false;
+	    const std::int64_t m( static_cast<std::int64_t>(multiple) );
+	    q = (static_cast<std::uint64_t>(m) << 1) ^ static_cast<std::uint64_t>(m >> 63);
+	    return true;
+	  }
+	}
+      return false;
+    }
+
+    inline CountersCount_t dequantizeDelta( std::uint64_t q, DeltaCountEncoding encoding, CountersCount_t step )
+    {
+      switch( encoding )
+	{
+	case DELTA_COUNTS_DOUBLE:
+	  {
+	    double d;
+	    std::memcpy( &d, &q, sizeof(d) );
+	    return d;
+	  }
+	case DELTA_COUNTS_FLOAT:
+	  {
+	    const std::uint32_t bits( static_cast<std::uint32_t>(q) );
+	    float f;
+	    std::memcpy( &f, &bits, sizeof(f) );
+	    return f;
+	  }
+	case DELTA_COUNTS_STEPS:
+	  return static_cast<CountersCount_t>( static_cast<std::int64_t>( q >> 1 ) ^ -static_cast<std::int64_t>( q & 1 ) ) * step;
+	}
+      return 0;
+    }
+
+    inline void writeDeltaCount( DeltaWriter& w, std::uint64_t q, DeltaCountEncoding encoding )
+    {
+      if( encoding == DELTA_COUNTS_STEPS )
+	w.varint( q );
+      else
+	w.fixed( q, encoding == DELTA_COUNTS_DOUBLE ? 8 : 4 );
+    }
+
+    inline bool readDeltaCount( DeltaReader& r, DeltaCountEncoding encoding, CountersCount_t step,
+				CountersCount_t& count )
+    {
+      std::uint64_t q;
+      if( !(encoding == DELTA_COUNTS_STEPS ? r.varint(q) : r.fixed( q, encoding == DELTA_COUNTS_DOUBLE ? 8 : 4 )) )
+	return false;
+      count = dequantizeDelta( q, encoding, step );
+      return true;
+    }
+
+    //------------------------------ Header ------------------------------------
+
+    // keyTag is 0 for Counters.
+    inline void writeDeltaHeader( DeltaWriter& w, DeltaOptions const& options,
+				  std::uint32_t valueTag, std::uint32_t keyTag )
+    {
+      w.bytes( DELTA_MAGIC, sizeof(DELTA_MAGIC) );
+      w.byte( DELTA_VERSION );
+      w.byte( keyTag == 0 ? DELTA_COUNTER : 0 );
+      w.byte( static_cast<std::uint8_t>(options.counts) );
+      if( options.counts == DELTA_COUNTS_STEPS )
+	{
+	  std::uint64_t bits;
+	  std::memcpy( &bits, &options.step, sizeof(bits) );
+	  w.fixed( bits, 8 );
+	}
+      w.varint( valueTag );
+      if( keyTag != 0 )
+	w.varint( keyTag );
+    }
+
+    inline bool readDeltaHeader( DeltaReader& r, std::uint32_t valueTag, std::uint32_t keyTag,
+				 DeltaCountEncoding& encoding, CountersCount_t& step )
+    {
+      char magic[sizeof(DELTA_MAGIC)];
+      std::uint8_t version, flags, counts;
+      if( !r.bytes( magic, sizeof(magic) ) || std::memcmp( magic, DELTA_MAGIC, sizeof(magic) ) != 0 ||
+	  !r.byte(version) || version != DELTA_VERSION ||
+	  !r.byte(flags) || flags != (keyTag == 0 ? DELTA_COUNTER : 0) ||
+	  !r.byte(counts) || counts > DELTA_COUNTS_STEPS )
+	return false;
+      encoding = static_cast<DeltaCountEncoding>(counts);
+      step = 1;
+      if( encoding == DELTA_COUNTS_STEPS )
+	{
+	  std::uint64_t bits;
+	  if( !r.fixed( bits, 8 ) )
+	    return false;
+	  std::memcpy( &step, &bits, sizeof(step) );
+	  if( !(step > 0) )
+	    return false;
+	}
+      std::uint64_t tag;
+      if( !r.varint(tag) || tag != valueTag )
+	return false;
+      return keyTag == 0 || (r.varint(tag) && tag == keyTag);
+    }
+
+    //------------------------------- Rows -------------------------------------
+
+    // The rows of a delta being written: the dictionary of their values, and
+    // their entries (dictionary index, quantized count), sorted by index
+    // within each row.
+    template <typename V>
+    class DeltaRowsWriter
+    {
+    public:
+      explicit DeltaRowsWriter( DeltaOptions const& options ) : options_(options), valid_(true) {}
+
+      // Adds the counts of the counter which do not round to 0 as a row.
+      // Returns the number of entries added.
+      template <typename CoreMap>
+      std::size_t add( Counter<V, CoreMap> const& row )
+      {
+	const std::size_t first( entries_.size() );
+	row.forEach( [this](V const& val, CountersCount_t count)
+		     {
+		       std::uint64_t q;
+		       if( count == 0 )
+			 return;
+		       if( !quantizeDelta( count, options_, q ) )
+			 valid_ = false;
+		       else if( dequantizeDelta( q, options_.counts, options_.step ) != 0 )
+			 entries_.push_back( Entry_t( index(val), q ) );
+		     } );
+	std::sort( entries_.begin() + first, entries_.end() );
+	return entries_.size() - first;
+      }
+      // FALSE if a count could not be quantized.
+      bool valid(void) const { return valid_; }
+      std::size_t entries(void) const { return entries_.size(); }
+
+      void writeDictionary( DeltaWriter& w ) const
+      {
+	w.varint( values_.size() );
+	for( std::size_t i = 0; i < values_.size(); ++i )
+	  DeltaEncoding<V>::write( w, *values_[i] );
+      }
+      // Writes the row of the entries in [first, last).
+      void writeRow( DeltaWriter& w, std::size_t first, std::size_t last ) const
+      {
+	w.varint( last - first );
+	std::uint64_t previous(0);
+	for( std::size_t i = first; i < last; ++i )
+	  {
+	    w.varint( entries_[i].first - previous );
+	    previous = entries_[i].first;
+	    writeDeltaCount( w, entries_[i].second, options_.counts );
+	  }
+      }
+
+    private:
+      typedef std::pair<std::uint64_t, std::uint64_t> Entry_t;
+
+      std::uint64_t index( V const& val )
+      {
+	std::pair<typename Indices_t::iterator, bool> r( indices_.emplace( val, values_.size() ) );
+	if( r.second )
+	  values_.push_back( &r.first->first );
+	return r.first->second;
+      }
+
+      typedef boost::unordered_map<V, std::uint64_t, boost::hash<V> > Indices_t;
+      DeltaOptions options_;
+      bool valid_;
+      Indices_t indices_;
+      // the keys of indices_, in the order of their indices
+      std::vector<V const*> values_;
+      std::vector<Entry_t> entries_;
+    };
+
+    // The rows of a delta being read: its dictionary and the entries
+    // (dictionary index, count) of all its rows.
+    template <typename V>
+    class DeltaRowsReader
+    {
+    public:
+      DeltaRowsReader( DeltaCountEncoding encoding, CountersCount_t step ) : encoding_(encoding), step_(step) {}
+
+      bool readDictionary( DeltaReader& r )
+      {
+	// Not reserved: the sizes come from the input.
+	std::uint64_t n;
+	if( !r.varint(n) )
+	  return false;
+	for( ; n > 0; --n )
+	  {
+	    V val;
+	    if( !DeltaEncoding<V>::read( r, val ) )
+	      return false;
+	    values_.push_back( std::move(val) );
+	  }
+	return true;
+      }
+      // Appends the entries of a row.
+      bool readRow( DeltaReader& r )
+      {
+	std::uint64_t n, index(0);
+	if( !r.varint(n) )
+	  return false;
+	for( std::uint64_t i = 0; i < n; ++i )
+	  {
+	    std::uint64_t gap;
+	    CountersCount_t count;
+	    if( !r.varint(gap) || (i > 0 && gap == 0) || gap >= values_.size() - index ||
+		!readDeltaCount( r, encoding_, step_, count ) )
+	      return false;
+	    index += gap;
+	    entries_.push_back( std::make_pair( index, count ) );
+	  }
+	return true;
+      }
+      std::size_t entries(void) const { return entries_.size(); }
+      V const& value( std::size_t i ) const { return values_[ entries_[i].first ]; }
+      CountersCount_t count( std::size_t i ) const { return entries_[i].second; }
+
+    private:
+      DeltaCountEncoding encoding_;
+      CountersCount_t step_;
+      std::vector<V> values_;
+      std::vector< std::pair<std::uint64_t, CountersCount_t> > entries_;
+    };
+  };
+
+  //----------------------------- Encodings ------------------------------------
+
+  template <typename T>
+  void DeltaEncoding<T, typename std::enable_if<std::is_integral<T>::value>::type>::write( details::DeltaWriter& w, T const& x )
+  {
+    if( std::is_signed<T>::value )
+      w.zigzag( static_cast<std::int64_t>(x) );
+    else
+      w.varint( static_cast<std::uint64_t>(x) );
+  }
+
+  template <typename T>
+  bool DeltaEncoding<T, typename std::enable_if<std::is_integral<T>::value>::type>::read( details::DeltaReader& r, T& x )
+  {
+    if( std::is_signed<T>::value )
+      {
+	std::int64_t s;
+	if( !r.zigzag(s) || s < static_cast<std::int64_t>( std::numeric_limits<T>::min() ) ||
+	    s > static_cast<std::int64_t>( std::numeric_limits<T>::max() ) )
+	  return false;
+	x = static_cast<T>(s);
+      }
+    else
+      {
+	std::uint64_t u;
+	if( !r.varint(u) || u > static_cast<std::uint64_t>( std::numeric_limits<T>::max() ) )
+	  return false;
+	x = static_cast<T>(u);
+      }
+    return true;
+  }
+
+  template <typename T>
+  void DeltaEncoding<T, typename std::enable_if<std::is_floating_point<T>::value &&
+						(sizeof(T) == 4 || sizeof(T) == 8)>::type>::write( details::DeltaWriter& w, T const& x )
+  {
+    typedef typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type Bits_t;
+    Bits_t bits;
+    std::memcpy( &bits, &x, sizeof(T) );
+    w.fixed( bits, sizeof(T) );
+  }
+
+  template <typename T>
+  bool DeltaEncoding<T, typename std::enable_if<std::is_floating_point<T>::value &&
+						(sizeof(T) == 4 || sizeof(T) == 8)>::type>::read( details::DeltaReader& r, T& x )
+  {
+    typedef typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type Bits_t;
+    std::uint64_t q;
+    if( !r.fixed( q, sizeof(T) ) )
+      return false;
+    const Bits_t bits( static_cast<Bits_t>(q) );
+    std::memcpy( &x, &bits, sizeof(T) );
+    return true;
+  }
+
+  template <typename C, typename Traits, typename Alloc>
+  void DeltaEncoding< std::basic_string<C, Traits, Alloc> >::write( details::DeltaWriter& w, String_t const& x )
+  {
+    w.varint( x.size() );
+    if( sizeof(C) == 1 )
+      w.bytes( reinterpret_cast<char const*>( x.data() ), x.size() );
+    else
+      for( std::size_t i = 0; i < x.size(); ++i )
+	w.varint( static_cast<typename std::make_unsigned<C>::type>( x[i] ) );
+  }
+
+  template <typename C, typename Traits, typename Alloc>
+  bool DeltaEncoding< std::basic_string<C, Traits, Alloc> >::read( details::DeltaReader& r, String_t& x )
+  {
+    typedef typename std::make_unsigned<C>::type Unit_t;
+    std::uint64_t n;
+    if( !r.varint(n) )
+      return false;
+    x.clear();
+    if( sizeof(C) == 1 )
+      {
+	// In blocks, so that a corrupt length fails at the end of the input
+	// rather than allocating it.
+	char block[256];
+	for( std::uint64_t read = 0; read < n; )
+	  {
+	    const std::size_t m( static_cast<std::size_t>( std::min<std::uint64_t>( sizeof(block), n - read ) ) );
+	    if( !r.bytes( block, m ) )
+	      return false;
+	    x.append( reinterpret_cast<C const*>(block), m );
+	    read += m;
+	  }
+	return true;
+      }
+    for( std::uint64_t i = 0; i < n; ++i )
+      {
+	std::uint64_t unit;
+	if( !r.varint(unit) || unit > std::numeric_limits<Unit_t>::max() )
+	  return false;
+	x.push_back( static_cast<C>( static_cast<Unit_t>(unit) ) );
+      }
+    return true;
+  }
+
+  //----------------------------- Writers --------------------------------------
+
+  template <typename V, typename CoreMap>
+  bool writeDelta( std::ostream& os, Counter<V, CoreMap> const& delta, DeltaOptions const& options )
+  {
+    if( options.counts == DELTA_COUNTS_STEPS && !(options.step > 0) )
+      return false;
+    details::DeltaRowsWriter<V> rows( options );
+    const std::size_t entries( rows.add( delta ) );
+    if( !rows.valid() )
+      return false;
+    details::DeltaWriter w( os );
+    details::writeDeltaHeader( w, options, DeltaEncoding<V>::tag(), 0 );
+    rows.writeDictionary( w );
+    w.varint( entries > 0 ? 1 : 0 );
+    if( entries > 0 )
+      rows.writeRow( w, 0, entries );
+    if( !w.good() )
+      os.setstate( std::ios_base::badbit );
+    return w.good();
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool writeDelta( std::ostream& os, CounterMap<K, V, RowMap, OuterMap> const& delta, DeltaOptions const& options )
+  {
+    if( options.counts == DELTA_COUNTS_STEPS && !(options.step > 0) )
+      return false;
+    details::DeltaRowsWriter<V> rows( options );
+    // the keys of the rows with entries, and where their entries end
+    std::vector< std::pair<K const*, std::size_t> > keys;
+    for( typename CounterMap<K, V, RowMap, OuterMap>::ConstIterator i( delta.begin() ); i != delta.end(); ++i )
+      if( rows.add( i->second ) > 0 )
+	keys.push_back( std::make_pair( &i->first, rows.entries() ) );
+    if( !rows.valid() )
+      return false;
+    details::DeltaWriter w( os );
+    details::writeDeltaHeader( w, options, DeltaEncoding<V>::tag(), DeltaEncoding<K>::tag() );
+    rows.writeDictionary( w );
+    w.varint( keys.size() );
+    std::size_t first(0);
+    for( std::size_t i = 0; i < keys.size(); ++i )
+      {
+	DeltaEncoding<K>::write( w, *keys[i].first );
+	rows.writeRow( w, first, keys[i].second );
+	first = keys[i].second;
+      }
+    if( !w.good() )
+      os.setstate( std::ios_base::badbit );
+    return w.good();
+  }
+
+  //----------------------------- Readers --------------------------------------
+
+  template <typename V, typename CoreMap>
+  bool readDelta( std::istream& is, Counter<V, CoreMap>& delta )
+  {
+    details::DeltaReader r( is );
+    DeltaCountEncoding encoding;
+    CountersCount_t step;
+    std::uint64_t rows;
+    if( !details::readDeltaHeader( r, DeltaEncoding<V>::tag(), 0, encoding, step ) )
+      return false;
+    details::DeltaRowsReader<V> in( encoding, step );
+    if( !in.readDictionary(r) || !r.varint(rows) || rows > 1 || (rows == 1 && !in.readRow(r)) )
+      return false;
+    delta.clear();
+    for( std::size_t i = 0; i < in.entries(); ++i )
+      delta.setCount( in.value(i), in.count(i) );
+    return true;
+  }
+
+  template <typename K, typename V, typename RowMap, typename OuterMap>
+  bool readDelta( std::istream& is, CounterMap<K, V, RowMap, OuterMap>& delta )
+  {
+    details::DeltaReader r( is );
+    DeltaCountEncoding encoding;
+    CountersCount_t step;
+    std::uint64_t rows;
+    if( !details::readDeltaHeader( r, DeltaEncoding<V>::tag(), DeltaEncoding<K>::tag(), encoding, step ) )
+      return false;
+    details::DeltaRowsReader<V> in( encoding, step );
+    if( !in.readDictionary(r) || !r.varint(rows) )
+      return false;
+    // the keys of the rows, and where their entries end
+    std::vector< std::pair<K, std::size_t> > keys;
+    for( ; rows > 0; --rows )
+      {
+	K key;
+	if( !DeltaEncoding<K>::read( r, key ) || !in.readRow(r) )
+	  return false;
+	keys.push_back( std::make_pair( std::move(key), in.entries() ) );
+      }
+    delta.clear();
+    std::size_t first(0);
+    for( std::size_t i = 0; i < keys.size(); ++i )
+      for( ; first < keys[i].second; ++first )
+	delta.setCount( keys[i].first, in.value(first), in.count(first) );
+    return true;
+  }
+
+};
+
+#endif // __COUNTERS_DELTA_FORMAT_IMPL_HPP__
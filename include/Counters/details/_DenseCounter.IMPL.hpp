@@ -0,0 +1,234 @@
+#ifndef __DENSE_COUNTER_IMPL_HPP__
+#define __DENSE_COUNTER_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/DenseCounter.hpp"
+
+#include <algorithm>
+
+namespace Counters
+{
+  //------------- Constructors, Assignment, Swap -------------------------------
+
+  template <typename V>
+  DenseCounter<V>::DenseCounter( std::shared_ptr<Vocabulary_t> vocabulary )
+    : vocabulary_( std::move(vocabulary) ),
+      counts_(),
+      cachedTotal_( 0, CACHE_POLICY_RELAXED, true ),
+      summation_( SUMMATION_NAIVE )
+  {}
+
+  template <typename V>
+  void DenseCounter<V>::swap( DenseCounter<V>& other )
+  {
+    using std::swap;
+    swap( vocabulary_, other.vocabulary_ );
+    counts_.swap( other.counts_ );
+    swap( cachedTotal_, other.cachedTotal_ );
+    swap( summation_, other.summation_ );
+  }
+
+  //--------------------------- Modifiers --------------------------------------
+
+  template <typename V>
+  void DenseCounter<V>::incrementCount( V const& val, Count_t count )
+  {
+    incrementCountById( vocabulary_->intern(val), count );
+  }
+
+  template <typename V>
+  template <typename ValueLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value>::type
+  DenseCounter<V>::incrementCount( ValueLike const& val, Count_t count )
+  {
+    incrementCountById( vocabulary_->intern(val), count );
+  }
+
+  template <typename V>
+  void DenseCounter<V>::setCount( V const& val, Count_t count )
+  {
+    setCountById( vocabulary_->intern(val), count );
+  }
+
+  template <typename V>
+  void DenseCounter<V>::normalize(void)
+  {
+    Count_t total( totalCount() );
+    if( total != 0 )
+      {
+	(*this) /= total;
+	cachedTotal_.set( 1.0 );
+      }
+    else
+      {
+	clear();
+	cachedTotal_.set( 0 );
+      }
+  }
+
+  template <typename V>
+  void DenseCounter<V>::remove( V const& val )
+  {
+    const Id_t id( vocabulary_->find(val) );
+    if( id != Vocabulary_t::NOT_FOUND )
+      setCountById( id, 0 );
+  }
+
+  template <typename V>
+  void DenseCounter<V>::clear(void)
+  {
+    std::fill( counts_.begin(), counts_.end(), Count_t(0) );
+    cachedTotal_.set( 0 );
+  }
+
+  //----------------------------- By Id ----------------------------------------
+
+  template <typename V>
+  void DenseCounter<V>::incrementCountById( Id_t id, Count_t count )
+  {
+    ensureCount(id) += count;
+    cachedTotal_ += count;
+  }
+
+  template <typename V>
+  void DenseCounter<V>::setCountById( Id_t id, Count_t count )
+  {
+    Count_t& storedCount( ensureCount(id) );
+    cachedTotal_ += (count - storedCount);
+    storedCount = count;
+  }
+
+  //------------------------- Size and Lookup ----------------------------------
+
+  template <typename V>
+  typename DenseCounter<V>::Size_t DenseCounter<V>::size(void) const
+  {
+    return counts_.size() - std::count( counts_.begin(), counts_.end(), Count_t(0) );
+  }
+
+  template <typename V>
+  typename DenseCounter<V>::Count_t DenseCounter<V>::getCount( V const& val ) const
+  {
+    const Id_t id( vocabulary_->find(val) );
+    return id == Vocabulary_t::NOT_FOUND ? 0 : getCountById(id);
+  }
+
+  template <typename V>
+  template <typename ValueLike>
+  typename std::enable_if<MapTypeErasure::IsKeyLike<V, ValueLike>::value, typename DenseCounter<V>::Count_t>::type
+  DenseCounter<V>::getCount( ValueLike const& val ) const
+  {
+    const Id_t id( vocabulary_->find(val) );
+    return id == Vocabulary_t::NOT_FOUND ? 0 : getCountById(id);
+  }
+
+  template <typename V>
+  typename DenseCounter<V>::Count_t DenseCounter<V>::totalCount(void) const
+  {
+    if( ! cachedTotal_.isSynched() )
+      cachedTotal_.set( kernels::sum( counts_.data(), counts_.size(), summation_ ) );
+    return cachedTotal_.get();
+  }
+
+  template <typename V>
+  V DenseCounter<V>::maxValue(void) const
+  {
+    const Size_t maxId( kernels::argmaxNonZero( counts_.data(), counts_.size() ) );
+    return maxId == counts_.size() ? V() : vocabulary_->value( static_cast<Id_t>(maxId) );
+  }
+
+  template <typename V>
+  Counter<V> DenseCounter<V>::toCounter(void) const
+  {
+    Counter<V> counter;
+    for( Size_t id = 0; id < counts_.size(); ++id )
+      if( counts_[id] != 0 )
+	counter.setCount( vocabulary_->value( static_cast<Id_t>(id) ), counts_[id] );
+    return counter;
+  }
+
+  //--------------------------- Equality ---------------------------------------
+
+  template <typename V>
+  bool DenseCounter<V>::equals( DenseCounter<V> const& o, Count_t precision ) const
+  {
+    if( this == &o ) return true;
+    if( vocabulary_ != o.vocabulary_ )
+      return precision == 0 ? toCounter() == o.toCounter()
+	                    : toCounter().equals( o.toCounter(), precision );
+    // The common ids, then the counts past the end of the shorter array
+    // against 0.
+    const Size_t n( std::min( counts_.size(), o.counts_.size() ) );
+    if( !kernels::equalWithin( counts_.data(), o.counts_.data(), n, precision ) )
+      return false;
+    std::vector<Count_t> const& longer( counts_.size() > n ? counts_ : o.counts_ );
+    for( Size_t id = n; id < longer.size(); ++id )
+      if( precision == 0 ? longer[id] != 0 : std::fabs( longer[id] ) >= precision )
+	return false;
+    return true;
+  }
+
+  //----------------------- Arithmetic Operators ------------------------------
+
+  template <typename V>
+  DenseCounter<V>& DenseCounter<V>::operator+=( DenseCounter<V> const& o )
+  {
+    addScaled( o, 1 );
+    return *this;
+  }
+
+  template <typename V>
+  DenseCounter<V>& DenseCounter<V>::operator-=( DenseCounter<V> const& o )
+  {
+    addScaled( o, -1 );
+    return *this;
+  }
+
+  template <typename V>
+  DenseCounter<V>& DenseCounter<V>::operator*=( Count_t count )
+  {
+    kernels::scale( counts_.data(), counts_.size(), count );
+    cachedTotal_ *= count;
+    return *this;
+  }
+
+  //----------------------------- Private -------------------------------------
+
+  template <typename V>
+  void DenseCounter<V>::addScaled( DenseCounter<V> const& o, Count_t scale )
+  {
+    if( vocabulary_ == o.vocabulary_ )
+      {
+	if( counts_.size() < o.counts_.size() )
+	  counts_.resize( o.counts_.size(), 0 );
+	kernels::axpy( counts_.data(), o.counts_.data(), o.counts_.size(), scale );
+	if( cachedTotal_.getCachePolicy() == CACHE_POLICY_PERSISTENT )
+	  cachedTotal_ += scale * o.totalCount();
+	else
+	  cachedTotal_.reset();
+      }
+    else
+      for( Size_t id = 0; id < o.counts_.size(); ++id )
+	if( o.counts_[id] != 0 )
+	  incrementCount( o.vocabulary_->value( static_cast<Id_t>(id) ), scale * o.counts_[id] );
+  }
+
+  template <typename V>
+  typename DenseCounter<V>::Count_t& DenseCounter<V>::ensureCount( Id_t id )
+  {
+    if( id >= counts_.size() )
+      counts_.resize( std::max<Size_t>( id + 1, vocabulary_->size() ), 0 );
+    return counts_[id];
+  }
+
+  //-------------------- Output Operator ---------------------------------------
+
+  template <typename V>
+  std::ostream& operator<<(std::ostream& os, const DenseCounter<V>& counter)
+  {
+    return os << counter.toCounter();
+  }
+
+};
+
+#endif // __DENSE_COUNTER_IMPL_HPP__
@@ -0,0 +1,204 @@
+#ifndef __FROZEN_COUNTER_MAP_IMPL_HPP__
+#define __FROZEN_COUNTER_MAP_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/FrozenCounterMap.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace Counters
+{
+  namespace details
+  {
+    // Orders the elements of a sorted array against a key view.
+    template <typename View>
+    struct ViewLess
+    {
+      template <typename T>
+      bool operator()( T const& element, View const& view ) const { return View(element) < view; }
+    };
+
+    // Returns the index of the view in the sorted array [first, first + n),
+    // or n if it is not there.
+    template <typename T, typename View>
+    std::size_t findSorted( T const* first, std::size_t n, View const& view )
+    {
+      T const* const i( std::lower_bound( first, first + n, view, ViewLess<View>() ) );
+      return i == first + n || view < View(*i) ? n : i - first;
+    }
+
+    // Orders pointers to pairs by their first elements.
+    struct PointeeFirstLess
+    {
+      template <typename Pair>
+      bool operator()( Pair const* a, Pair const* b ) const { return a->first < b->first; }
+    };
+  };
+
+  //------------------------------- Row ----------------------------------------
+
+  template <typename K, typename V>
+  typename FrozenCounterMap<K, V>::Size_t
+  FrozenCounterMap<K, V>::Row::findView( ValView_t const& val ) const
+  {
+    return details::findSorted( values_, size_, val );
+  }
+
+  template <typename K, typename V>
+  typename FrozenCounterMap<K, V>::Count_t
+  FrozenCounterMap<K, V>::Row::probabilityAt( Size_t i ) const
+  {
+    if( i == size_ )
+      return 0;
+    if( probabilities_ != NULL )
+      return probabilities_[i];
+    return total_ == 0 ? 0 : counts_[i] / total_;
+  }
+
+  template <typename K, typename V>
+  V FrozenCounterMap<K, V>::Row::maxValue(void) const
+  {
+    if( size_ == 0 )
+      return V();
+    Size_t max(0);
+    for( Size_t i = 1; i < size_; ++i )
+      if( counts_[i] > counts_[max] )
+	max = i;
+    return values_[max];
+  }
+
+  //------------------------ Constructors and Swap -----------------------------
+
+  template <typename K, typename V>
+  template <typename RowMap, typename OuterMap>
+  FrozenCounterMap<K, V>::FrozenCounterMap( CounterMap<K, V, RowMap, OuterMap> const& counterMap,
+					    bool withProbabilities )
+    : total_( counterMap.totalCount() ),
+      withProbabilities_( withProbabilities )
+  {
+    typedef typename CounterMap<K, V, RowMap, OuterMap>::IteratorValue_t Entry_t;
+    typedef std::pair<V, Count_t> ValueCount_t;
+
+    // the rows in the order of their keys
+    std::vector<Entry_t const*> rows;
+    rows.reserve( counterMap.size() );
+    Size_t values(0);
+    for( typename CounterMap<K, V, RowMap, OuterMap>::ConstIterator i(counterMap.begin()), e(counterMap.end());
+	 i != e; ++i )
+      {
+	rows.push_back( &*i );
+	values += i->second.size();
+      }
+    std::sort( rows.begin(), rows.end(), details::PointeeFirstLess() );
+
+    keys_.reserve( rows.size() );
+    offsets_.reserve( rows.size() + 1 );
+    rowTotals_.reserve( rows.size() );
+    values_.reserve( values );
+    counts_.reserve( values );
+    offsets_.push_back( 0 );
+
+    std::vector<ValueCount_t> row;
+    for( typename std::vector<Entry_t const*>::const_iterator i(rows.begin()); i != rows.end(); ++i )
+      {
+	typename CounterMap<K, V, RowMap, OuterMap>::Counter_t const& counter( (*i)->second );
+	row.assign( counter.begin(), counter.end() );
+	std::sort( row.begin(), row.end() );
+
+	const Count_t total( counter.totalCount() );
+	keys_.push_back( (*i)->first );
+	rowTotals_.push_back( total );
+	for( typename std::vector<ValueCount_t>::const_iterator j(row.begin()); j != row.end(); ++j )
+	  {
+	    values_.push_back( j->first );
+	    counts_.push_back( j->second );
+	    if( withProbabilities )
+	      probabilities_.push_back( total == 0 ? 0 : j->second / total );
+	  }
+	offsets_.push_back( values_.size() );
+      }
+  }
+
+  template <typename K, typename V>
+  void FrozenCounterMap<K, V>::swap( FrozenCounterMap<K, V>& other )
+  {
+    keys_.swap( other.keys_ );
+    offsets_.swap( other.offsets_ );
+    values_.swap( other.values_ );
+    counts_.swap( other.counts_ );
+    probabilities_.swap( other.probabilities_ );
+    rowTotals_.swap( other.rowTotals_ );
+    std::swap( total_, other.total_ );
+    std::swap( withProbabilities_, other.withProbabilities_ );
+  }
+
+  //----------------------------- Lookup ---------------------------------------
+
+  template <typename K, typename V>
+  bool FrozenCounterMap<K, V>::contains( K const& key, V const& val ) const
+  {
+    const Row r( getRow(key) );
+    return r.find(val) != r.size();
+  }
+
+  template <typename K, typename V>
+  template <typename KeyArg, typename ValArg>
+  typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value, bool>::type
+  FrozenCounterMap<K, V>::contains( KeyArg const& key, ValArg const& val ) const
+  {
+    const Row r( getRow(key) );
+    return r.find(val) != r.size();
+  }
+
+  //------------------------------ Rows ----------------------------------------
+
+  template <typename K, typename V>
+  typename FrozenCounterMap<K, V>::Row FrozenCounterMap<K, V>::row( Size_t i ) const
+  {
+    if( i >= keys_.size() )
+      return Row();
+    const Size_t first( offsets_[i] );
+    return Row( values_.data() + first, counts_.data() + first,
+		withProbabilities_ ? probabilities_.data() + first : NULL,
+		offsets_[i + 1] - first, rowTotals_[i] );
+  }
+
+  template <typename K, typename V>
+  typename FrozenCounterMap<K, V>::Size_t
+  FrozenCounterMap<K, V>::findRow( KeyView_t const& key ) const
+  {
+    return details::findSorted( keys_.data(), keys_.size(), key );
+  }
+
+  template <typename K, typename V>
+  template <typename CounterMap_t>
+  CounterMap_t FrozenCounterMap<K, V>::thaw( CounterMap_t counterMap ) const
+  {
+    counterMap.reserve( keys_.size() );
+    for( Size_t i = 0; i < keys_.size(); ++i )
+      for( Size_t j = offsets_[i]; j < offsets_[i + 1]; ++j )
+	counterMap.setCount( keys_[i], values_[j], counts_[j] );
+    return counterMap;
+  }
+
+  //------------------------------ Output --------------------------------------
+
+  template <typename K, typename V>
+  std::ostream& operator<<( std::ostream& os, FrozenCounterMap<K, V> const& frozen )
+  {
+    os << "[\n";
+    for( std::size_t i = 0; i < frozen.size(); ++i )
+      {
+	const typename FrozenCounterMap<K, V>::Row row( frozen.row(i) );
+	os << " " << frozen.keys()[i] << MAPPING_DELIMITER << "[";
+	for( std::size_t j = 0; j < row.size(); ++j )
+	  os << (j == 0 ? "" : ", ") << row.value(j) << MAPPING_DELIMITER << row.count(j);
+	os << "]\n";
+      }
+    return os << "]";
+  }
+
+};
+
+#endif // __FROZEN_COUNTER_MAP_IMPL_HPP__
@@ -0,0 +1,139 @@
+#ifndef __INTERNED_COUNTER_MAP_IMPL_HPP__
+#define __INTERNED_COUNTER_MAP_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/InternedCounterMap.hpp"
+
+namespace Counters
+{
+  //------------------------ Constructors and Swap -----------------------------
+
+  template <typename K, typename V>
+  InternedCounterMap<K, V>::InternedCounterMap( std::shared_ptr<Vocabulary_t> vocabulary,
+						typename IdCounterMap_t::CoreMap_t coreMap,
+						CounterFactory<Id_t> const& rowFactory )
+    : vocabulary_( std::move(vocabulary) ),
+      idCounterMap_( std::move(coreMap), rowFactory )
+  {}
+
+  template <typename K, typename V>
+  void InternedCounterMap<K, V>::swap( InternedCounterMap<K, V>& other )
+  {
+    vocabulary_.swap( other.vocabulary_ );
+    idCounterMap_.swap( other.idCounterMap_ );
+  }
+
+  //---------------------------- Modifiers -------------------------------------
+
+  template <typename K, typename V>
+  void InternedCounterMap<K, V>::remove( K const& key, V const& val )
+  {
+    const Id_t id( vocabulary_->find(val) );
+    if( id != Vocabulary_t::NOT_FOUND )
+      idCounterMap_.remove( key, id );
+  }
+
+  //----------------------------- Lookup ---------------------------------------
+
+  template <typename K, typename V>
+  bool InternedCounterMap<K, V>::contains( K const& key, V const& val ) const
+  {
+    const Id_t id( vocabulary_->find(val) );
+    return id != Vocabulary_t::NOT_FOUND && idCounterMap_.contains( key, id );
+  }
+
+  template <typename K, typename V>
+  typename InternedCounterMap<K, V>::Count_t
+  InternedCounterMap<K, V>::getCount( K const& key, V const& val ) const
+  {
+    const Id_t id( vocabulary_->find(val) );
+    return id == Vocabulary_t::NOT_FOUND ? 0 : idCounterMap_.getCount( key, id );
+  }
+
+  template <typename K, typename V>
+  template <typename KeyArg, typename ValArg>
+  typename std::enable_if<IsCounterMapLookup<K, V, KeyArg, ValArg>::value,
+			  typename InternedCounterMap<K, V>::Count_t>::type
+  InternedCounterMap<K, V>::getCount( KeyArg const& key, ValArg const& val ) const
+  {
+    const Id_t id( vocabulary_->find(val) );
+    if( id == Vocabulary_t::NOT_FOUND )
+      return 0;
+    Row_t const * const row( idCounterMap_.getCounter(key) );
+    return row == NULL ? 0 : row->getCount(id);
+  }
+
+  template <typename K, typename V>
+  V InternedCounterMap<K, V>::maxValue( K const& key ) const
+  {
+    Row_t const * const row( idCounterMap_.getCounter(key) );
+    if( row == NULL || row->empty() )
+      return V();
+    return vocabulary_->value( row->maxValue() );
+  }
+
+  //----------------------- Rows and Vocabulary --------------------------------
+
+  template <typename K, typename V>
+  Counter<V> InternedCounterMap<K, V>::getValueCounter( K const& key ) const
+  {
+    Counter<V> counter;
+    Row_t const * const row( idCounterMap_.getCounter(key) );
+    if( row != NULL )
+      for( typename Row_t::ConstIterator i(row->begin()); i != row->end(); ++i )
+	counter.setCount( vocabulary_->value(i->first), i->second );
+    return counter;
+  }
+
+  //------------------ Equality and Arithmetic Operators -----------------------
+
+  template <typename K, typename V>
+  bool InternedCounterMap<K, V>::equals( InternedCounterMap<K, V> const& other,
+					 Count_t precision ) const
+  {
+    if( this == &other ) return true;
+    // Counter::equals() compares strictly, so precision 0 uses operator==.
+    if( vocabulary_ == other.vocabulary_ )
+      return precision == 0 ? idCounterMap_ == other.idCounterMap_
+	                    : idCounterMap_.equals( other.idCounterMap_, precision );
+    // The ids differ between the vocabularies: compare the rows by value.
+    if( size() != other.size() ) return false;
+    for( ConstIterator i(begin()); i != end(); ++i )
+      {
+	if( ! other.contains(i->first) )
+	  return false;
+	Counter<V> const row( getValueCounter(i->first) ), otherRow( other.getValueCounter(i->first) );
+	if( precision == 0 ? row != otherRow : ! row.equals( otherRow, precision ) )
+	  return false;
+      }
+    return true;
+  }
+
+  template <typename K, typename V>
+  InternedCounterMap<K, V>& InternedCounterMap<K, V>::operator+=( InternedCounterMap<K, V> const& rhs )
+  {
+    if( vocabulary_ == rhs.vocabulary_ )
+      {
+	idCounterMap_ += rhs.idCounterMap_;
+	return *this;
+      }
+    for( ConstIterator i(rhs.begin()); i != rhs.end(); ++i )
+      for( typename Row_t::ConstIterator j(i->second.begin()); j != i->second.end(); ++j )
+	incrementCount( i->first, rhs.vocabulary_->value(j->first), j->second );
+    return *this;
+  }
+
+  //-------------------- Output Operator ---------------------------------------
+
+  template <typename K, typename V>
+  std::ostream& operator<<( std::ostream& os, InternedCounterMap<K, V> const& counterMap )
+  {
+    os << "[\n";
+    for( typename InternedCounterMap<K, V>::ConstIterator i(counterMap.begin()); i != counterMap.end(); ++i )
+      os << " " << i->first << MAPPING_DELIMITER << counterMap.getValueCounter(i->first) << "\n";
+    return os << "]";
+  }
+
+};
+
+#endif // __INTERNED_COUNTER_MAP_IMPL_HPP__
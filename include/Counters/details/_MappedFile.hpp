@@ -0,0 +1,78 @@
+#ifndef __COUNTERS_MAPPED_FILE_HPP__
+#define __COUNTERS_MAPPED_FILE_HPP__
+
+/*!
+ * @file _MappedFile.hpp
+ * @brief A read-only memory mapping of a file, used by the binary format and
+ * by the text ingestion. Requires POSIX mmap().
+ *
+ * @author Yuriy Skobov
+ */
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Counters
+{
+  namespace details
+  {
+    /*! @brief A read-only, shared memory mapping of a whole file. */
+    class MappedFile
+    {
+    public:
+      MappedFile() : data_(NULL), size_(0) {}
+      ~MappedFile() { close(); }
+
+      /*! @brief Maps the file; returns false if it cannot be opened or
+       *  mapped. */
+      bool open( std::string const& path );
+      void close(void);
+      /*! @brief Tells the OS that the mapping will be read sequentially
+       *  (more read-ahead, early reclaim of the pages read). */
+      void adviseSequential(void) const
+      { if( data_ != NULL ) ::posix_madvise( const_cast<char*>(data_), size_, POSIX_MADV_SEQUENTIAL ); }
+      char const* data(void) const { return data_; }
+      std::size_t size(void) const { return size_; }
+
+    private:
+      MappedFile( MappedFile const& );
+      MappedFile& operator=( MappedFile const& );
+
+      char const* data_;
+      std::size_t size_;
+    };
+
+    inline bool MappedFile::open( std::string const& path )
+    {
+      close();
+      const int fd( ::open( path.c_str(), O_RDONLY ) );
+      if( fd < 0 )
+	return false;
+      struct stat st;
+      void* data( MAP_FAILED );
+      if( ::fstat( fd, &st ) == 0 && st.st_size > 0 )
+	data = ::mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+      ::close( fd );
+      if( data == MAP_FAILED )
+	return false;
+      data_ = static_cast<char const*>(data);
+      size_ = st.st_size;
+      return true;
+    }
+
+    inline void MappedFile::close(void)
+    {
+      if( data_ != NULL )
+	::munmap( const_cast<char*>(data_), size_ );
+      data_ = NULL;
+      size_ = 0;
+    }
+  };
+};
+
+#endif // __COUNTERS_MAPPED_FILE_HPP__
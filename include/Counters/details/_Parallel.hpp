@@ -0,0 +1,42 @@
+#ifndef __COUNTERS_PARALLEL_HPP__
+#define __COUNTERS_PARALLEL_HPP__
+
+/*!
+ * @file _Parallel.hpp
+ * @brief A minimal parallel loop over std::thread, used by the parallel
+ * algorithms of the library.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace Counters
+{
+  namespace details
+  {
+    /*! @brief Calls task(i) for every i in [0, n), using up to threads threads
+     *  (the calling thread included). The tasks are handed out one at a time,
+     *  so their costs need not be balanced. */
+    template <typename Task>
+    void parallelFor( std::size_t n, std::size_t threads, Task task )
+    {
+      std::atomic<std::size_t> next(0);
+      auto run = [&next, n, &task]() {
+	for( std::size_t i = next++; i < n; i = next++ )
+	  task( i );
+      };
+      std::vector<std::thread> helpers;
+      for( std::size_t t = 1; t < threads && t < n; ++t )
+	helpers.push_back( std::thread( run ) );
+      run();
+      for( std::size_t t = 0; t < helpers.size(); ++t )
+	helpers[t].join();
+    }
+  };
+};
+
+#endif // __COUNTERS_PARALLEL_HPP__
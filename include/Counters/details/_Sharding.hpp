@@ -0,0 +1,46 @@
+#ifndef __COUNTERS_SHARDING_HPP__
+#define __COUNTERS_SHARDING_HPP__
+
+/*!
+ * @file _Sharding.hpp
+ * @brief Assignment of keys to the shards of ConcurrentCounter and
+ * ConcurrentCounterMap.
+ *
+ * @author Yuriy Skobov
+ */
+
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+#include "Counters/CounterFactories.hpp"
+
+namespace Counters
+{
+  namespace details
+  {
+    /*! @brief Index of the shard (out of shards) of a key with the given hash.
+     *  Uses the high bits of a multiplicative hash, so that the shards do not
+     *  split the low bits the maps inside them hash by (boost::hash is the
+     *  identity for integers). */
+    inline std::size_t shardIndex( std::size_t hash, std::size_t shards )
+    {
+      return std::size_t( (boost::uint64_t(hash) * 0x9e3779b97f4a7c15ULL) >> 32 ) % shards;
+    }
+
+    /*! @brief The factory the shards are created by: a clone of counterFactory,
+     *  or a DefaultCounterFactory if the Counters of counterFactory use memory
+     *  it owns. Such memory (e.g. the Arena of an ArenaCounterFactory) is
+     *  shared by the shards, which are updated under different mutexes.
+     *  Caller responsible for deletion. */
+    template <typename V>
+    CounterFactory<V> *shardFactory( CounterFactory<V> const& counterFactory )
+    {
+      if( counterFactory.ownsCounterMemory() )
+	return new DefaultCounterFactory<V>();
+      return counterFactory.clone();
+    }
+  };
+};
+
+#endif // __COUNTERS_SHARDING_HPP__
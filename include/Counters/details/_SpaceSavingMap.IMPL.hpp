@@ -0,0 +1,173 @@
+#ifndef __SPACE_SAVING_MAP_IMPL_HPP__
+#define __SPACE_SAVING_MAP_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/SpaceSavingMap.hpp"
+
+#include <algorithm>
+
+namespace Counters
+{
+  //------------- Constructors, Assignment, Swap -------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  SpaceSavingMap<K, V, Hash, Pred>::SpaceSavingMap( size_type capacity )
+    : map_(), heap_(), capacity_( capacity > 0 ? capacity : 1 ), evictions_(0)
+  {}
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  SpaceSavingMap<K, V, Hash, Pred>::SpaceSavingMap( SpaceSavingMap const& other )
+    : map_( other.map_ ), heap_(), capacity_( other.capacity_ ), evictions_( other.evictions_ )
+  {
+    rebuildHeap();
+  }
+
+  // The nodes of the map move with it, so the snapshots stay valid.
+  template <typename K, typename V, typename Hash, typename Pred>
+  SpaceSavingMap<K, V, Hash, Pred>::SpaceSavingMap( SpaceSavingMap && other )
+    : map_( std::move(other.map_) ), heap_( std::move(other.heap_) ),
+      capacity_( other.capacity_ ), evictions_( other.evictions_ )
+  {
+    other.map_.clear();
+    other.heap_.clear();
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  SpaceSavingMap<K, V, Hash, Pred>& SpaceSavingMap<K, V, Hash, Pred>::operator=( SpaceSavingMap const& other )
+  {
+    if( this != &other ) {
+      SpaceSavingMap tmp( other );
+      swap( tmp );
+    }
+    return *this;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  SpaceSavingMap<K, V, Hash, Pred>& SpaceSavingMap<K, V, Hash, Pred>::operator=( SpaceSavingMap && other )
+  {
+    swap( other );
+    return *this;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void SpaceSavingMap<K, V, Hash, Pred>::swap( SpaceSavingMap& other )
+  {
+    using std::swap;
+    map_.swap( other.map_ );
+    heap_.swap( other.heap_ );
+    swap( capacity_, other.capacity_ );
+    swap( evictions_, other.evictions_ );
+  }
+
+  //-------------------------- Size and Capacity -------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void SpaceSavingMap<K, V, Hash, Pred>::reserve( size_type n )
+  {
+    map_.reserve( std::min(n, capacity_) );
+    heap_.reserve( std::min(n, capacity_) );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  V SpaceSavingMap<K, V, Hash, Pred>::min_count() const
+  {
+    if( map_.size() < capacity_ )
+      return V();
+    settleHeap();
+    return heap_.front().first;
+  }
+
+  //------------------------------ Modifiers -----------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename InputIterator>
+  void SpaceSavingMap<K, V, Hash, Pred>::insert( InputIterator first, InputIterator last )
+  {
+    for( ; first != last; ++first )
+      insert( *first );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  typename SpaceSavingMap<K, V, Hash, Pred>::size_type SpaceSavingMap<K, V, Hash, Pred>::erase( K const& k )
+  {
+    iterator i( map_.find(k) );
+    if( i == map_.end() )
+      return 0;
+    value_type* const entry( &*i );
+    for( typename std::vector<Snapshot_t>::iterator h(heap_.begin()); h != heap_.end(); ++h )
+      if( h->second == entry )
+	{
+	  *h = heap_.back();
+	  heap_.pop_back();
+	  std::make_heap( heap_.begin(), heap_.end(), SnapshotGreater() );
+	  break;
+	}
+    map_.erase( i );
+    return 1;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void SpaceSavingMap<K, V, Hash, Pred>::clear()
+  {
+    map_.clear();
+    heap_.clear();
+  }
+
+  //------------------------------- Private ------------------------------------
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  template <typename KeyArg, typename... Args>
+  std::pair<typename SpaceSavingMap<K, V, Hash, Pred>::iterator, bool>
+  SpaceSavingMap<K, V, Hash, Pred>::tryEmplaceImpl( KeyArg && k, Args&&... args )
+  {
+    iterator i( map_.find(k) );
+    if( i != map_.end() )
+      return std::make_pair( i, false );
+    V mapped( std::forward<Args>(args)... );
+    if( map_.size() >= capacity_ )
+      mapped = mapped + evict();
+    i = map_.emplace( std::forward<KeyArg>(k), std::move(mapped) ).first;
+    heap_.push_back( Snapshot_t( i->second, &*i ) );
+    std::push_heap( heap_.begin(), heap_.end(), SnapshotGreater() );
+    return std::make_pair( i, true );
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  V SpaceSavingMap<K, V, Hash, Pred>::evict()
+  {
+    settleHeap();
+    std::pop_heap( heap_.begin(), heap_.end(), SnapshotGreater() );
+    value_type* const entry( heap_.back().second );
+    heap_.pop_back();
+    const V count( entry->second );
+    map_.erase( entry->first );
+    ++evictions_;
+    return count;
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void SpaceSavingMap<K, V, Hash, Pred>::settleHeap() const
+  {
+    // Each refresh makes one snapshot current, so this ends after at most
+    // size() refreshes.
+    while( ! heap_.empty() && ! (heap_.front().first == heap_.front().second->second) )
+      {
+	std::pop_heap( heap_.begin(), heap_.end(), SnapshotGreater() );
+	heap_.back().first = heap_.back().second->second;
+	std::push_heap( heap_.begin(), heap_.end(), SnapshotGreater() );
+      }
+  }
+
+  template <typename K, typename V, typename Hash, typename Pred>
+  void SpaceSavingMap<K, V, Hash, Pred>::rebuildHeap()
+  {
+    heap_.clear();
+    heap_.reserve( map_.size() );
+    for( iterator i(map_.begin()); i != map_.end(); ++i )
+      heap_.push_back( Snapshot_t( i->second, &*i ) );
+    std::make_heap( heap_.begin(), heap_.end(), SnapshotGreater() );
+  }
+
+}; // namespace Counters
+
+#endif // __SPACE_SAVING_MAP_IMPL_HPP__
@@ -0,0 +1,312 @@
+#ifndef __COUNTERS_TEXT_INGESTION_IMPL_HPP__
+#define __COUNTERS_TEXT_INGESTION_IMPL_HPP__
+
+// See _Counter.IMPL.hpp for why the header is included here.
+#include "Counters/TextIngestion.hpp"
+#include "Counters/CounterMapReduction.hpp"
+#include "Counters/details/_MappedFile.hpp"
+#include "Counters/details/_Parallel.hpp"
+#include "AnyMap/details/_KeyView.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <type_traits>
+
+namespace Counters
+{
+  namespace details
+  {
+    // Whitespace of the "C" locale.
+    inline bool isTextSpace( char c ) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    // The start of the n-th token before pos (or of the first one in
+    // [base, pos) if there are fewer), or pos if n is 0.
+    inline char const* precedingTokens( char const* base, char const* pos, std::size_t n )
+    {
+      char const* start( pos );
+      for( char const* p(pos); n > 0; --n )
+	{
+	  while( p > base && isTextSpace( p[-1] ) )
+	    --p;
+	  if( p == base )
+	    break;
+	  while( p > base && !isTextSpace( p[-1] ) )
+	    --p;
+	  start = p;
+	}
+      return start;
+    }
+
+    // The boundaries of the chunks of about chunkSize bytes of [begin, end),
+    // cut at whitespace.
+    inline std::vector<char const*> textChunks( char const* begin, char const* end, std::size_t chunkSize )
+    {
+      std::vector<char const*> bounds( 1, begin );
+      for( char const* p(begin); static_cast<std::size_t>(end - p) > chunkSize; )
+	{
+	  char const* q( p + chunkSize );
+	  while( q < end && !isTextSpace(*q) )
+	    ++q;
+	  if( q == end )
+	    break;
+	  bounds.push_back( q );
+	  p = q;
+	}
+      bounds.push_back( end );
+      return bounds;
+    }
+
+    inline std::size_t ingestionThreads( IngestionOptions const& options, std::size_t chunks )
+    {
+      std::size_t threads( options.threads > 0 ? options.threads : std::thread::hardware_concurrency() );
+      return std::max<std::size_t>( 1, std::min( threads, chunks ) );
+    }
+
+    // Reads the stream in buffers and calls scan(base, begin, end) for the
+    // complete tokens of the buffer, keeping the tokens which are the
+    // context of the next ones (and the incomplete last token) for the next
+    // read.
+    template <typename Scan>
+    bool scanStream( std::istream& is, std::size_t contextTokens, std::size_t bufferSize, Scan scan )
+    {
+      std::vector<char> buffer( std::max<std::size_t>( bufferSize, 64 ) );
+      std::size_t filled(0), counted(0);
+      for(;;)
+	{
+	  if( filled == buffer.size() )
+	    buffer.resize( 2 * buffer.size() );
+	  is.read( buffer.data() + filled, buffer.size() - filled );
+	  filled += is.gcount();
+	  char const* const data( buffer.data() );
+	  if( !is )
+	    {
+	      scan( data, data + counted, data + filled );
+	      return !is.bad();
+	    }
+
+	  std::size_t fence( filled );
+	  while( fence > counted && !isTextSpace( data[fence - 1] ) )
+	    --fence;
+	  if( fence == counted )
+	    continue;
+	  --fence;
+	  scan( data, data + counted, data + fence );
+
+	  const std::size_t keep( precedingTokens( data, data + fence, contextTokens ) - data );
+	  std::memmove( buffer.data(), data + keep, filled - keep );
+	  counted = fence - keep;
+	  filled -= keep;
+	}
+    }
+
+    template <typename K, typename V>
+    struct IsTextIngestible : std::integral_constant<bool,
+      MapTypeErasure::IsKeyLike<K, boost::string_view>::value &&
+      MapTypeErasure::IsKeyLike<V, boost::string_view>::value> {};
+  };
+
+  //----------------------------- Tokenizing -----------------------------------
+
+  template <typename F>
+  void forEachToken( char const* begin, char const* end, F f )
+  {
+    for( char const* p(begin); ; )
+      {
+	while( p < end && details::isTextSpace(*p) )
+	  ++p;
+	if( p == end )
+	  return;
+	char const* q( p );
+	while( q < end && !details::isTextSpace(*q) )
+	  ++q;
+	f( boost::string_view( p, q - p ) );
+	p = q;
+      }
+  }
+
+  inline NgramScanner::NgramScanner( std::size_t order, bool lowercase )
+    : order_( order > 0 ? order : 1 ), lowercase_( lowercase ), pushed_(0),
+      window_(), lowered_( lowercase ? order_ : 0 ), joined_()
+  {
+    window_.reserve( order_ );
+  }
+
+  template <typename F>
+  void NgramScanner::transitions( char const* base, char const* begin, char const* end, F f )
+  {
+    if( order_ < 2 )
+      return;
+    scan( base, begin, end, [this, &f]() { f( join( 0, order_ - 1 ), window_.back() ); } );
+  }
+
+  template <typename F>
+  void NgramScanner::ngrams( char const* base, char const* begin, char const* end, F f )
+  {
+    scan( base, begin, end, [this, &f]() { f( join( 0, order_ ) ); } );
+  }
+
+  template <typename F>
+  void NgramScanner::scan( char const* base, char const* begin, char const* end, F f )
+  {
+    window_.clear();
+    pushed_ = 0;
+    forEachToken( details::precedingTokens( base, begin, order_ - 1 ), begin,
+		  [this](boost::string_view token) { push( token ); } );
+    forEachToken( begin, end, [this, &f](boost::string_view token) {
+	push( token );
+	if( window_.size() == order_ )
+	  f();
+      } );
+  }
+
+  inline void NgramScanner::push( boost::string_view token )
+  {
+    if( window_.size() == order_ )
+      window_.erase( window_.begin() );
+    if( lowercase_ )
+      {
+	std::string& lowered( lowered_[pushed_ % order_] );
+	lowered.assign( token.data(), token.size() );
+	for( std::string::iterator i(lowered.begin()); i != lowered.end(); ++i )
+	  if( *i >= 'A' && *i <= 'Z' )
+	    *i += 'a' - 'A';
+	token = boost::string_view( lowered.data(), lowered.size() );
+      }
+    window_.push_back( token );
+    ++pushed_;
+  }
+
+  inline boost::string_view NgramScanner::join( std::size_t first, std::size_t count )
+  {
+    if( count == 1 )
+      return window_[first];
+    joined_.assign( window_[first].data(), window_[first].size() );
+    for( std::size_t i = first + 1; i < first + count; ++i )
+      {
+	joined_ += ' ';
+	joined_.append( window_[i].data(), window_[i].size() );
+      }
+    return boost::string_view( joined_.data(), joined_.size() );
+  }
+
+  //----------------------------- Ingestion ------------------------------------
+
+  template <typename K, typename V>
+  void ingestText( char const* begin, char const* end, CounterMap<K, V>& counterMap,
+		   IngestionOptions const& options )
+  {
+    static_assert( details::IsTextIngestible<K, V>::value, "K and V need boost::string_view key views" );
+    const std::vector<char const*> bounds( details::textChunks( begin, end, options.chunkSize ) );
+    const std::size_t chunks( bounds.size() - 1 );
+    const std::size_t threads( details::ingestionThreads( options, chunks ) );
+    if( threads == 1 )
+      {
+	NgramScanner scanner( options.order, options.lowercase );
+	scanner.transitions( begin, begin, end, [&counterMap](boost::string_view context, boost::string_view token) {
+	    counterMap.incrementCount( context, token, 1 );
+	  } );
+	return;
+      }
+
+    std::atomic<std::size_t> next(0);
+    counterMap += parallelCount<K, V>( threads, [&](std::size_t, CounterMap<K, V>& local) {
+	NgramScanner scanner( options.order, options.lowercase );
+	for( std::size_t i = next++; i < chunks; i = next++ )
+	  scanner.transitions( begin, bounds[i], bounds[i + 1],
+			       [&local](boost::string_view context, boost::string_view token) {
+				 local.incrementCount( context, token, 1 );
+			       } );
+      } );
+  }
+
+  template <typename V, typename CoreMap>
+  void ingestText( char const* begin, char const* end, Counter<V, CoreMap>& counter,
+		   IngestionOptions const& options )
+  {
+    static_assert( details::IsTextIngestible<V, V>::value, "V needs a boost::string_view key view" );
+    const std::vector<char const*> bounds( details::textChunks( begin, end, options.chunkSize ) );
+    const std::size_t chunks( bounds.size() - 1 );
+    const std::size_t threads( details::ingestionThreads( options, chunks ) );
+    if( threads == 1 )
+      {
+	NgramScanner scanner( options.order, options.lowercase );
+	scanner.ngrams( begin, begin, end, [&counter](boost::string_view ngram) {
+	    counter.incrementCount( ngram, 1 );
+	  } );
+	return;
+      }
+
+    std::atomic<std::size_t> next(0);
+    std::vector< Counter<V, CoreMap> > locals( threads );
+    details::parallelFor( threads, threads, [&](std::size_t w) {
+	NgramScanner scanner( options.order, options.lowercase );
+	Counter<V, CoreMap>& local( locals[w] );
+	for( std::size_t i = next++; i < chunks; i = next++ )
+	  scanner.ngrams( begin, bounds[i], bounds[i + 1], [&local](boost::string_view ngram) {
+	      local.incrementCount( ngram, 1 );
+	    } );
+      } );
+    for( std::size_t w = 0; w < threads; ++w )
+      counter += locals[w];
+  }
+
+  template <typename K, typename V>
+  bool ingestStream( std::istream& is, CounterMap<K, V>& counterMap, IngestionOptions const& options )
+  {
+    static_assert( details::IsTextIngestible<K, V>::value, "K and V need boost::string_view key views" );
+    NgramScanner scanner( options.order, options.lowercase );
+    return details::scanStream( is, options.order - 1, options.chunkSize,
+				[&](char const* base, char const* begin, char const* end) {
+	scanner.transitions( base, begin, end, [&counterMap](boost::string_view context, boost::string_view token) {
+	    counterMap.incrementCount( context, token, 1 );
+	  } );
+      } );
+  }
+
+  template <typename V, typename CoreMap>
+  bool ingestStream( std::istream& is, Counter<V, CoreMap>& counter, IngestionOptions const& options )
+  {
+    static_assert( details::IsTextIngestible<V, V>::value, "V needs a boost::string_view key view" );
+    NgramScanner scanner( options.order, options.lowercase );
+    return details::scanStream( is, options.order - 1, options.chunkSize,
+				[&](char const* base, char const* begin, char const* end) {
+	scanner.ngrams( base, begin, end, [&counter](boost::string_view ngram) {
+	    counter.incrementCount( ngram, 1 );
+	  } );
+      } );
+  }
+
+  template <typename K, typename V>
+  bool ingestFile( std::string const& path, CounterMap<K, V>& counterMap, IngestionOptions const& options )
+  {
+    details::MappedFile file;
+    if( file.open( path ) )
+      {
+	file.adviseSequential();
+	ingestText( file.data(), file.data() + file.size(), counterMap, options );
+	return true;
+      }
+    std::ifstream is( path.c_str(), std::ios::binary );
+    return is && ingestStream( is, counterMap, options );
+  }
+
+  template <typename V, typename CoreMap>
+  bool ingestFile( std::string const& path, Counter<V, CoreMap>& counter, IngestionOptions const& options )
+  {
+    details::MappedFile file;
+    if( file.open( path ) )
+      {
+	file.adviseSequential();
+	ingestText( file.data(), file.data() + file.size(), counter, options );
+	return true;
+      }
+    std::ifstream is( path.c_str(), std::ios::binary );
+    return is && ingestStream( is, counter, options );
+  }
+
+};
+
+#endif // __COUNTERS_TEXT_INGESTION_IMPL_HPP__
@@ -7,6 +7,9 @@
 // ================
 //
 // 27 Dec 2006 (Thomas Becker) Created
+// 14 Oct 2026 Small wrappers are stored in place instead of on the heap, so
+// that constructing, copying and destroying an any_iterator around a typical
+// container iterator does not allocate.
 
 #ifndef ANY_ITERATOR_01102007TMB_HPP
 #define ANY_ITERATOR_01102007TMB_HPP
@@ -17,12 +20,14 @@
 #include "detail/any_iterator_abstract_base.hpp"
 #include "detail/any_iterator_wrapper.hpp"
 #include "detail/any_iterator_metafunctions.hpp"
+#include "detail/any_iterator_small_buffer.hpp"
 #include <boost/iterator/iterator_facade.hpp>
 #include <boost/utility/enable_if.hpp>
 #include <boost/mpl/bool.hpp>
 #include <boost/mpl/and.hpp>
 #include <boost/mpl/not.hpp>
 #include <boost/static_assert.hpp>
+#include <functional>
 
 namespace IteratorTypeErasure
 {
@@ -36,6 +41,10 @@ namespace IteratorTypeErasure
   // boost::any::placeholder ==> any_iterator_abstract_base
   // boost::any::holder      ==> any_iterator_wrapper
   //
+  // Wrappers that fit into ANY_ITERATOR_SMALL_BUFFER_SIZE bytes are kept in a
+  // buffer inside the any_iterator itself; m_pointer_to_impl then points into
+  // that buffer. Larger wrappers are allocated on the heap.
+  //
   template<
     class Value,
     class CategoryOrTraversal,
@@ -125,7 +134,7 @@ namespace IteratorTypeErasure
     {
       if( rhs.m_pointer_to_impl )
       {
-        m_pointer_to_impl = rhs.m_pointer_to_impl->clone();
+        m_pointer_to_impl = rhs.m_pointer_to_impl->clone(&m_buffer);
       }
       else
       {
@@ -133,12 +142,56 @@ namespace IteratorTypeErasure
       }
     }
 
+    // A heap-allocated wrapper is stolen, an in-place one is copied into this
+    // iterator's own buffer.
+    any_iterator(any_iterator && rhs) : super_type(rhs)
+    {
+      if( rhs.m_pointer_to_impl == NULL )
+      {
+        m_pointer_to_impl = NULL;
+      }
+      else if( rhs.is_stored_in_place() )
+      {
+        m_pointer_to_impl = rhs.m_pointer_to_impl->clone(&m_buffer);
+      }
+      else
+      {
+        m_pointer_to_impl = rhs.m_pointer_to_impl;
+        rhs.m_pointer_to_impl = NULL;
+      }
+    }
+
     any_iterator& operator=(any_iterator const & rhs)
     {
       if(this != &rhs)
       {
-        any_iterator tmp(rhs);
-        swap(tmp);
+        destroy_impl();
+        if( rhs.m_pointer_to_impl )
+        {
+          m_pointer_to_impl = rhs.m_pointer_to_impl->clone(&m_buffer);
+        }
+      }
+
+      return *this;
+    }
+
+    any_iterator& operator=(any_iterator && rhs)
+    {
+      if(this != &rhs)
+      {
+        destroy_impl();
+        if( rhs.m_pointer_to_impl == NULL )
+        {
+        }
+        else if( rhs.is_stored_in_place() )
+        {
+          m_pointer_to_impl = rhs.m_pointer_to_impl->clone(&m_buffer);
+        }
+        else
+        {
+          m_pointer_to_impl = rhs.m_pointer_to_impl;
+          rhs.m_pointer_to_impl = NULL;
+        }
       }
 
       return *this;
@@ -187,7 +240,7 @@ namespace IteratorTypeErasure
         Difference
       > wrapper_type;
 
-      m_pointer_to_impl = wrapper_type::create(wrapped_iterator);
+      m_pointer_to_impl = wrapper_type::create(wrapped_iterator, &m_buffer);
     }
 
     // Assignment from wrapped iterator. The enable_if condition defines
@@ -207,8 +260,17 @@ namespace IteratorTypeErasure
     >::type &
     operator=(WrappedIterator const & wrapped_iterator)
     {
-      any_iterator tmp(wrapped_iterator);
-      swap(tmp);
+      typedef
+        detail::any_iterator_wrapper<
+        WrappedIterator,
+        Value,
+        Traversal,
+        Reference,
+        Difference
+      > wrapper_type;
+
+      destroy_impl();
+      m_pointer_to_impl = wrapper_type::create(wrapped_iterator, &m_buffer);
       return *this;
     }
 
@@ -219,7 +281,7 @@ namespace IteratorTypeErasure
       const_type_with_const_value_type conversion_result;
       if( m_pointer_to_impl )
       {
-        conversion_result.m_pointer_to_impl = m_pointer_to_impl->make_const_clone_with_const_value_type();
+        conversion_result.m_pointer_to_impl = m_pointer_to_impl->make_const_clone_with_const_value_type(&conversion_result.m_buffer);
       }
       return conversion_result;
     }
@@ -231,7 +293,7 @@ namespace IteratorTypeErasure
       const_type_with_non_const_value_type conversion_result;
       if( m_pointer_to_impl )
       {
-        conversion_result.m_pointer_to_impl = m_pointer_to_impl->make_const_clone_with_non_const_value_type();
+        conversion_result.m_pointer_to_impl = m_pointer_to_impl->make_const_clone_with_non_const_value_type(&conversion_result.m_buffer);
       }
       return conversion_result;
     }
@@ -270,14 +332,14 @@ namespace IteratorTypeErasure
       if( m_pointer_to_impl )
       {
         typename boost::iterator_category_to_traversal<TargetTraversal>::type* funcSelector = NULL;
-        conversion_result.m_pointer_to_impl = make_traversal_converted_version(funcSelector);
+        conversion_result.m_pointer_to_impl = make_traversal_converted_version(funcSelector, &conversion_result.m_buffer);
       }
       return conversion_result;
       }
     
     ~any_iterator()
     {
-      delete m_pointer_to_impl;
+      destroy_impl();
     }
 
   private:
@@ -355,18 +417,49 @@ namespace IteratorTypeErasure
     {
       // NOTE: iterator_facade doesn't have a swap method, so no call
       // to base class here.
-      std::swap(m_pointer_to_impl, other.m_pointer_to_impl);
+      if( !is_stored_in_place() && !other.is_stored_in_place() )
+      {
+        std::swap(m_pointer_to_impl, other.m_pointer_to_impl);
+      }
+      else
+      {
+        any_iterator tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+      }
       return *this;
     }
 
+    bool is_stored_in_place() const
+    {
+      char const* impl = reinterpret_cast<char const*>(m_pointer_to_impl);
+      char const* buffer = reinterpret_cast<char const*>(&m_buffer);
+      return m_pointer_to_impl != NULL &&
+        !std::less<char const*>()(impl, buffer) &&
+        std::less<char const*>()(impl, buffer + sizeof(m_buffer));
+    }
+
+    void destroy_impl()
+    {
+      if( is_stored_in_place() )
+      {
+        m_pointer_to_impl->~abstract_base_type();
+      }
+      else
+      {
+        delete m_pointer_to_impl;
+      }
+      m_pointer_to_impl = NULL;
+    }
+
     detail::any_iterator_abstract_base<
       Value,
       boost::incrementable_traversal_tag,
       Reference,
       Difference
-    >* make_traversal_converted_version(boost::incrementable_traversal_tag* funcSelector) const
+    >* make_traversal_converted_version(boost::incrementable_traversal_tag* funcSelector, void* storage) const
     {
-      return m_pointer_to_impl->make_incrementable_version();
+      return m_pointer_to_impl->make_incrementable_version(storage);
     }
 
     detail::any_iterator_abstract_base<
@@ -374,9 +467,9 @@ namespace IteratorTypeErasure
       boost::single_pass_traversal_tag,
       Reference,
       Difference
-    >* make_traversal_converted_version(boost::single_pass_traversal_tag* funcSelector) const
+    >* make_traversal_converted_version(boost::single_pass_traversal_tag* funcSelector, void* storage) const
     {
-      return m_pointer_to_impl->make_single_pass_version();
+      return m_pointer_to_impl->make_single_pass_version(storage);
     }
 
     detail::any_iterator_abstract_base<
@@ -384,9 +477,9 @@ namespace IteratorTypeErasure
       boost::forward_traversal_tag,
       Reference,
       Difference
-    >* make_traversal_converted_version(boost::forward_traversal_tag* funcSelector) const
+    >* make_traversal_converted_version(boost::forward_traversal_tag* funcSelector, void* storage) const
     {
-      return m_pointer_to_impl->make_forward_version();
+      return m_pointer_to_impl->make_forward_version(storage);
     }
 
     detail::any_iterator_abstract_base<
@@ -394,12 +487,13 @@ namespace IteratorTypeErasure
       boost::bidirectional_traversal_tag,
       Reference,
       Difference
-    >* make_traversal_converted_version(boost::bidirectional_traversal_tag* funcSelector) const
+    >* make_traversal_converted_version(boost::bidirectional_traversal_tag* funcSelector, void* storage) const
     {
-      return m_pointer_to_impl->make_bidirectional_version();
+      return m_pointer_to_impl->make_bidirectional_version(storage);
     }
 
     abstract_base_type* m_pointer_to_impl;
+    detail::any_iterator_small_buffer m_buffer;
 
   };
 
@@ -7,6 +7,9 @@
 // ================
 //
 // 27 Dec 2006 (Thomas Becker) Created
+// 14 Oct 2026 Clone functions take the storage to construct the clone in, so
+// that any_iterator can keep small wrappers in place (see
+// any_iterator_small_buffer.hpp).
 
 #ifndef ANY_ITERATOR_ABSTRACT_BASE_01102007TMB_HPP
 #define ANY_ITERATOR_ABSTRACT_BASE_01102007TMB_HPP
@@ -92,11 +95,16 @@ namespace IteratorTypeErasure
     public:
 
       // Plain clone function for copy construction and assignment.
-      virtual clone_result_type * clone() const=0;
+      //
+      // All clone functions construct the clone in the any_iterator_small_buffer
+      // pointed to by storage if it fits there, and on the heap otherwise. A
+      // clone constructed in storage must be destroyed by an explicit destructor
+      // call rather than by delete.
+      virtual clone_result_type * clone(void* storage = NULL) const=0;
   
       // Clone functions for conversion to a const iterator
-      virtual const_clone_with_const_value_type_result_type * make_const_clone_with_const_value_type() const=0;
-      virtual const_clone_with_non_const_value_type_result_type * make_const_clone_with_non_const_value_type() const=0;
+      virtual const_clone_with_const_value_type_result_type * make_const_clone_with_const_value_type(void* storage = NULL) const=0;
+      virtual const_clone_with_non_const_value_type_result_type * make_const_clone_with_non_const_value_type(void* storage = NULL) const=0;
 
       // gcc 3.4.2 does not like pure virtual declaration with inline definition,
       // so I make the destructor non-pure just to spite them.
@@ -141,7 +149,7 @@ namespace IteratorTypeErasure
         boost::incrementable_traversal_tag,
         Reference,
         Difference
-      >* make_incrementable_version() const=0;
+      >* make_incrementable_version(void* storage = NULL) const=0;
     };
 
     ///////////////////////////////////////////////////////////////////////
@@ -172,7 +180,7 @@ namespace IteratorTypeErasure
         boost::single_pass_traversal_tag,
         Reference,
         Difference
-      >* make_single_pass_version() const=0;
+      >* make_single_pass_version(void* storage = NULL) const=0;
     };
 
     ///////////////////////////////////////////////////////////////////////
@@ -207,7 +215,7 @@ namespace IteratorTypeErasure
         boost::forward_traversal_tag,
         Reference,
         Difference
-      >* make_forward_version() const=0;
+      >* make_forward_version(void* storage = NULL) const=0;
     };
 
     ///////////////////////////////////////////////////////////////////////
@@ -245,7 +253,7 @@ namespace IteratorTypeErasure
         boost::bidirectional_traversal_tag,
         Reference,
         Difference
-      >* make_bidirectional_version() const=0;
+      >* make_bidirectional_version(void* storage = NULL) const=0;
     };
 
   } // end namespace detail
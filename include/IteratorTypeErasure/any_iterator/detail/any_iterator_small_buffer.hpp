@@ -0,0 +1,87 @@
+//  (C) Copyright Thomas Becker 2005. Permission to copy, use, modify, sell and
+//  distribute this software is granted provided this copyright notice appears
+//  in all copies. This software is provided "as is" without express or implied
+//  warranty, and with no claim as to its suitability for any purpose.
+
+// File Name
+// =========
+//
+// any_iterator_small_buffer.hpp
+
+// Description
+// ===========
+//
+// In-place storage for the wrappers held by an any_iterator. Wrappers whose
+// size and alignment fit the buffer are constructed inside the any_iterator
+// object itself; all others are allocated on the heap as before.
+
+#ifndef ANY_ITERATOR_SMALL_BUFFER_01102007TMB_HPP
+#define ANY_ITERATOR_SMALL_BUFFER_01102007TMB_HPP
+
+// Revision History
+// ================
+//
+// 14 Oct 2026 Created
+
+// Includes
+// ========
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/mpl/bool.hpp>
+#include <cstddef>
+#include <new>
+
+// The number of bytes each any_iterator reserves for in-place storage of its
+// wrapper. The default leaves room for the vtable pointer plus up to three
+// pointers of wrapped iterator state, which covers the iterators of std::map
+// and boost::unordered_map. Define this before including any_iterator.hpp to
+// change it.
+#ifndef ANY_ITERATOR_SMALL_BUFFER_SIZE
+#define ANY_ITERATOR_SMALL_BUFFER_SIZE (4 * sizeof(void*))
+#endif
+
+namespace IteratorTypeErasure
+{
+
+  namespace detail
+  {
+
+    typedef boost::aligned_storage<ANY_ITERATOR_SMALL_BUFFER_SIZE>::type any_iterator_small_buffer;
+
+    ///////////////////////////////////////////////////////////////////////
+    //
+    // Metafunction that tells whether an object of type T can be constructed
+    // in an any_iterator_small_buffer.
+    //
+    template<class T>
+    struct fits_any_iterator_small_buffer : public boost::mpl::bool_<
+      sizeof(T) <= sizeof(any_iterator_small_buffer) &&
+      boost::alignment_of<any_iterator_small_buffer>::value % boost::alignment_of<T>::value == 0
+    >
+    {};
+
+    template<class T, class Arg>
+    T* construct_in_small_buffer(void* storage, Arg const& arg, boost::mpl::true_)
+    {
+      return storage ? new (storage) T(arg) : new T(arg);
+    }
+
+    template<class T, class Arg>
+    T* construct_in_small_buffer(void*, Arg const& arg, boost::mpl::false_)
+    {
+      return new T(arg);
+    }
+
+    // Constructs a T from arg inside the buffer pointed to by storage if T fits
+    // there, on the heap otherwise (or if storage is NULL).
+    template<class T, class Arg>
+    T* construct_in_small_buffer(void* storage, Arg const& arg)
+    {
+      return construct_in_small_buffer<T>(storage, arg, typename fits_any_iterator_small_buffer<T>::type());
+    }
+
+  } // end namespace detail
+
+} // end namespace IteratorTypeErasure
+
+#endif // ANY_ITERATOR_SMALL_BUFFER_01102007TMB_HPP
@@ -10,6 +10,8 @@
 // 12 Jul 2010 (Thomas Becker acting on bug report by Edgar Binder)
 // Bug fix: Constructors and create function of <code>any_iterator_wrapper</code>
 // from wrapped iterator must take their argument by const reference (performance!).
+// 14 Oct 2026 Wrappers are constructed in the storage passed to create and the
+// clone functions whenever they fit (see any_iterator_small_buffer.hpp).
 
 #ifndef ANY_ITERATOR_WRAPPER_01102007TMB_HPP
 #define ANY_ITERATOR_WRAPPER_01102007TMB_HPP
@@ -19,6 +21,7 @@
 
 #include "any_iterator_abstract_base.hpp"
 #include "any_iterator_metafunctions.hpp"
+#include "any_iterator_small_buffer.hpp"
 #include <boost/type_traits/add_const.hpp>
 #include <boost/type_traits/remove_const.hpp>
 #include <boost/cast.hpp>
@@ -118,26 +121,26 @@ namespace IteratorTypeErasure
         m_wrapped_iterator(wrapped_iterator)
       {}
 
-      static abstract_base_type* create(WrappedIterator const& wrapped_iterator)
+      static abstract_base_type* create(WrappedIterator const& wrapped_iterator, void* storage = NULL)
       {
-        return new clone_type(wrapped_iterator);
+        return construct_in_small_buffer<clone_type>(storage, wrapped_iterator);
       }
 
       // Plain clone function for copy construction and assignment.
-      virtual clone_result_type * clone() const
+      virtual clone_result_type * clone(void* storage = NULL) const
       {
-        return new clone_type(m_wrapped_iterator);
+        return construct_in_small_buffer<clone_type>(storage, m_wrapped_iterator);
       }
   
       // Clone functions for conversion to a const iterator
-      virtual const_clone_with_const_value_type_result_type* make_const_clone_with_const_value_type() const
+      virtual const_clone_with_const_value_type_result_type* make_const_clone_with_const_value_type(void* storage = NULL) const
       {
-        return new const_clone_type_with_const_value_type(m_wrapped_iterator);
+        return construct_in_small_buffer<const_clone_type_with_const_value_type>(storage, m_wrapped_iterator);
       }
       //
-      virtual const_clone_with_non_const_value_type_result_type* make_const_clone_with_non_const_value_type() const
+      virtual const_clone_with_non_const_value_type_result_type* make_const_clone_with_non_const_value_type(void* storage = NULL) const
       {
-        return new const_clone_type_with_non_const_value_type(m_wrapped_iterator);
+        return construct_in_small_buffer<const_clone_type_with_non_const_value_type>(storage, m_wrapped_iterator);
       }
       
       virtual Reference dereference() const
@@ -225,15 +228,15 @@ namespace IteratorTypeErasure
         boost::incrementable_traversal_tag,
         Reference,
         Difference
-      >* make_incrementable_version() const
+      >* make_incrementable_version(void* storage = NULL) const
       {
-        return new any_iterator_wrapper<
+        return construct_in_small_buffer<any_iterator_wrapper<
           WrappedIterator,
           Value,
           boost::incrementable_traversal_tag,
           Reference,
           Difference
-        >(this->get_wrapped_iterator());
+        > >(storage, this->get_wrapped_iterator());
       }
     };
 
@@ -286,15 +289,15 @@ namespace IteratorTypeErasure
         boost::single_pass_traversal_tag,
         Reference,
         Difference
-      >* make_single_pass_version() const
+      >* make_single_pass_version(void* storage = NULL) const
       {
-        return new any_iterator_wrapper<
+        return construct_in_small_buffer<any_iterator_wrapper<
           WrappedIterator,
           Value,
           boost::single_pass_traversal_tag,
           Reference,
           Difference
-        >(this->get_wrapped_iterator());
+        > >(storage, this->get_wrapped_iterator());
       }
     };
 
@@ -352,15 +355,15 @@ namespace IteratorTypeErasure
         boost::forward_traversal_tag,
         Reference,
         Difference
-      >* make_forward_version() const
+      >* make_forward_version(void* storage = NULL) const
       {
-        return new any_iterator_wrapper<
+        return construct_in_small_buffer<any_iterator_wrapper<
           WrappedIterator,
           Value,
           boost::forward_traversal_tag,
           Reference,
           Difference
-        >(this->get_wrapped_iterator());
+        > >(storage, this->get_wrapped_iterator());
       }
     };
 
@@ -424,15 +427,15 @@ namespace IteratorTypeErasure
         boost::bidirectional_traversal_tag,
         Reference,
         Difference
-      >* make_bidirectional_version() const
+      >* make_bidirectional_version(void* storage = NULL) const
       {
-        return new any_iterator_wrapper<
+        return construct_in_small_buffer<any_iterator_wrapper<
           WrappedIterator,
           Value,
           boost::bidirectional_traversal_tag,
           Reference,
           Difference
-        >(this->get_wrapped_iterator());
+        > >(storage, this->get_wrapped_iterator());
       }
     };
 
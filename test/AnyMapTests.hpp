@@ -2,7 +2,11 @@
 #define __ANY_MAP_TESTS_HPP__
 
 #include "AnyMap/AnyMap.hpp"
+#include "AnyMap/Arena.hpp"
+#include "AnyMap/SortedVectorMap.hpp"
+#include "AnyMap/StaticMap.hpp"
 #include <boost/unordered_map.hpp>
+#include <boost/lexical_cast.hpp>
 #include <map>
 
 class AnyMapTests : public ::testing::Test
@@ -210,4 +214,479 @@ TEST_F(AnyMapTests, APIs)
 
 }
 
+TEST_F(AnyMapTests, InPlaceIterators)
+{
+  using namespace std;
+  using namespace IteratorTypeErasure;
+
+  cout << "- Wrapped map iterators fit in place." << endl;
+  typedef detail::any_iterator_wrapper<BoostMap::iterator, Map::value_type,
+    boost::forward_traversal_tag, Map::value_type&, std::ptrdiff_t> BoostWrapper;
+  typedef detail::any_iterator_wrapper<StlMap::const_iterator, Map::value_type const,
+    boost::forward_traversal_tag, Map::value_type const&, std::ptrdiff_t> StlConstWrapper;
+  EXPECT_TRUE( detail::fits_any_iterator_small_buffer<BoostWrapper>::value );
+  EXPECT_TRUE( detail::fits_any_iterator_small_buffer<StlConstWrapper>::value );
+
+  cout << "- Copies, conversions and assignments." << endl;
+  Map map1( boostMap );
+  Map::iterator i1( map1.find("one") );
+  Map::iterator i2( i1 );
+  Map::iterator i3( std::move(Map::iterator(map1.find("two"))) );
+  Map::const_iterator ci( i1 );
+  EXPECT_EQ( i1, i2 );
+  EXPECT_EQ( "one", ci->first );
+  EXPECT_EQ( "two", i3->first );
+  i2 = i3;
+  EXPECT_EQ( i2, i3 );
+  EXPECT_NE( i1, i2 );
+  i2 = Map::iterator( map1.end() );
+  EXPECT_EQ( map1.end(), i2 );
+
+  // iterate through copies to make sure no copy refers to another's storage
+  size_t howMany = 0;
+  for( Map::const_iterator i( map1.begin() ), e( map1.end() ); i != e; ) {
+    Map::const_iterator next( i );
+    ++next;
+    i = next;
+    ++howMany;
+  }
+  EXPECT_EQ( map1.size(), howMany );
+}
+
+TEST_F(AnyMapTests, InternalIteration)
+{
+  using namespace std;
+
+  Map map1( boostMap );
+  Map map2( stlMap );
+  const Map emptyMap( emptyStlMap );
+
+  cout << "- for_each." << endl;
+  double sum1 = 0, sum2 = 0;
+  size_t howMany = 0;
+  map1.for_each( [&sum1, &howMany](Map::value_type const& v) { sum1 += v.second; ++howMany; } );
+  map2.for_each( [&sum2](Map::value_type const& v) { sum2 += v.second; } );
+  EXPECT_EQ( 1 + 2 + 3 + 4, sum1 );
+  EXPECT_EQ( sum1, sum2 );
+  EXPECT_EQ( map1.size(), howMany );
+  emptyMap.for_each( [&howMany](Map::value_type const&) { ++howMany; } );
+  EXPECT_EQ( map1.size(), howMany );
+
+  cout << "- for_each_mut." << endl;
+  map1.for_each_mut( [](Map::value_type& v) { v.second *= 10; } );
+  EXPECT_EQ( 10, map1["one"] );
+  EXPECT_EQ( 40, map1["four"] );
+  EXPECT_NE( map1, map2 );
+  map2.for_each_mut( [](Map::value_type& v) { v.second *= 10; } );
+  EXPECT_EQ( map1, map2 );
+
+  cout << "- all_of." << endl;
+  EXPECT_TRUE( map1.all_of( [](Map::value_type const& v) { return v.second >= 10; } ) );
+  EXPECT_FALSE( map1.all_of( [](Map::value_type const& v) { return v.second > 10; } ) );
+  EXPECT_TRUE( emptyMap.all_of( [](Map::value_type const&) { return false; } ) );
+
+  howMany = 0;
+  map1.all_of( [&howMany](Map::value_type const&) { ++howMany; return false; } );
+  EXPECT_EQ( 1, howMany );
+}
+
+TEST_F(AnyMapTests, Emplacement)
+{
+  using namespace std;
+
+  Map map1( boostMap );
+  Map map2( stlMap );
+  Map map3( (std::map<K, V, std::greater<K> >()) );
+  map3.insert( map2.begin(), map2.end() );
+
+  Map* maps[] = { &map1, &map2, &map3 };
+  for( size_t m = 0; m < 3; ++m )
+    {
+      Map& map( *maps[m] );
+      const size_t size( map.size() );
+
+      cout << "- try_emplace (map " << m << ")." << endl;
+      std::pair<Map::iterator, bool> r( map.try_emplace( "one", 100.0 ) );
+      EXPECT_FALSE( r.second );
+      EXPECT_EQ( "one", r.first->first );
+      EXPECT_EQ( 1, r.first->second );
+
+      r = map.try_emplace( NEW_KEY, 100.0 );
+      EXPECT_TRUE( r.second );
+      EXPECT_EQ( NEW_KEY, r.first->first );
+      EXPECT_EQ( 100, map[NEW_KEY] );
+      EXPECT_EQ( size + 1, map.size() );
+
+      K movedKey( "moved" );
+      r = map.try_emplace( std::move(movedKey) );
+      EXPECT_TRUE( r.second );
+      EXPECT_EQ( 0, map["moved"] );
+
+      cout << "- emplace and insert of temporaries (map " << m << ")." << endl;
+      r = map.emplace( K("emplaced"), 5.0 );
+      EXPECT_TRUE( r.second );
+      EXPECT_EQ( 5, map["emplaced"] );
+      r = map.emplace( K("emplaced"), 6.0 );
+      EXPECT_FALSE( r.second );
+      EXPECT_EQ( 5, map["emplaced"] );
+
+      r = map.insert( Map::value_type("inserted", 7.0) );
+      EXPECT_TRUE( r.second );
+      EXPECT_EQ( 7, r.first->second );
+      EXPECT_EQ( size + 4, map.size() );
+    }
+
+  EXPECT_EQ( map1, map2 );
+  EXPECT_EQ( map2, map3 );
+}
+
+TEST_F(AnyMapTests, Capacity)
+{
+  using namespace std;
+
+  cout << "- reserve keeps the buckets while the map grows." << endl;
+  Map map1( emptyBoostMap );
+  map1.reserve( 1000 );
+  const Map::size_type buckets( map1.bucket_count() );
+  EXPECT_GT( buckets, 0u );
+  EXPECT_GE( buckets * map1.max_load_factor(), 1000 );
+  for( int i = 0; i < 1000; ++i )
+    map1[ boost::lexical_cast<K>(i) ] = i;
+  EXPECT_EQ( buckets, map1.bucket_count() );
+
+  cout << "- shrink_to_fit and rehash." << endl;
+  for( int i = 10; i < 1000; ++i )
+    map1.erase( boost::lexical_cast<K>(i) );
+  map1.shrink_to_fit();
+  EXPECT_LT( map1.bucket_count(), buckets );
+  EXPECT_EQ( 10, map1.size() );
+  EXPECT_EQ( 9, map1["9"] );
+  map1.rehash( 500 );
+  EXPECT_GE( map1.bucket_count(), 500u );
+
+  map1.max_load_factor( 0.5f );
+  EXPECT_FLOAT_EQ( 0.5f, map1.max_load_factor() );
+
+  cout << "- No-ops for maps without buckets." << endl;
+  Map map2( stlMap );
+  map2.reserve( 1000 );
+  map2.rehash( 1000 );
+  map2.shrink_to_fit();
+  map2.max_load_factor( 0.5f );
+  EXPECT_EQ( 0, map2.bucket_count() );
+  EXPECT_EQ( 0, map2.max_load_factor() );
+  EXPECT_EQ( Map(boostMap), map2 );
+}
+
+TEST_F(AnyMapTests, HeterogeneousLookup)
+{
+  using namespace std;
+
+  // Keys are slices of a single buffer, as produced by a tokenizer.
+  const char* const buffer = "one two xxxx five";
+  const boost::string_view one( buffer, 3 );
+  const boost::string_view two( buffer + 4, 3 );
+  const boost::string_view newKey( buffer + 8, 4 );
+  const boost::string_view five( buffer + 13, 4 );
+
+  Map map1( boostMap );
+  Map map2( stlMap );
+  Map* maps[] = { &map1, &map2 };
+  for( size_t m = 0; m < 2; ++m )
+    {
+      Map& map( *maps[m] );
+      const Map& constMap( map );
+
+      cout << "- find and count by key view (map " << m << ")." << endl;
+      EXPECT_EQ( 1, map.find(one)->second );
+      EXPECT_EQ( 2, constMap.find(two)->second );
+      EXPECT_EQ( 3, constMap.find("three")->second );
+      EXPECT_TRUE( map.find(newKey) == map.end() );
+      EXPECT_EQ( 1, constMap.count(one) );
+      EXPECT_EQ( 0, constMap.count(five) );
+
+      cout << "- try_emplace by key view (map " << m << ")." << endl;
+      std::pair<Map::iterator, bool> r( map.try_emplace( one, 100.0 ) );
+      EXPECT_FALSE( r.second );
+      EXPECT_EQ( 1, r.first->second );
+      r = map.try_emplace( newKey, 100.0 );
+      EXPECT_TRUE( r.second );
+      EXPECT_EQ( NEW_KEY, r.first->first );
+      EXPECT_EQ( 100, map[NEW_KEY] );
+      r = map.try_emplace( five );
+      EXPECT_TRUE( r.second );
+      EXPECT_EQ( 0, map.at("five") );
+      EXPECT_EQ( boostMap.size() + 2, map.size() );
+    }
+  EXPECT_EQ( map1, map2 );
+}
+
+// A map too large to be stored within AnyMap.
+struct PaddedStlMap : std::map<std::string, double>
+{
+  char padding[ MapTypeErasure::AnyMap<std::string, double>::INLINE_MODEL_SIZE ];
+};
+
+TEST_F(AnyMapTests, InlineStorage)
+{
+  using namespace std;
+
+  cout << "- Copies and moves of inline and heap maps." << endl;
+  PaddedStlMap padded;
+  padded.insert( extraMap.begin(), extraMap.end() );
+  Map inline1( boostMap ), heap1( padded );
+  Map inline2( inline1 ), heap2( heap1 );
+  EXPECT_EQ( Map(boostMap), inline2 );
+  EXPECT_EQ( Map(extraMap), heap2 );
+  Map inline3( std::move(inline2) ), heap3( std::move(heap2) );
+  EXPECT_EQ( Map(boostMap), inline3 );
+  EXPECT_EQ( Map(extraMap), heap3 );
+  EXPECT_TRUE( inline2.empty() );
+
+  cout << "- Swaps between inline and heap maps." << endl;
+  inline3.swap( heap3 );
+  EXPECT_EQ( Map(extraMap), inline3 );
+  EXPECT_EQ( Map(boostMap), heap3 );
+  inline3[NEW_KEY] = 1;
+  heap3[NEW_KEY] = 2;
+  EXPECT_EQ( 2, heap3.at(NEW_KEY) );
+  heap3.swap( inline1 );
+  EXPECT_EQ( 2, inline1.at(NEW_KEY) );
+  EXPECT_EQ( Map(boostMap), heap3 );
+  Map stl( stlMap );
+  stl.swap( heap3 );
+  EXPECT_EQ( Map(boostMap), stl );
+  inline1 = heap1;
+  EXPECT_EQ( Map(extraMap), inline1 );
+  heap1 = Map( boostMap );
+  EXPECT_EQ( Map(boostMap), heap1 );
+}
+
+TEST_F(AnyMapTests, Arena)
+{
+  using namespace std;
+
+  cout << "- Small blocks are reused by size class." << endl;
+  MapTypeErasure::Arena arena( 1024 );
+  void* a( arena.allocate(24) );
+  void* b( arena.allocate(20) );
+  EXPECT_EQ( 0u, reinterpret_cast<std::size_t>(a) % MapTypeErasure::Arena::ALIGNMENT );
+  EXPECT_EQ( 64, arena.bytesUsed() );
+  arena.deallocate( a, 24 );
+  EXPECT_EQ( a, arena.allocate(32) );
+  EXPECT_NE( b, arena.allocate(16) );
+  EXPECT_EQ( 1, arena.chunkCount() );
+  arena.allocate( 4096 );
+  EXPECT_EQ( 2, arena.chunkCount() );
+
+  cout << "- Maps with an ArenaAllocator." << endl;
+  typedef MapTypeErasure::ArenaAllocator<Map::value_type> Allocator_t;
+  typedef boost::unordered_map<K, V, boost::hash<K>, std::equal_to<K>, Allocator_t> ArenaMap_t;
+  ArenaMap_t arenaMap( 0, boost::hash<K>(), std::equal_to<K>(), Allocator_t(&arena) );
+  arenaMap.insert( boostMap.begin(), boostMap.end() );
+  Map map1( std::move(arenaMap) );
+  EXPECT_EQ( Map(boostMap), map1 );
+  const std::size_t used( arena.bytesUsed() );
+  map1[NEW_KEY] = 1;
+  EXPECT_GT( arena.bytesUsed(), used );
+  const std::size_t usedByMap1( arena.bytesUsed() );
+  Map map2( map1 );
+  map2[ NEW_KEY + NEW_KEY ] = 2;
+  EXPECT_EQ( usedByMap1, arena.bytesUsed() );
+  map1.clear();
+  EXPECT_EQ( 1, map2.count(NEW_KEY) );
+}
+
+TEST_F(AnyMapTests, SameTypeFastPaths)
+{
+  using namespace std;
+
+  cout << "- Equality of maps of the same type." << endl;
+  EXPECT_EQ( Map(stlMap), Map(stlMap) );
+  EXPECT_EQ( Map(boostMap), Map(boostMap) );
+  EXPECT_EQ( Map(stlMap), Map(boostMap) );
+  StlMap otherStl( stlMap );
+  otherStl["two"] = 22;
+  BoostMap otherBoost( boostMap );
+  otherBoost["two"] = 22;
+  EXPECT_NE( Map(stlMap), Map(otherStl) );
+  EXPECT_NE( Map(boostMap), Map(otherBoost) );
+  otherStl.erase( "two" );
+  otherStl[NEW_KEY] = 2;
+  EXPECT_NE( Map(stlMap), Map(otherStl) );
+
+  cout << "- add_mapped merges ordered maps and loops over unordered ones." << endl;
+  StlMap extraStl( extraMap.begin(), extraMap.end() );
+  extraStl["two"] = 20;
+  Map stl( stlMap );
+  EXPECT_TRUE( stl.add_mapped( Map(extraStl), 2 ) );
+  EXPECT_EQ( 7, stl.size() );
+  EXPECT_EQ( 42, stl.at("two") );
+  EXPECT_EQ( 22, stl.at("eleven") );
+  EXPECT_EQ( 1, stl.at("one") );
+  BoostMap extraBoost( extraMap );
+  extraBoost["two"] = 20;
+  Map boost( boostMap );
+  EXPECT_TRUE( boost.add_mapped( Map(extraBoost), -1 ) );
+  EXPECT_EQ( 7, boost.size() );
+  EXPECT_EQ( -18, boost.at("two") );
+  EXPECT_EQ( -13, boost.at("thirteen") );
+  EXPECT_TRUE( boost.add_mapped( boost, 1 ) );
+  EXPECT_EQ( -36, boost.at("two") );
+
+  cout << "- add_mapped fails for maps of different types." << endl;
+  Map unchanged( stlMap );
+  EXPECT_FALSE( unchanged.add_mapped( Map(boostMap), 1 ) );
+  EXPECT_EQ( Map(stlMap), unchanged );
+
+  cout << "- Insertion of whole maps." << endl;
+  Map sameType( stlMap );
+  sameType.insert( Map(extraStl) );
+  EXPECT_EQ( 7, sameType.size() );
+  EXPECT_EQ( 2, sameType.at("two") );
+  Map mixed( boostMap );
+  mixed.insert( Map(extraStl) );
+  EXPECT_EQ( 7, mixed.size() );
+  EXPECT_EQ( 2, mixed.at("two") );
+  mixed.insert( mixed );
+  EXPECT_EQ( 7, mixed.size() );
+}
+
+TEST_F(AnyMapTests, Instrumentation)
+{
+  using namespace std;
+  using MapTypeErasure::MapStats;
+
+  cout << "- Plain maps have no statistics." << endl;
+  Map hashed( boostMap ), ordered( stlMap );
+  MapStats stats;
+  EXPECT_FALSE( hashed.is_instrumented() );
+  EXPECT_FALSE( hashed.stats( stats ) );
+
+  Map* maps[] = { &hashed, &ordered };
+  for( size_t m = 0; m < 2; ++m )
+    {
+      Map& map( *maps[m] );
+      cout << "- Turning the instrumentation on keeps the elements (map " << m << ")." << endl;
+      map.set_instrumented( true );
+      EXPECT_TRUE( map.is_instrumented() );
+      EXPECT_TRUE( Map( boostMap ) == map );
+      map.reset_stats();
+      ASSERT_TRUE( map.stats( stats ) );
+      EXPECT_EQ( 0u, stats.find.count );
+      EXPECT_EQ( 4u, stats.peakSize );
+
+      cout << "- Operations are counted by kind." << endl;
+      EXPECT_TRUE( map.find( "one" ) != map.end() );
+      EXPECT_EQ( 1, map.count( "two" ) );
+      EXPECT_EQ( 3, map.at( "three" ) );
+      map["five"] = 5;
+      map.insert( std::make_pair( K("six"), 6.0 ) );
+      map.erase( "one" );
+      map.reserve( 100 );
+      double sum(0);
+      map.for_each( [&sum](Map::value_type const& v) { sum += v.second; } );
+      EXPECT_EQ( 20, sum );
+      for( Map::const_iterator i(map.begin()); i != map.end(); ++i ) {}
+      ASSERT_TRUE( map.stats( stats ) );
+      EXPECT_EQ( 3u, stats.find.count );
+      EXPECT_EQ( 2u, stats.insert.count );
+      EXPECT_EQ( 1u, stats.erase.count );
+      EXPECT_EQ( 1u, stats.rehash.count );
+      EXPECT_EQ( 1u, stats.iteration.count );
+      EXPECT_EQ( 1u, stats.iteratorTraversals );
+      EXPECT_EQ( 6u, stats.peakSize );
+      EXPECT_EQ( 5u, stats.size );
+      EXPECT_GE( stats.estimatedBytes, 5 * sizeof(Map::value_type) );
+      std::uint64_t histogram(0);
+      for( size_t b = 0; b < MapTypeErasure::OperationStats::LATENCY_BUCKETS; ++b )
+	histogram += stats.find.histogram[b];
+      EXPECT_EQ( stats.find.count, histogram );
+
+      cout << "- Copies keep the instrumentation and the native paths." << endl;
+      Map copy( map );
+      MapStats copied;
+      ASSERT_TRUE( copy.stats( copied ) );
+      EXPECT_EQ( stats.find.count, copied.find.count );
+      Map plain( m == 0 ? Map( boostMap ) : Map( stlMap ) );
+      plain.erase( "one" );
+      plain["five"] = 5;
+      plain["six"] = 6;
+      EXPECT_TRUE( plain == copy );
+      EXPECT_TRUE( copy == plain );
+      EXPECT_TRUE( plain.add_mapped( copy, 1 ) );
+      EXPECT_TRUE( copy.add_mapped( plain, -1 ) );
+      EXPECT_EQ( 12, plain.at( "six" ) );
+      EXPECT_EQ( -6, copy.at( "six" ) );
+
+      cout << "- Turning it off keeps the elements." << endl;
+      map.reset_stats();
+      ASSERT_TRUE( map.stats( stats ) );
+      EXPECT_EQ( 0u, stats.insert.count );
+      map.set_instrumented( false );
+      EXPECT_FALSE( map.stats( stats ) );
+      EXPECT_EQ( 5u, map.size() );
+      EXPECT_EQ( 6, map["six"] );
+    }
+}
+
+TEST_F(AnyMapTests, EraseIfAndMemoryUsage)
+{
+  using namespace std;
+  typedef MapTypeErasure::FlatHashMap<K, V> FlatMap;
+  typedef MapTypeErasure::SortedVectorMap<K, V> SortedMap;
+  Map maps[] = { Map( BoostMap() ), Map( StlMap() ), Map( FlatMap() ), Map( SortedMap() ) };
+
+  cout << "- erase_if() removes the matching elements of every map." << endl;
+  for( size_t m = 0; m < 4; ++m )
+    {
+      SCOPED_TRACE( m );
+      Map& map( maps[m] );
+      for( int i = 0; i < 200; ++i )
+	map[ boost::lexical_cast<K>(i) ] = i;
+      const Map::size_type before( map.memory_usage() );
+      EXPECT_GE( before, sizeof(Map) + 200 * sizeof(Map::value_type) );
+      EXPECT_EQ( 100u, map.erase_if( [](Map::value_type const& v) { return int(v.second) % 2 == 0; } ) );
+      EXPECT_EQ( 100u, map.size() );
+      EXPECT_TRUE( map.all_of( [](Map::value_type const& v) { return int(v.second) % 2 == 1; } ) );
+      for( int i = 1; i < 200; i += 2 )
+	EXPECT_EQ( i, map.at( boost::lexical_cast<K>(i) ) );
+      EXPECT_EQ( 0u, map.erase_if( [](Map::value_type const& v) { return v.second > 1000; } ) );
+      map.shrink_to_fit();
+      EXPECT_LT( map.memory_usage(), before );
+      map["new"] = -1;
+      EXPECT_EQ( -1, map.at( "new" ) );
+      EXPECT_EQ( 101u, map.erase_if( [](Map::value_type const&) { return true; } ) );
+      EXPECT_TRUE( map.empty() );
+    }
+
+  cout << "- Native memory_usage() is exact." << endl;
+  FlatMap flat;
+  flat.reserve( 10 );
+  const size_t slots( flat.bucket_count() );
+  EXPECT_EQ( slots * (sizeof(FlatMap::value_type) + 1) + 1, Map( std::move(flat) ).memory_usage() - sizeof(Map) );
+  SortedMap sorted;
+  sorted.reserve( 10 );
+  EXPECT_EQ( 10 * sizeof(SortedMap::value_type), Map( std::move(sorted) ).memory_usage() - sizeof(Map) );
+  MapTypeErasure::StaticMap<SortedMap> staticMap;
+  staticMap.reserve( 10 );
+  EXPECT_EQ( sizeof(staticMap) + 10 * sizeof(SortedMap::value_type), staticMap.memory_usage() );
+  staticMap["a"] = 1;
+  staticMap["b"] = 2;
+  EXPECT_EQ( 1u, staticMap.erase_if( [](SortedMap::value_type const& v) { return v.first == "a"; } ) );
+  EXPECT_EQ( 1u, staticMap.count( "b" ) );
+
+  cout << "- Instrumented maps time erase_if() and report the memory." << endl;
+  Map instrumented( boostMap );
+  instrumented.set_instrumented( true );
+  EXPECT_GT( instrumented.memory_usage(), Map( boostMap ).memory_usage() );
+  EXPECT_EQ( 2u, instrumented.erase_if( [](Map::value_type const& v) { return v.second < 3; } ) );
+  MapTypeErasure::MapStats stats;
+  ASSERT_TRUE( instrumented.stats( stats ) );
+  EXPECT_EQ( 1u, stats.erase.count );
+  EXPECT_EQ( 2u, instrumented.size() );
+  EXPECT_GT( Map( boostMap ).memory_usage(), stats.estimatedBytes );
+  EXPECT_GT( instrumented.memory_usage(), stats.estimatedBytes );
+}
+
 #endif // __ANY_MAP_TESTS_HPP__
@@ -0,0 +1,203 @@
+#ifndef __BINARY_FORMAT_TESTS_HPP__
+#define __BINARY_FORMAT_TESTS_HPP__
+
+#include "Counters/BinaryFormat.hpp"
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class BinaryFormatTests : public ::testing::Test
+{
+public:
+  typedef std::string K;
+  typedef Counters::Counter<K> Counter_t;
+  typedef Counters::CounterMap<K, K> CounterMap_t;
+  typedef Counters::MappedCounterMap<K, K> Mapped_t;
+
+protected:
+  virtual void SetUp()
+  {
+    for( int i = 0; i < 500; ++i )
+      counterMap.incrementCount( K( 1 + i % 2, 'a' + i % 11 ), K( 1, 'a' + i % 19 ), 1 + i % 4 );
+    counter = *counterMap.getCounter( "b" );
+  }
+
+  // An aligned copy of the bytes written to os.
+  static std::vector<std::uint64_t> buffer( std::ostringstream const& os )
+  {
+    const std::string bytes( os.str() );
+    std::vector<std::uint64_t> words( (bytes.size() + 7) / 8 );
+    std::memcpy( words.data(), bytes.data(), bytes.size() );
+    return words;
+  }
+
+  CounterMap_t counterMap;
+  Counter_t counter;
+};
+
+TEST_F(BinaryFormatTests, CounterMap)
+{
+  using namespace std;
+
+  cout << "- Lookups in place match the CounterMap." << endl;
+  std::ostringstream os;
+  ASSERT_TRUE( Counters::writeBinary( os, counterMap, true ) );
+  const std::vector<std::uint64_t> bytes( buffer(os) );
+  Mapped_t mapped;
+  EXPECT_FALSE( mapped.isOpen() );
+  EXPECT_EQ( 0, mapped.getCount( "a", "a" ) );
+  ASSERT_TRUE( mapped.attach( bytes.data(), os.str().size() ) );
+  EXPECT_EQ( counterMap.size(), mapped.size() );
+  EXPECT_DOUBLE_EQ( counterMap.totalCount(), mapped.totalCount() );
+  for( CounterMap_t::ConstIterator i(counterMap.begin()); i != counterMap.end(); ++i )
+    {
+      EXPECT_TRUE( mapped.contains( i->first ) );
+      EXPECT_EQ( i->second.size(), mapped.size( i->first ) );
+      EXPECT_DOUBLE_EQ( i->second.totalCount(), mapped.totalCount( i->first ) );
+      EXPECT_EQ( i->second.getCount( i->second.maxValue() ),
+		 mapped.getCount( i->first, mapped.maxValue( i->first ) ) );
+      for( Counter_t::ConstIterator j(i->second.begin()); j != i->second.end(); ++j )
+	{
+	  EXPECT_EQ( j->second, mapped.getCount( i->first, j->first ) );
+	  EXPECT_DOUBLE_EQ( j->second / i->second.totalCount(), mapped.getProbability( i->first, j->first ) );
+	}
+    }
+  EXPECT_TRUE( mapped.hasProbabilities() );
+  EXPECT_FALSE( mapped.contains( "zz" ) );
+  EXPECT_FALSE( mapped.contains( "a", "zz" ) );
+  EXPECT_EQ( 0, mapped.getCount( "zz", "a" ) );
+  EXPECT_EQ( 0, mapped.totalCount( "zz" ) );
+  EXPECT_EQ( "", mapped.maxValue( "zz" ) );
+
+  cout << "- Heterogeneous lookups." << endl;
+  const std::string text( "bb c" );
+  const boost::string_view bb( text.data(), 2 ), c( text.data() + 3, 1 );
+  EXPECT_TRUE( mapped.contains( bb ) );
+  EXPECT_EQ( counterMap.getCount( "bb", "c" ), mapped.getCount( bb, c ) );
+  EXPECT_EQ( counterMap.totalCount( "bb" ), mapped.totalCount( bb ) );
+  EXPECT_EQ( "a", mapped.key(0) );
+
+  cout << "- Thawing into a CounterMap." << endl;
+  EXPECT_TRUE( counterMap.equals( mapped.thaw<CounterMap_t>() ) );
+  std::ostringstream frozen;
+  ASSERT_TRUE( Counters::writeBinary( frozen, Counters::freeze( counterMap ) ) );
+  std::size_t values(0);
+  for( CounterMap_t::ConstIterator i(counterMap.begin()); i != counterMap.end(); ++i )
+    values += i->second.size();
+  EXPECT_EQ( os.str().size(), frozen.str().size() + 8 * values ) << "only the probabilities differ";
+}
+
+TEST_F(BinaryFormatTests, Files)
+{
+  using namespace std;
+  const std::string mapFile( "BinaryFormatTests.map.bin" ), counterFile( "BinaryFormatTests.counter.bin" );
+
+  cout << "- Writing and mapping files." << endl;
+  {
+    std::ofstream out( mapFile.c_str(), std::ios::binary );
+    ASSERT_TRUE( Counters::writeBinary( out, counterMap ) );
+  }
+  {
+    std::ofstream out( counterFile.c_str(), std::ios::binary );
+    ASSERT_TRUE( Counters::writeBinary( out, counter ) );
+  }
+  Mapped_t mapped;
+  ASSERT_TRUE( mapped.open( mapFile ) );
+  EXPECT_FALSE( mapped.hasProbabilities() );
+  EXPECT_EQ( counterMap.getCount( "c", "d" ), mapped.getCount( "c", "d" ) );
+  Mapped_t copy( mapped );
+  mapped = Mapped_t();
+  EXPECT_EQ( counterMap.getCount( "c", "d" ), copy.getCount( "c", "d" ) );
+
+  Counters::MappedCounter<K> mappedCounter;
+  ASSERT_TRUE( mappedCounter.open( counterFile ) );
+  EXPECT_EQ( counter.size(), mappedCounter.size() );
+  EXPECT_DOUBLE_EQ( counter.totalCount(), mappedCounter.totalCount() );
+  EXPECT_EQ( counter.getCount( counter.maxValue() ), mappedCounter.getCount( mappedCounter.maxValue() ) );
+  EXPECT_EQ( counter.getCount("e"), mappedCounter.getCount( boost::string_view("e") ) );
+  EXPECT_DOUBLE_EQ( counter.getCount("e") / counter.totalCount(), mappedCounter.getProbability("e") );
+  EXPECT_FALSE( mappedCounter.contains( "zz" ) );
+
+  cout << "- Loading into the mutable types." << endl;
+  CounterMap_t loadedMap;
+  ASSERT_TRUE( Counters::loadBinary( mapFile, loadedMap ) );
+  EXPECT_TRUE( counterMap.equals( loadedMap ) );
+  Counter_t loaded;
+  ASSERT_TRUE( Counters::loadBinary( counterFile, loaded ) );
+  EXPECT_TRUE( counter.equals( loaded ) );
+
+  cout << "- Mismatched files are rejected." << endl;
+  EXPECT_FALSE( Counters::loadBinary( counterFile, loadedMap ) );
+  EXPECT_FALSE( Counters::loadBinary( mapFile, loaded ) );
+  EXPECT_FALSE( Counters::loadBinary( "BinaryFormatTests.missing.bin", loaded ) );
+  EXPECT_TRUE( counter.equals( loaded ) );
+  EXPECT_FALSE( (Counters::MappedCounterMap<int, K>().open( mapFile )) );
+  EXPECT_FALSE( (Counters::MappedCounterMap<K, double>().open( mapFile )) );
+
+  std::remove( mapFile.c_str() );
+  std::remove( counterFile.c_str() );
+}
+
+TEST_F(BinaryFormatTests, Validation)
+{
+  using namespace std;
+
+  cout << "- Arithmetic keys and values." << endl;
+  Counters::CounterMap<int, double> numbers;
+  numbers.incrementCount( 3, 0.5, 2 );
+  numbers.incrementCount( -1, 0.25, 1 );
+  numbers.incrementCount( 3, -2.0, 6 );
+  std::ostringstream os;
+  ASSERT_TRUE( Counters::writeBinary( os, numbers ) );
+  std::vector<std::uint64_t> bytes( buffer(os) );
+  const std::size_t size( os.str().size() );
+  Counters::MappedCounterMap<int, double> mapped;
+  ASSERT_TRUE( mapped.attach( bytes.data(), size ) );
+  EXPECT_EQ( 6, mapped.getCount( 3, -2.0 ) );
+  EXPECT_EQ( 0, mapped.getCount( 3, 0.25 ) );
+  EXPECT_EQ( -2.0, mapped.maxValue( 3 ) );
+  EXPECT_EQ( -1, mapped.key(0) );
+  EXPECT_TRUE( numbers.equals( mapped.thaw< Counters::CounterMap<int, double> >() ) );
+
+  cout << "- Empty and damaged buffers." << endl;
+  std::ostringstream empty;
+  ASSERT_TRUE( Counters::writeBinary( empty, CounterMap_t() ) );
+  const std::vector<std::uint64_t> emptyBytes( buffer(empty) );
+  Mapped_t emptyMap;
+  ASSERT_TRUE( emptyMap.attach( emptyBytes.data(), empty.str().size() ) );
+  EXPECT_TRUE( emptyMap.empty() );
+  EXPECT_FALSE( emptyMap.contains( "a" ) );
+  EXPECT_FALSE( mapped.attach( bytes.data(), size - 8 ) );
+  EXPECT_FALSE( mapped.attach( reinterpret_cast<char const*>( bytes.data() ) + 4, size - 4 ) );
+  EXPECT_FALSE( mapped.attach( NULL, 0 ) );
+  reinterpret_cast<char*>( bytes.data() )[0] = 'X';
+  EXPECT_FALSE( mapped.attach( bytes.data(), size ) );
+  EXPECT_TRUE( mapped.isOpen() );
+  EXPECT_EQ( 6, mapped.getCount( 3, -2.0 ) ) << "a failed attach keeps the previous buffer";
+
+  cout << "- Offsets out of order are rejected." << endl;
+  std::ostringstream strings;
+  ASSERT_TRUE( Counters::writeBinary( strings, counterMap ) );
+  const std::size_t stringsSize( strings.str().size() );
+  const std::vector<std::uint64_t> original( buffer(strings) );
+  Counters::details::BinaryHeader const& h( *reinterpret_cast<Counters::details::BinaryHeader const*>( original.data() ) );
+  ASSERT_LE( 2u, h.rows );
+  const std::uint64_t columns[] = { h.offsetsOffset, h.keysOffset, h.valuesOffset };
+  for( std::size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); ++c )
+    {
+      std::vector<std::uint64_t> damaged( original );
+      ASSERT_TRUE( Mapped_t().attach( damaged.data(), stringsSize ) );
+      damaged[ columns[c] / 8 + 1 ] = h.values + 1000;
+      EXPECT_FALSE( Mapped_t().attach( damaged.data(), stringsSize ) ) << "column " << c;
+    }
+}
+
+#endif // __BINARY_FORMAT_TESTS_HPP__
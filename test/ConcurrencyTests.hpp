@@ -0,0 +1,165 @@
+#ifndef __CONCURRENCY_TESTS_HPP__
+#define __CONCURRENCY_TESTS_HPP__
+
+#include "Counters/ConcurrentCounter.hpp"
+#include "Counters/ConcurrentCounterMap.hpp"
+#include "Counters/CounterFactories.hpp"
+#include "Counters/CounterMapReduction.hpp"
+#include "AnyMap/FlatHashMap.hpp"
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ConcurrencyTests : public ::testing::Test
+{
+public:
+  typedef Counters::ConcurrentCounter<int> ConcurrentCounter_t;
+  typedef Counters::ConcurrentCounterMap<std::string, int> ConcurrentCounterMap_t;
+
+  // an enum, since EXPECT_EQ takes its arguments by reference
+  enum { THREADS = 4, VALUES = 100, ROUNDS = 50 };
+
+  // Each thread adds 1 to every value, ROUNDS times.
+  static void incrementValues( ConcurrentCounter_t* counter )
+  {
+    for( int r = 0; r < ROUNDS; ++r )
+      for( int v = 0; v < VALUES; ++v )
+	counter->incrementCount( v, 1 );
+  }
+
+  static void incrementRows( ConcurrentCounterMap_t* counterMap )
+  {
+    static char const* keys[] = { "a", "b", "c" };
+    for( int r = 0; r < ROUNDS; ++r )
+      for( int v = 0; v < VALUES; ++v )
+	counterMap->incrementCount( keys[v % 3], v, 1 );
+  }
+};
+
+TEST_F(ConcurrencyTests, ConcurrentCounter)
+{
+  using namespace std;
+
+  cout << "- Concurrent increments." << endl;
+  ConcurrentCounter_t counter( 8 );
+  EXPECT_EQ( 8, counter.shards() );
+  std::vector<std::thread> threads;
+  for( int t = 0; t < THREADS; ++t )
+    threads.push_back( std::thread( incrementValues, &counter ) );
+  for( std::size_t t = 0; t < threads.size(); ++t )
+    threads[t].join();
+  EXPECT_EQ( THREADS * ROUNDS * VALUES, counter.totalCount() );
+  EXPECT_EQ( VALUES, counter.size() );
+  EXPECT_EQ( THREADS * ROUNDS, counter.getCount(7) );
+
+  cout << "- Snapshot." << endl;
+  Counters::Counter<int> snapshot( counter.snapshot() );
+  EXPECT_EQ( VALUES, snapshot.size() );
+  EXPECT_EQ( counter.totalCount(), snapshot.totalCount() );
+  for( int v = 0; v < VALUES; ++v )
+    EXPECT_EQ( THREADS * ROUNDS, snapshot.getCount(v) );
+
+  cout << "- setCount and remove keep the total." << endl;
+  counter.setCount( 0, 1 );
+  counter.remove( 1 );
+  EXPECT_FALSE( counter.contains(1) );
+  EXPECT_EQ( THREADS * ROUNDS * (VALUES - 2) + 1, counter.totalCount() );
+  EXPECT_EQ( counter.snapshot().totalCount(), counter.totalCount() );
+
+  cout << "- Other backends." << endl;
+  ConcurrentCounter_t hashed( 3, Counters::MapTypeCounterFactory<int, MapTypeErasure::FlatHashMap<int, double> >() );
+  hashed.incrementCount( 5, 2 );
+  hashed.incrementCount( 5, 3 );
+  EXPECT_EQ( 5, hashed.snapshot().getCount(5) );
+
+  cout << "- Factories owning the counters' memory are not shared." << endl;
+  ConcurrentCounter_t arena( 8, Counters::ArenaCounterFactory<int>() );
+  threads.clear();
+  for( int t = 0; t < THREADS; ++t )
+    threads.push_back( std::thread( incrementValues, &arena ) );
+  for( std::size_t t = 0; t < threads.size(); ++t )
+    threads[t].join();
+  EXPECT_EQ( THREADS * ROUNDS * VALUES, arena.snapshot().totalCount() );
+  EXPECT_EQ( THREADS * ROUNDS, arena.snapshot().getCount(7) );
+}
+
+TEST_F(ConcurrencyTests, ConcurrentCounterMap)
+{
+  using namespace std;
+
+  cout << "- Concurrent increments." << endl;
+  ConcurrentCounterMap_t counterMap( 16 );
+  std::vector<std::thread> threads;
+  for( int t = 0; t < THREADS; ++t )
+    threads.push_back( std::thread( incrementRows, &counterMap ) );
+  for( std::size_t t = 0; t < threads.size(); ++t )
+    threads[t].join();
+  EXPECT_EQ( THREADS * ROUNDS * VALUES, counterMap.totalCount() );
+  EXPECT_EQ( 3, counterMap.size() );
+  EXPECT_EQ( THREADS * ROUNDS, counterMap.getCount( "b", 4 ) );
+  EXPECT_EQ( 0, counterMap.getCount( "a", 4 ) );
+
+  cout << "- Snapshot." << endl;
+  Counters::CounterMap<std::string, int> snapshot( counterMap.snapshot() );
+  EXPECT_EQ( 3, snapshot.size() );
+  EXPECT_EQ( counterMap.totalCount(), snapshot.totalCount() );
+  EXPECT_EQ( counterMap.totalCount("c"), snapshot.totalCount("c") );
+
+  cout << "- setCount and remove keep the total." << endl;
+  counterMap.setCount( "a", 0, 1 );
+  counterMap.remove( "b", 1 );
+  counterMap.remove( "c" );
+  EXPECT_FALSE( counterMap.contains("c") );
+  EXPECT_FALSE( counterMap.contains("b", 1) );
+  EXPECT_EQ( counterMap.snapshot().totalCount(), counterMap.totalCount() );
+
+  cout << "- Factories owning the counters' memory are not shared." << endl;
+  ConcurrentCounterMap_t arena( 16, Counters::ArenaCounterFactory<int>() );
+  threads.clear();
+  for( int t = 0; t < THREADS; ++t )
+    threads.push_back( std::thread( incrementRows, &arena ) );
+  for( std::size_t t = 0; t < threads.size(); ++t )
+    threads[t].join();
+  EXPECT_EQ( THREADS * ROUNDS * VALUES, arena.snapshot().totalCount() );
+  EXPECT_EQ( THREADS * ROUNDS, arena.snapshot().getCount( "b", 4 ) );
+}
+
+TEST_F(ConcurrencyTests, CounterMapReduction)
+{
+  using namespace std;
+  typedef Counters::CounterMap<int, int> CounterMap_t;
+
+  cout << "- Thread-local maps are merged into their sum." << endl;
+  CounterMap_t expected;
+  for( int w = 0; w < 5; ++w )
+    for( int i = 0; i < 1000; ++i )
+      expected.incrementCount( (i * (w + 1)) % 97, i % 11, 1 );
+  auto work = [](std::size_t w, CounterMap_t& local) {
+    for( int i = 0; i < 1000; ++i )
+      local.incrementCount( (i * int(w + 1)) % 97, i % 11, 1 );
+  };
+  CounterMap_t counted( Counters::parallelCount<int, int>( 5, work ) );
+  EXPECT_TRUE( counted == expected );
+  EXPECT_EQ( 5000, counted.totalCount() );
+
+  cout << "- Any number of merging threads." << endl;
+  for( std::size_t threads = 0; threads < 8; ++threads )
+    {
+      Counters::CounterMapReduction<int, int> reduction( 5 );
+      for( std::size_t w = 0; w < reduction.workers(); ++w )
+	work( w, reduction.local(w) );
+      EXPECT_TRUE( reduction.merge( threads ) == expected );
+      EXPECT_TRUE( reduction.local(0).empty() );
+    }
+
+  cout << "- The prototype's map type is kept." << endl;
+  CounterMap_t prototype( (CounterMap_t::CoreMap_t( std::map<int, Counters::Counter<int> >() )) );
+  prototype.incrementCount( 1, 1, 1 );
+  CounterMap_t sorted( Counters::parallelCount<int, int>( 3, work, prototype ) );
+  EXPECT_EQ( 0, sorted.begin()->first );
+  EXPECT_EQ( 3000, sorted.totalCount() );
+}
+
+#endif // __CONCURRENCY_TESTS_HPP__
@@ -11,7 +11,10 @@
 #include <map>
 #include <list>
 #include <algorithm>
+#include <cmath>
 #include <string>
+#include <tuple>
+#include <vector>
 
 class CounterMapTests : public ::testing::Test
 {
@@ -606,4 +609,474 @@ TEST_F(CounterMapTests, APIs)
 
 }
 
+// Factory which counts the counters it creates.
+struct CountingCounterFactory : public Counters::CounterFactory<CounterMapTests::Value_t>
+{
+  CountingCounterFactory( int* created ) : created_(created) {}
+  Counters::Counter<CounterMapTests::Value_t> createCounter(void) const {
+    ++*created_;  return Counters::Counter<CounterMapTests::Value_t>(); }
+  CountingCounterFactory *clone(void) const {
+    return new CountingCounterFactory(*this); }
+private:
+  int* created_;
+};
+
+TEST_F(CounterMapTests, CounterCreation)
+{
+  using namespace std;
+
+  const Word one("one");
+  const Word two("two");
+
+  cout << "- Counters are created only for new keys." << endl;
+  int created = 0;
+  CounterMap_t counterMap( (AnyMap_t(CounterMapBoostMap_t())), CountingCounterFactory(&created) );
+  counterMap.incrementCount( "a", one, 1 );
+  counterMap.incrementCount( "a", two, 1 );
+  counterMap.setCount( "a", one, 3 );
+  EXPECT_EQ( 1, created );
+  counterMap.incrementCount( string("b"), one, 1 );
+  counterMap.incrementCount( string("b"), two, 1 );
+  EXPECT_EQ( 2, created );
+  EXPECT_EQ( 2, counterMap.size() );
+  EXPECT_EQ( 3, counterMap.getCount( "a", one ) );
+  EXPECT_EQ( 1, counterMap.getCount( "b", two ) );
+
+  CounterMap_t stdCounterMap( (AnyMap_t(CounterMapSTDMap_t())), CountingCounterFactory(&created) );
+  stdCounterMap += counterMap;
+  stdCounterMap += counterMap;
+  EXPECT_EQ( 4, created );
+  EXPECT_TRUE( stdCounterMap.equals( counterMap * 2.0 ) );
+
+  cout << "- Copies share the factory." << endl;
+  std::shared_ptr<Counters::CounterFactory<Word> const> factory( new CountingCounterFactory(&created) );
+  CounterMap_t shared( (AnyMap_t(CounterMapBoostMap_t())), factory );
+  CounterMap_t copy( shared );
+  stdCounterMap = shared;
+  EXPECT_EQ( 4, factory.use_count() );
+  copy.incrementCount( "c", one, 1 );
+  EXPECT_EQ( 5, created );
+}
+
+TEST_F(CounterMapTests, Capacity)
+{
+  using namespace std;
+
+  cout << "- Factories presize the counters they create." << endl;
+  CounterMap_t counterMap( (AnyMap_t(CounterMapBoostMap_t())), BoostMapCounterFactory_t(100) );
+  counterMap.reserve( 10 );
+  counterMap.incrementCount( "a", Word("one"), 1 );
+  counterMap.incrementCount( "a", Word("two"), 2 );
+  counterMap.incrementCount( "b", Word("one"), 3 );
+  EXPECT_EQ( 2, counterMap.size() );
+  EXPECT_EQ( 3, counterMap.totalCount("a") );
+
+  cout << "- shrinkToFit keeps the counts." << endl;
+  CounterMap_t copy( counterMap );
+  counterMap.shrinkToFit();
+  EXPECT_EQ( copy, counterMap );
+
+  CounterMap_t stdCounterMap( (AnyMap_t(CounterMapSTDMap_t())), STDMapCounterFactory_t(100) );
+  stdCounterMap += counterMap;
+  stdCounterMap.reserve( 10 );
+  stdCounterMap.shrinkToFit();
+  EXPECT_EQ( counterMap, stdCounterMap );
+}
+
+TEST_F(CounterMapTests, HeterogeneousLookup)
+{
+  using namespace std;
+
+  cout << "- Lookups by key view." << endl;
+  const char* const buffer = "alpha beta";
+  const boost::string_view alpha( buffer, 5 );
+  const boost::string_view beta( buffer + 6, 4 );
+  const Word one("one");
+
+  CounterMap_t counterMap;
+  counterMap.incrementCount( alpha, one, 1 );
+  counterMap.incrementCount( alpha, one, 2 );
+  counterMap.setCount( beta, Word("two"), 4 );
+  EXPECT_EQ( 2, counterMap.size() );
+  EXPECT_TRUE( counterMap.contains("alpha") );
+  EXPECT_TRUE( counterMap.contains(beta, Word("two")) );
+  EXPECT_FALSE( counterMap.contains(beta, one) );
+  EXPECT_FALSE( counterMap.contains("gamma") );
+  EXPECT_EQ( 3, counterMap.getCount(alpha, one) );
+  EXPECT_EQ( 3, counterMap.getCount(string("alpha"), one) );
+  EXPECT_EQ( 0, counterMap.getCount("gamma", one) );
+  ASSERT_TRUE( counterMap.getCounter(beta) != NULL );
+  EXPECT_EQ( 4, counterMap.getCounter(beta)->totalCount() );
+  EXPECT_TRUE( counterMap.getCounter("gamma") == NULL );
+}
+
+TEST_F(CounterMapTests, Batches)
+{
+  using namespace std;
+
+  cout << "- incrementMany matches incrementCount." << endl;
+  typedef std::tuple<Key_t, Value_t, Counter_t::Count_t> Item_t;
+  std::vector<Item_t> items;
+  for( int i = 0; i < 400; ++i )
+    items.push_back( Item_t( Key_t( 1, 'a' + i / 100 + (i % 7 == 0) ), Word( Key_t( 1 + i % 2, 'a' + i % 13 ) ), i % 3 ) );
+  CounterMap_t expected, batched;
+  for( size_t i = 0; i < items.size(); ++i )
+    expected.incrementCount( std::get<0>(items[i]), std::get<1>(items[i]), std::get<2>(items[i]) );
+  batched.incrementCount( "a", Word("a"), 0 );
+  batched.totalCount();
+  batched.incrementMany( items.data(), items.size() );
+  EXPECT_EQ( expected, batched );
+  EXPECT_EQ( expected.totalCount(), batched.totalCount() );
+  batched.incrementMany( items.data(), 0 );
+  EXPECT_EQ( expected, batched );
+
+  cout << "- getMany matches getCount." << endl;
+  std::vector< std::pair<Key_t, Value_t> > pairs;
+  for( size_t i = 0; i < items.size(); ++i )
+    pairs.push_back( std::make_pair( std::get<0>(items[i]), std::get<1>(items[i]) ) );
+  pairs.push_back( std::make_pair( Key_t("zz"), Word("a") ) );
+  pairs.push_back( std::make_pair( Key_t("a"), Word("zz") ) );
+  std::vector<Counter_t::Count_t> out( pairs.size(), -1 );
+  batched.getMany( pairs.data(), pairs.size(), out.data() );
+  for( size_t i = 0; i < pairs.size(); ++i )
+    EXPECT_EQ( expected.getCount( pairs[i].first, pairs[i].second ), out[i] );
+}
+
+TEST_F(CounterMapTests, MaxValue)
+{
+  using namespace std;
+
+  cout << "- maxValue of a row." << endl;
+  Counters::CounterMap<string, string> counterMap;
+  counterMap.incrementCount( "a", "one", 1 );
+  counterMap.incrementCount( "a", "two", 2 );
+  counterMap.incrementCount( "b", "one", 3 );
+  EXPECT_EQ( "two", counterMap.maxValue("a") );
+  EXPECT_EQ( "one", counterMap.maxValue("b") );
+  EXPECT_EQ( "", counterMap.maxValue("c") );
+  counterMap.incrementCount( "a", "one", 2 );
+  EXPECT_EQ( "one", counterMap.maxValue("a") );
+  counterMap.getCounter("a")->setMaxCachePolicy( Counters::CACHE_POLICY_PERSISTENT );
+  counterMap.conditionalNormalize();
+  EXPECT_EQ( "one", counterMap.maxValue("a") );
+}
+
+TEST_F(CounterMapTests, ArenaRows)
+{
+  using namespace std;
+  typedef Counters::CounterMap<int, int> IntCounterMap_t;
+
+  cout << "- Rows and their nodes come from the arena." << endl;
+  std::shared_ptr<MapTypeErasure::Arena> arena( std::make_shared<MapTypeErasure::Arena>() );
+  IntCounterMap_t heapMap;
+  {
+    IntCounterMap_t arenaMap( Counters::makeArenaCounterMap<int, int>( arena ) );
+    for( int i = 0; i < 2000; ++i )
+      {
+	arenaMap.incrementCount( i % 100, i % 7, 1 );
+	heapMap.incrementCount( i % 100, i % 7, 1 );
+      }
+    EXPECT_GT( arena->bytesUsed(), 100 * 7 * sizeof(std::pair<int const, double>) );
+    EXPECT_TRUE( arenaMap.equals( heapMap ) );
+    EXPECT_EQ( 2000, arenaMap.totalCount() );
+
+    cout << "- Copies use the heap." << endl;
+    const std::size_t used( arena->bytesUsed() );
+    IntCounterMap_t copy( arenaMap );
+    EXPECT_EQ( used, arena->bytesUsed() );
+    EXPECT_TRUE( copy.equals( heapMap ) );
+    arenaMap.remove( 5 );
+    EXPECT_LT( arena->bytesUsed(), used );
+    arenaMap.incrementCount( 5, 1, 1 );
+    copy.incrementCount( 1000, 1, 1 );
+    EXPECT_EQ( 1, copy.getCount( 1000, 1 ) );
+    arenaMap = copy;
+    EXPECT_TRUE( arenaMap.equals( copy ) );
+  }
+  EXPECT_EQ( 0, arena->bytesUsed() );
+  EXPECT_GT( arena->bytesReserved(), 0 );
+}
+
+TEST_F(CounterMapTests, MoveMerge)
+{
+  using namespace std;
+  typedef Counters::CounterMap<int, int> IntCounterMap_t;
+
+  cout << "- Moving merge matches the copying one." << endl;
+  IntCounterMap_t a, b;
+  for( int i = 0; i < 300; ++i )
+    {
+      a.incrementCount( i % 20, i % 7, 1 );
+      b.incrementCount( i % 30 + 10, i % 5, 2 );
+    }
+  b /= 2;
+  IntCounterMap_t expected( a );
+  expected += b;
+  a += std::move( b );
+  EXPECT_TRUE( a == expected );
+  EXPECT_EQ( expected.totalCount(), a.totalCount() );
+  EXPECT_TRUE( b.empty() );
+  a += std::move( a );
+  EXPECT_EQ( 2 * expected.totalCount(), a.totalCount() );
+
+  cout << "- Arena rows are copied out of other arenas." << endl;
+  std::shared_ptr<MapTypeErasure::Arena> arena( std::make_shared<MapTypeErasure::Arena>() );
+  IntCounterMap_t merged;
+  {
+    IntCounterMap_t arenaMap( Counters::makeArenaCounterMap<int, int>( arena ) );
+    arenaMap.incrementCount( 1, 2, 3 );
+    merged += std::move( arenaMap );
+  }
+  arena.reset();
+  merged.incrementCount( 1, 3, 1 );
+  EXPECT_EQ( 3, merged.getCount( 1, 2 ) );
+  EXPECT_EQ( 4, merged.totalCount() );
+}
+
+TEST_F(CounterMapTests, ParallelRows)
+{
+  using namespace std;
+  typedef Counters::CounterMap<int, int> IntCounterMap_t;
+  typedef Counters::ExecutionPolicy ExecutionPolicy;
+
+  IntCounterMap_t counterMap;
+  for( int i = 0; i < 20000; ++i )
+    counterMap.incrementCount( i % 3001, i % 13, 0.1 * (i % 17) + 0.01 );
+  const ExecutionPolicy parallel( 4, 64 );
+
+  cout << "- totalCount matches the sequential sum." << endl;
+  // Copies of the same map, so that the rows are in the same order and state.
+  IntCounterMap_t sequential( counterMap ), copy( counterMap );
+  EXPECT_EQ( sequential.totalCount(), copy.totalCount( parallel ) );
+  IntCounterMap_t blocked2( counterMap ), blocked7( counterMap );
+  const double blockedTotal( blocked2.totalCount( ExecutionPolicy( 2, 64, ExecutionPolicy::BLOCKED ) ) );
+  EXPECT_EQ( blockedTotal, blocked7.totalCount( ExecutionPolicy( 7, 64, ExecutionPolicy::BLOCKED ) ) );
+  EXPECT_NEAR( sequential.totalCount(), blockedTotal, 1e-9 * blockedTotal );
+
+  cout << "- Row-wise operations match the sequential ones." << endl;
+  sequential *= 3;
+  copy.multiply( parallel, 3 );
+  EXPECT_TRUE( copy == sequential );
+  sequential /= 7;
+  copy.divide( parallel, 7 );
+  EXPECT_TRUE( copy == sequential );
+  sequential.conditionalNormalize();
+  copy.conditionalNormalize( parallel );
+  EXPECT_TRUE( copy == sequential );
+  EXPECT_EQ( sequential.totalCount(), copy.totalCount( parallel ) );
+
+  cout << "- equals." << endl;
+  EXPECT_TRUE( copy.equals( sequential, parallel ) );
+  copy.incrementCount( 2999, 1, 0.5 );
+  EXPECT_FALSE( copy.equals( sequential, parallel ) );
+  EXPECT_TRUE( copy.equals( sequential, parallel, 1.0 ) );
+  copy.remove( 2999 );
+  EXPECT_FALSE( copy.equals( sequential, parallel ) );
+}
+
+TEST_F(CounterMapTests, InstrumentedRows)
+{
+  using namespace std;
+  typedef Counters::CounterMap<int, int> IntCounterMap_t;
+
+  cout << "- The rows of an instrumented factory record their lookups." << endl;
+  IntCounterMap_t cm( (IntCounterMap_t::CoreMap_t()), Counters::InstrumentedCounterFactory<int>() );
+  for( int i = 0; i < 300; ++i )
+    cm.incrementCount( i % 3, i % 11, 1 );
+  for( int i = 0; i < 100; ++i )
+    EXPECT_GT( cm.getCount( 1, i % 11 ), 0 );
+  MapTypeErasure::MapStats hot, cold;
+  ASSERT_TRUE( cm.getCounter( 1 )->getMapStats( hot ) );
+  ASSERT_TRUE( cm.getCounter( 2 )->getMapStats( cold ) );
+  EXPECT_GE( hot.find.count, cold.find.count + 100 );
+  EXPECT_EQ( 11u, hot.peakSize );
+  EXPECT_EQ( 300, cm.totalCount() );
+}
+
+TEST_F(CounterMapTests, PruningAndEviction)
+{
+  using namespace std;
+  typedef Counters::CounterMap<int, int> IntCounterMap_t;
+
+  cout << "- prune() removes the small counts, then the small rows." << endl;
+  IntCounterMap_t cm;
+  for( int key = 0; key < 10; ++key )
+    for( int val = 0; val <= key; ++val )
+      cm.setCount( key, val, val + 1 );
+  EXPECT_EQ( 220, cm.totalCount() );
+  // The counts 1 and 2 go (19 of them), which empties rows 0 and 1 and
+  // leaves rows 2 and 3 with the totals 3 and 7 (3 counts).
+  EXPECT_EQ( 22u, cm.prune( 10, 3 ) );
+  EXPECT_EQ( 6u, cm.size() );
+  EXPECT_FALSE( cm.contains( 3 ) );
+  EXPECT_TRUE( cm.contains( 4 ) );
+  EXPECT_EQ( 12, cm.getCounter( 4 )->totalCount() );
+  EXPECT_EQ( 3u, cm.size( 4 ) );
+  EXPECT_FALSE( cm.contains( 9, 1 ) );
+  EXPECT_EQ( 220 - 28 - 10, cm.totalCount() );
+
+  cout << "- Memory usage counts the rows." << endl;
+  const std::size_t usage( cm.memoryUsage() );
+  EXPECT_GT( usage, cm.getCounter( 9 )->memoryUsage() );
+  cm.incrementCount( 100, 1, 1 );
+  EXPECT_GT( cm.memoryUsage(), usage );
+  cm.remove( 100 );
+
+  cout << "- A memory budget evicts the smallest counts." << endl;
+  IntCounterMap_t evicting;
+  evicting.setEvictionPolicy( Counters::EvictionPolicy( 0, 0.5, 100 ) );
+  for( int i = 0; i < 2000; ++i )
+    evicting.incrementCount( i % 20, i % 200, 1 + (i % 200 == 7) );
+  const std::size_t unbounded( evicting.memoryUsage() );
+  EXPECT_EQ( 0u, evicting.enforceMemoryBudget() );
+  EXPECT_EQ( 2010, evicting.totalCount() );
+  const Counters::EvictionPolicy policy( unbounded / 2, 0.5, 1 );
+  evicting.setEvictionPolicy( policy );
+  EXPECT_EQ( policy.memoryBudget, evicting.getEvictionPolicy().memoryBudget );
+  EXPECT_GT( evicting.enforceMemoryBudget(), 0u );
+  EXPECT_LE( evicting.memoryUsage(), unbounded / 4 );
+  EXPECT_EQ( 20, evicting.getCount( 7, 7 ) );
+  for( int i = 0; i < 20000; ++i )
+    evicting.incrementCount( i, 0, 1 );
+  EXPECT_LT( evicting.size(), 100u );
+  evicting.enforceMemoryBudget();
+  EXPECT_LE( evicting.memoryUsage(), policy.memoryBudget );
+  EXPECT_EQ( 20, evicting.getCount( 7, 7 ) );
+
+  cout << "- Ties at the threshold are only evicted as needed." << endl;
+  IntCounterMap_t tied;
+  for( int key = 0; key < 100; ++key )
+    for( int val = 0; val < 100; ++val )
+      tied.setCount( key, val, val % 20 == 0 ? 2 : 1 );
+  const std::size_t tiedUsage( tied.memoryUsage() );
+  tied.setEvictionPolicy( Counters::EvictionPolicy( tiedUsage - 1, 0.75, 1 ) );
+  EXPECT_GT( tied.enforceMemoryBudget(), 0u );
+  const double tiedTarget( (tiedUsage - 1) * 0.75 );
+  EXPECT_LE( tied.memoryUsage(), tiedTarget );
+  EXPECT_GT( tied.memoryUsage(), tiedTarget * 0.8 );
+  std::size_t pairs(0), greater(0);
+  for( IntCounterMap_t::ConstIterator i( tied.begin() ); i != tied.end(); ++i )
+    {
+      pairs += i->second.size();
+      for( IntCounterMap_t::Counter_t::ConstIterator j( i->second.begin() ); j != i->second.end(); ++j )
+	greater += j->second == 2;
+    }
+  EXPECT_GT( pairs, 6000u );
+  EXPECT_EQ( 500u, greater );
+
+  cout << "- Copies keep the policy." << endl;
+  IntCounterMap_t copy( evicting );
+  EXPECT_EQ( policy.memoryBudget, copy.getEvictionPolicy().memoryBudget );
+  copy.setEvictionPolicy( Counters::EvictionPolicy() );
+  for( int i = 0; i < 5000; ++i )
+    copy.incrementCount( -i - 1, 0, 1 );
+  EXPECT_GT( copy.memoryUsage(), policy.memoryBudget );
+}
+
+TEST_F(CounterMapTests, ReverseIndex)
+{
+  using namespace std;
+  typedef Counters::CounterMap<int, int> IntCounterMap_t;
+  typedef IntCounterMap_t::Counter_t IntCounter_t;
+
+  // TRUE if the index of cm holds the transpose of its current counts.
+  auto indexed = []( IntCounterMap_t const& cm ) -> bool
+    {
+      const Counters::CounterMap<int, int> transpose( cm.transpose() );
+      for( int val = 0; val < 40; ++val )
+	{
+	  IntCounter_t const* expected( transpose.getCounter( val ) );
+	  IntCounter_t const* column( cm.getColumn( val ) );
+	  std::vector<int> rows( cm.rowsContaining( val ) );
+	  std::sort( rows.begin(), rows.end() );
+	  if( expected == NULL )
+	    {
+	      if( column != NULL || !rows.empty() || cm.marginalCount( val ) != 0 )
+		return false;
+	      continue;
+	    }
+	  std::vector<int> keys;
+	  for( IntCounter_t::ConstIterator i( expected->begin() ); i != expected->end(); ++i )
+	    keys.push_back( i->first );
+	  std::sort( keys.begin(), keys.end() );
+	  if( column == NULL || !column->equals( *expected, 1e-9 ) || rows != keys ||
+	      std::fabs( cm.marginalCount( val ) - expected->totalCount() ) > 1e-9 )
+	    return false;
+	}
+      return true;
+    };
+
+  cout << "- transpose() swaps the keys and the values." << endl;
+  IntCounterMap_t cm;
+  for( int i = 0; i < 300; ++i )
+    cm.incrementCount( i % 17, i % 29, 1 + i % 4 );
+  const Counters::CounterMap<int, int> transpose( cm.transpose() );
+  EXPECT_EQ( 29u, transpose.size() );
+  EXPECT_EQ( cm.totalCount(), transpose.totalCount() );
+  EXPECT_EQ( cm.getCount( 3, 5 ), transpose.getCount( 5, 3 ) );
+  EXPECT_TRUE( transpose.transpose() == cm );
+
+  cout << "- Without an index, the queries visit the rows." << endl;
+  EXPECT_FALSE( cm.hasReverseIndex() );
+  EXPECT_EQ( NULL, cm.getColumn( 5 ) );
+  EXPECT_EQ( transpose.getCounter( 5 )->totalCount(), cm.marginalCount( 5 ) );
+  EXPECT_EQ( transpose.size( 5 ), cm.rowsContaining( 5 ).size() );
+
+  cout << "- The index is built from the current counts." << endl;
+  cm.setReverseIndex( true );
+  EXPECT_TRUE( cm.hasReverseIndex() );
+  EXPECT_TRUE( indexed( cm ) );
+  EXPECT_EQ( transpose.getCounter( 5 )->totalCount(), cm.marginalCount( 5 ) );
+
+  cout << "- Every modifier updates it." << endl;
+  cm.incrementCount( 30, 30, 2 );
+  cm.setCount( 3, 5, 100 );
+  cm.setCount( 31, 31, 0 );
+  const std::tuple<int, int, double> batch[] = { std::make_tuple( 1, 32, 2.0 ), std::make_tuple( 1, 33, 1.0 ) };
+  cm.incrementMany( batch, 2 );
+  EXPECT_TRUE( indexed( cm ) );
+  cm.remove( 4 );
+  cm.remove( 3, 5 );
+  cm.remove( 30, 30 );
+  EXPECT_TRUE( indexed( cm ) );
+  IntCounterMap_t other;
+  for( int i = 0; i < 50; ++i )
+    other.incrementCount( i % 23, i % 37, 1 );
+  cm += other;
+  cm -= other * 0.5;
+  cm += IntCounterMap_t( other );
+  cm *= 3;
+  EXPECT_TRUE( indexed( cm ) );
+  cm.prune( 10, 4 );
+  EXPECT_TRUE( indexed( cm ) );
+  cm.conditionalNormalize();
+  EXPECT_TRUE( indexed( cm ) );
+  IntCounterMap_t delta;
+  delta.incrementCount( 0, 0, -cm.getCount( 0, 0 ) );
+  delta.incrementCount( 0, 38, 1 );
+  cm.applyDelta( delta );
+  EXPECT_FALSE( cm.contains( 0, 0 ) );
+  EXPECT_TRUE( indexed( cm ) );
+
+  cout << "- So do the evictions and clear()." << endl;
+  IntCounterMap_t copy( cm );
+  EXPECT_TRUE( copy.hasReverseIndex() );
+  for( int i = 0; i < 2000; ++i )
+    copy.incrementCount( i % 20, i % 40, 1 + (i % 40 == 7) );
+  // The budget does not count the index, about as large as the rows.
+  copy.setEvictionPolicy( Counters::EvictionPolicy( copy.memoryUsage() / 4, 0.5, 1 ) );
+  EXPECT_GT( copy.enforceMemoryBudget(), 0u );
+  EXPECT_TRUE( indexed( copy ) );
+  EXPECT_TRUE( indexed( cm ) );
+  copy.clear();
+  EXPECT_TRUE( indexed( copy ) );
+  EXPECT_EQ( 0, copy.marginalCount( 7 ) );
+
+  cout << "- Turning it off drops it." << endl;
+  const std::size_t usage( cm.memoryUsage() );
+  cm.setReverseIndex( false );
+  EXPECT_FALSE( cm.hasReverseIndex() );
+  EXPECT_LT( cm.memoryUsage(), usage );
+}
+
 #endif // __COUNTER_MAP_TESTS_HPP__
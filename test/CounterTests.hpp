@@ -305,4 +305,426 @@ TEST_F(CounterTests, APIs)
   }
 }
 
+TEST_F(CounterTests, HeterogeneousLookup)
+{
+  using namespace std;
+  using namespace Counters;
+
+  const char* const buffer = "pawn king pawn rook";
+  const boost::string_view pawn( buffer, 4 );
+  const boost::string_view king( buffer + 5, 4 );
+  const boost::string_view rook( buffer + 15, 4 );
+
+  const Counter<StringV> expected( chessList.begin(), chessList.end() );
+
+  typedef boost::unordered_map<StringV, Count> BoostMap;
+  typedef std::map<StringV, Count> StlMap;
+  Counter<StringV> boostCounter( (StringMap(BoostMap())) );
+  Counter<StringV> stlCounter( (StringMap(StlMap())) );
+  Counter<StringV>* counters[] = { &boostCounter, &stlCounter };
+  for( size_t c = 0; c < 2; ++c )
+    {
+      Counter<StringV>& counter( *counters[c] );
+
+      cout << "- incrementCount and setCount by key view (counter " << c << ")." << endl;
+      counter.incrementAll( chessList.begin(), chessList.end(), 1.0 );
+      counter.incrementCount( pawn, 2 );
+      counter.incrementCount( "queen", 1 );
+      counter.setCount( rook, 5 );
+      EXPECT_TRUE( counter.contains(king) );
+      EXPECT_FALSE( counter.contains("castle") );
+      EXPECT_EQ( 10, counter.getCount(pawn) );
+      EXPECT_EQ(  2, counter.getCount("queen") );
+      EXPECT_EQ(  5, counter.getCount(rook) );
+      EXPECT_EQ(  0, counter.getCount("castle") );
+      EXPECT_EQ( expected.totalCount() + 6, counter.totalCount() );
+      counter.resetCache();
+      EXPECT_EQ( expected.totalCount() + 6, counter.totalCount() );
+      EXPECT_EQ( expected.size(), counter.size() );
+    }
+  EXPECT_EQ( boostCounter, stlCounter );
+}
+
+TEST_F(CounterTests, Batches)
+{
+  using namespace std;
+  using namespace Counters;
+
+  std::vector< std::pair<StringV, Count> > items;
+  for( std::list<std::string>::const_iterator i(chessList.begin()); i != chessList.end(); ++i )
+    items.push_back( std::make_pair( *i, Count(i->size()) ) );
+  for( int i = 0; i < 150; ++i )
+    items.push_back( std::make_pair( StringV( 1 + i % 3, 'a' + i % 7 ), Count(i % 5) ) );
+
+  typedef boost::unordered_map<StringV, Count> BoostMap;
+  typedef std::map<StringV, Count> StlMap;
+  typedef MapTypeErasure::FlatHashMap<StringV, Count> FlatMap;
+  Counter<StringV> boostCounter( (StringMap(BoostMap())) );
+  Counter<StringV> stlCounter( (StringMap(StlMap())) );
+  Counter<StringV> flatCounter( (StringMap(FlatMap())) );
+  Counter<StringV, MapTypeErasure::StaticMap<FlatMap> > staticCounter;
+  Counter<StringV>* counters[] = { &boostCounter, &stlCounter, &flatCounter };
+  for( size_t c = 0; c < 3; ++c )
+    {
+      Counter<StringV>& counter( *counters[c] );
+      Counter<StringV> expected;
+
+      cout << "- incrementMany matches incrementCount (counter " << c << ")." << endl;
+      counter.setCachePolicy( CACHE_POLICY_PERSISTENT );
+      counter.setMaxCachePolicy( CACHE_POLICY_PERSISTENT );
+      counter.incrementCount( "pawn", 1 );
+      expected.incrementCount( "pawn", 1 );
+      counter.totalCount();
+      counter.maxValue();
+      counter.incrementMany( items.data(), items.size() );
+      for( size_t i = 0; i < items.size(); ++i )
+	expected.incrementCount( items[i].first, items[i].second );
+      EXPECT_TRUE( expected.equals( counter ) );
+      EXPECT_TRUE( counter.isTotalSynched() );
+      EXPECT_EQ( expected.totalCount(), counter.totalCount() );
+      EXPECT_TRUE( counter.isMaxSynched() );
+      EXPECT_EQ( expected.maxValue(), counter.maxValue() );
+
+      cout << "- getMany matches getCount under a scale." << endl;
+      counter *= 0.5;
+      std::vector<StringV> vals;
+      for( size_t i = 0; i < items.size(); i += 2 )
+	vals.push_back( items[i].first );
+      vals.push_back( "castle" );
+      std::vector<Count> out( vals.size(), -1 );
+      counter.getMany( vals.data(), vals.size(), out.data() );
+      for( size_t i = 0; i < vals.size(); ++i )
+	EXPECT_EQ( counter.getCount( vals[i] ), out[i] );
+      EXPECT_EQ( 0, out.back() );
+      counter.incrementMany( items.data(), 3 );
+      EXPECT_EQ( expected.getCount("king") / 2 + 4, counter.getCount("king") );
+    }
+
+  cout << "- StaticMap backend." << endl;
+  staticCounter.incrementMany( items.data(), items.size() );
+  Counter<StringV> expected;
+  for( size_t i = 0; i < items.size(); ++i )
+    expected.incrementCount( items[i].first, items[i].second );
+  EXPECT_EQ( expected.size(), staticCounter.size() );
+  EXPECT_EQ( expected.totalCount(), staticCounter.totalCount() );
+  std::vector<Count> out( items.size() );
+  std::vector<StringV> vals;
+  for( size_t i = 0; i < items.size(); ++i )
+    vals.push_back( items[i].first );
+  staticCounter.getMany( vals.data(), vals.size(), out.data() );
+  for( size_t i = 0; i < items.size(); ++i )
+    EXPECT_EQ( expected.getCount( vals[i] ), out[i] );
+}
+
+TEST_F(CounterTests, LazyScaling)
+{
+  using namespace std;
+  using namespace Counters;
+  const Count EPSILON = 1e-12;
+
+  const Counter<StringV> original( chessList.begin(), chessList.end() );
+  Counter<StringV> scaled( original );
+
+  cout << "- Scaling is applied on read." << endl;
+  scaled *= 4;
+  scaled /= 8;
+  EXPECT_EQ( 0.5, scaled.getScale() );
+  EXPECT_EQ( 4, scaled.getCount("pawn") );
+  EXPECT_EQ( 0.5, scaled.getCount("king") );
+  EXPECT_EQ( 0, scaled.getCount("castle") );
+  EXPECT_EQ( original.totalCount() / 2, scaled.totalCount() );
+  EXPECT_TRUE( scaled.isTotalSynched() );
+  scaled.resetCache();
+  EXPECT_EQ( original.totalCount() / 2, scaled.totalCount() );
+  EXPECT_EQ( "pawn", scaled.maxValue() );
+  EXPECT_TRUE( scaled.equals( original * 0.5, EPSILON ) );
+
+  cout << "- Modifications under a scale." << endl;
+  scaled.incrementCount( "pawn", 1 );
+  scaled.setCount( "king", 3 );
+  scaled.incrementCount( "castle", 2 );
+  EXPECT_EQ( 5, scaled.getCount("pawn") );
+  EXPECT_EQ( 3, scaled.getCount("king") );
+  EXPECT_EQ( 2, scaled.getCount("castle") );
+  scaled.remove( "castle" );
+  EXPECT_EQ( original.totalCount() / 2 + 3.5, scaled.totalCount() );
+  EXPECT_EQ( 0.5, scaled.getScale() );
+
+  cout << "- Normalization is constant time." << endl;
+  scaled.normalize();
+  EXPECT_EQ( 1, scaled.totalCount() );
+  EXPECT_NEAR( 5 / (original.totalCount() / 2 + 3.5), scaled.getCount("pawn"), EPSILON );
+  EXPECT_NE( 1, scaled.getScale() );
+
+  cout << "- Iteration and combination fold the scale." << endl;
+  Counter<StringV> iterated( original / 2 );
+  EXPECT_EQ( 0.5, iterated.getScale() );
+  for( Counter<StringV>::ConstIterator i(iterated.begin()); i != iterated.end(); ++i )
+    EXPECT_EQ( original.getCount(i->first) / 2, i->second );
+  EXPECT_EQ( 1, iterated.getScale() );
+  Counter<StringV> half( original / 2 );
+  EXPECT_TRUE( half == iterated );
+  Counter<StringV> sum( original / 2 );
+  sum += half / 2;
+  EXPECT_EQ( 1, sum.getScale() );
+  EXPECT_EQ( 6, sum.getCount("pawn") );
+  sum -= original * 0.25;
+  EXPECT_TRUE( sum.equals( half, EPSILON ) );
+
+  cout << "- Extreme and zero scales are folded." << endl;
+  Counter<StringV> tiny( original );
+  for( int i = 0; i < 10; ++i )
+    tiny *= 1e-20;
+  EXPECT_GT( 1e64, 1 / tiny.getScale() );
+  EXPECT_NEAR( 8e-200, tiny.getCount("pawn"), 1e-210 );
+  tiny *= 0;
+  EXPECT_EQ( 1, tiny.getScale() );
+  EXPECT_EQ( 0, tiny.getCount("pawn") );
+  tiny.incrementCount( "pawn", 2 );
+  EXPECT_EQ( 2, tiny.getCount("pawn") );
+}
+
+TEST_F(CounterTests, Expressions)
+{
+  using namespace std;
+  using namespace Counters;
+  const Count EPSILON = 1e-12;
+
+  Counter<StringV> a( chessList.begin(), chessList.end() );
+  Counter<StringV> b( chessSet.begin(), chessSet.end(), 2 );
+  Counter<StringV> c;
+  c.incrementCount( "castle", 10 );
+  c.incrementCount( "pawn", 1 );
+
+  cout << "- Interpolation in one expression." << endl;
+  Counter<StringV> expected( a );
+  expected *= 0.7;
+  Counter<StringV> bPart( b ), cPart( c );
+  bPart *= 0.2;
+  cPart *= 0.1;
+  expected += bPart;
+  expected += cPart;
+  Counter<StringV> interpolated( a*0.7 + b*0.2 + c*0.1 );
+  EXPECT_TRUE( expected.equals( interpolated, EPSILON ) );
+  EXPECT_NEAR( 0.7 * 8 + 0.4 + 0.1, interpolated.getCount("pawn"), EPSILON );
+  EXPECT_NEAR( 1, interpolated.getCount("castle"), EPSILON );
+  Counter<StringV> assigned;
+  assigned = 0.7 * a + (b + c) * 0.1 - b * -0.1;
+  EXPECT_TRUE( expected.equals( assigned, EPSILON ) );
+  EXPECT_TRUE( Counter<StringV>( a - b / 2 * 2 + b ).equals( a, EPSILON ) );
+
+  cout << "- Expressions added in place." << endl;
+  Counter<StringV> inPlace( a*0.7 );
+  EXPECT_EQ( 0.7, inPlace.getScale() );
+  inPlace += b*0.2 + c*0.1;
+  EXPECT_TRUE( expected.equals( inPlace, EPSILON ) );
+  inPlace -= b*0.2 + c*0.1;
+  EXPECT_NEAR( 0, inPlace.getCount("castle"), EPSILON );
+  inPlace.remove( "castle" );
+  EXPECT_TRUE( inPlace.equals( a*0.7, EPSILON ) );
+
+  cout << "- Expressions referring to their destination." << endl;
+  Counter<StringV> self( a );
+  self += b + self;
+  EXPECT_TRUE( self.equals( a*2 + b, EPSILON ) );
+  self = self - a*2;
+  EXPECT_TRUE( self.equals( b, EPSILON ) );
+  self -= self * 0.5;
+  EXPECT_TRUE( self.equals( b / 2, EPSILON ) );
+
+  cout << "- Temporaries are reused." << endl;
+  Counter<StringV> moved( Counter<StringV>( a ) * 4 + a );
+  EXPECT_TRUE( moved.equals( a * 5, EPSILON ) );
+  Counter<StringV> scaledTemporary( Counter<StringV>( a ) / 4 );
+  EXPECT_EQ( 0.25, scaledTemporary.getScale() );
+}
+
+TEST_F(CounterTests, MaxValueCache)
+{
+  using namespace std;
+  using namespace Counters;
+
+  cout << "- Negative counts." << endl;
+  Counter<StringV> negative;
+  negative.setCount( "king", -3 );
+  negative.setCount( "queen", -1 );
+  EXPECT_EQ( "queen", negative.maxValue() );
+  EXPECT_EQ( StringV(), Counter<StringV>().maxValue() );
+
+  cout << "- Relaxed policy." << endl;
+  Counter<StringV> relaxed( chessList.begin(), chessList.end() );
+  EXPECT_EQ( CACHE_POLICY_RELAXED, relaxed.getMaxCachePolicy() );
+  EXPECT_FALSE( relaxed.isMaxSynched() );
+  EXPECT_EQ( "pawn", relaxed.maxValue() );
+  EXPECT_TRUE( relaxed.isMaxSynched() );
+  relaxed.incrementCount( "king", 10 );
+  EXPECT_FALSE( relaxed.isMaxSynched() );
+  EXPECT_EQ( "king", relaxed.maxValue() );
+  relaxed *= 0.5;
+  relaxed += 1;
+  EXPECT_TRUE( relaxed.isMaxSynched() );
+  EXPECT_EQ( "king", relaxed.maxValue() );
+  relaxed *= -1;
+  EXPECT_FALSE( relaxed.isMaxSynched() );
+  EXPECT_EQ( "queen", relaxed.maxValue() );
+
+  cout << "- Persistent policy." << endl;
+  Counter<StringV> persistent;
+  persistent.setMaxCachePolicy( CACHE_POLICY_PERSISTENT );
+  persistent.incrementAll( chessList.begin(), chessList.end(), 1 );
+  EXPECT_TRUE( persistent.isMaxSynched() );
+  EXPECT_EQ( "pawn", persistent.maxValue() );
+  persistent.incrementCount( "rook", 5 );
+  persistent.setCount( "bishop", 3 );
+  persistent.remove( "knight" );
+  EXPECT_TRUE( persistent.isMaxSynched() );
+  EXPECT_EQ( "pawn", persistent.maxValue() );
+  persistent.setCount( "queen", 9 );
+  EXPECT_TRUE( persistent.isMaxSynched() );
+  EXPECT_EQ( "queen", persistent.maxValue() );
+  persistent.normalize();
+  EXPECT_TRUE( persistent.isMaxSynched() );
+  persistent.incrementCount( "queen", -0.5 );
+  EXPECT_FALSE( persistent.isMaxSynched() );
+  EXPECT_EQ( "pawn", persistent.maxValue() );
+  persistent.remove( "pawn" );
+  EXPECT_FALSE( persistent.isMaxSynched() );
+  EXPECT_EQ( "rook", persistent.maxValue() );
+
+  cout << "- Copies and combination." << endl;
+  Counter<StringV> copy( persistent );
+  EXPECT_TRUE( copy.isMaxSynched() );
+  EXPECT_EQ( CACHE_POLICY_PERSISTENT, copy.getMaxCachePolicy() );
+  copy += relaxed * -10;
+  EXPECT_EQ( "king", copy.maxValue() );
+  copy.resetCache();
+  EXPECT_FALSE( copy.isMaxSynched() );
+  EXPECT_EQ( "king", copy.maxValue() );
+
+  cout << "- Summation policies of the total." << endl;
+  Counter<int> tenths;
+  for( int i = 0; i < 100000; ++i )
+    tenths.incrementCount( i, 0.1 );
+  EXPECT_EQ( SUMMATION_NAIVE, tenths.getSummationPolicy() );
+  tenths.setSummationPolicy( SUMMATION_KAHAN );
+  EXPECT_FALSE( tenths.isTotalSynched() );
+  EXPECT_EQ( 10000, tenths.totalCount() );
+  Counter<int> pairwise( tenths );
+  EXPECT_EQ( SUMMATION_KAHAN, pairwise.getSummationPolicy() );
+  pairwise.setSummationPolicy( SUMMATION_PAIRWISE );
+  EXPECT_NEAR( 10000, pairwise.totalCount(), 1e-9 );
+  pairwise *= 2;
+  pairwise.resetCache();
+  EXPECT_NEAR( 20000, pairwise.totalCount(), 1e-9 );
+}
+
+TEST_F(CounterTests, Instrumentation)
+{
+  using namespace std;
+  using namespace Counters;
+
+  cout << "- The total cache counts its hits, misses and invalidations." << endl;
+  Counter<StringV> counter( chessList.begin(), chessList.end() );
+  counter.resetCache();
+  const NumCacheStats before( counter.getTotalCacheStats() );
+  EXPECT_EQ( 16, counter.totalCount() );
+  EXPECT_EQ( 16, counter.totalCount() );
+  counter.incrementCount( "king", 1 );
+  counter.incrementCount( "king", 1 );
+  EXPECT_EQ( 18, counter.totalCount() );
+  NumCacheStats stats( counter.getTotalCacheStats() );
+  EXPECT_EQ( before.misses + 2, stats.misses );
+  EXPECT_EQ( before.hits + 1, stats.hits );
+  EXPECT_EQ( before.invalidations + 1, stats.invalidations );
+
+  cout << "- A persistent cache keeps hitting." << endl;
+  counter.setCachePolicy( CACHE_POLICY_PERSISTENT );
+  counter.incrementCount( "king", 1 );
+  EXPECT_EQ( 19, counter.totalCount() );
+  EXPECT_EQ( stats.hits + 1, counter.getTotalCacheStats().hits );
+  EXPECT_EQ( stats.invalidations, counter.getTotalCacheStats().invalidations );
+
+  cout << "- The map of the counts can be instrumented." << endl;
+  MapTypeErasure::MapStats mapStats;
+  EXPECT_FALSE( counter.getMapStats( mapStats ) );
+  EXPECT_TRUE( counter.setMapInstrumented( true ) );
+  EXPECT_EQ( 4, counter.getCount( "king" ) );
+  counter.incrementCount( "castle", 1 );
+  ASSERT_TRUE( counter.getMapStats( mapStats ) );
+  EXPECT_GE( mapStats.find.count, 1u );
+  EXPECT_GE( mapStats.insert.count, 1u );
+  EXPECT_EQ( 7u, mapStats.peakSize );
+  EXPECT_TRUE( Counter<StringV>( counter ).getMapStats( mapStats ) );
+
+  StaticCounter<StringV> fixed;
+  EXPECT_FALSE( fixed.setMapInstrumented( true ) );
+  EXPECT_FALSE( fixed.getMapStats( mapStats ) );
+}
+
+TEST_F(CounterTests, Pruning)
+{
+  using namespace std;
+  using namespace Counters;
+
+  cout << "- prune() removes the counts below the threshold." << endl;
+  Counter<StringV> counter( chessList.begin(), chessList.end() );
+  counter.setCachePolicy( CACHE_POLICY_PERSISTENT );
+  counter.setMaxCachePolicy( CACHE_POLICY_PERSISTENT );
+  EXPECT_EQ( 16, counter.totalCount() );
+  EXPECT_EQ( "pawn", counter.maxValue() );
+  EXPECT_EQ( 2u, counter.prune( 2 ) );
+  EXPECT_EQ( 4u, counter.size() );
+  EXPECT_FALSE( counter.contains( "king" ) );
+  EXPECT_EQ( 2, counter.getCount( "rook" ) );
+  EXPECT_TRUE( counter.isTotalSynched() );
+  EXPECT_TRUE( counter.isMaxSynched() );
+  EXPECT_EQ( 14, counter.totalCount() );
+  EXPECT_EQ( 0u, counter.prune( 1 ) );
+  EXPECT_EQ( 3u, counter.prune( 3 ) );
+  EXPECT_EQ( "pawn", counter.maxValue() );
+  EXPECT_EQ( 8, counter.totalCount() );
+  EXPECT_EQ( 1u, counter.prune( 100 ) );
+  EXPECT_TRUE( counter.empty() );
+  EXPECT_EQ( 0, counter.totalCount() );
+
+  cout << "- Scaled counts are compared after scaling." << endl;
+  Counter<StringV> scaled( chessList.begin(), chessList.end() );
+  scaled *= 0.5;
+  EXPECT_EQ( 5u, scaled.prune( 1.5 ) );
+  EXPECT_EQ( 1u, scaled.size() );
+  EXPECT_EQ( 4, scaled.getCount( "pawn" ) );
+  EXPECT_EQ( 4, scaled.totalCount() );
+
+  cout << "- pruneToTopK() keeps k values, ties included." << endl;
+  Counter<StringV> top( chessList.begin(), chessList.end() );
+  EXPECT_EQ( 0u, top.pruneToTopK( 6 ) );
+  EXPECT_EQ( 2u, top.pruneToTopK( 4 ) );
+  EXPECT_EQ( 4u, top.size() );
+  EXPECT_TRUE( top.contains( "pawn" ) );
+  EXPECT_EQ( 14, top.totalCount() );
+  EXPECT_EQ( 2u, top.pruneToTopK( 2 ) );
+  EXPECT_EQ( 2u, top.size() );
+  EXPECT_EQ( 10, top.totalCount() );
+  EXPECT_EQ( 2, top.topK(2)[1].second );
+  EXPECT_EQ( "pawn", top.maxValue() );
+  EXPECT_EQ( 2u, top.pruneToTopK( 0 ) );
+  EXPECT_TRUE( top.empty() );
+
+  cout << "- Memory usage follows the pruning." << endl;
+  Counter<StringV> large;
+  for( int i = 0; i < 1000; ++i )
+    large.incrementCount( std::to_string(i), i % 10 );
+  const std::size_t before( large.memoryUsage() );
+  EXPECT_GT( before, 1000 * sizeof(Counter<StringV>::IteratorValue_t) );
+  EXPECT_EQ( 500u, large.prune( 5 ) );
+  large.shrinkToFit();
+  EXPECT_LT( large.memoryUsage(), before );
+  EXPECT_GE( large.memoryUsage(), sizeof(large) );
+  Counters::Counter<StringV, MapTypeErasure::StaticMap< std::map<StringV, Count> > > ordered( large );
+  EXPECT_EQ( 500u, ordered.size() );
+  EXPECT_EQ( 400u, ordered.pruneToTopK( 100 ) );
+  EXPECT_EQ( 100u, ordered.size() );
+  EXPECT_EQ( 900, ordered.totalCount() );
+}
+
 #endif // __COUNTER_TESTS_HPP__
@@ -0,0 +1,336 @@
+#ifndef __DELTA_TESTS_HPP__
+#define __DELTA_TESTS_HPP__
+
+#include "Counters/DeltaFormat.hpp"
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+class DeltaTests : public ::testing::Test
+{
+public:
+  typedef std::string K;
+  typedef Counters::Counter<K> Counter_t;
+  typedef Counters::CounterMap<K, K> CounterMap_t;
+
+protected:
+  // Merges the changes of node since its last checkpoint into aggregate,
+  // through the wire format.
+  template <typename Model>
+  static std::size_t ship( Model& node, Model& aggregate,
+			   Counters::DeltaOptions const& options = Counters::DeltaOptions() )
+  {
+    std::stringstream wire;
+    EXPECT_TRUE( Counters::writeDelta( wire, node.extractDelta(), options ) );
+    Model delta;
+    EXPECT_TRUE( Counters::readDelta( wire, delta ) );
+    aggregate.applyDelta( delta );
+    return wire.str().size();
+  }
+
+  // TRUE if no counts of the maps differ by precision or more, a missing
+  // count being 0: merging floating-point deltas may leave tiny counts
+  // where the counts cancel out.
+  static bool near( CounterMap_t const& a, CounterMap_t const& b, double precision = 1e-9 )
+  {
+    for( int pass = 0; pass < 2; ++pass )
+      {
+	CounterMap_t const& x( pass == 0 ? a : b );
+	CounterMap_t const& y( pass == 0 ? b : a );
+	for( CounterMap_t::ConstIterator i( x.begin() ); i != x.end(); ++i )
+	  for( Counter_t::ConstIterator j( i->second.begin() ); j != i->second.end(); ++j )
+	    if( !(std::fabs( j->second - y.getCount( i->first, j->first ) ) < precision) )
+	      return false;
+      }
+    return true;
+  }
+};
+
+TEST_F(DeltaTests, CounterTracking)
+{
+  using namespace std;
+
+  cout << "- Without tracking, the delta is empty." << endl;
+  Counter_t node;
+  node.incrementCount( "a", 2 );
+  EXPECT_FALSE( node.isDeltaTracking() );
+  EXPECT_TRUE( node.extractDelta().empty() );
+
+  cout << "- The delta holds the changes since the checkpoint." << endl;
+  node.setDeltaTracking( true );
+  EXPECT_TRUE( node.isDeltaTracking() );
+  node.incrementCount( "a", 3 );
+  node.incrementCount( "b", 1 );
+  node.setCount( "c", 4 );
+  node.incrementCount( "d", 1 );
+  node.remove( "d" );
+  Counter_t delta( node.extractDelta() );
+  EXPECT_EQ( 3u, delta.size() );
+  EXPECT_EQ( 3, delta.getCount( "a" ) );
+  EXPECT_EQ( 1, delta.getCount( "b" ) );
+  EXPECT_EQ( 4, delta.getCount( "c" ) );
+  EXPECT_FALSE( delta.contains( "d" ) );
+  EXPECT_TRUE( node.extractDelta().empty() );
+
+  cout << "- Applying the deltas of every modifier tracks the counter." << endl;
+  Counter_t aggregate( node ), other;
+  other.incrementCount( "a", 1 );
+  other.incrementCount( "e", 5 );
+  const std::pair<K, double> batch[] = { std::make_pair( "b", 2.0 ), std::make_pair( "f", 1.0 ) };
+  node.incrementMany( batch, 2 );
+  node.setCount( "a", 1 );
+  node += other;
+  node -= other * 0.5;
+  node *= 3;
+  node += 1;
+  node.prune( 4 );
+  node.pruneToTopK( 3 );
+  node = node * 2 + other;
+  node.normalize();
+  ship( node, aggregate );
+  EXPECT_TRUE( aggregate.equals( node, 1e-9 ) ) << aggregate << " " << node;
+
+  cout << "- Deltas scale with the churn, not with the counter." << endl;
+  for( int i = 0; i < 1000; ++i )
+    node.incrementCount( K( 1, 'a' + i % 26 ) + std::to_string(i), 1 );
+  ship( node, aggregate );
+  node.incrementCount( "a", 1 );
+  EXPECT_EQ( 1u, node.extractDelta().size() );
+  EXPECT_GT( node.size(), 1000u );
+
+  cout << "- Copies keep the log; turning tracking off drops it." << endl;
+  node.incrementCount( "b", 1 );
+  Counter_t copy( node );
+  EXPECT_TRUE( copy.isDeltaTracking() );
+  EXPECT_EQ( 1, copy.extractDelta().getCount( "b" ) );
+  node.setDeltaTracking( false );
+  EXPECT_TRUE( node.extractDelta().empty() );
+
+  cout << "- Assignments keep the tracking and are logged." << endl;
+  Counter_t tracked, replacement;
+  tracked.incrementCount( "a", 1 );
+  tracked.setDeltaTracking( true );
+  tracked.incrementCount( "b", 2 );
+  replacement.incrementCount( "c", 3 );
+  tracked = replacement;
+  EXPECT_TRUE( tracked.isDeltaTracking() );
+  Counter_t assigned( tracked.extractDelta() );
+  EXPECT_EQ( 2u, assigned.size() );
+  EXPECT_EQ( -1, assigned.getCount( "a" ) );
+  EXPECT_EQ( 3, assigned.getCount( "c" ) );
+  EXPECT_FALSE( assigned.contains( "b" ) );
+  Counter_t moved;
+  moved.incrementCount( "d", 4 );
+  moved.setDeltaTracking( true );
+  tracked = std::move( moved );
+  EXPECT_TRUE( tracked.isDeltaTracking() );
+  EXPECT_TRUE( moved.isDeltaTracking() );
+  assigned = tracked.extractDelta();
+  EXPECT_EQ( -3, assigned.getCount( "c" ) );
+  EXPECT_EQ( 4, assigned.getCount( "d" ) );
+  EXPECT_TRUE( moved.extractDelta().empty() );
+  replacement = tracked;
+  EXPECT_FALSE( replacement.isDeltaTracking() );
+}
+
+TEST_F(DeltaTests, CounterMapTracking)
+{
+  using namespace std;
+
+  cout << "- Nodes ship deltas to an aggregator." << endl;
+  CounterMap_t nodes[2], aggregate, expected;
+  for( int n = 0; n < 2; ++n )
+    {
+      nodes[n].setDeltaTracking( true );
+      for( int i = 0; i < 300; ++i )
+	nodes[n].incrementCount( K( 1, 'a' + (i + n) % 7 ), K( 1, 'a' + i % 13 ), 1 + i % 3 );
+    }
+  for( int n = 0; n < 2; ++n )
+    ship( nodes[n], aggregate );
+  expected = nodes[0] + nodes[1];
+  EXPECT_TRUE( near( aggregate, expected ) );
+
+  cout << "- Every modifier is logged." << endl;
+  const std::tuple<K, K, double> batch[] = { std::make_tuple( "a", "z", 2.0 ), std::make_tuple( "y", "a", 1.0 ) };
+  nodes[0].incrementMany( batch, 2 );
+  nodes[0].setCount( "a", "a", 100 );
+  nodes[0].remove( "b" );
+  nodes[0].remove( "c", "c" );
+  nodes[0] += nodes[1];
+  nodes[0].prune( 20, 3 );
+  nodes[1] *= 2;
+  nodes[1].conditionalNormalize();
+  nodes[1] -= nodes[0];
+  for( int n = 0; n < 2; ++n )
+    ship( nodes[n], aggregate );
+  expected = nodes[0] + nodes[1];
+  EXPECT_TRUE( near( aggregate, expected ) );
+
+  cout << "- Deltas only hold the touched rows." << endl;
+  nodes[0].incrementCount( "a", "a", 1 );
+  nodes[0].incrementCount( "d", "b", 1 );
+  CounterMap_t delta( nodes[0].extractDelta() );
+  EXPECT_EQ( 2u, delta.size() );
+  EXPECT_EQ( 1u, delta.size( "a" ) );
+  EXPECT_DOUBLE_EQ( 2, delta.totalCount() );
+  aggregate.applyDelta( delta );
+
+  cout << "- Evictions and clear() are logged." << endl;
+  const std::size_t usage( nodes[0].memoryUsage() );
+  nodes[0].setEvictionPolicy( Counters::EvictionPolicy( usage / 2, 0.75, 1 ) );
+  nodes[0].incrementCount( "e", "e", 1 );
+  nodes[1].clear();
+  for( int n = 0; n < 2; ++n )
+    ship( nodes[n], aggregate );
+  EXPECT_LT( nodes[0].memoryUsage(), usage / 2 );
+  EXPECT_TRUE( nodes[1].empty() );
+  EXPECT_TRUE( near( aggregate, nodes[0] ) );
+}
+
+TEST_F(DeltaTests, MergingTrackedMaps)
+{
+  using namespace std;
+
+  cout << "- A tracked map merged by move logs its removals." << endl;
+  CounterMap_t a, b, aggregate;
+  b.setDeltaTracking( true );
+  b.incrementCount( "k", "v", 3 );
+  b.incrementCount( "l", "v", 1 );
+  ship( b, aggregate );
+  a += std::move( b );
+  EXPECT_TRUE( b.empty() );
+  const CounterMap_t delta( b.extractDelta() );
+  EXPECT_EQ( -3, delta.getCount( "k", "v" ) );
+  EXPECT_EQ( -1, delta.getCount( "l", "v" ) );
+  aggregate.applyDelta( delta );
+  EXPECT_TRUE( aggregate.empty() );
+
+  cout << "- So does one copied because of its factory." << endl;
+  CounterMap_t arena( Counters::makeArenaCounterMap<K, K>() );
+  arena.setDeltaTracking( true );
+  arena.incrementCount( "k", "w", 2 );
+  arena.extractDelta();
+  a += std::move( arena );
+  EXPECT_EQ( -2, arena.extractDelta().getCount( "k", "w" ) );
+  EXPECT_EQ( 2, a.getCount( "k", "w" ) );
+
+  cout << "- A tracked destination logs the counts it reads." << endl;
+  Counter_t counter;
+  counter.incrementCount( "a", 1 );
+  counter.setDeltaTracking( true );
+  std::stringstream wire;
+  Counter_t written;
+  written.incrementCount( "b", 2 );
+  ASSERT_TRUE( Counters::writeDelta( wire, written ) );
+  ASSERT_TRUE( Counters::readDelta( wire, counter ) );
+  const Counter_t counterDelta( counter.extractDelta() );
+  EXPECT_EQ( -1, counterDelta.getCount( "a" ) );
+  EXPECT_EQ( 2, counterDelta.getCount( "b" ) );
+}
+
+TEST_F(DeltaTests, WireFormat)
+{
+  using namespace std;
+
+  CounterMap_t model;
+  model.setDeltaTracking( true );
+  for( int i = 0; i < 1000; ++i )
+    model.incrementCount( "row" + std::to_string( i % 50 ), "value" + std::to_string( i % 37 ), 1 + i % 5 );
+  const CounterMap_t delta( model.extractDelta() );
+
+  cout << "- Doubles are exact." << endl;
+  std::stringstream exact;
+  ASSERT_TRUE( Counters::writeDelta( exact, delta ) );
+  CounterMap_t read;
+  read.incrementCount( "stale", "stale", 1 );
+  ASSERT_TRUE( Counters::readDelta( exact, read ) );
+  EXPECT_TRUE( read == delta );
+
+  cout << "- Integral counts in steps of 1 are exact and smaller." << endl;
+  std::stringstream steps;
+  ASSERT_TRUE( Counters::writeDelta( steps, delta, Counters::DeltaOptions( Counters::DELTA_COUNTS_STEPS ) ) );
+  EXPECT_LT( steps.str().size() * 2, exact.str().size() );
+  ASSERT_TRUE( Counters::readDelta( steps, read ) );
+  EXPECT_TRUE( read == delta );
+
+  cout << "- Each value is written once." << endl;
+  std::size_t values(0);
+  for( int i = 0; i < 37; ++i )
+    values += ( "value" + std::to_string(i) ).size();
+  EXPECT_LT( steps.str().size(), 32 + 37 + values + 50 * (7 + 20 * 2) );
+
+  cout << "- Quantized counts are rounded, and those rounding to 0 left out." << endl;
+  Counter_t counter;
+  counter.incrementCount( "a", 0.3 );
+  counter.incrementCount( "b", 1.26 );
+  counter.incrementCount( "c", -2.5e-8 );
+  std::stringstream quantized;
+  ASSERT_TRUE( Counters::writeDelta( quantized, counter, Counters::DeltaOptions( Counters::DELTA_COUNTS_STEPS, 0.25 ) ) );
+  ASSERT_TRUE( Counters::writeDelta( quantized, counter, Counters::DeltaOptions( Counters::DELTA_COUNTS_FLOAT ) ) );
+  Counter_t first, second;
+  ASSERT_TRUE( Counters::readDelta( quantized, first ) );
+  ASSERT_TRUE( Counters::readDelta( quantized, second ) );
+  EXPECT_EQ( 2u, first.size() );
+  EXPECT_EQ( 0.25, first.getCount( "a" ) );
+  EXPECT_EQ( 1.25, first.getCount( "b" ) );
+  EXPECT_FALSE( first.contains( "c" ) );
+  EXPECT_TRUE( second.equals( counter, 1e-6 ) );
+  EXPECT_FALSE( Counters::readDelta( quantized, first ) );
+  EXPECT_EQ( 2u, first.size() );
+  std::stringstream invalid;
+  EXPECT_FALSE( Counters::writeDelta( invalid, counter, Counters::DeltaOptions( Counters::DELTA_COUNTS_STEPS, 0 ) ) );
+
+  cout << "- Integral keys and values." << endl;
+  Counters::CounterMap<int, unsigned char> numbers, numbersRead;
+  numbers.incrementCount( -300, 255, 2 );
+  numbers.incrementCount( 1 << 30, 0, -1 );
+  std::stringstream numbersWire;
+  ASSERT_TRUE( Counters::writeDelta( numbersWire, numbers ) );
+  ASSERT_TRUE( Counters::readDelta( numbersWire, numbersRead ) );
+  EXPECT_TRUE( numbersRead == numbers );
+}
+
+TEST_F(DeltaTests, MalformedInput)
+{
+  using namespace std;
+
+  CounterMap_t delta, read;
+  delta.incrementCount( "a", "b", 1 );
+  delta.incrementCount( "a", "c", 2 );
+  delta.incrementCount( "b", "c", 3 );
+  std::ostringstream os;
+  ASSERT_TRUE( Counters::writeDelta( os, delta, Counters::DeltaOptions( Counters::DELTA_COUNTS_STEPS ) ) );
+  const std::string bytes( os.str() );
+  read.incrementCount( "x", "y", 1 );
+  const CounterMap_t unchanged( read );
+
+  cout << "- Truncated deltas are rejected, leaving the destination unchanged." << endl;
+  for( std::size_t n = 0; n < bytes.size(); ++n )
+    {
+      std::istringstream is( bytes.substr( 0, n ) );
+      EXPECT_FALSE( Counters::readDelta( is, read ) ) << n;
+    }
+  EXPECT_TRUE( read == unchanged );
+
+  cout << "- So are deltas of other types and corrupt indices." << endl;
+  std::istringstream asCounter( bytes );
+  Counter_t counter;
+  EXPECT_FALSE( Counters::readDelta( asCounter, counter ) );
+  std::istringstream asNumbers( bytes );
+  Counters::CounterMap<int, K> numbers;
+  EXPECT_FALSE( Counters::readDelta( asNumbers, numbers ) );
+  std::string corrupt( bytes );
+  // the gap of the last entry, followed by its count
+  corrupt[ corrupt.size() - 2 ] = 0x7f;
+  std::istringstream is( corrupt );
+  EXPECT_FALSE( Counters::readDelta( is, read ) );
+  EXPECT_TRUE( read == unchanged );
+}
+
+#endif // __DELTA_TESTS_HPP__
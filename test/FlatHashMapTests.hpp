@@ -0,0 +1,196 @@
+#ifndef __FLAT_HASH_MAP_TESTS_HPP__
+#define __FLAT_HASH_MAP_TESTS_HPP__
+
+#include "AnyMap/FlatHashMap.hpp"
+#include "AnyMap/AnyMap.hpp"
+#include "Counters/Counter.hpp"
+#include "Counters/CounterFactories.hpp"
+
+#include <boost/unordered_map.hpp>
+#include <boost/lexical_cast.hpp>
+#include <map>
+#include <string>
+#include <stdlib.h>
+
+class FlatHashMapTests : public ::testing::Test
+{
+public:
+  typedef std::string K;
+  typedef double V;
+
+  typedef MapTypeErasure::FlatHashMap<K, V> FlatMap;
+  typedef MapTypeErasure::FlatHashMap<int, int> IntFlatMap;
+  typedef MapTypeErasure::AnyMap<K, V> Map;
+
+protected:
+  virtual void SetUp()
+  {
+    flatMap["one"]   = 1;
+    flatMap["two"]   = 2;
+    flatMap["three"] = 3;
+    flatMap["four"]  = 4;
+  }
+
+  FlatMap flatMap;
+};
+
+TEST_F(FlatHashMapTests, APIs)
+{
+  using namespace std;
+
+  cout << "- Empty map." << endl;
+  FlatMap empty;
+  EXPECT_TRUE( empty.empty() );
+  EXPECT_EQ( 0, empty.bucket_count() );
+  EXPECT_TRUE( empty.begin() == empty.end() );
+  EXPECT_TRUE( empty.find("one") == empty.end() );
+  EXPECT_EQ( 0, empty.erase("one") );
+
+  cout << "- Lookup." << endl;
+  EXPECT_EQ( 4, flatMap.size() );
+  EXPECT_EQ( 1, flatMap.count("one") );
+  EXPECT_EQ( 0, flatMap.count("five") );
+  EXPECT_EQ( 3, flatMap.at("three") );
+  EXPECT_EQ( 2, flatMap.find("two")->second );
+  EXPECT_THROW( flatMap.at("five"), std::out_of_range );
+
+  cout << "- Inserts." << endl;
+  EXPECT_FALSE( flatMap.insert( FlatMap::value_type("one", 10) ).second );
+  EXPECT_TRUE( flatMap.insert( FlatMap::value_type("five", 5) ).second );
+  EXPECT_FALSE( flatMap.emplace( K("five"), 50.0 ).second );
+  EXPECT_TRUE( flatMap.try_emplace( "six", 6.0 ).second );
+  EXPECT_EQ( 0, flatMap["seven"] );
+  EXPECT_EQ( 7, flatMap.size() );
+  EXPECT_EQ( 1, flatMap["one"] );
+  EXPECT_EQ( 5, flatMap["five"] );
+
+  cout << "- Traversal." << endl;
+  V sum(0);
+  size_t n(0);
+  for( FlatMap::const_iterator i(flatMap.begin()); i != flatMap.end(); ++i, ++n )
+    sum += i->second;
+  EXPECT_EQ( flatMap.size(), n );
+  EXPECT_EQ( 21, sum );
+
+  cout << "- Copy, move, swap." << endl;
+  FlatMap copy( flatMap );
+  EXPECT_EQ( flatMap.size(), copy.size() );
+  EXPECT_EQ( 6, copy["six"] );
+  FlatMap moved( std::move(copy) );
+  EXPECT_EQ( 6, moved["six"] );
+  EXPECT_TRUE( copy.empty() );
+  copy = moved;
+  EXPECT_EQ( moved.size(), copy.size() );
+  copy.swap( empty );
+  EXPECT_TRUE( copy.empty() );
+  EXPECT_EQ( 5, empty.at("five") );
+
+  cout << "- Erase and clear." << endl;
+  EXPECT_EQ( 1, flatMap.erase("one") );
+  EXPECT_EQ( 0, flatMap.erase("one") );
+  EXPECT_EQ( 6, flatMap.size() );
+  for( FlatMap::iterator i(flatMap.begin()); i != flatMap.end(); )
+    i = i->second > 4 ? flatMap.erase(i) : ++i;
+  EXPECT_EQ( 4, flatMap.size() );
+  EXPECT_EQ( 1, flatMap.count("seven") );
+  EXPECT_EQ( 0, flatMap.count("six") );
+  const FlatMap::size_type buckets( flatMap.bucket_count() );
+  flatMap.clear();
+  EXPECT_TRUE( flatMap.empty() );
+  EXPECT_TRUE( flatMap.begin() == flatMap.end() );
+  EXPECT_EQ( buckets, flatMap.bucket_count() );
+}
+
+TEST_F(FlatHashMapTests, AgainstStdMap)
+{
+  using namespace std;
+
+  cout << "- Random inserts and erases match std::map." << endl;
+  srand( 7 );
+  IntFlatMap flat;
+  std::map<int, int> expected;
+  for( int step = 0; step < 200000; ++step )
+    {
+      const int key( rand() % 5000 );
+      if( rand() % 3 == 0 )
+	EXPECT_EQ( expected.erase(key), flat.erase(key) );
+      else
+	{
+	  flat[key] += step;
+	  expected[key] += step;
+	}
+      ASSERT_TRUE( flat.empty() || flat.size() < flat.bucket_count() );
+    }
+  ASSERT_EQ( expected.size(), flat.size() );
+  for( std::map<int, int>::const_iterator i(expected.begin()); i != expected.end(); ++i )
+    {
+      IntFlatMap::const_iterator fi( flat.find(i->first) );
+      ASSERT_TRUE( fi != flat.end() );
+      EXPECT_EQ( i->second, fi->second );
+    }
+
+  cout << "- Capacity." << endl;
+  IntFlatMap reserved;
+  reserved.reserve( 10000 );
+  const IntFlatMap::size_type buckets( reserved.bucket_count() );
+  for( int i = 0; i < 10000; ++i )
+    reserved[i] = i;
+  EXPECT_EQ( buckets, reserved.bucket_count() );
+  for( int i = 100; i < 10000; ++i )
+    reserved.erase(i);
+  reserved.rehash(0);
+  EXPECT_LT( reserved.bucket_count(), buckets / 16 );
+  EXPECT_EQ( 100, reserved.size() );
+  EXPECT_EQ( 99, reserved.at(99) );
+  reserved.max_load_factor( 2.0f );
+  EXPECT_FLOAT_EQ( 0.9375f, reserved.max_load_factor() );
+  reserved.clear();
+  reserved.rehash(0);
+  EXPECT_EQ( 0, reserved.bucket_count() );
+}
+
+TEST_F(FlatHashMapTests, InAnyMapAndCounter)
+{
+  using namespace std;
+  using namespace Counters;
+
+  cout << "- AnyMap over a FlatHashMap." << endl;
+  boost::unordered_map<K, V> boostMap( flatMap.begin(), flatMap.end() );
+  Map flat( flatMap );
+  EXPECT_EQ( Map(boostMap), flat );
+  EXPECT_EQ( 3, flat.find( boost::string_view("three") )->second );
+  EXPECT_TRUE( flat.try_emplace( "five", 5.0 ).second );
+  flat.reserve( 1000 );
+  EXPECT_GE( flat.bucket_count(), 1000u );
+  flat.shrink_to_fit();
+  EXPECT_LT( flat.bucket_count(), 1000u );
+  EXPECT_EQ( 5, flat.size() );
+
+  cout << "- Counters created by a MapTypeCounterFactory." << endl;
+  MapTypeCounterFactory<K, FlatMap> factory;
+  Counter<K> counter( factory.createCounter() );
+  Counter<K> expected;
+  for( int i = 0; i < 1000; ++i )
+    {
+      const K word( boost::lexical_cast<K>(i % 37) );
+      counter.incrementCount( word, 1 );
+      expected.incrementCount( word, 1 );
+    }
+  EXPECT_EQ( 37, counter.size() );
+  EXPECT_EQ( 1000, counter.totalCount() );
+  EXPECT_EQ( expected, counter );
+  counter.normalize();
+  expected.normalize();
+  EXPECT_TRUE( expected.equals( counter, 1e-12 ) );
+
+  cout << "- Bulk arithmetic scans the slots." << endl;
+  EXPECT_EQ( 10, flatMap.sum_mapped() );
+  flatMap.scale_mapped( 2 );
+  EXPECT_EQ( 4, flatMap.at("two") );
+  double sum(0);
+  ASSERT_TRUE( Map(flatMap).sum_mapped( sum ) );
+  EXPECT_EQ( 20, sum );
+  EXPECT_FALSE( (MapTypeErasure::details::HasSumMapped< MapTypeErasure::FlatHashMap<K, Counter<K> > >::value) );
+}
+
+#endif // __FLAT_HASH_MAP_TESTS_HPP__
@@ -0,0 +1,146 @@
+#ifndef __FROZEN_COUNTER_MAP_TESTS_HPP__
+#define __FROZEN_COUNTER_MAP_TESTS_HPP__
+
+#include "Counters/FrozenCounterMap.hpp"
+#include "Counters/CounterMap.hpp"
+
+#include <boost/utility/string_view.hpp>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrozenCounterMapTests : public ::testing::Test
+{
+public:
+  typedef std::string K;
+  typedef Counters::CounterMap<K, K> CounterMap_t;
+  typedef Counters::FrozenCounterMap<K, K> Frozen_t;
+
+protected:
+  virtual void SetUp()
+  {
+    for( int i = 0; i < 1000; ++i )
+      counterMap.incrementCount( K( 1, 'a' + i % 13 ), K( 1 + i % 3, 'a' + i % 17 ), 1 + i % 5 );
+    counterMap.setCount( "empty", "zero", 0 );
+  }
+
+  CounterMap_t counterMap;
+};
+
+TEST_F(FrozenCounterMapTests, Lookup)
+{
+  using namespace std;
+
+  cout << "- Same counts and totals as the CounterMap." << endl;
+  const Frozen_t frozen( counterMap );
+  EXPECT_EQ( counterMap.size(), frozen.size() );
+  EXPECT_DOUBLE_EQ( counterMap.totalCount(), frozen.totalCount() );
+  for( CounterMap_t::ConstIterator i(counterMap.begin()); i != counterMap.end(); ++i )
+    {
+      EXPECT_TRUE( frozen.contains( i->first ) );
+      EXPECT_EQ( i->second.size(), frozen.size( i->first ) );
+      EXPECT_DOUBLE_EQ( i->second.totalCount(), frozen.totalCount( i->first ) );
+      EXPECT_EQ( i->second.getCount( i->second.maxValue() ), frozen.getCount( i->first, frozen.maxValue( i->first ) ) );
+      for( CounterMap_t::Counter_t::ConstIterator j(i->second.begin()); j != i->second.end(); ++j )
+	{
+	  EXPECT_TRUE( frozen.contains( i->first, j->first ) );
+	  EXPECT_EQ( j->second, frozen.getCount( i->first, j->first ) );
+	}
+    }
+
+  cout << "- Missing keys and values." << endl;
+  EXPECT_FALSE( frozen.contains( "zz" ) );
+  EXPECT_FALSE( frozen.contains( "a", "zz" ) );
+  EXPECT_EQ( 0, frozen.getCount( "zz", "a" ) );
+  EXPECT_EQ( 0, frozen.getCount( "a", "zz" ) );
+  EXPECT_EQ( 0, frozen.totalCount( "zz" ) );
+  EXPECT_EQ( 0, frozen.size( "zz" ) );
+  EXPECT_EQ( "", frozen.maxValue( "zz" ) );
+  EXPECT_TRUE( frozen.contains( "empty", "zero" ) );
+  EXPECT_EQ( 0, frozen.getProbability( "empty", "zero" ) );
+  EXPECT_TRUE( Frozen_t().empty() );
+  EXPECT_FALSE( Frozen_t().contains( "a" ) );
+
+  cout << "- Heterogeneous lookups." << endl;
+  const std::string text( "a bb" );
+  const boost::string_view a( text.data(), 1 ), bb( text.data() + 2, 2 );
+  EXPECT_TRUE( frozen.contains( a ) );
+  EXPECT_TRUE( frozen.contains( a, bb ) == frozen.contains( "a", "bb" ) );
+  EXPECT_EQ( counterMap.getCount( "a", "bb" ), frozen.getCount( a, bb ) );
+  EXPECT_EQ( counterMap.getCount( "a", "bb" ), frozen.getCount( K("a"), bb ) );
+  EXPECT_EQ( counterMap.totalCount( "a" ), frozen.totalCount( a ) );
+}
+
+TEST_F(FrozenCounterMapTests, Rows)
+{
+  using namespace std;
+
+  cout << "- Rows are sorted and delimited." << endl;
+  Frozen_t frozen( counterMap, true );
+  EXPECT_TRUE( frozen.hasProbabilities() );
+  for( size_t i = 0; i < frozen.size(); ++i )
+    {
+      const Frozen_t::Row row( frozen.row(i) );
+      if( i > 0 )
+	{
+	  EXPECT_TRUE( frozen.keys()[i - 1] < frozen.keys()[i] );
+	}
+      EXPECT_EQ( counterMap.size( frozen.keys()[i] ), row.size() );
+      for( size_t j = 1; j < row.size(); ++j )
+	EXPECT_TRUE( row.value(j - 1) < row.value(j) );
+    }
+  EXPECT_TRUE( frozen.row( frozen.size() ).empty() );
+
+  cout << "- Precomputed probabilities." << endl;
+  const Frozen_t::Row row( frozen.getRow( "c" ) );
+  ASSERT_TRUE( row.probabilities() != NULL );
+  double sum(0);
+  for( size_t j = 0; j < row.size(); ++j )
+    {
+      sum += row.probabilities()[j];
+      EXPECT_DOUBLE_EQ( row.count(j) / row.totalCount(), row.getProbability( row.value(j) ) );
+    }
+  EXPECT_DOUBLE_EQ( 1, sum );
+  EXPECT_DOUBLE_EQ( Frozen_t( counterMap ).getProbability( "c", row.value(0) ),
+		    frozen.getProbability( "c", row.value(0) ) );
+  EXPECT_TRUE( Frozen_t( counterMap ).getRow( "c" ).probabilities() == NULL );
+
+  cout << "- Thawing, swapping and output." << endl;
+  CounterMap_t thawed( frozen.thaw<CounterMap_t>() );
+  EXPECT_TRUE( counterMap.equals( thawed ) );
+  Frozen_t other;
+  other.swap( frozen );
+  EXPECT_TRUE( frozen.empty() );
+  EXPECT_EQ( counterMap.size(), other.size() );
+  std::ostringstream os;
+  os << Counters::freeze( CounterMap_t() );
+  EXPECT_EQ( "[\n]", os.str() );
+}
+
+TEST_F(FrozenCounterMapTests, ConcurrentReaders)
+{
+  using namespace std;
+
+  cout << "- Concurrent lookups see the same counts." << endl;
+  const Frozen_t frozen( Counters::freeze( counterMap ) );
+  std::vector<double> sums( 4, 0 );
+  std::vector<std::thread> readers;
+  for( size_t t = 0; t < sums.size(); ++t )
+    readers.push_back( std::thread( [&frozen, &sums, t]()
+      {
+	for( int repeat = 0; repeat < 20; ++repeat )
+	  for( int i = 0; i < 1000; ++i )
+	    sums[t] += frozen.getCount( K( 1, 'a' + i % 13 ), K( 1 + i % 3, 'a' + i % 17 ) );
+      } ) );
+  for( size_t t = 0; t < readers.size(); ++t )
+    readers[t].join();
+  for( size_t t = 1; t < sums.size(); ++t )
+    EXPECT_EQ( sums[0], sums[t] );
+  double expected(0);
+  for( int i = 0; i < 1000; ++i )
+    expected += counterMap.getCount( K( 1, 'a' + i % 13 ), K( 1 + i % 3, 'a' + i % 17 ) );
+  EXPECT_DOUBLE_EQ( 20 * expected, sums[0] );
+}
+
+#endif // __FROZEN_COUNTER_MAP_TESTS_HPP__
@@ -0,0 +1,269 @@
+#ifndef __HEAVY_HITTERS_TESTS_HPP__
+#define __HEAVY_HITTERS_TESTS_HPP__
+
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+#include "Counters/CounterFactories.hpp"
+#include "Counters/SpaceSavingMap.hpp"
+#include "Counters/CountMinSketch.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+class HeavyHittersTests : public ::testing::Test
+{
+public:
+  typedef Counters::Counter<int> Counter_t;
+  typedef Counter_t::ValueCount_t ValueCount_t;
+  typedef Counters::SpaceSavingMap<int, double> SpaceSavingMap_t;
+  typedef Counters::CountMinSketch<int, double> CountMinSketch_t;
+
+protected:
+  virtual void SetUp()
+  {
+    // A Zipf-like stream: value v occurs about 1000 / v times.
+    srand(11);
+    for( int v = 1; v <= 1000; ++v )
+      for( int i = 0; i < 1000 / v; ++i )
+	stream.push_back( v );
+    for( std::size_t i = stream.size() - 1; i > 0; --i )
+      std::swap( stream[i], stream[rand() % (i + 1)] );
+  }
+
+  static bool greaterCount( ValueCount_t const& a, ValueCount_t const& b )
+  { return a.second > b.second; }
+
+  std::vector<int> stream;
+};
+
+TEST_F(HeavyHittersTests, TopK)
+{
+  using namespace std;
+
+  cout << "- topK against a full sort." << endl;
+  Counter_t counter( stream.begin(), stream.end() );
+  std::vector<ValueCount_t> sorted( counter.begin(), counter.end() );
+  std::sort( sorted.begin(), sorted.end(), greaterCount );
+  std::vector<ValueCount_t> top( counter.topK(50) );
+  ASSERT_EQ( 50, top.size() );
+  for( std::size_t i = 0; i < top.size(); ++i )
+    EXPECT_EQ( sorted[i].second, top[i].second );
+  EXPECT_EQ( 1, top[0].first );
+  EXPECT_EQ( counter.maxValue(), top[0].first );
+
+  cout << "- Edge cases." << endl;
+  EXPECT_TRUE( counter.topK(0).empty() );
+  EXPECT_EQ( counter.size(), counter.topK( counter.size() + 10 ).size() );
+  EXPECT_TRUE( Counter_t().topK(5).empty() );
+
+  cout << "- Scaled counters." << endl;
+  counter /= 2;
+  top = counter.topK(2);
+  EXPECT_EQ( 500, top[0].second );
+  EXPECT_EQ( 250, top[1].second );
+
+  cout << "- CounterMap rows." << endl;
+  Counters::CounterMap<std::string, int> counterMap;
+  counterMap.incrementCount( "a", 1, 3 );
+  counterMap.incrementCount( "a", 2, 5 );
+  counterMap.incrementCount( "a", 3, 1 );
+  std::vector<ValueCount_t> rowTop( counterMap.topK( "a", 2 ) );
+  ASSERT_EQ( 2, rowTop.size() );
+  EXPECT_EQ( 2, rowTop[0].first );
+  EXPECT_EQ( 1, rowTop[1].first );
+  EXPECT_TRUE( counterMap.topK( "b", 2 ).empty() );
+}
+
+TEST_F(HeavyHittersTests, SpaceSavingMap)
+{
+  using namespace std;
+
+  cout << "- Bounded size and inherited counts." << endl;
+  SpaceSavingMap_t map( 2 );
+  map[1] += 5;
+  map[2] += 1;
+  EXPECT_EQ( 2, map.size() );
+  EXPECT_EQ( 0, map.evictions() );
+  map[3] += 1;
+  EXPECT_EQ( 2, map.size() );
+  EXPECT_EQ( 1, map.evictions() );
+  EXPECT_EQ( 0, map.count(2) );
+  EXPECT_EQ( 2, map.at(3) );
+  EXPECT_EQ( 2, map.min_count() );
+  map[1] += 1;
+  map[3] += 10;
+  EXPECT_TRUE( map.insert( SpaceSavingMap_t::value_type(4, 1) ).second );
+  EXPECT_EQ( 0, map.count(1) );
+  EXPECT_EQ( 7, map.at(4) );
+
+  cout << "- Copies, erase and clear." << endl;
+  SpaceSavingMap_t copy( map );
+  EXPECT_EQ( 1, copy.erase(3) );
+  EXPECT_EQ( 0, copy.erase(3) );
+  copy[5] += 1;
+  EXPECT_EQ( 2, copy.size() );
+  EXPECT_EQ( 1, copy.at(5) );
+  copy[6] += 1;
+  EXPECT_EQ( 0, copy.count(5) );
+  EXPECT_EQ( 2, map.size() );
+  EXPECT_EQ( 1, map.count(3) );
+  map.clear();
+  EXPECT_TRUE( map.empty() );
+  map[1] += 1;
+  EXPECT_EQ( 1, map.at(1) );
+
+  cout << "- Error bounds on a skewed stream." << endl;
+  const std::size_t capacity( 100 );
+  Counter_t exact( stream.begin(), stream.end() );
+  Counters::SpaceSavingCounterFactory<int> factory( capacity );
+  Counter_t approximate( factory.createCounter() );
+  approximate.incrementAll( stream.begin(), stream.end(), 1 );
+  EXPECT_EQ( capacity, approximate.size() );
+  EXPECT_DOUBLE_EQ( exact.totalCount(), approximate.totalCount() );
+  approximate.resetCache();
+  EXPECT_DOUBLE_EQ( exact.totalCount(), approximate.totalCount() );
+  const double bound( exact.totalCount() / capacity );
+  for( Counter_t::ConstIterator i(approximate.begin()); i != approximate.end(); ++i )
+    {
+      EXPECT_GE( i->second, exact.getCount(i->first) );
+      EXPECT_LE( i->second - exact.getCount(i->first), bound );
+    }
+  for( Counter_t::ConstIterator i(exact.begin()); i != exact.end(); ++i )
+    if( i->second > bound )
+      {
+	EXPECT_TRUE( approximate.contains(i->first) );
+      }
+  std::vector<ValueCount_t> top( approximate.topK(5) );
+  for( std::size_t i = 0; i < top.size(); ++i )
+    EXPECT_EQ( int(i + 1), top[i].first );
+
+  cout << "- Heavy-hitter rows in a CounterMap." << endl;
+  Counters::CounterMap<std::string, int> counterMap( Counters::CounterMap<std::string, int>::CoreMap_t(), factory );
+  for( std::size_t i = 0; i < stream.size(); ++i )
+    counterMap.incrementCount( i % 2 == 0 ? "even" : "odd", stream[i], 1 );
+  EXPECT_GE( capacity, counterMap.size("even") );
+  EXPECT_GE( capacity, counterMap.size("odd") );
+  EXPECT_DOUBLE_EQ( exact.totalCount(), counterMap.totalCount() );
+  EXPECT_EQ( 1, counterMap.topK( "even", 1 )[0].first );
+}
+
+TEST_F(HeavyHittersTests, CountMinSketch)
+{
+  using namespace std;
+
+  cout << "- Estimates through the map interface." << endl;
+  CountMinSketch_t sketch( 64, 4 );
+  EXPECT_TRUE( sketch.empty() );
+  EXPECT_TRUE( sketch.begin() == sketch.end() );
+  EXPECT_TRUE( sketch.find(1) == sketch.end() );
+  sketch[1] += 5;
+  sketch[2] += 1;
+  EXPECT_EQ( 1, sketch.count(1) );
+  EXPECT_GE( sketch.at(1), 5 );
+  EXPECT_GE( sketch.estimate(2), 1 );
+  EXPECT_DOUBLE_EQ( 6, sketch.sum_mapped() );
+  EXPECT_EQ( 1, sketch.erase(2) );
+  EXPECT_DOUBLE_EQ( 0, sketch.estimate(2) );
+  EXPECT_EQ( 0, sketch.erase(2) );
+  CountMinSketch_t copy( sketch );
+  copy[1] += 1;
+  EXPECT_DOUBLE_EQ( sketch.estimate(1) + 1, copy.estimate(1) );
+  sketch.clear();
+  EXPECT_EQ( 0, sketch.count(1) );
+  EXPECT_DOUBLE_EQ( 0, sketch.sum_mapped() );
+
+  cout << "- Error bounds on a skewed stream." << endl;
+  Counter_t exact( stream.begin(), stream.end() );
+  const double total( exact.totalCount() );
+  for( int conservative = 0; conservative < 2; ++conservative )
+    {
+      Counters::CountMinCounterFactory<int> factory( 256, 5, conservative == 1 );
+      Counter_t approximate( factory.createCounter() );
+      approximate.incrementAll( stream.begin(), stream.end(), 1 );
+      EXPECT_TRUE( approximate.empty() );
+      EXPECT_DOUBLE_EQ( total, approximate.totalCount() );
+      approximate.resetCache();
+      EXPECT_DOUBLE_EQ( total, approximate.totalCount() );
+      const double bound( std::exp(1.0) / 256 * total );
+      std::size_t exceeding(0);
+      for( Counter_t::ConstIterator i(exact.begin()); i != exact.end(); ++i )
+	{
+	  const double estimate( approximate.getCount(i->first) );
+	  EXPECT_GE( estimate, i->second );
+	  if( estimate - i->second > bound ) ++exceeding;
+	}
+      // exp(-5) of the 1000 values are expected to exceed the bound.
+      EXPECT_GE( 20, exceeding );
+      EXPECT_TRUE( approximate.contains(1) );
+      EXPECT_FALSE( Counter_t( factory.createCounter() ).contains(1) );
+
+      cout << "- Scaling and merging." << endl;
+      const double estimate( approximate.getCount(1) );
+      Counter_t merged( factory.createCounter() );
+      merged.incrementCount( 1, 10 );
+      merged += approximate;
+      EXPECT_DOUBLE_EQ( total + 10, merged.totalCount() );
+      EXPECT_DOUBLE_EQ( estimate + 10, merged.getCount(1) );
+      merged -= approximate;
+      EXPECT_DOUBLE_EQ( 10, merged.getCount(1) );
+      approximate /= 2;
+      EXPECT_DOUBLE_EQ( estimate / 2, approximate.getCount(1) );
+      approximate += approximate;
+      EXPECT_DOUBLE_EQ( estimate, approximate.getCount(1) );
+      EXPECT_DOUBLE_EQ( total, approximate.totalCount() );
+      approximate.setCount( 1, 3 );
+      EXPECT_DOUBLE_EQ( 3, approximate.getCount(1) );
+      Counter_t added( exact );
+      added += approximate;
+      EXPECT_DOUBLE_EQ( exact.totalCount(), added.totalCount() );
+      Counter_t other( Counters::CountMinCounterFactory<int>( 128, 5 ).createCounter() );
+      other += exact;
+      EXPECT_DOUBLE_EQ( total, other.totalCount() );
+      EXPECT_GE( other.getCount(7), exact.getCount(7) );
+
+      cout << "- Sketches are compared by their cells." << endl;
+      Counter_t same( Counters::CountMinCounterFactory<int>( 128, 5 ).createCounter() );
+      same += exact;
+      EXPECT_TRUE( same == other );
+      EXPECT_TRUE( same.equals( other ) );
+      same.incrementCount( 7, 1e-3 );
+      EXPECT_FALSE( same == other );
+      EXPECT_FALSE( same.equals( other ) );
+      EXPECT_TRUE( same.equals( other, 1e-2 ) );
+      same *= 0.5;
+      EXPECT_TRUE( same.equals( other * 0.5, 1e-2 ) );
+      EXPECT_FALSE( same.equals( other, 1e-2 ) );
+      EXPECT_FALSE( Counter_t( factory.createCounter() ) == Counter_t( Counters::CountMinCounterFactory<int>( 128, 5 ).createCounter() ) );
+      EXPECT_FALSE( Counter_t( factory.createCounter() ) == Counter_t() );
+      EXPECT_FALSE( Counter_t() == Counter_t( factory.createCounter() ) );
+      EXPECT_FALSE( Counter_t().equals( Counter_t( factory.createCounter() ) ) );
+      EXPECT_TRUE( Counter_t( factory.createCounter() ) == Counter_t( factory.createCounter() ) );
+
+      cout << "- Moved-from counters stay valid and empty." << endl;
+      Counter_t moved( std::move(other) );
+      EXPECT_DOUBLE_EQ( total, moved.totalCount() );
+      EXPECT_EQ( 0u, other.size() );
+      EXPECT_DOUBLE_EQ( 0, other.totalCount() );
+      other.incrementCount( 1, 2 );
+      EXPECT_DOUBLE_EQ( 2, other.getCount(1) );
+
+      cout << "- clear() empties the sketch." << endl;
+      moved.clear();
+      EXPECT_DOUBLE_EQ( 0, moved.getCount(1) );
+      EXPECT_DOUBLE_EQ( 0, moved.totalCount() );
+      moved.resetCache();
+      EXPECT_DOUBLE_EQ( 0, moved.totalCount() );
+    }
+
+  cout << "- Sketch rows in a CounterMap." << endl;
+  Counters::CountMinCounterFactory<int> factory( 256, 5, true );
+  Counters::CounterMap<std::string, int> counterMap( Counters::CounterMap<std::string, int>::CoreMap_t(), factory );
+  for( std::size_t i = 0; i < stream.size(); ++i )
+    counterMap.incrementCount( i % 2 == 0 ? "even" : "odd", stream[i], 1 );
+  EXPECT_DOUBLE_EQ( total, counterMap.totalCount() );
+  EXPECT_GE( counterMap.getCount( "even", 1 ) + counterMap.getCount( "odd", 1 ), exact.getCount(1) );
+}
+
+#endif // __HEAVY_HITTERS_TESTS_HPP__
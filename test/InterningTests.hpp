@@ -0,0 +1,312 @@
+#ifndef __INTERNING_TESTS_HPP__
+#define __INTERNING_TESTS_HPP__
+
+#include "AnyMap/SortedVectorMap.hpp"
+#include "AnyMap/AnyMap.hpp"
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+#include "Counters/Vocabulary.hpp"
+#include "Counters/DenseCounter.hpp"
+#include "Counters/InternedCounterMap.hpp"
+
+#include <boost/utility/string_view.hpp>
+#include <boost/lexical_cast.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <stdlib.h>
+
+class InterningTests : public ::testing::Test
+{
+public:
+  typedef std::string K;
+  typedef std::string V;
+
+  typedef Counters::Vocabulary<V> Vocabulary_t;
+  typedef Counters::DenseCounter<V> DenseCounter_t;
+  typedef Counters::InternedCounterMap<K, V> InternedCounterMap_t;
+  typedef Counters::CounterMap<K, V> CounterMap_t;
+  typedef MapTypeErasure::SortedVectorMap<int, int> SortedMap;
+
+protected:
+  virtual void SetUp()
+  {
+    vocabulary.reset( new Vocabulary_t() );
+    text = "the cat sat on the mat and the dog sat on the cat";
+  }
+
+  std::shared_ptr<Vocabulary_t> vocabulary;
+  std::string text;
+};
+
+TEST_F(InterningTests, SortedVectorMap)
+{
+  using namespace std;
+
+  cout << "- Basic operations." << endl;
+  SortedMap sorted;
+  EXPECT_TRUE( sorted.empty() );
+  EXPECT_TRUE( sorted.find(1) == sorted.end() );
+  EXPECT_TRUE( sorted.emplace( 3, 30 ).second );
+  EXPECT_TRUE( sorted.insert( SortedMap::value_type(1, 10) ).second );
+  EXPECT_TRUE( sorted.try_emplace( 2, 20 ).second );
+  EXPECT_FALSE( sorted.try_emplace( 2, 200 ).second );
+  sorted[5] = 50;
+  EXPECT_EQ( 4, sorted.size() );
+  EXPECT_EQ( 20, sorted.at(2) );
+  EXPECT_THROW( sorted.at(4), std::out_of_range );
+  EXPECT_EQ( 0, sorted.count(4) );
+
+  cout << "- Iteration is in key order." << endl;
+  int previous( 0 );
+  for( SortedMap::const_iterator i(sorted.begin()); i != sorted.end(); ++i )
+    {
+      EXPECT_LT( previous, i->first );
+      EXPECT_EQ( i->first * 10, i->second );
+      previous = i->first;
+    }
+
+  cout << "- Hinted inserts." << endl;
+  sorted.emplace_hint( sorted.end(), 7, 70 );
+  sorted.emplace_hint( sorted.begin(), 4, 40 );  // wrong hint
+  EXPECT_EQ( 40, sorted.at(4) );
+  EXPECT_EQ( 70, (sorted.end() - 1)->second );
+
+  cout << "- Erase, copy and capacity." << endl;
+  EXPECT_EQ( 1, sorted.erase(1) );
+  EXPECT_EQ( 0, sorted.erase(1) );
+  SortedMap copy( sorted );
+  EXPECT_EQ( 5, copy.size() );
+  EXPECT_EQ( 2, copy.begin()->first );
+  sorted.clear();
+  EXPECT_TRUE( sorted.empty() );
+  EXPECT_EQ( 5, copy.size() );
+  copy.shrink_to_fit();
+  EXPECT_EQ( copy.size(), copy.capacity() );
+
+  cout << "- Against std::map." << endl;
+  std::map<int, int> reference;
+  SortedMap random;
+  srand(7);
+  for( int i = 0; i < 2000; ++i )
+    {
+      const int k( rand() % 300 );
+      if( rand() % 4 == 0 )
+	EXPECT_EQ( reference.erase(k), random.erase(k) );
+      else
+	{
+	  reference[k] += i;
+	  random[k] += i;
+	}
+    }
+  EXPECT_EQ( reference.size(), random.size() );
+  EXPECT_TRUE( std::equal( reference.begin(), reference.end(), random.begin() ) );
+
+  cout << "- In AnyMap and Counter." << endl;
+  MapTypeErasure::AnyMap<int, int> anyMap( (MapTypeErasure::SortedVectorMap<int, int>()) );
+  anyMap.try_emplace( 2, 20 );
+  anyMap.try_emplace( 1, 10 );
+  anyMap.reserve( 10 );
+  EXPECT_EQ( 1, anyMap.begin()->first );
+  EXPECT_EQ( 20, anyMap.at(2) );
+  Counters::Counter<int> counter( (MapTypeErasure::AnyMap<int, double>( MapTypeErasure::SortedVectorMap<int, double>() )) );
+  counter.incrementCount( 3, 1 );
+  counter.incrementCount( 1, 2 );
+  counter.incrementCount( 3, 1 );
+  EXPECT_EQ( 2, counter.getCount(3) );
+  EXPECT_EQ( 4, counter.totalCount() );
+}
+
+TEST_F(InterningTests, Vocabulary)
+{
+  using namespace std;
+
+  cout << "- Interning." << endl;
+  EXPECT_TRUE( vocabulary->empty() );
+  EXPECT_EQ( 0, vocabulary->intern("the") );
+  EXPECT_EQ( 1, vocabulary->intern(V("cat")) );
+  EXPECT_EQ( 0, vocabulary->intern("the") );
+  EXPECT_EQ( 2, vocabulary->size() );
+
+  cout << "- Interning from slices." << endl;
+  boost::string_view slice( text );
+  EXPECT_EQ( 0, vocabulary->intern( slice.substr(0, 3) ) );
+  EXPECT_EQ( 1, vocabulary->intern( slice.substr(4, 3) ) );
+  EXPECT_EQ( 2, vocabulary->intern( slice.substr(8, 3) ) );
+  EXPECT_EQ( "sat", vocabulary->value(2) );
+
+  cout << "- Lookup." << endl;
+  EXPECT_EQ( 1, vocabulary->find("cat") );
+  EXPECT_EQ( 2, vocabulary->find( slice.substr(8, 3) ) );
+  EXPECT_EQ( Vocabulary_t::NOT_FOUND, vocabulary->find("dog") );
+  EXPECT_EQ( 3, vocabulary->size() );
+
+  cout << "- Values survive growth." << endl;
+  vocabulary->reserve( 10 );
+  for( int i = 0; i < 1000; ++i )
+    vocabulary->intern( boost::lexical_cast<V>(i) );
+  EXPECT_EQ( "the", vocabulary->value(0) );
+  EXPECT_EQ( "cat", vocabulary->value(1) );
+  EXPECT_EQ( "999", vocabulary->value( vocabulary->find("999") ) );
+  EXPECT_EQ( 1003, vocabulary->size() );
+}
+
+TEST_F(InterningTests, DenseCounter)
+{
+  using namespace std;
+
+  cout << "- Counting." << endl;
+  DenseCounter_t dense( vocabulary );
+  Counters::Counter<V> reference;
+  boost::string_view slice( text );
+  for( std::size_t begin = 0; begin < slice.size(); )
+    {
+      std::size_t end( std::min( slice.find(' ', begin), slice.size() ) );
+      dense.incrementCount( slice.substr(begin, end - begin), 1 );
+      reference.incrementCount( V( slice.substr(begin, end - begin) ), 1 );
+      begin = end + 1;
+    }
+  EXPECT_EQ( reference.size(), dense.size() );
+  EXPECT_EQ( reference.totalCount(), dense.totalCount() );
+  EXPECT_EQ( 4, dense.getCount("the") );
+  EXPECT_EQ( 4, dense.getCount( slice.substr(0, 3) ) );
+  EXPECT_EQ( 0, dense.getCount("bird") );
+  EXPECT_EQ( "the", dense.maxValue() );
+  EXPECT_TRUE( reference == dense.toCounter() );
+
+  cout << "- By id." << endl;
+  const Vocabulary_t::Id_t catId( vocabulary->find("cat") );
+  EXPECT_EQ( 2, dense.getCountById(catId) );
+  dense.incrementCountById( catId, 3 );
+  EXPECT_EQ( 5, dense.getCount("cat") );
+  dense.setCountById( catId, 2 );
+  EXPECT_EQ( reference.totalCount(), dense.totalCount() );
+
+  cout << "- Counters sharing the vocabulary." << endl;
+  DenseCounter_t other( vocabulary );
+  other.incrementCount( "bird", 2 );
+  other.incrementCount( "cat", 1 );
+  DenseCounter_t sum( dense );
+  sum += other;
+  EXPECT_EQ( 3, sum.getCount("cat") );
+  EXPECT_EQ( 2, sum.getCount("bird") );
+  EXPECT_EQ( dense.totalCount() + other.totalCount(), sum.totalCount() );
+  sum -= other;
+  EXPECT_TRUE( sum == dense );
+  EXPECT_EQ( dense.size(), sum.size() );
+  EXPECT_FALSE( sum.contains("bird") );
+
+  cout << "- Counters with different vocabularies." << endl;
+  DenseCounter_t foreign;
+  foreign.incrementCount( "cat", 2 );
+  foreign.incrementCount( "dog", 1 );
+  DenseCounter_t sumForeign( other );
+  sumForeign += foreign;
+  EXPECT_EQ( 3, sumForeign.getCount("cat") );
+  EXPECT_EQ( 1, sumForeign.getCount("dog") );
+  foreign.incrementCount( "bird", 2 );
+  foreign.setCount( "dog", 0 );
+  foreign.incrementCount( "cat", -1 );
+  EXPECT_TRUE( foreign == other );
+
+  cout << "- Normalization and removal." << endl;
+  dense.normalize();
+  EXPECT_DOUBLE_EQ( 1.0, dense.totalCount() );
+  EXPECT_DOUBLE_EQ( 4.0 / 13, dense.getCount("the") );
+  dense.remove( "the" );
+  EXPECT_FALSE( dense.contains("the") );
+  dense.resetCache();
+  EXPECT_DOUBLE_EQ( 9.0 / 13, dense.totalCount() );
+  dense.clear();
+  EXPECT_TRUE( dense.empty() );
+
+  cout << "- Summation policies." << endl;
+  DenseCounter_t many;
+  for( int i = 0; i < 100000; ++i )
+    many.incrementCount( V( boost::lexical_cast<std::string>(i) ), 0.1 );
+  EXPECT_EQ( Counters::SUMMATION_NAIVE, many.getSummationPolicy() );
+  many.setSummationPolicy( Counters::SUMMATION_KAHAN );
+  EXPECT_EQ( 10000, many.totalCount() );
+  many.setSummationPolicy( Counters::SUMMATION_PAIRWISE );
+  EXPECT_NEAR( 10000, many.totalCount(), 1e-9 );
+  many.setCount( V("77"), 5 );
+  EXPECT_EQ( "77", many.maxValue() );
+}
+
+TEST_F(InterningTests, InternedCounterMap)
+{
+  using namespace std;
+
+  cout << "- Against CounterMap." << endl;
+  InternedCounterMap_t interned( vocabulary );
+  CounterMap_t reference;
+  std::vector<V> words;
+  boost::string_view slice( text );
+  for( std::size_t begin = 0; begin < slice.size(); )
+    {
+      std::size_t end( std::min( slice.find(' ', begin), slice.size() ) );
+      words.push_back( V( slice.substr(begin, end - begin) ) );
+      begin = end + 1;
+    }
+  for( std::size_t i = 1; i < words.size(); ++i )
+    {
+      interned.incrementCount( words[i - 1], words[i], 1 );
+      reference.incrementCount( words[i - 1], words[i], 1 );
+    }
+  EXPECT_EQ( reference.size(), interned.size() );
+  EXPECT_EQ( reference.totalCount(), interned.totalCount() );
+  for( CounterMap_t::ConstIterator i(reference.begin()); i != reference.end(); ++i )
+    {
+      EXPECT_EQ( i->second.size(), interned.size(i->first) );
+      EXPECT_TRUE( i->second == interned.getValueCounter(i->first) );
+      for( Counters::Counter<V>::ConstIterator j(i->second.begin()); j != i->second.end(); ++j )
+	EXPECT_EQ( j->second, interned.getCount( i->first, j->first ) );
+    }
+  EXPECT_EQ( 2, interned.getCount( "the", "cat" ) );
+  EXPECT_EQ( 2, interned.getCount( slice.substr(0, 3), slice.substr(4, 3) ) );
+  EXPECT_EQ( 0, interned.getCount( "the", "bird" ) );
+  EXPECT_EQ( 0, interned.getCount( "bird", "the" ) );
+  EXPECT_TRUE( interned.contains( "sat", "on" ) );
+  EXPECT_FALSE( interned.contains( "on", "sat" ) );
+  EXPECT_EQ( "on", interned.maxValue("sat") );
+  EXPECT_EQ( "", interned.maxValue("bird") );
+
+  cout << "- Rows are counters over ids." << endl;
+  InternedCounterMap_t::Row_t const * row( interned.getCounter("the") );
+  ASSERT_TRUE( row != NULL );
+  EXPECT_EQ( 2, row->getCount( vocabulary->find("cat") ) );
+  EXPECT_TRUE( interned.getCounter("bird") == NULL );
+
+  cout << "- Maps sharing the vocabulary." << endl;
+  DenseCounter_t unigrams( vocabulary );
+  for( std::size_t i = 0; i < words.size(); ++i )
+    unigrams.incrementCount( words[i], 1 );
+  EXPECT_EQ( unigrams.vocabulary()->size(), vocabulary->size() );
+  InternedCounterMap_t copy( vocabulary );
+  copy += interned;
+  EXPECT_TRUE( copy == interned );
+  copy += interned;
+  EXPECT_EQ( 4, copy.getCount( "the", "cat" ) );
+  copy /= 2;
+  EXPECT_TRUE( copy.equals( interned ) );
+
+  cout << "- Maps with different vocabularies." << endl;
+  InternedCounterMap_t foreign;
+  foreign.incrementCount( "dog", "sat", 1 );
+  EXPECT_FALSE( foreign == interned );
+  foreign += interned;
+  EXPECT_EQ( 2, foreign.getCount( "dog", "sat" ) );
+  foreign.incrementCount( "dog", "sat", -1 );
+  EXPECT_TRUE( foreign == interned );
+
+  cout << "- Removal and normalization." << endl;
+  interned.remove( "the", "cat" );
+  EXPECT_FALSE( interned.contains( "the", "cat" ) );
+  interned.remove( "the", "bird" );
+  interned.remove( "sat" );
+  EXPECT_FALSE( interned.contains("sat") );
+  interned.conditionalNormalize();
+  EXPECT_DOUBLE_EQ( 1.0, interned.totalCount("the") );
+}
+
+#endif // __INTERNING_TESTS_HPP__
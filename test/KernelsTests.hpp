@@ -0,0 +1,91 @@
+#ifndef __KERNELS_TESTS_HPP__
+#define __KERNELS_TESTS_HPP__
+
+#include "Counters/Kernels.hpp"
+
+#include <cmath>
+#include <vector>
+#include <stdlib.h>
+
+class KernelsTests : public ::testing::Test
+{
+public:
+  // Counts with zeros, negative counts and equal maxima mixed in.
+  static std::vector<double> counts( std::size_t n )
+  {
+    std::vector<double> x( n );
+    for( std::size_t i = 0; i < n; ++i )
+      x[i] = (rand() % 4 == 0) ? 0 : (rand() % 50) - 20 + 0.25 * (rand() % 4);
+    return x;
+  }
+};
+
+TEST_F(KernelsTests, AgainstPortableLoops)
+{
+  using namespace std;
+  using namespace Counters::kernels;
+  srand(5);
+
+  cout << "- Every length, for the vector bodies and tails." << endl;
+  for( std::size_t n = 0; n < 70; ++n )
+    {
+      std::vector<double> x( counts(n) ), y( counts(n) );
+      const double* px( x.data() );
+      EXPECT_EQ( details::naiveSumPortable( px, n ), sum( px, n ) );
+      EXPECT_EQ( details::argmaxNonZeroPortable( px, n ), argmaxNonZero( px, n ) );
+      EXPECT_TRUE( equalWithin( px, px, n, 0 ) );
+      EXPECT_EQ( details::equalWithinPortable( px, y.data(), n, 10 ), equalWithin( px, y.data(), n, 10 ) );
+      EXPECT_NEAR( details::dotPortable( px, y.data(), n ), dot( px, y.data(), n ), 1e-9 );
+      EXPECT_NEAR( details::absSumPortable( px, n ), absSum( px, n ), 1e-9 );
+      EXPECT_NEAR( details::l1DistancePortable( px, y.data(), n ), l1Distance( px, y.data(), n ), 1e-9 );
+      EXPECT_NEAR( details::squaredDistancePortable( px, y.data(), n ), squaredDistance( px, y.data(), n ), 1e-9 );
+      EXPECT_EQ( 0, l1Distance( px, px, n ) );
+
+      std::vector<double> scaled( x ), expectedScaled( x );
+      scale( scaled.data(), n, 0.3 );
+      details::scalePortable( expectedScaled.data(), n, 0.3 );
+      EXPECT_TRUE( expectedScaled == scaled );
+
+      std::vector<double> added( y ), expectedAdded( y );
+      axpy( added.data(), px, n, -0.7 );
+      details::axpyPortable( expectedAdded.data(), px, n, -0.7 );
+      EXPECT_TRUE( expectedAdded == added );
+      if( n > 0 )
+	{
+	  added[n - 1] += 1e-3;
+	  EXPECT_FALSE( equalWithin( expectedAdded.data(), added.data(), n, 0 ) );
+	  EXPECT_TRUE( equalWithin( expectedAdded.data(), added.data(), n, 1e-2 ) );
+	}
+    }
+
+  cout << "- argmax skips zeros." << endl;
+  std::vector<double> negative( 9, 0 );
+  EXPECT_EQ( 9, argmaxNonZero( negative.data(), 9 ) );
+  negative[6] = -2;
+  negative[3] = -1;
+  negative[7] = -1;
+  EXPECT_EQ( 3, argmaxNonZero( negative.data(), 9 ) );
+
+  cout << "- Accuracy of the summation policies." << endl;
+  std::vector<double> tenths( 1000000, 0.1 );
+  const double naive( sum( tenths.data(), tenths.size() ) );
+  const double pairwise( sum( tenths.data(), tenths.size(), Counters::SUMMATION_PAIRWISE ) );
+  EXPECT_EQ( 100000, sum( tenths.data(), tenths.size(), Counters::SUMMATION_KAHAN ) );
+  EXPECT_LE( std::fabs( pairwise - 100000 ), std::fabs( naive - 100000 ) );
+  EXPECT_NEAR( 100000, pairwise, 1e-9 );
+
+  cout << "- Sums of values added one at a time." << endl;
+  const Counters::SummationPolicy policies[] = { Counters::SUMMATION_NAIVE, Counters::SUMMATION_PAIRWISE,
+						  Counters::SUMMATION_KAHAN };
+  const double errors[] = { 1e-3, 1e-9, 0 };
+  for( std::size_t p = 0; p < 3; ++p )
+    {
+      Counters::kernels::Summation summation( policies[p] );
+      EXPECT_EQ( 0, summation.result() );
+      for( std::size_t i = 0; i < tenths.size(); ++i )
+	summation.add( tenths[i] );
+      EXPECT_NEAR( 100000, summation.result(), errors[p] ) << "policy " << p;
+    }
+}
+
+#endif // __KERNELS_TESTS_HPP__
@@ -0,0 +1,149 @@
+#ifndef __STATIC_MAP_TESTS_HPP__
+#define __STATIC_MAP_TESTS_HPP__
+
+#include "AnyMap/StaticMap.hpp"
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+
+#include <boost/unordered_map.hpp>
+#include <map>
+#include <string>
+
+// Every member of the static variants must compile.
+template class MapTypeErasure::StaticMap< boost::unordered_map<std::string, double> >;
+template class MapTypeErasure::StaticMap< std::map<std::string, double> >;
+template class Counters::Counter< std::string, MapTypeErasure::StaticMap< boost::unordered_map<std::string, double> > >;
+template class Counters::Counter< std::string, MapTypeErasure::StaticMap< std::map<std::string, double> > >;
+template class Counters::CounterMap< std::string, std::string,
+				     MapTypeErasure::StaticMap< boost::unordered_map<std::string, double> >,
+				     MapTypeErasure::StaticMap< boost::unordered_map<std::string,
+					 Counters::StaticCounter<std::string> > > >;
+
+class StaticMapTests : public ::testing::Test
+{
+public:
+  typedef std::string K;
+  typedef double V;
+  typedef boost::unordered_map<K, V> BoostMap;
+  typedef std::map<K, V> StlMap;
+
+  typedef Counters::Counter<K> Counter_t;
+  typedef Counters::StaticCounter<K> StaticCounter_t;
+  typedef Counters::StaticCounter<K, StlMap> OrderedCounter_t;
+  typedef Counters::CounterMap<K, K> CounterMap_t;
+  typedef Counters::StaticCounterMap<K, K> StaticCounterMap_t;
+
+protected:
+  virtual void SetUp()
+  {
+    boostMap["one"]   = 1;
+    boostMap["two"]   = 2;
+    boostMap["three"] = 3;
+    stlMap.insert( boostMap.begin(), boostMap.end() );
+  }
+
+  BoostMap boostMap;
+  StlMap stlMap;
+};
+
+TEST_F(StaticMapTests, Map)
+{
+  using namespace std;
+  typedef MapTypeErasure::StaticMap<BoostMap> Map;
+  typedef MapTypeErasure::StaticMap<StlMap> OrderedMap;
+
+  cout << "- Lookups, including heterogeneous ones." << endl;
+  Map map( boostMap );
+  EXPECT_EQ( 3, map.size() );
+  EXPECT_EQ( 2, map.at("two") );
+  EXPECT_EQ( 1, map.count( boost::string_view("one") ) );
+  EXPECT_TRUE( map.find( boost::string_view("four") ) == map.end() );
+  EXPECT_TRUE( map.try_emplace( boost::string_view("four"), 4 ).second );
+  EXPECT_FALSE( map.try_emplace( K("four"), 5 ).second );
+  EXPECT_EQ( 4, map.at("four") );
+
+  cout << "- Internal iteration and bulk arithmetic." << endl;
+  V sum(0);
+  map.for_each( [&sum](Map::value_type const& v) { sum += v.second; } );
+  EXPECT_EQ( 10, sum );
+  EXPECT_FALSE( map.sum_mapped(sum) );
+  OrderedMap ordered( stlMap ), other;
+  other.try_emplace( "two", 10 );
+  other.try_emplace( "zero", 1 );
+  EXPECT_TRUE( ordered.add_mapped( other, 2 ) );
+  EXPECT_EQ( 22, ordered.at("two") );
+  EXPECT_EQ( 2, ordered.at("zero") );
+
+  cout << "- Comparison and conversion to AnyMap." << endl;
+  EXPECT_EQ( Map(boostMap), Map(boostMap) );
+  EXPECT_NE( Map(boostMap), map );
+  MapTypeErasure::AnyMap<K, V> any( map.any_map() );
+  EXPECT_EQ( 4, any.size() );
+  EXPECT_TRUE( any == (MapTypeErasure::AnyMap<K, V>(map.map())) );
+}
+
+TEST_F(StaticMapTests, Counter)
+{
+  using namespace std;
+
+  cout << "- Same results as the AnyMap-based Counter." << endl;
+  Counter_t counter;
+  StaticCounter_t staticCounter;
+  OrderedCounter_t orderedCounter;
+  for( int i = 0; i < 100; ++i )
+    {
+      const K value( 1, 'a' + i % 7 );
+      counter.incrementCount( value, i );
+      staticCounter.incrementCount( value, i );
+      orderedCounter.incrementCount( value, i );
+    }
+  staticCounter.incrementCount( "h", 1 );
+  counter.incrementCount( "h", 1 );
+  EXPECT_EQ( counter.totalCount(), staticCounter.totalCount() );
+  EXPECT_EQ( counter.maxValue(), staticCounter.maxValue() );
+  EXPECT_EQ( counter.getCount("c"), orderedCounter.getCount("c") );
+  EXPECT_EQ( counter.getCount("c"), staticCounter.getCount( boost::string_view("c") ) );
+  staticCounter *= 0.5;
+  staticCounter += staticCounter;
+  EXPECT_TRUE( counter.equals( Counter_t(staticCounter) ) );
+
+  cout << "- Conversions keep the map type and the caches." << endl;
+  staticCounter.totalCount();
+  Counter_t converted( staticCounter );
+  EXPECT_TRUE( converted.isTotalSynched() );
+  StaticCounter_t back( converted );
+  EXPECT_EQ( staticCounter, back );
+  OrderedCounter_t ordered( back );
+  EXPECT_EQ( "a", ordered.begin()->first );
+  EXPECT_EQ( counter.size(), ordered.size() );
+}
+
+TEST_F(StaticMapTests, CounterMap)
+{
+  using namespace std;
+
+  cout << "- Same results as the AnyMap-based CounterMap." << endl;
+  CounterMap_t counterMap;
+  StaticCounterMap_t staticMap;
+  for( int i = 0; i < 100; ++i )
+    {
+      const K key( 1, 'a' + i % 3 ), value( 1, 'a' + i % 7 );
+      counterMap.incrementCount( key, value, 1 );
+      staticMap.incrementCount( key, value, 1 );
+    }
+  EXPECT_EQ( counterMap.totalCount(), staticMap.totalCount() );
+  EXPECT_EQ( counterMap.getCount("b", "c"), staticMap.getCount("b", "c") );
+  EXPECT_EQ( counterMap.getCount("b", "c"),
+	     staticMap.getCount( boost::string_view("b"), boost::string_view("c") ) );
+  staticMap.conditionalNormalize();
+  counterMap.conditionalNormalize();
+  EXPECT_TRUE( counterMap.equals( CounterMap_t(staticMap) ) );
+
+  cout << "- Round trip through the AnyMap-based CounterMap." << endl;
+  StaticCounterMap_t back( (CounterMap_t(staticMap)) );
+  EXPECT_TRUE( staticMap.equals( back ) );
+  back += staticMap;
+  EXPECT_DOUBLE_EQ( 2 * staticMap.totalCount(), back.totalCount() );
+}
+
+#endif // __STATIC_MAP_TESTS_HPP__
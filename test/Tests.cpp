@@ -5,6 +5,17 @@
 #include "AnyMapTests.hpp"
 #include "CounterTests.hpp"
 #include "CounterMapTests.hpp"
+#include "FlatHashMapTests.hpp"
+#include "InterningTests.hpp"
+#include "HeavyHittersTests.hpp"
+#include "ConcurrencyTests.hpp"
+#include "KernelsTests.hpp"
+#include "StaticMapTests.hpp"
+#include "FrozenCounterMapTests.hpp"
+#include "BinaryFormatTests.hpp"
+#include "DeltaTests.hpp"
+#include "TextIngestionTests.hpp"
+#include "VectorOpsTests.hpp"
 
 
 
@@ -0,0 +1,145 @@
+#ifndef __TEXT_INGESTION_TESTS_HPP__
+#define __TEXT_INGESTION_TESTS_HPP__
+
+#include "Counters/TextIngestion.hpp"
+#include "Counters/Counter.hpp"
+#include "Counters/CounterMap.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class TextIngestionTests : public ::testing::Test
+{
+public:
+  typedef std::string K;
+  typedef Counters::Counter<K> Counter_t;
+  typedef Counters::CounterMap<K, K> CounterMap_t;
+
+protected:
+  virtual void SetUp()
+  {
+    std::ifstream infile( testFileName.c_str() );
+    text.assign( std::istreambuf_iterator<char>( infile ), std::istreambuf_iterator<char>() );
+
+    std::istringstream is( text );
+    std::string word;
+    while( is >> word )
+      {
+	std::transform( word.begin(), word.end(), word.begin(), ::tolower );
+	words.push_back( word );
+      }
+  }
+
+  // The n-grams of the words, counted the plain way.
+  Counter_t ngrams( std::size_t order ) const
+  {
+    Counter_t counter;
+    for( std::size_t i = 0; i + order <= words.size(); ++i )
+      {
+	std::string ngram( words[i] );
+	for( std::size_t j = 1; j < order; ++j )
+	  ngram += " " + words[i + j];
+	counter.incrementCount( ngram, 1 );
+      }
+    return counter;
+  }
+
+  static const std::string testFileName;
+  std::string text;
+  std::vector<std::string> words;
+};
+
+const std::string TextIngestionTests::testFileName( "test/data/rock-n-roll-nerd" );
+
+TEST_F(TextIngestionTests, Tokens)
+{
+  using namespace std;
+
+  cout << "- Tokens are views of the text." << endl;
+  const std::string line( " \tone  two\nthree\r\n" );
+  std::vector<boost::string_view> tokens;
+  Counters::forEachToken( line.data(), line.data() + line.size(),
+			  [&tokens](boost::string_view token) { tokens.push_back( token ); } );
+  ASSERT_EQ( 3u, tokens.size() );
+  EXPECT_EQ( "one", tokens[0] );
+  EXPECT_EQ( "three", tokens[2] );
+  EXPECT_EQ( line.data() + 7, tokens[1].data() );
+
+  cout << "- Chunks are scanned with the context preceding them." << endl;
+  const std::string abc( "A b C d" );
+  Counters::NgramScanner scanner( 3, true );
+  std::vector<std::string> seen;
+  scanner.transitions( abc.data(), abc.data() + 3, abc.data() + abc.size(),
+		       [&seen](boost::string_view context, boost::string_view token) {
+			 seen.push_back( std::string( context.data(), context.size() ) + ">" +
+					 std::string( token.data(), token.size() ) );
+		       } );
+  ASSERT_EQ( 2u, seen.size() );
+  EXPECT_EQ( "a b>c", seen[0] );
+  EXPECT_EQ( "b c>d", seen[1] );
+}
+
+TEST_F(TextIngestionTests, CounterMap)
+{
+  using namespace std;
+  ASSERT_FALSE( words.empty() );
+
+  cout << "- Bigram transitions match reading with operator>>." << endl;
+  CounterMap_t expected;
+  for( std::size_t i = 1; i < words.size(); ++i )
+    expected.incrementCount( words[i - 1], words[i], 1 );
+  const Counters::IngestionOptions options( 2, true );
+  CounterMap_t mapped;
+  ASSERT_TRUE( Counters::ingestFile( testFileName, mapped, options ) );
+  EXPECT_TRUE( expected.equals( mapped ) );
+
+  cout << "- Parallel chunks add up to the sequential counts." << endl;
+  CounterMap_t parallel;
+  Counters::ingestText( text.data(), text.data() + text.size(), parallel, Counters::IngestionOptions( 2, true, 4, 64 ) );
+  EXPECT_TRUE( expected.equals( parallel ) );
+  CounterMap_t trigrams, parallelTrigrams;
+  Counters::ingestText( text.data(), text.data() + text.size(), trigrams, Counters::IngestionOptions( 3 ) );
+  Counters::ingestText( text.data(), text.data() + text.size(), parallelTrigrams, Counters::IngestionOptions( 3, false, 0, 100 ) );
+  EXPECT_TRUE( trigrams.equals( parallelTrigrams ) );
+  EXPECT_DOUBLE_EQ( double(words.size() - 2), trigrams.totalCount() );
+
+  cout << "- Streams read in small buffers." << endl;
+  CounterMap_t streamed;
+  std::istringstream is( text );
+  ASSERT_TRUE( Counters::ingestStream( is, streamed, Counters::IngestionOptions( 3, false, 1, 16 ) ) );
+  EXPECT_TRUE( trigrams.equals( streamed ) );
+
+  EXPECT_FALSE( Counters::ingestFile( "test/data/missing", mapped ) );
+  EXPECT_TRUE( expected.equals( mapped ) );
+}
+
+TEST_F(TextIngestionTests, Counter)
+{
+  using namespace std;
+
+  cout << "- Words and n-grams." << endl;
+  for( std::size_t order = 1; order <= 3; ++order )
+    {
+      const Counter_t expected( ngrams( order ) );
+      Counter_t counter;
+      ASSERT_TRUE( Counters::ingestFile( testFileName, counter, Counters::IngestionOptions( order, true ) ) );
+      EXPECT_TRUE( expected.equals( counter ) );
+
+      Counter_t parallel;
+      Counters::ingestText( text.data(), text.data() + text.size(), parallel,
+			    Counters::IngestionOptions( order, true, 3, 50 ) );
+      EXPECT_TRUE( expected.equals( parallel ) );
+
+      Counter_t streamed;
+      std::istringstream is( text );
+      ASSERT_TRUE( Counters::ingestStream( is, streamed, Counters::IngestionOptions( order, true, 1, 1 ) ) );
+      EXPECT_TRUE( expected.equals( streamed ) );
+    }
+}
+
+#endif // __TEXT_INGESTION_TESTS_HPP__
@@ -0,0 +1,221 @@
+#ifndef __VECTOR_OPS_TESTS_HPP__
+#define __VECTOR_OPS_TESTS_HPP__
+
+#include "Counters/Counters.hpp"
+#include "AnyMap/FlatHashMap.hpp"
+
+#include <boost/unordered_map.hpp>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <stdlib.h>
+
+class VectorOpsTests : public ::testing::Test
+{
+public:
+  typedef std::string V;
+  typedef Counters::Counter<V> Counter_t;
+  typedef Counter_t::CoreMap_t CoreMap_t;
+  typedef std::map<V, double> Reference;
+
+  // The vector operations computed over the union of the values.
+  struct Expected
+  {
+    Expected( Reference const& a, Reference const& b )
+      : dot(0), l1(0), l2(0), kl(0), js(0)
+    {
+      double normA(0), normB(0), totalA(0), totalB(0);
+      for( Reference::const_iterator i(a.begin()); i != a.end(); ++i )
+	{ normA += i->second * i->second; totalA += i->second; }
+      for( Reference::const_iterator i(b.begin()); i != b.end(); ++i )
+	{ normB += i->second * i->second; totalB += i->second; }
+      Reference all( a );
+      all.insert( b.begin(), b.end() );
+      for( Reference::const_iterator i(all.begin()); i != all.end(); ++i )
+	{
+	  const double x( get(a, i->first) ), y( get(b, i->first) );
+	  dot += x * y;
+	  l1 += std::fabs( x - y );
+	  l2 += ( x - y ) * ( x - y );
+	  const double p( x / totalA ), q( y / totalB ), m( (p + q) / 2 );
+	  if( p > 0 )
+	    {
+	      kl += q > 0 ? p * std::log( p / q ) : std::numeric_limits<double>::infinity();
+	      js += p * std::log( p / m ) / 2;
+	    }
+	  if( q > 0 )
+	    js += q * std::log( q / m ) / 2;
+	}
+      l2 = std::sqrt( l2 );
+      cosine = dot / std::sqrt( normA * normB );
+    }
+    static double get( Reference const& r, V const& v )
+    {
+      Reference::const_iterator i( r.find(v) );
+      return i == r.end() ? 0 : i->second;
+    }
+    double dot, l1, l2, cosine, kl, js;
+  };
+
+  // Random positive counts over values drawn from the first range values.
+  static Reference randomCounts( std::size_t n, std::size_t range )
+  {
+    Reference r;
+    while( r.size() < n )
+      r[ "v" + std::to_string( rand() % range ) ] = 1 + rand() % 9 + 0.5 * (rand() % 2);
+    return r;
+  }
+
+  static void fill( Counter_t& c, Reference const& r )
+  {
+    for( Reference::const_iterator i(r.begin()); i != r.end(); ++i )
+      c.incrementCount( i->first, i->second );
+  }
+
+  template <typename A, typename B>
+  static void expectOps( std::string const& what, A const& a, B const& b, Expected const& e )
+  {
+    SCOPED_TRACE( what );
+    EXPECT_NEAR( e.dot, Counters::dot( a, b ), 1e-9 );
+    EXPECT_NEAR( e.l1, Counters::l1Distance( a, b ), 1e-9 );
+    EXPECT_NEAR( e.l2, Counters::l2Distance( a, b ), 1e-9 );
+    EXPECT_NEAR( e.cosine, Counters::cosine( a, b ), 1e-12 );
+    EXPECT_NEAR( e.js, Counters::jsDivergence( a, b ), 1e-12 );
+    if( std::isinf( e.kl ) )
+      EXPECT_TRUE( std::isinf( Counters::klDivergence( a, b ) ) );
+    else
+      EXPECT_NEAR( e.kl, Counters::klDivergence( a, b ), 1e-12 );
+  }
+};
+
+TEST_F(VectorOpsTests, Counters)
+{
+  using namespace std;
+  srand(11);
+  typedef boost::unordered_map<V, double> BoostMap;
+  typedef std::map<V, double> StlMap;
+  typedef MapTypeErasure::FlatHashMap<V, double> FlatMap;
+
+  cout << "- Every pair of backends, merged or probed, either side smaller." << endl;
+  const std::size_t sizes[][2] = { { 40, 45 }, { 5, 300 }, { 300, 5 }, { 200, 200 } };
+  for( std::size_t s = 0; s < 4; ++s )
+    {
+      const Reference ra( randomCounts( sizes[s][0], 400 ) ), rb( randomCounts( sizes[s][1], 400 ) );
+      const Expected e( ra, rb );
+      Counter_t a[] = { Counter_t( (CoreMap_t(BoostMap())) ),
+			Counter_t( (CoreMap_t(StlMap())) ),
+			Counter_t( (CoreMap_t(FlatMap())) ) };
+      Counter_t b[] = { Counter_t( (CoreMap_t(BoostMap())) ),
+			Counter_t( (CoreMap_t(StlMap())) ),
+			Counter_t( (CoreMap_t(FlatMap())) ) };
+      for( std::size_t i = 0; i < 3; ++i )
+	{
+	  fill( a[i], ra );
+	  fill( b[i], rb );
+	}
+      for( std::size_t i = 0; i < 3; ++i )
+	for( std::size_t j = 0; j < 3; ++j )
+	  expectOps( "sizes " + std::to_string(s) + ", maps " + std::to_string(i) + std::to_string(j), a[i], b[j], e );
+    }
+
+  cout << "- Scaled counters, statically-typed maps and subsets." << endl;
+  const Reference ra( randomCounts( 50, 100 ) );
+  Reference rb;
+  for( Reference::const_iterator i(ra.begin()); i != ra.end(); ++i )
+    if( rand() % 2 )
+      rb[i->first] = 3 * i->second;
+  Counter_t a, b;
+  fill( a, ra );
+  fill( b, rb );
+  a *= 2;
+  a *= 0.5;
+  Counters::Counter<V, MapTypeErasure::StaticMap<StlMap> > sa, sb;
+  for( Reference::const_iterator i(ra.begin()); i != ra.end(); ++i )
+    sa.incrementCount( i->first, i->second );
+  for( Reference::const_iterator i(rb.begin()); i != rb.end(); ++i )
+    sb.incrementCount( i->first, i->second );
+  const Expected e( ra, rb );
+  expectOps( "scaled", a, b, e );
+  expectOps( "static", sa, sb, e );
+  expectOps( "mixed", sa, b, e );
+  EXPECT_TRUE( std::isinf( Counters::klDivergence( a, b ) ) );
+  EXPECT_FALSE( std::isinf( Counters::klDivergence( b, a ) ) );
+
+  cout << "- Identical, disjoint and empty counters." << endl;
+  EXPECT_EQ( 0, Counters::l1Distance( a, a ) );
+  EXPECT_EQ( 0, Counters::l2Distance( a, a ) );
+  EXPECT_NEAR( 0, Counters::klDivergence( a, a ), 1e-12 );
+  EXPECT_NEAR( 0, Counters::jsDivergence( a, a ), 1e-12 );
+  EXPECT_NEAR( 1, Counters::cosine( a, a ), 1e-12 );
+  Counter_t x, y, empty;
+  x.incrementCount( "x", 2 );
+  y.incrementCount( "y", 5 );
+  EXPECT_EQ( 0, Counters::dot( x, y ) );
+  EXPECT_EQ( 7, Counters::l1Distance( x, y ) );
+  EXPECT_NEAR( std::log(2.0), Counters::jsDivergence( x, y ), 1e-12 );
+  EXPECT_EQ( 0, Counters::cosine( x, empty ) );
+  EXPECT_EQ( 0, Counters::klDivergence( empty, x ) );
+  EXPECT_EQ( 2, Counters::l1Distance( empty, x ) );
+
+  cout << "- Entropy and norms." << endl;
+  Counter_t uniform;
+  for( int i = 0; i < 8; ++i )
+    uniform.incrementCount( std::to_string(i), 3 );
+  EXPECT_NEAR( std::log(8.0), Counters::entropy( uniform ), 1e-12 );
+  EXPECT_NEAR( std::sqrt(72.0), Counters::l2Norm( uniform ), 1e-12 );
+  EXPECT_EQ( 0, Counters::entropy( empty ) );
+}
+
+TEST_F(VectorOpsTests, DenseCounters)
+{
+  using namespace std;
+  srand(13);
+  typedef Counters::DenseCounter<V> Dense_t;
+  std::shared_ptr<Dense_t::Vocabulary_t> vocabulary( new Dense_t::Vocabulary_t() ), other( new Dense_t::Vocabulary_t() );
+
+  cout << "- Same vocabulary, arrays of different lengths." << endl;
+  const Reference ra( randomCounts( 60, 100 ) ), rb( randomCounts( 30, 200 ) );
+  Dense_t da( vocabulary ), db( vocabulary ), dc( other );
+  for( Reference::const_iterator i(ra.begin()); i != ra.end(); ++i )
+    da.incrementCount( i->first, i->second );
+  for( Reference::const_iterator i(rb.begin()); i != rb.end(); ++i )
+    {
+      db.incrementCount( i->first, i->second );
+      dc.incrementCount( i->first, i->second );
+    }
+  const Expected e( ra, rb );
+  expectOps( "dense", da, db, e );
+  expectOps( "dense reversed", db, da, Expected( rb, ra ) );
+  EXPECT_NEAR( Counters::entropy( da.toCounter() ), Counters::entropy( da ), 1e-12 );
+  EXPECT_NEAR( Counters::l2Norm( da.toCounter() ), Counters::l2Norm( da ), 1e-9 );
+
+  cout << "- Different vocabularies." << endl;
+  expectOps( "vocabularies", da, dc, e );
+}
+
+TEST_F(VectorOpsTests, CounterMapRows)
+{
+  using namespace std;
+  srand(17);
+  Counters::CounterMap<V, V> cm;
+  const Reference ra( randomCounts( 20, 50 ) ), rb( randomCounts( 40, 50 ) );
+  for( Reference::const_iterator i(ra.begin()); i != ra.end(); ++i )
+    cm.incrementCount( "a", i->first, i->second );
+  for( Reference::const_iterator i(rb.begin()); i != rb.end(); ++i )
+    cm.incrementCount( "b", i->first, i->second );
+
+  cout << "- Rows against each other and against a missing row." << endl;
+  const Expected e( ra, rb );
+  EXPECT_NEAR( e.dot, Counters::dot( cm, V("a"), V("b") ), 1e-9 );
+  EXPECT_NEAR( e.cosine, Counters::cosine( cm, V("a"), V("b") ), 1e-12 );
+  EXPECT_NEAR( e.l1, Counters::l1Distance( cm, V("a"), V("b") ), 1e-9 );
+  EXPECT_NEAR( e.l2, Counters::l2Distance( cm, V("a"), V("b") ), 1e-9 );
+  EXPECT_NEAR( e.js, Counters::jsDivergence( cm, V("a"), V("b") ), 1e-12 );
+  EXPECT_EQ( Counters::klDivergence( *cm.getCounter("b"), *cm.getCounter("a") ),
+	     Counters::klDivergence( cm, V("b"), V("a") ) );
+  EXPECT_EQ( 0, Counters::dot( cm, V("a"), V("none") ) );
+  EXPECT_NEAR( cm.getCounter("b")->totalCount(), Counters::l1Distance( cm, V("none"), V("b") ), 1e-9 );
+}
+
+#endif // __VECTOR_OPS_TESTS_HPP__